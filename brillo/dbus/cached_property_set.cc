@@ -0,0 +1,135 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/cached_property_set.h>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <brillo/dbus/dbus_method_invoker.h>
+#include <brillo/dbus/dbus_signal_handler.h>
+#include <dbus/property.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+CachedPropertySet::CachedPropertySet(dbus::ObjectProxy* object_proxy,
+                                     const std::string& interface_name)
+    : object_proxy_{object_proxy}, interface_name_{interface_name} {}
+
+CachedPropertySet::~CachedPropertySet() = default;
+
+void CachedPropertySet::ConnectSignals() {
+  ConnectToSignal(
+      object_proxy_,
+      dbus::kPropertiesInterface,
+      dbus::kPropertiesChanged,
+      base::Bind(&CachedPropertySet::OnPropertiesChanged,
+                 weak_ptr_factory_.GetWeakPtr()),
+      base::Bind(&CachedPropertySet::OnSignalConnected,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void CachedPropertySet::FetchAll(const FetchCallback& callback) {
+  CallMethod(object_proxy_,
+             dbus::kPropertiesInterface,
+             dbus::kPropertiesGetAll,
+             base::Bind(&CachedPropertySet::OnFetchAllSuccess,
+                        weak_ptr_factory_.GetWeakPtr(), callback),
+             base::Bind(&CachedPropertySet::OnFetchAllError,
+                        weak_ptr_factory_.GetWeakPtr(), callback),
+             interface_name_);
+}
+
+bool CachedPropertySet::FetchAllAndBlock(ErrorPtr* error) {
+  auto response = CallMethodAndBlock(object_proxy_,
+                                     dbus::kPropertiesInterface,
+                                     dbus::kPropertiesGetAll,
+                                     error,
+                                     interface_name_);
+  VariantDictionary properties;
+  if (!response || !ExtractMethodCallResults(response.get(), error,
+                                             &properties)) {
+    return false;
+  }
+  SetAll(properties);
+  return true;
+}
+
+void CachedPropertySet::SetAll(const VariantDictionary& properties) {
+  properties_ = properties;
+}
+
+void CachedPropertySet::UpdateProperties(
+    const VariantDictionary& changed_properties,
+    const std::vector<std::string>& invalidated_properties) {
+  for (const auto& pair : changed_properties) {
+    properties_[pair.first] = pair.second;
+    NotifyPropertyChanged(pair.first);
+  }
+  for (const std::string& property_name : invalidated_properties) {
+    properties_.erase(property_name);
+    NotifyPropertyChanged(property_name);
+    CallMethod(object_proxy_,
+               dbus::kPropertiesInterface,
+               dbus::kPropertiesGet,
+               base::Bind(&CachedPropertySet::OnGetSuccess,
+                          weak_ptr_factory_.GetWeakPtr(), property_name),
+               AsyncErrorCallback{},
+               interface_name_,
+               property_name);
+  }
+}
+
+const Any* CachedPropertySet::GetProperty(
+    const std::string& property_name) const {
+  auto it = properties_.find(property_name);
+  return it != properties_.end() ? &it->second : nullptr;
+}
+
+void CachedPropertySet::OnSignalConnected(const std::string& interface_name,
+                                          const std::string& signal_name,
+                                          bool success) {
+  LOG_IF(ERROR, !success) << "Failed to connect to " << interface_name << "."
+                          << signal_name << " for " << interface_name_;
+}
+
+void CachedPropertySet::OnPropertiesChanged(
+    const std::string& interface_name,
+    const VariantDictionary& changed_properties,
+    const std::vector<std::string>& invalidated_properties) {
+  if (interface_name != interface_name_)
+    return;
+  UpdateProperties(changed_properties, invalidated_properties);
+}
+
+void CachedPropertySet::OnFetchAllSuccess(
+    const FetchCallback& callback,
+    const VariantDictionary& properties) {
+  SetAll(properties);
+  if (!callback.is_null())
+    callback.Run(true);
+}
+
+void CachedPropertySet::OnFetchAllError(const FetchCallback& callback,
+                                        Error* error) {
+  LOG(ERROR) << "Failed to get the properties of " << interface_name_ << ": "
+             << error->GetMessage();
+  if (!callback.is_null())
+    callback.Run(false);
+}
+
+void CachedPropertySet::OnGetSuccess(const std::string& property_name,
+                                     const Any& value) {
+  properties_[property_name] = value;
+  NotifyPropertyChanged(property_name);
+}
+
+void CachedPropertySet::NotifyPropertyChanged(
+    const std::string& property_name) {
+  if (!property_changed_callback_.is_null())
+    property_changed_callback_.Run(property_name);
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
@@ -0,0 +1,127 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// CachedPropertySet is the client-side counterpart of ExportedPropertySet.
+// It keeps a local copy of all the properties of one interface of a remote
+// object: the values are fetched once with org.freedesktop.DBus.Properties
+// .GetAll and then kept up to date from the PropertiesChanged signals, so
+// reading a property doesn't involve any D-Bus traffic.
+//
+// Properties invalidated by PropertiesChanged (i.e. sent without their new
+// value) are dropped from the cache and fetched again asynchronously with
+// Properties.Get.
+//
+// Example:
+//
+//  CachedPropertySet properties(object_proxy, "org.chromium.MyInterface");
+//  properties.SetPropertyChangedCallback(base::Bind(&OnPropertyChanged));
+//  properties.ConnectSignals();
+//  brillo::ErrorPtr error;
+//  if (!properties.FetchAllAndBlock(&error))
+//    return false;
+//  std::string name;
+//  if (properties.GetValue("Name", &name))
+//    LOG(INFO) << "Name: " << name;
+
+#ifndef LIBBRILLO_BRILLO_DBUS_CACHED_PROPERTY_SET_H_
+#define LIBBRILLO_BRILLO_DBUS_CACHED_PROPERTY_SET_H_
+
+#include <string>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <brillo/any.h>
+#include <brillo/brillo_export.h>
+#include <brillo/errors/error.h>
+#include <brillo/variant_dictionary.h>
+#include <dbus/object_proxy.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+class BRILLO_EXPORT CachedPropertySet {
+ public:
+  // Called with the name of a property whose cached value has changed or has
+  // been invalidated.
+  using PropertyChangedCallback =
+      base::Callback<void(const std::string& property_name)>;
+  // Called when FetchAll() completes, with true if the values were received.
+  using FetchCallback = base::Callback<void(bool success)>;
+
+  // |object_proxy| must outlive this object.
+  CachedPropertySet(dbus::ObjectProxy* object_proxy,
+                    const std::string& interface_name);
+  ~CachedPropertySet();
+
+  // Subscribes to the PropertiesChanged signal of the remote object. Call it
+  // before fetching the values, so no change is missed in between.
+  void ConnectSignals();
+
+  // Fetches the values of all the properties and replaces the cache with
+  // them.
+  void FetchAll(const FetchCallback& callback);
+  bool FetchAllAndBlock(ErrorPtr* error);
+
+  // Replaces the cache with |properties|, e.g. when the values are already
+  // known from ObjectManager.GetManagedObjects. The property changed callback
+  // is not called.
+  void SetAll(const VariantDictionary& properties);
+
+  // Applies the content of a PropertiesChanged signal to the cache.
+  void UpdateProperties(const VariantDictionary& changed_properties,
+                        const std::vector<std::string>& invalidated_properties);
+
+  void SetPropertyChangedCallback(const PropertyChangedCallback& callback) {
+    property_changed_callback_ = callback;
+  }
+
+  const std::string& interface_name() const { return interface_name_; }
+  const VariantDictionary& GetAll() const { return properties_; }
+
+  // Returns the cached value of |property_name|, or nullptr if the property
+  // isn't known.
+  const Any* GetProperty(const std::string& property_name) const;
+
+  // Copies the cached value of |property_name| to |value|. Returns false if
+  // the property isn't known or isn't of type T.
+  template<typename T>
+  bool GetValue(const std::string& property_name, T* value) const {
+    const Any* property = GetProperty(property_name);
+    if (!property || !property->IsTypeCompatible<T>())
+      return false;
+    *value = property->Get<T>();
+    return true;
+  }
+
+ private:
+  void OnSignalConnected(const std::string& interface_name,
+                         const std::string& signal_name,
+                         bool success);
+  void OnPropertiesChanged(
+      const std::string& interface_name,
+      const VariantDictionary& changed_properties,
+      const std::vector<std::string>& invalidated_properties);
+  void OnFetchAllSuccess(const FetchCallback& callback,
+                         const VariantDictionary& properties);
+  void OnFetchAllError(const FetchCallback& callback, Error* error);
+  // Stores the refreshed value of a property invalidated by a signal.
+  void OnGetSuccess(const std::string& property_name, const Any& value);
+  void NotifyPropertyChanged(const std::string& property_name);
+
+  dbus::ObjectProxy* object_proxy_;
+  std::string interface_name_;
+  VariantDictionary properties_;
+  PropertyChangedCallback property_changed_callback_;
+
+  base::WeakPtrFactory<CachedPropertySet> weak_ptr_factory_{this};
+
+  DISALLOW_COPY_AND_ASSIGN(CachedPropertySet);
+};
+
+}  // namespace dbus_utils
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_DBUS_CACHED_PROPERTY_SET_H_
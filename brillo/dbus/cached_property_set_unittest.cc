@@ -0,0 +1,178 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/cached_property_set.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <brillo/dbus/dbus_param_writer.h>
+#include <dbus/mock_bus.h>
+#include <dbus/mock_object_proxy.h>
+#include <dbus/property.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::AnyNumber;
+using testing::Invoke;
+using testing::SaveArg;
+using testing::_;
+
+using dbus::MessageReader;
+using dbus::MessageWriter;
+using dbus::Response;
+
+namespace brillo {
+namespace dbus_utils {
+
+namespace {
+
+const char kTestPath[] = "/test/path";
+const char kTestServiceName[] = "org.test.Object";
+const char kTestInterface[] = "org.test.Object.TestInterface";
+const char kOtherInterface[] = "org.test.Object.OtherInterface";
+
+}  // namespace
+
+class CachedPropertySetTest : public testing::Test {
+ public:
+  void SetUp() override {
+    dbus::Bus::Options options;
+    options.bus_type = dbus::Bus::SYSTEM;
+    bus_ = new dbus::MockBus(options);
+    EXPECT_CALL(*bus_, AssertOnOriginThread()).Times(AnyNumber());
+    EXPECT_CALL(*bus_, AssertOnDBusThread()).Times(AnyNumber());
+    mock_object_proxy_ = new dbus::MockObjectProxy(
+        bus_.get(), kTestServiceName, dbus::ObjectPath(kTestPath));
+    EXPECT_CALL(*mock_object_proxy_,
+                ConnectToSignal(dbus::kPropertiesInterface,
+                                dbus::kPropertiesChanged, _, _))
+        .WillOnce(SaveArg<2>(&signal_callback_));
+    EXPECT_CALL(*mock_object_proxy_,
+                MockCallMethodAndBlockWithErrorDetails(_, _, _))
+        .WillRepeatedly(Invoke(this, &CachedPropertySetTest::HandleGetAll));
+    EXPECT_CALL(*mock_object_proxy_, CallMethodWithErrorCallback(_, _, _, _))
+        .WillRepeatedly(Invoke(this, &CachedPropertySetTest::HandleGet));
+
+    properties_.reset(
+        new CachedPropertySet(mock_object_proxy_.get(), kTestInterface));
+    properties_->SetPropertyChangedCallback(base::Bind(
+        &CachedPropertySetTest::OnPropertyChanged, base::Unretained(this)));
+    properties_->ConnectSignals();
+  }
+
+  void TearDown() override {
+    properties_.reset();
+    bus_ = nullptr;
+  }
+
+  Response* HandleGetAll(dbus::MethodCall* method_call,
+                         int /* timeout_ms */,
+                         dbus::ScopedDBusError* /* dbus_error */) {
+    get_all_count_++;
+    EXPECT_EQ(dbus::kPropertiesInterface, method_call->GetInterface());
+    EXPECT_EQ(dbus::kPropertiesGetAll, method_call->GetMember());
+    auto response = Response::CreateEmpty();
+    MessageWriter writer(response.get());
+    DBusParamWriter::Append(&writer, remote_properties_);
+    return response.release();
+  }
+
+  void HandleGet(dbus::MethodCall* method_call,
+                 int /* timeout_ms */,
+                 dbus::ObjectProxy::ResponseCallback success_callback,
+                 dbus::ObjectProxy::ErrorCallback /* error_callback */) {
+    EXPECT_EQ(dbus::kPropertiesGet, method_call->GetMember());
+    MessageReader reader(method_call);
+    std::string interface_name;
+    std::string property_name;
+    ASSERT_TRUE(reader.PopString(&interface_name));
+    ASSERT_TRUE(reader.PopString(&property_name));
+    EXPECT_EQ(kTestInterface, interface_name);
+    auto response = Response::CreateEmpty();
+    MessageWriter writer(response.get());
+    AppendValueToWriter(&writer, remote_properties_[property_name]);
+    success_callback.Run(response.get());
+  }
+
+  void OnPropertyChanged(const std::string& property_name) {
+    changed_properties_.push_back(property_name);
+  }
+
+  void SendPropertiesChanged(const std::string& interface_name,
+                             const VariantDictionary& changed_properties,
+                             const std::vector<std::string>& invalidated) {
+    dbus::Signal signal(dbus::kPropertiesInterface, dbus::kPropertiesChanged);
+    MessageWriter writer(&signal);
+    DBusParamWriter::Append(&writer, interface_name, changed_properties,
+                            invalidated);
+    signal_callback_.Run(&signal);
+  }
+
+  scoped_refptr<dbus::MockBus> bus_;
+  scoped_refptr<dbus::MockObjectProxy> mock_object_proxy_;
+  dbus::ObjectProxy::SignalCallback signal_callback_;
+  std::unique_ptr<CachedPropertySet> properties_;
+  VariantDictionary remote_properties_{{"Name", std::string{"test"}},
+                                       {"Count", int32_t{3}}};
+  std::vector<std::string> changed_properties_;
+  int get_all_count_{0};
+};
+
+TEST_F(CachedPropertySetTest, FetchAll) {
+  EXPECT_TRUE(properties_->FetchAllAndBlock(nullptr));
+  EXPECT_EQ(1, get_all_count_);
+
+  std::string name;
+  EXPECT_TRUE(properties_->GetValue("Name", &name));
+  EXPECT_EQ("test", name);
+  int32_t count = 0;
+  EXPECT_TRUE(properties_->GetValue("Count", &count));
+  EXPECT_EQ(3, count);
+  // Wrong type and unknown property.
+  EXPECT_FALSE(properties_->GetValue("Count", &name));
+  EXPECT_FALSE(properties_->GetValue("Unknown", &name));
+  EXPECT_EQ(nullptr, properties_->GetProperty("Unknown"));
+
+  // Reads are served from the cache.
+  EXPECT_TRUE(properties_->GetValue("Name", &name));
+  EXPECT_EQ(1, get_all_count_);
+  EXPECT_TRUE(changed_properties_.empty());
+}
+
+TEST_F(CachedPropertySetTest, PropertiesChanged) {
+  EXPECT_TRUE(properties_->FetchAllAndBlock(nullptr));
+  SendPropertiesChanged(kTestInterface, {{"Count", int32_t{4}}}, {});
+  EXPECT_EQ(std::vector<std::string>{"Count"}, changed_properties_);
+  int32_t count = 0;
+  EXPECT_TRUE(properties_->GetValue("Count", &count));
+  EXPECT_EQ(4, count);
+  EXPECT_EQ(1, get_all_count_);
+}
+
+TEST_F(CachedPropertySetTest, OtherInterfaceIsIgnored) {
+  EXPECT_TRUE(properties_->FetchAllAndBlock(nullptr));
+  SendPropertiesChanged(kOtherInterface, {{"Count", int32_t{4}}}, {});
+  EXPECT_TRUE(changed_properties_.empty());
+  int32_t count = 0;
+  EXPECT_TRUE(properties_->GetValue("Count", &count));
+  EXPECT_EQ(3, count);
+}
+
+TEST_F(CachedPropertySetTest, InvalidatedPropertyIsFetchedAgain) {
+  EXPECT_TRUE(properties_->FetchAllAndBlock(nullptr));
+  remote_properties_["Name"] = std::string{"new name"};
+  SendPropertiesChanged(kTestInterface, {}, {"Name"});
+  // Notified once for the invalidation and once for the new value.
+  EXPECT_EQ((std::vector<std::string>{"Name", "Name"}), changed_properties_);
+  std::string name;
+  EXPECT_TRUE(properties_->GetValue("Name", &name));
+  EXPECT_EQ("new name", name);
+  EXPECT_EQ(1, get_all_count_);
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
@@ -4,6 +4,8 @@
 
 #include <brillo/dbus/data_serialization.h>
 
+#include <unordered_map>
+
 #include <base/logging.h>
 #include <brillo/any.h>
 #include <brillo/variant_dictionary.h>
@@ -161,107 +163,131 @@ bool PopTypedValueFromReader(dbus::MessageReader* reader,
   return true;
 }
 
-// std::vector<T> overload.
+using AnyDecoder = bool (*)(dbus::MessageReader*, brillo::Any*);
+using AnyDecoderMap = std::unordered_map<std::string, AnyDecoder>;
+
+// Returns an entry of the decoder table for type T, keyed by its signature.
 template<typename T>
-bool PopTypedArrayFromReader(dbus::MessageReader* reader,
+AnyDecoderMap::value_type MakeAnyDecoder() {
+  return {GetDBusSignature<T>(), &PopTypedValueFromReader<T>};
+}
+
+// Returns the table of the container types that are decoded into their own
+// C++ type. Values with other container signatures are decoded generically
+// (see PopGenericValueFromReader() below).
+const AnyDecoderMap& GetAnyDecoders() {
+  static const AnyDecoderMap* decoders = new AnyDecoderMap{
+      MakeAnyDecoder<std::vector<bool>>(),
+      MakeAnyDecoder<std::vector<uint8_t>>(),
+      MakeAnyDecoder<std::vector<int16_t>>(),
+      MakeAnyDecoder<std::vector<uint16_t>>(),
+      MakeAnyDecoder<std::vector<int32_t>>(),
+      MakeAnyDecoder<std::vector<uint32_t>>(),
+      MakeAnyDecoder<std::vector<int64_t>>(),
+      MakeAnyDecoder<std::vector<uint64_t>>(),
+      MakeAnyDecoder<std::vector<double>>(),
+      MakeAnyDecoder<std::vector<std::string>>(),
+      MakeAnyDecoder<std::vector<dbus::ObjectPath>>(),
+      MakeAnyDecoder<std::vector<brillo::Any>>(),
+      MakeAnyDecoder<std::map<std::string, std::string>>(),
+      MakeAnyDecoder<brillo::VariantDictionary>(),
+      MakeAnyDecoder<std::vector<std::map<std::string, std::string>>>(),
+      MakeAnyDecoder<std::vector<brillo::VariantDictionary>>(),
+      MakeAnyDecoder<
+          std::map<std::string, std::map<std::string, std::string>>>(),
+      MakeAnyDecoder<std::map<std::string, brillo::VariantDictionary>>(),
+      MakeAnyDecoder<std::map<std::string, std::vector<uint8_t>>>(),
+      MakeAnyDecoder<std::map<uint32_t, brillo::Any>>(),
+      MakeAnyDecoder<std::vector<std::tuple<std::string, uint32_t>>>(),
+      MakeAnyDecoder<std::map<uint32_t, uint32_t>>(),
+      MakeAnyDecoder<std::vector<std::tuple<uint32_t, uint32_t>>>(),
+      MakeAnyDecoder<std::tuple<int, int>>(),
+      MakeAnyDecoder<std::tuple<std::string, std::string>>(),
+      MakeAnyDecoder<std::tuple<uint32_t, bool>>(),
+      MakeAnyDecoder<std::tuple<uint32_t, uint32_t>>(),
+  };
+  return *decoders;
+}
+
+// Pops a dictionary with keys of D-Bus type |key_type| as std::map<KEY, Any>.
+bool PopGenericMapFromReader(dbus::MessageReader* reader,
+                             char key_type,
                              brillo::Any* value) {
-  return PopTypedValueFromReader<std::vector<T>>(reader, value);
+  switch (key_type) {
+    case DBUS_TYPE_BYTE:
+      return PopTypedValueFromReader<std::map<uint8_t, brillo::Any>>(reader,
+                                                                     value);
+    case DBUS_TYPE_BOOLEAN:
+      return PopTypedValueFromReader<std::map<bool, brillo::Any>>(reader,
+                                                                  value);
+    case DBUS_TYPE_INT16:
+      return PopTypedValueFromReader<std::map<int16_t, brillo::Any>>(reader,
+                                                                     value);
+    case DBUS_TYPE_UINT16:
+      return PopTypedValueFromReader<std::map<uint16_t, brillo::Any>>(reader,
+                                                                      value);
+    case DBUS_TYPE_INT32:
+      return PopTypedValueFromReader<std::map<int32_t, brillo::Any>>(reader,
+                                                                     value);
+    case DBUS_TYPE_UINT32:
+      return PopTypedValueFromReader<std::map<uint32_t, brillo::Any>>(reader,
+                                                                      value);
+    case DBUS_TYPE_INT64:
+      return PopTypedValueFromReader<std::map<int64_t, brillo::Any>>(reader,
+                                                                     value);
+    case DBUS_TYPE_UINT64:
+      return PopTypedValueFromReader<std::map<uint64_t, brillo::Any>>(reader,
+                                                                      value);
+    case DBUS_TYPE_DOUBLE:
+      return PopTypedValueFromReader<std::map<double, brillo::Any>>(reader,
+                                                                    value);
+    case DBUS_TYPE_STRING:
+      return PopTypedValueFromReader<brillo::VariantDictionary>(reader, value);
+    case DBUS_TYPE_OBJECT_PATH:
+      return PopTypedValueFromReader<std::map<dbus::ObjectPath, brillo::Any>>(
+          reader, value);
+  }
+  LOG(ERROR) << "Variant de-serialization of dictionaries with keys of type '"
+             << key_type << "' is not supported";
+  return false;
 }
 
-// std::map<KEY, VALUE> overload.
-template<typename KEY, typename VALUE>
-bool PopTypedMapFromReader(dbus::MessageReader* reader, brillo::Any* value) {
-  return PopTypedValueFromReader<std::map<KEY, VALUE>>(reader, value);
+// Pops the members of a struct as std::vector<Any>.
+bool PopGenericStructFromReader(dbus::MessageReader* reader,
+                                brillo::Any* value) {
+  dbus::MessageReader struct_reader(nullptr);
+  if (!reader->PopStruct(&struct_reader))
+    return false;
+  std::vector<brillo::Any> members;
+  while (struct_reader.HasMoreData()) {
+    brillo::Any member;
+    if (!PopValueFromReader(&struct_reader, &member))
+      return false;
+    members.push_back(std::move(member));
+  }
+  *value = std::move(members);
+  return true;
 }
 
-// Helper methods for reading common ARRAY signatures into a Variant.
-// Note that only common types are supported. If an additional specific
-// type signature is required, feel free to add support for it.
-bool PopArrayValueFromReader(dbus::MessageReader* reader,
-                             brillo::Any* value) {
+// Reads an ARRAY or STRUCT value into a Variant. The types from the table
+// above are decoded into their exact C++ type. Other arrays, dictionaries and
+// structs are decoded recursively into std::vector<Any>, std::map<KEY, Any>
+// and std::vector<Any> respectively, so any valid D-Bus data can be read.
+// Note that writing such an Any back produces the signature of the generic
+// type (e.g. "av" rather than "aai").
+bool PopContainerValueFromReader(dbus::MessageReader* reader,
+                                 brillo::Any* value) {
   std::string signature = reader->GetDataSignature();
-  if (signature == "ab")
-    return PopTypedArrayFromReader<bool>(reader, value);
-  else if (signature == "ay")
-    return PopTypedArrayFromReader<uint8_t>(reader, value);
-  else if (signature == "an")
-    return PopTypedArrayFromReader<int16_t>(reader, value);
-  else if (signature == "aq")
-    return PopTypedArrayFromReader<uint16_t>(reader, value);
-  else if (signature == "ai")
-    return PopTypedArrayFromReader<int32_t>(reader, value);
-  else if (signature == "au")
-    return PopTypedArrayFromReader<uint32_t>(reader, value);
-  else if (signature == "ax")
-    return PopTypedArrayFromReader<int64_t>(reader, value);
-  else if (signature == "at")
-    return PopTypedArrayFromReader<uint64_t>(reader, value);
-  else if (signature == "ad")
-    return PopTypedArrayFromReader<double>(reader, value);
-  else if (signature == "as")
-    return PopTypedArrayFromReader<std::string>(reader, value);
-  else if (signature == "ao")
-    return PopTypedArrayFromReader<dbus::ObjectPath>(reader, value);
-  else if (signature == "av")
-    return PopTypedArrayFromReader<brillo::Any>(reader, value);
-  else if (signature == "a{ss}")
-    return PopTypedMapFromReader<std::string, std::string>(reader, value);
-  else if (signature == "a{sv}")
-    return PopTypedValueFromReader<brillo::VariantDictionary>(reader, value);
-  else if (signature == "aa{ss}")
-    return PopTypedArrayFromReader<
-        std::map<std::string, std::string>>(reader, value);
-  else if (signature == "aa{sv}")
-    return PopTypedArrayFromReader<brillo::VariantDictionary>(reader, value);
-  else if (signature == "a{sa{ss}}")
-    return PopTypedMapFromReader<
-        std::string, std::map<std::string, std::string>>(reader, value);
-  else if (signature == "a{sa{sv}}")
-    return PopTypedMapFromReader<
-        std::string, brillo::VariantDictionary>(reader, value);
-  else if (signature == "a{say}")
-    return PopTypedMapFromReader<
-        std::string, std::vector<uint8_t>>(reader, value);
-  else if (signature == "a{uv}")
-    return PopTypedMapFromReader<uint32_t, brillo::Any>(reader, value);
-  else if (signature == "a(su)")
-    return PopTypedArrayFromReader<
-        std::tuple<std::string, uint32_t>>(reader, value);
-  else if (signature == "a{uu}")
-    return PopTypedMapFromReader<uint32_t, uint32_t>(reader, value);
-  else if (signature == "a(uu)")
-    return PopTypedArrayFromReader<
-        std::tuple<uint32_t, uint32_t>>(reader, value);
-
-  // When a use case for particular array signature is found, feel free
-  // to add handing for it here.
-  LOG(ERROR) << "Variant de-serialization of array containing data of "
-             << "type '" << signature << "' is not yet supported";
-  return false;
-}
+  const AnyDecoderMap& decoders = GetAnyDecoders();
+  auto it = decoders.find(signature);
+  if (it != decoders.end())
+    return it->second(reader, value);
 
-// Helper methods for reading common STRUCT signatures into a Variant.
-// Note that only common types are supported. If an additional specific
-// type signature is required, feel free to add support for it.
-bool PopStructValueFromReader(dbus::MessageReader* reader,
-                              brillo::Any* value) {
-  std::string signature = reader->GetDataSignature();
-  if (signature == "(ii)")
-    return PopTypedValueFromReader<std::tuple<int, int>>(reader, value);
-  else if (signature == "(ss)")
-    return PopTypedValueFromReader<std::tuple<std::string, std::string>>(reader,
-                                                                         value);
-  else if (signature == "(ub)")
-    return PopTypedValueFromReader<std::tuple<uint32_t, bool>>(reader, value);
-  else if (signature == "(uu)")
-    return PopTypedValueFromReader<std::tuple<uint32_t, uint32_t>>(reader,
-                                                                   value);
-
-  // When a use case for particular struct signature is found, feel free
-  // to add handing for it here.
-  LOG(ERROR) << "Variant de-serialization of structs of type '" << signature
-             << "' is not yet supported";
-  return false;
+  if (signature.front() == DBUS_STRUCT_BEGIN_CHAR)
+    return PopGenericStructFromReader(reader, value);
+  if (signature.size() > 2 && signature[1] == DBUS_DICT_ENTRY_BEGIN_CHAR)
+    return PopGenericMapFromReader(reader, signature[2], value);
+  return PopTypedValueFromReader<std::vector<brillo::Any>>(reader, value);
 }
 
 }  // anonymous namespace
@@ -295,9 +321,8 @@ bool PopValueFromReader(dbus::MessageReader* reader, brillo::Any* value) {
     case dbus::Message::OBJECT_PATH:
       return PopTypedValueFromReader<dbus::ObjectPath>(reader, value);
     case dbus::Message::ARRAY:
-      return PopArrayValueFromReader(reader, value);
     case dbus::Message::STRUCT:
-      return PopStructValueFromReader(reader, value);
+      return PopContainerValueFromReader(reader, value);
     case dbus::Message::DICT_ENTRY:
       LOG(ERROR) << "Variant of DICT_ENTRY is invalid";
       return false;
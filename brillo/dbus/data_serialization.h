@@ -464,10 +464,80 @@ struct DBusType<brillo::Any> {
 };
 
 // std::vector = D-Bus ARRAY. -------------------------------------------------
+namespace details {
+// FixedArrayOps<T> provides bulk Append()/Pop() for arrays of fixed-width
+// types that dbus::MessageWriter/MessageReader can copy in one go, instead of
+// one element at a time. This matters for large binary blobs (ay).
+template<typename T>
+struct FixedArrayOps : public std::false_type {};
+
+template<>
+struct FixedArrayOps<uint8_t> : public std::true_type {
+  inline static void Append(dbus::MessageWriter* writer,
+                            const uint8_t* values,
+                            size_t size) {
+    writer->AppendArrayOfBytes(values, size);
+  }
+  inline static bool Pop(dbus::MessageReader* reader,
+                         const uint8_t** values,
+                         size_t* size) {
+    return reader->PopArrayOfBytes(values, size);
+  }
+};
+
+template<>
+struct FixedArrayOps<int32_t> : public std::true_type {
+  inline static void Append(dbus::MessageWriter* writer,
+                            const int32_t* values,
+                            size_t size) {
+    writer->AppendArrayOfInt32s(values, size);
+  }
+  inline static bool Pop(dbus::MessageReader* reader,
+                         const int32_t** values,
+                         size_t* size) {
+    return reader->PopArrayOfInt32s(values, size);
+  }
+};
+
+template<>
+struct FixedArrayOps<uint32_t> : public std::true_type {
+  inline static void Append(dbus::MessageWriter* writer,
+                            const uint32_t* values,
+                            size_t size) {
+    writer->AppendArrayOfUint32s(values, size);
+  }
+  inline static bool Pop(dbus::MessageReader* reader,
+                         const uint32_t** values,
+                         size_t* size) {
+    return reader->PopArrayOfUint32s(values, size);
+  }
+};
+
+template<>
+struct FixedArrayOps<double> : public std::true_type {
+  inline static void Append(dbus::MessageWriter* writer,
+                            const double* values,
+                            size_t size) {
+    writer->AppendArrayOfDoubles(values, size);
+  }
+  inline static bool Pop(dbus::MessageReader* reader,
+                         const double** values,
+                         size_t* size) {
+    return reader->PopArrayOfDoubles(values, size);
+  }
+};
+
 template<typename T, typename ALLOC>
-typename std::enable_if<IsTypeSupported<T>::value>::type AppendValueToWriter(
-    dbus::MessageWriter* writer,
-    const std::vector<T, ALLOC>& value) {
+inline void AppendArrayToWriter(dbus::MessageWriter* writer,
+                                const std::vector<T, ALLOC>& value,
+                                std::true_type /* fixed_width */) {
+  FixedArrayOps<T>::Append(writer, value.data(), value.size());
+}
+
+template<typename T, typename ALLOC>
+inline void AppendArrayToWriter(dbus::MessageWriter* writer,
+                                const std::vector<T, ALLOC>& value,
+                                std::false_type /* fixed_width */) {
   dbus::MessageWriter array_writer(nullptr);
   writer->OpenArray(GetDBusSignature<T>(), &array_writer);
   for (const auto& element : value) {
@@ -480,12 +550,23 @@ typename std::enable_if<IsTypeSupported<T>::value>::type AppendValueToWriter(
 }
 
 template<typename T, typename ALLOC>
-typename std::enable_if<IsTypeSupported<T>::value, bool>::type
-PopValueFromReader(dbus::MessageReader* reader, std::vector<T, ALLOC>* value) {
-  dbus::MessageReader variant_reader(nullptr);
+inline bool PopArrayFromReader(dbus::MessageReader* reader,
+                               std::vector<T, ALLOC>* value,
+                               std::true_type /* fixed_width */) {
+  const T* values = nullptr;
+  size_t size = 0;
+  if (!FixedArrayOps<T>::Pop(reader, &values, &size))
+    return false;
+  value->assign(values, values + size);
+  return true;
+}
+
+template<typename T, typename ALLOC>
+inline bool PopArrayFromReader(dbus::MessageReader* reader,
+                               std::vector<T, ALLOC>* value,
+                               std::false_type /* fixed_width */) {
   dbus::MessageReader array_reader(nullptr);
-  if (!details::DescendIntoVariantIfPresent(&reader, &variant_reader) ||
-      !reader->PopArray(&array_reader))
+  if (!reader->PopArray(&array_reader))
     return false;
   value->clear();
   while (array_reader.HasMoreData()) {
@@ -499,6 +580,24 @@ PopValueFromReader(dbus::MessageReader* reader, std::vector<T, ALLOC>* value) {
   }
   return true;
 }
+}  // namespace details
+
+template<typename T, typename ALLOC>
+typename std::enable_if<IsTypeSupported<T>::value>::type AppendValueToWriter(
+    dbus::MessageWriter* writer,
+    const std::vector<T, ALLOC>& value) {
+  details::AppendArrayToWriter(writer, value, details::FixedArrayOps<T>{});
+}
+
+template<typename T, typename ALLOC>
+typename std::enable_if<IsTypeSupported<T>::value, bool>::type
+PopValueFromReader(dbus::MessageReader* reader, std::vector<T, ALLOC>* value) {
+  dbus::MessageReader variant_reader(nullptr);
+  if (!details::DescendIntoVariantIfPresent(&reader, &variant_reader))
+    return false;
+  return details::PopArrayFromReader(reader, value,
+                                     details::FixedArrayOps<T>{});
+}
 
 namespace details {
 // DBusArrayType<> is a helper base class for DBusType<vector<T>> that provides
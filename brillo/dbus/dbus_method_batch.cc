@@ -0,0 +1,157 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/dbus_method_batch.h>
+
+#include <algorithm>
+#include <limits>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <brillo/errors/error_codes.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+namespace {
+
+void SetTrue(bool* value) {
+  *value = true;
+}
+
+}  // anonymous namespace
+
+DBusMethodBatch::DBusMethodBatch() = default;
+
+DBusMethodBatch::~DBusMethodBatch() {
+  if (deadline_task_ != MessageLoop::kTaskIdNull)
+    MessageLoop::current()->CancelTask(deadline_task_);
+}
+
+size_t DBusMethodBatch::AddCallImpl(
+    dbus::ObjectProxy* object,
+    std::unique_ptr<dbus::MethodCall> method_call,
+    const ResultReader& read_results) {
+  CHECK(!running_) << "Can't add a call to a running batch";
+  Call call;
+  call.object = object;
+  call.method_call = std::move(method_call);
+  call.read_results = read_results;
+  calls_.push_back(std::move(call));
+  return calls_.size() - 1;
+}
+
+void DBusMethodBatch::Run(base::TimeDelta timeout,
+                          const base::Closure& callback) {
+  CHECK(!running_) << "The batch can only be run once";
+  running_ = true;
+  callback_ = callback;
+  pending_calls_ = calls_.size();
+  if (calls_.empty()) {
+    callback_.Run();
+    return;
+  }
+
+  // The calls are sent at the same time, so they all get the same timeout.
+  // The deadline task also covers calls that never get a reply at all.
+  int64_t timeout_ms = std::min<int64_t>(timeout.InMilliseconds(),
+                                         std::numeric_limits<int>::max());
+  deadline_task_ = MessageLoop::current()->PostDelayedTask(
+      FROM_HERE,
+      base::Bind(&DBusMethodBatch::OnDeadline, weak_ptr_factory_.GetWeakPtr()),
+      timeout);
+
+  // The replies may arrive synchronously, and the completion callback may
+  // destroy this object.
+  base::WeakPtr<DBusMethodBatch> self = weak_ptr_factory_.GetWeakPtr();
+  for (size_t i = 0; i < calls_.size(); i++) {
+    Call& call = calls_[i];
+    call.object->CallMethodWithErrorCallback(
+        call.method_call.get(),
+        static_cast<int>(timeout_ms),
+        base::Bind(&DBusMethodBatch::OnSuccess, self, i),
+        base::Bind(&DBusMethodBatch::OnError, self, i));
+    if (!self)
+      return;
+    // The message is not needed anymore once it is sent.
+    calls_[i].method_call.reset();
+  }
+}
+
+bool DBusMethodBatch::RunAndBlock(base::TimeDelta timeout) {
+  bool done = false;
+  Run(timeout, base::Bind(&SetTrue, &done));
+  while (!done)
+    MessageLoop::current()->RunOnce(true);
+  return GetFailedCallCount() == 0;
+}
+
+size_t DBusMethodBatch::GetFailedCallCount() const {
+  return std::count_if(calls_.begin(), calls_.end(), [](const Call& call) {
+    return call.error != nullptr;
+  });
+}
+
+const Error* DBusMethodBatch::GetError(size_t index) const {
+  CHECK_LT(index, calls_.size());
+  return calls_[index].error.get();
+}
+
+void DBusMethodBatch::OnSuccess(size_t index, dbus::Response* response) {
+  Call& call = calls_[index];
+  if (call.completed)
+    return;
+  if (!response) {
+    Error::AddTo(&call.error, FROM_HERE, errors::dbus::kDomain,
+                 DBUS_ERROR_NO_REPLY, "No response to the method call");
+  } else {
+    call.read_results.Run(response, &call.error);
+  }
+  CompleteCall(index);
+}
+
+void DBusMethodBatch::OnError(size_t index, dbus::ErrorResponse* response) {
+  Call& call = calls_[index];
+  if (call.completed)
+    return;
+  if (!response) {
+    Error::AddTo(&call.error, FROM_HERE, errors::dbus::kDomain,
+                 DBUS_ERROR_NO_REPLY, "No response to the method call");
+  } else {
+    // Translates the D-Bus error into |call.error|.
+    ExtractMethodCallResults(response, &call.error);
+  }
+  CompleteCall(index);
+}
+
+void DBusMethodBatch::OnDeadline() {
+  deadline_task_ = MessageLoop::kTaskIdNull;
+  for (Call& call : calls_) {
+    if (call.completed)
+      continue;
+    Error::AddTo(&call.error, FROM_HERE, errors::dbus::kDomain,
+                 DBUS_ERROR_NO_REPLY, "The method call batch timed out");
+    call.completed = true;
+  }
+  pending_calls_ = 0;
+  // Running the callback may destroy this object.
+  base::Closure callback = callback_;
+  callback.Run();
+}
+
+void DBusMethodBatch::CompleteCall(size_t index) {
+  calls_[index].completed = true;
+  if (--pending_calls_ > 0)
+    return;
+  if (deadline_task_ != MessageLoop::kTaskIdNull) {
+    MessageLoop::current()->CancelTask(deadline_task_);
+    deadline_task_ = MessageLoop::kTaskIdNull;
+  }
+  // Running the callback may destroy this object.
+  base::Closure callback = callback_;
+  callback.Run();
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
@@ -0,0 +1,150 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// DBusMethodBatch sends several D-Bus method calls at once, possibly to
+// different objects and services, and collects their typed results. Since the
+// calls are all in flight at the same time, the whole batch takes about one
+// round trip instead of one round trip per call as with a sequence of
+// CallMethodAndBlock() calls.
+//
+// Each call stores its return values in a std::tuple provided by the caller.
+// A failed call doesn't prevent the other calls of the batch from completing;
+// its error is available from GetError(). The whole batch shares a single
+// deadline, after which the calls still pending fail with
+// DBUS_ERROR_NO_REPLY.
+//
+// Example: read the "Name" of a list of objects.
+//
+//  using brillo::dbus_utils::DBusMethodBatch;
+//
+//  DBusMethodBatch batch;
+//  std::vector<std::tuple<std::string>> names(proxies.size());
+//  for (size_t i = 0; i < proxies.size(); i++) {
+//    batch.AddCall(proxies[i], "org.chromium.MyInterface", "GetName",
+//                  &names[i]);
+//  }
+//  if (!batch.RunAndBlock(base::TimeDelta::FromSeconds(5))) {
+//    for (size_t i = 0; i < batch.GetCallCount(); i++) {
+//      if (batch.GetError(i))
+//        LOG(ERROR) << "Call " << i << " failed";
+//    }
+//  }
+
+#ifndef LIBBRILLO_BRILLO_DBUS_DBUS_METHOD_BATCH_H_
+#define LIBBRILLO_BRILLO_DBUS_DBUS_METHOD_BATCH_H_
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
+#include <brillo/brillo_export.h>
+#include <brillo/dbus/dbus_method_invoker.h>
+#include <brillo/errors/error.h>
+#include <brillo/message_loops/message_loop.h>
+#include <dbus/message.h>
+#include <dbus/object_proxy.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+class BRILLO_EXPORT DBusMethodBatch {
+ public:
+  DBusMethodBatch();
+  ~DBusMethodBatch();
+
+  // Adds a call of |interface_name|.|method_name| on |object| with the
+  // arguments |args| to the batch. On success, the return values of the method
+  // are stored in |results|, which must outlive the batch. Returns the index
+  // of the call in the batch. Calls can't be added once the batch is running.
+  template<typename... OutArgs, typename... InArgs>
+  size_t AddCall(dbus::ObjectProxy* object,
+                 const std::string& interface_name,
+                 const std::string& method_name,
+                 std::tuple<OutArgs...>* results,
+                 const InArgs&... args) {
+    std::unique_ptr<dbus::MethodCall> method_call{
+        new dbus::MethodCall(interface_name, method_name)};
+    dbus::MessageWriter writer(method_call.get());
+    DBusParamWriter::Append(&writer, args...);
+    return AddCallImpl(object, std::move(method_call),
+                       base::Bind(&ReadResults<OutArgs...>, results));
+  }
+
+  // Sends all the calls of the batch at once. |callback| is called when all
+  // the calls have completed, successfully or not. Calls still pending after
+  // |timeout| fail with DBUS_ERROR_NO_REPLY. |callback| may be called before
+  // Run() returns, e.g. if the batch is empty. Requires a MessageLoop on the
+  // current thread. Destroying the batch cancels the pending calls.
+  void Run(base::TimeDelta timeout, const base::Closure& callback);
+
+  // Same as Run(), but runs the current MessageLoop until all the calls have
+  // completed. Returns true if all the calls succeeded.
+  bool RunAndBlock(base::TimeDelta timeout);
+
+  size_t GetCallCount() const { return calls_.size(); }
+  // Returns the number of calls that have failed so far.
+  size_t GetFailedCallCount() const;
+
+  // Returns the error of the call at |index|, or nullptr if it succeeded or
+  // is still pending.
+  const Error* GetError(size_t index) const;
+
+ private:
+  // Reads the return values of a method call from |response| into |results|.
+  using ResultReader = base::Callback<bool(dbus::Response*, ErrorPtr*)>;
+
+  struct Call {
+    dbus::ObjectProxy* object;
+    std::unique_ptr<dbus::MethodCall> method_call;
+    ResultReader read_results;
+    ErrorPtr error;
+    bool completed{false};
+  };
+
+  template<typename... OutArgs>
+  static bool ReadResults(std::tuple<OutArgs...>* results,
+                          dbus::Response* response,
+                          ErrorPtr* error) {
+    auto callback = [results](const OutArgs&... values) {
+      *results = std::tuple<OutArgs...>{internal::HackMove(values)...};
+    };
+    dbus::MessageReader reader(response);
+    return DBusParamReader<false, OutArgs...>::Invoke(callback, &reader,
+                                                      error);
+  }
+
+  size_t AddCallImpl(dbus::ObjectProxy* object,
+                     std::unique_ptr<dbus::MethodCall> method_call,
+                     const ResultReader& read_results);
+
+  // Called when the call at |index| has received a |response|.
+  void OnSuccess(size_t index, dbus::Response* response);
+  // Called when the call at |index| has failed.
+  void OnError(size_t index, dbus::ErrorResponse* response);
+  // Fails the calls still pending when the deadline is reached.
+  void OnDeadline();
+  // Marks the call at |index| as completed and runs the completion callback
+  // once all the calls have completed.
+  void CompleteCall(size_t index);
+
+  std::vector<Call> calls_;
+  size_t pending_calls_{0};
+  bool running_{false};
+  base::Closure callback_;
+  MessageLoop::TaskId deadline_task_{MessageLoop::kTaskIdNull};
+
+  base::WeakPtrFactory<DBusMethodBatch> weak_ptr_factory_{this};
+
+  DISALLOW_COPY_AND_ASSIGN(DBusMethodBatch);
+};
+
+}  // namespace dbus_utils
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_DBUS_DBUS_METHOD_BATCH_H_
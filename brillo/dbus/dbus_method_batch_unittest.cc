@@ -0,0 +1,178 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/dbus_method_batch.h>
+
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <base/bind.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <dbus/mock_bus.h>
+#include <dbus/mock_object_proxy.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::AnyNumber;
+using testing::Invoke;
+using testing::_;
+
+using dbus::MessageReader;
+using dbus::MessageWriter;
+using dbus::Response;
+
+namespace brillo {
+namespace dbus_utils {
+
+namespace {
+
+const char kTestPath[] = "/test/path";
+const char kTestServiceName[] = "org.test.Object";
+const char kTestInterface[] = "org.test.Object.TestInterface";
+const char kTestMethodAdd[] = "Add";
+const char kTestMethodFail[] = "Fail";
+const char kTestMethodHang[] = "Hang";
+
+void SendStringResponse(const dbus::ObjectProxy::ResponseCallback& callback,
+                        const std::string& value) {
+  auto response = Response::CreateEmpty();
+  MessageWriter writer(response.get());
+  writer.AppendString(value);
+  callback.Run(response.get());
+}
+
+void SendErrorResponse(const dbus::ObjectProxy::ErrorCallback& callback,
+                       std::shared_ptr<dbus::ErrorResponse> response) {
+  callback.Run(response.get());
+}
+
+void SetTrue(bool* value) {
+  *value = true;
+}
+
+}  // namespace
+
+class DBusMethodBatchTest : public testing::Test {
+ public:
+  void SetUp() override {
+    fake_loop_.SetAsCurrent();
+    dbus::Bus::Options options;
+    options.bus_type = dbus::Bus::SYSTEM;
+    bus_ = new dbus::MockBus(options);
+    EXPECT_CALL(*bus_, AssertOnOriginThread()).Times(AnyNumber());
+    EXPECT_CALL(*bus_, AssertOnDBusThread()).Times(AnyNumber());
+    mock_object_proxy_ = new dbus::MockObjectProxy(
+        bus_.get(), kTestServiceName, dbus::ObjectPath(kTestPath));
+    EXPECT_CALL(*mock_object_proxy_, CallMethodWithErrorCallback(_, _, _, _))
+        .WillRepeatedly(Invoke(this, &DBusMethodBatchTest::HandleCall));
+  }
+
+  void TearDown() override { bus_ = nullptr; }
+
+  // Replies to the calls asynchronously, with a shorter delay for each new
+  // call so the replies arrive in the reverse order of the calls.
+  void HandleCall(dbus::MethodCall* method_call,
+                  int timeout_ms,
+                  dbus::ObjectProxy::ResponseCallback success_callback,
+                  dbus::ObjectProxy::ErrorCallback error_callback) {
+    EXPECT_EQ(1000, timeout_ms);
+    base::TimeDelta delay = base::TimeDelta::FromMilliseconds(10 - call_count_);
+    call_count_++;
+    if (method_call->GetMember() == kTestMethodAdd) {
+      MessageReader reader(method_call);
+      int32_t v1, v2;
+      ASSERT_TRUE(reader.PopInt32(&v1));
+      ASSERT_TRUE(reader.PopInt32(&v2));
+      fake_loop_.PostDelayedTask(
+          FROM_HERE,
+          base::Bind(&SendStringResponse, success_callback,
+                     std::to_string(v1 + v2)),
+          delay);
+    } else if (method_call->GetMember() == kTestMethodFail) {
+      method_call->SetSerial(123);
+      std::shared_ptr<dbus::ErrorResponse> error_response{
+          dbus::ErrorResponse::FromMethodCall(method_call, "org.MyError",
+                                              "My error message")};
+      fake_loop_.PostDelayedTask(
+          FROM_HERE,
+          base::Bind(&SendErrorResponse, error_callback, error_response),
+          delay);
+    }
+    // kTestMethodHang never gets a reply.
+  }
+
+  FakeMessageLoop fake_loop_{nullptr};
+  int call_count_{0};
+  scoped_refptr<dbus::MockBus> bus_;
+  scoped_refptr<dbus::MockObjectProxy> mock_object_proxy_;
+};
+
+TEST_F(DBusMethodBatchTest, EmptyBatch) {
+  DBusMethodBatch batch;
+  EXPECT_TRUE(batch.RunAndBlock(base::TimeDelta::FromSeconds(1)));
+  EXPECT_EQ(0u, batch.GetCallCount());
+}
+
+TEST_F(DBusMethodBatchTest, AllCallsAreSentAtOnce) {
+  DBusMethodBatch batch;
+  std::vector<std::tuple<std::string>> results(3);
+  for (int i = 0; i < 3; i++) {
+    EXPECT_EQ(static_cast<size_t>(i),
+              batch.AddCall(mock_object_proxy_.get(), kTestInterface,
+                            kTestMethodAdd, &results[i], i, 10));
+  }
+  bool done = false;
+  batch.Run(base::TimeDelta::FromSeconds(1),
+            base::Bind(&SetTrue, &done));
+  // All the calls are in flight before any reply is received.
+  EXPECT_EQ(3, call_count_);
+  EXPECT_FALSE(done);
+
+  while (!done)
+    fake_loop_.RunOnce(true);
+  EXPECT_EQ(0u, batch.GetFailedCallCount());
+  EXPECT_EQ("10", std::get<0>(results[0]));
+  EXPECT_EQ("11", std::get<0>(results[1]));
+  EXPECT_EQ("12", std::get<0>(results[2]));
+  // Only the replies were run, the deadline was canceled.
+  EXPECT_FALSE(fake_loop_.PendingTasks());
+}
+
+TEST_F(DBusMethodBatchTest, PartialFailure) {
+  DBusMethodBatch batch;
+  std::tuple<std::string> sum;
+  std::tuple<> no_results;
+  batch.AddCall(mock_object_proxy_.get(), kTestInterface, kTestMethodAdd, &sum,
+                2, 3);
+  batch.AddCall(mock_object_proxy_.get(), kTestInterface, kTestMethodFail,
+                &no_results);
+  EXPECT_FALSE(batch.RunAndBlock(base::TimeDelta::FromSeconds(1)));
+
+  EXPECT_EQ(1u, batch.GetFailedCallCount());
+  EXPECT_EQ(nullptr, batch.GetError(0));
+  EXPECT_EQ("5", std::get<0>(sum));
+  ASSERT_NE(nullptr, batch.GetError(1));
+  EXPECT_EQ("org.MyError", batch.GetError(1)->GetCode());
+}
+
+TEST_F(DBusMethodBatchTest, Deadline) {
+  DBusMethodBatch batch;
+  std::tuple<std::string> sum;
+  std::tuple<int32_t> hang_result{7};
+  batch.AddCall(mock_object_proxy_.get(), kTestInterface, kTestMethodAdd, &sum,
+                1, 1);
+  batch.AddCall(mock_object_proxy_.get(), kTestInterface, kTestMethodHang,
+                &hang_result);
+  EXPECT_FALSE(batch.RunAndBlock(base::TimeDelta::FromSeconds(1)));
+
+  EXPECT_EQ("2", std::get<0>(sum));
+  ASSERT_NE(nullptr, batch.GetError(1));
+  EXPECT_EQ(DBUS_ERROR_NO_REPLY, batch.GetError(1)->GetCode());
+  EXPECT_EQ(7, std::get<0>(hang_result));
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
@@ -4,6 +4,7 @@
 
 #include <brillo/dbus/dbus_object.h>
 
+#include <algorithm>
 #include <vector>
 
 #include <base/bind.h>
@@ -20,9 +21,9 @@ namespace {
 
 void SetupDefaultPropertyHandlers(DBusInterface* prop_interface,
                                   ExportedPropertySet* property_set) {
-  prop_interface->AddSimpleMethodHandler(dbus::kPropertiesGetAll,
-                                         base::Unretained(property_set),
-                                         &ExportedPropertySet::HandleGetAll);
+  prop_interface->AddRawMethodHandler(
+      dbus::kPropertiesGetAll, base::Unretained(property_set),
+      &ExportedPropertySet::HandleGetAllMethodCall);
   prop_interface->AddSimpleMethodHandlerWithError(
       dbus::kPropertiesGet, base::Unretained(property_set),
       &ExportedPropertySet::HandleGet);
@@ -31,10 +32,47 @@ void SetupDefaultPropertyHandlers(DBusInterface* prop_interface,
       &ExportedPropertySet::HandleSet);
 }
 
+// Converts the statistics of a method to the dictionary returned by
+// GetMethodStats() over D-Bus.
+VariantDictionary MethodStatsToDictionary(const DBusMethodStats& stats) {
+  return VariantDictionary{
+      {"Calls", stats.calls},
+      {"Errors", stats.errors},
+      {"TotalLatencyUs", stats.total_latency.InMicroseconds()},
+      {"MaxLatencyUs", stats.max_latency.InMicroseconds()},
+      {"LatencyHistogram",
+       std::vector<uint64_t>(stats.latency_histogram.begin(),
+                             stats.latency_histogram.end())},
+  };
+}
+
 }  // namespace
 
 //////////////////////////////////////////////////////////////////////////////
 
+const size_t DBusMethodStats::kLatencyBucketCount;
+
+size_t DBusMethodStats::GetLatencyBucket(base::TimeDelta latency) {
+  int64_t limit_ms = 1;
+  for (size_t bucket = 0; bucket < kLatencyBucketCount - 1; bucket++) {
+    if (latency < base::TimeDelta::FromMilliseconds(limit_ms))
+      return bucket;
+    limit_ms *= 4;
+  }
+  return kLatencyBucketCount - 1;
+}
+
+void DBusMethodStats::AddCall(base::TimeDelta latency, bool error) {
+  calls++;
+  if (error)
+    errors++;
+  total_latency += latency;
+  max_latency = std::max(max_latency, latency);
+  latency_histogram[GetLatencyBucket(latency)]++;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
 DBusInterface::DBusInterface(DBusObject* dbus_object,
                              const std::string& interface_name)
     : dbus_object_(dbus_object), interface_name_(interface_name) {
@@ -60,14 +98,14 @@ void DBusInterface::ExportAsync(
   VLOG(1) << "Registering D-Bus interface '" << interface_name_ << "' for '"
           << object_path.value() << "'";
   scoped_refptr<AsyncEventSequencer> sequencer(new AsyncEventSequencer());
-  for (const auto& pair : handlers_) {
+  for (auto& pair : handlers_) {
     std::string method_name = pair.first;
     VLOG(1) << "Exporting method: " << interface_name_ << "." << method_name;
     std::string export_error = "Failed exporting " + method_name + " method";
     auto export_handler = sequencer->GetExportHandler(
         interface_name_, method_name, export_error, true);
-    auto method_handler =
-        base::Bind(&DBusInterface::HandleMethodCall, base::Unretained(this));
+    auto method_handler = base::Bind(&DBusInterface::DispatchMethodCall,
+                                     base::Unretained(this), &pair.second);
     exported_object->ExportMethod(
         interface_name_, method_name, method_handler, export_handler);
   }
@@ -75,7 +113,7 @@ void DBusInterface::ExportAsync(
   std::vector<AsyncEventSequencer::CompletionAction> actions;
   if (object_manager) {
     auto property_writer_callback =
-        dbus_object_->property_set_.GetPropertyWriter(interface_name_);
+        dbus_object_->property_set_.GetPropertyMessageWriter(interface_name_);
     actions.push_back(
         base::Bind(&DBusInterface::ClaimInterface,
                    weak_factory_.GetWeakPtr(),
@@ -94,11 +132,11 @@ void DBusInterface::ExportAndBlock(
     const dbus::ObjectPath& object_path) {
   VLOG(1) << "Registering D-Bus interface '" << interface_name_ << "' for '"
           << object_path.value() << "'";
-  for (const auto& pair : handlers_) {
+  for (auto& pair : handlers_) {
     std::string method_name = pair.first;
     VLOG(1) << "Exporting method: " << interface_name_ << "." << method_name;
-    auto method_handler =
-        base::Bind(&DBusInterface::HandleMethodCall, base::Unretained(this));
+    auto method_handler = base::Bind(&DBusInterface::DispatchMethodCall,
+                                     base::Unretained(this), &pair.second);
     if (!exported_object->ExportMethodAndBlock(
             interface_name_, method_name, method_handler)) {
         LOG(FATAL) << "Failed exporting " << method_name << " method";
@@ -107,7 +145,7 @@ void DBusInterface::ExportAndBlock(
 
   if (object_manager) {
     auto property_writer_callback =
-        dbus_object_->property_set_.GetPropertyWriter(interface_name_);
+        dbus_object_->property_set_.GetPropertyMessageWriter(interface_name_);
     ClaimInterface(object_manager->AsWeakPtr(),
                    object_path,
                    property_writer_callback,
@@ -118,13 +156,14 @@ void DBusInterface::ExportAndBlock(
 void DBusInterface::ClaimInterface(
       base::WeakPtr<ExportedObjectManager> object_manager,
       const dbus::ObjectPath& object_path,
-      const ExportedPropertySet::PropertyWriter& writer,
+      const ExportedPropertySet::PropertyMessageWriter& writer,
       bool all_succeeded) {
   if (!all_succeeded || !object_manager) {
     LOG(ERROR) << "Skipping claiming interface: " << interface_name_;
     return;
   }
-  object_manager->ClaimInterface(object_path, interface_name_, writer);
+  object_manager->ClaimInterfaceWithMessageWriter(object_path, interface_name_,
+                                                  writer);
   release_interface_cb_.ReplaceClosure(
       base::Bind(&ExportedObjectManager::ReleaseInterface,
                  object_manager, object_path, interface_name_));
@@ -133,13 +172,10 @@ void DBusInterface::ClaimInterface(
 void DBusInterface::HandleMethodCall(dbus::MethodCall* method_call,
                                      ResponseSender sender) {
   std::string method_name = method_call->GetMember();
-  // Make a local copy of |interface_name_| because calling HandleMethod()
-  // can potentially kill this interface object...
-  std::string interface_name = interface_name_;
-  VLOG(1) << "Received method call request: " << interface_name << "."
-          << method_name << "(" << method_call->GetSignature() << ")";
   auto pair = handlers_.find(method_name);
   if (pair == handlers_.end()) {
+    VLOG(1) << "Received unknown method call: " << interface_name_ << "."
+            << method_name << "(" << method_call->GetSignature() << ")";
     auto response =
         dbus::ErrorResponse::FromMethodCall(method_call,
                                             DBUS_ERROR_UNKNOWN_METHOD,
@@ -147,8 +183,43 @@ void DBusInterface::HandleMethodCall(dbus::MethodCall* method_call,
     sender.Run(std::move(response));
     return;
   }
-  VLOG(1) << "Dispatching DBus method call: " << method_name;
-  pair->second->HandleMethod(method_call, sender);
+  DispatchMethodCall(&pair->second, method_call, sender);
+}
+
+void DBusInterface::DispatchMethodCall(MethodEntry* entry,
+                                       dbus::MethodCall* method_call,
+                                       ResponseSender sender) {
+  // Calling HandleMethod() can potentially kill this interface object, so
+  // only use the members of this object before the call.
+  VLOG(1) << "Dispatching DBus method call: " << interface_name_ << "."
+          << method_call->GetMember() << "(" << method_call->GetSignature()
+          << ")";
+  ResponseSender stats_sender =
+      base::Bind(&DBusInterface::OnMethodResponse,
+                 weak_factory_.GetWeakPtr(), entry, base::TimeTicks::Now(),
+                 sender);
+  entry->handler->HandleMethod(method_call, stats_sender);
+}
+
+// static
+void DBusInterface::OnMethodResponse(base::WeakPtr<DBusInterface> self,
+                                     MethodEntry* entry,
+                                     base::TimeTicks start_time,
+                                     const ResponseSender& sender,
+                                     std::unique_ptr<dbus::Response> response) {
+  if (self) {
+    bool error = response &&
+                 response->GetMessageType() == dbus::Message::MESSAGE_ERROR;
+    entry->stats.AddCall(base::TimeTicks::Now() - start_time, error);
+  }
+  sender.Run(std::move(response));
+}
+
+std::map<std::string, DBusMethodStats> DBusInterface::GetMethodStats() const {
+  std::map<std::string, DBusMethodStats> stats;
+  for (const auto& pair : handlers_)
+    stats.emplace(pair.first, pair.second.stats);
+  return stats;
 }
 
 void DBusInterface::AddHandlerImpl(
@@ -156,7 +227,9 @@ void DBusInterface::AddHandlerImpl(
     std::unique_ptr<DBusInterfaceMethodHandlerInterface> handler) {
   VLOG(1) << "Declaring method handler: " << interface_name_ << "."
           << method_name;
-  auto res = handlers_.insert(std::make_pair(method_name, std::move(handler)));
+  MethodEntry entry;
+  entry.handler = std::move(handler);
+  auto res = handlers_.emplace(method_name, std::move(entry));
   CHECK(res.second) << "Method '" << method_name << "' already exists";
 }
 
@@ -171,6 +244,9 @@ void DBusInterface::AddSignalImpl(
 
 ///////////////////////////////////////////////////////////////////////////////
 
+const char DBusObject::kMethodStatsInterface[] = "org.chromium.DBusMethodStats";
+const char DBusObject::kGetMethodStatsMethod[] = "GetMethodStats";
+
 DBusObject::DBusObject(ExportedObjectManager* object_manager,
                        const scoped_refptr<dbus::Bus>& bus,
                        const dbus::ObjectPath& object_path)
@@ -298,6 +374,31 @@ bool DBusObject::SendSignal(dbus::Signal* signal) {
   return false;
 }
 
+std::map<std::string, DBusMethodStats> DBusObject::GetMethodStats() const {
+  std::map<std::string, DBusMethodStats> stats;
+  for (const auto& itf_pair : interfaces_) {
+    for (const auto& method_pair : itf_pair.second->GetMethodStats()) {
+      stats.emplace(itf_pair.first + "." + method_pair.first,
+                    method_pair.second);
+    }
+  }
+  return stats;
+}
+
+void DBusObject::AddMethodStatsInterface() {
+  DBusInterface* itf = AddOrGetInterface(kMethodStatsInterface);
+  itf->AddSimpleMethodHandler(kGetMethodStatsMethod, base::Unretained(this),
+                              &DBusObject::HandleGetMethodStats);
+}
+
+std::map<std::string, VariantDictionary> DBusObject::HandleGetMethodStats()
+    const {
+  std::map<std::string, VariantDictionary> result;
+  for (const auto& pair : GetMethodStats())
+    result.emplace(pair.first, MethodStatsToDictionary(pair.second));
+  return result;
+}
+
 void DBusObject::RegisterPropertiesInterface() {
   DBusInterface* prop_interface = AddOrGetInterface(dbus::kPropertiesInterface);
   property_handler_setup_callback_.Run(prop_interface, &property_set_);
@@ -61,13 +61,16 @@ class MyDbusObject {
 #ifndef LIBBRILLO_BRILLO_DBUS_DBUS_OBJECT_H_
 #define LIBBRILLO_BRILLO_DBUS_DBUS_OBJECT_H_
 
+#include <array>
 #include <map>
 #include <string>
+#include <unordered_map>
 
 #include <base/bind.h>
 #include <base/callback_helpers.h>
 #include <base/macros.h>
 #include <base/memory/weak_ptr.h>
+#include <base/time/time.h>
 #include <brillo/brillo_export.h>
 #include <brillo/dbus/async_event_sequencer.h>
 #include <brillo/dbus/dbus_object_internal_impl.h>
@@ -86,6 +89,29 @@ class ExportedObjectManager;
 class ExportedPropertyBase;
 class DBusObject;
 
+// Call statistics of a D-Bus method. The latency of a call is the time from
+// the dispatch of the method call to its handler until the response is sent,
+// so it includes the time spent by asynchronous handlers.
+struct BRILLO_EXPORT DBusMethodStats {
+  static const size_t kLatencyBucketCount = 7;
+
+  // Returns the index of the latency histogram bucket for |latency|.
+  // Bucket i < kLatencyBucketCount - 1 counts the calls answered in less than
+  // 4^i milliseconds (and not in a lower bucket); the last bucket counts the
+  // calls that took a second or more.
+  static size_t GetLatencyBucket(base::TimeDelta latency);
+
+  // Records a call answered after |latency| with a normal or error response.
+  void AddCall(base::TimeDelta latency, bool error);
+
+  uint64_t calls{0};
+  // Calls answered with an error response.
+  uint64_t errors{0};
+  base::TimeDelta total_latency;
+  base::TimeDelta max_latency;
+  std::array<uint64_t, kLatencyBucketCount> latency_histogram{};
+};
+
 // This is an implementation proxy class for a D-Bus interface of an object.
 // The important functionality for the users is the ability to add D-Bus method
 // handlers and define D-Bus object properties. This is achieved by using one
@@ -412,6 +438,10 @@ class BRILLO_EXPORT DBusInterface final {
     return signal;
   }
 
+  // Returns the call statistics of the methods of this interface, keyed by
+  // method name.
+  std::map<std::string, DBusMethodStats> GetMethodStats() const;
+
   // For simple signal arguments, you can specify their types directly in
   // RegisterSignal<t1, t2, ...>():
   //  auto signal = itf->RegisterSignal<int>("SignalName");
@@ -441,10 +471,30 @@ class BRILLO_EXPORT DBusInterface final {
       self->AddHandlerImpl(method_name, std::move(sync_method_handler));
     }
   };
+  // A registered method handler and its call statistics.
+  struct MethodEntry {
+    std::unique_ptr<DBusInterfaceMethodHandlerInterface> handler;
+    DBusMethodStats stats;
+  };
+
   // A generic D-Bus method handler for the interface. It extracts the method
   // name from |method_call|, looks up a registered handler from |handlers_|
   // map and dispatched the call to that handler.
   void HandleMethodCall(dbus::MethodCall* method_call, ResponseSender sender);
+  // Dispatches |method_call| to the handler in |entry|. The exported methods
+  // are bound to their entry when they are exported, so calls coming from
+  // D-Bus don't need to look the handler up by name.
+  void DispatchMethodCall(MethodEntry* entry,
+                          dbus::MethodCall* method_call,
+                          ResponseSender sender);
+  // Records the statistics of a method call dispatched at |start_time| and
+  // sends its |response| with |sender|. The entry is only used if the
+  // interface still exists.
+  static void OnMethodResponse(base::WeakPtr<DBusInterface> self,
+                               MethodEntry* entry,
+                               base::TimeTicks start_time,
+                               const ResponseSender& sender,
+                               std::unique_ptr<dbus::Response> response);
   // Helper to add a handler for method |method_name| to the |handlers_| map.
   // Not marked BRILLO_PRIVATE because it needs to be called by the inline
   // template functions AddMethodHandler(...)
@@ -487,12 +537,12 @@ class BRILLO_EXPORT DBusInterface final {
   BRILLO_PRIVATE void ClaimInterface(
       base::WeakPtr<ExportedObjectManager> object_manager,
       const dbus::ObjectPath& object_path,
-      const ExportedPropertySet::PropertyWriter& writer,
+      const ExportedPropertySet::PropertyMessageWriter& writer,
       bool all_succeeded);
 
-  // Method registration map.
-  std::map<std::string, std::unique_ptr<DBusInterfaceMethodHandlerInterface>>
-      handlers_;
+  // Method registration map. The entries don't move once added, so exported
+  // methods can keep pointers to them.
+  std::unordered_map<std::string, MethodEntry> handlers_;
   // Signal registration map.
   std::map<std::string, std::shared_ptr<DBusSignalBase>> signals_;
 
@@ -581,10 +631,32 @@ class BRILLO_EXPORT DBusObject {
   // Returns the reference to dbus::Bus this object is associated with.
   scoped_refptr<dbus::Bus> GetBus() { return bus_; }
 
+  // Returns the call statistics of the methods of all the interfaces of this
+  // object, keyed by "interface.method".
+  std::map<std::string, DBusMethodStats> GetMethodStats() const;
+
+  // Adds the kMethodStatsInterface interface to this object, so the method
+  // call statistics can be queried over D-Bus with its GetMethodStats()
+  // method. It returns a dictionary keyed by "interface.method" whose values
+  // are dictionaries with the "Calls", "Errors", "TotalLatencyUs",
+  // "MaxLatencyUs" and "LatencyHistogram" entries. Must be called before the
+  // object is registered.
+  void AddMethodStatsInterface();
+
+  static const char kMethodStatsInterface[];
+  static const char kGetMethodStatsMethod[];
+
+  // Returns the property set of this object, e.g. to group property updates
+  // in an ExportedPropertySet::Transaction.
+  ExportedPropertySet* GetPropertySet() { return &property_set_; }
+
  private:
   // Add the org.freedesktop.DBus.Properties interface to the object.
   void RegisterPropertiesInterface();
 
+  // Handler of kMethodStatsInterface.GetMethodStats().
+  std::map<std::string, VariantDictionary> HandleGetMethodStats() const;
+
   // A map of all the interfaces added to this object.
   std::map<std::string, std::unique_ptr<DBusInterface>> interfaces_;
   // Exported property set for properties registered with the interfaces
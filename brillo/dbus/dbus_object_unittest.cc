@@ -404,6 +404,68 @@ TEST_F(DBusObjectTest, UnknownMethod) {
   ExpectError(response.get(), DBUS_ERROR_UNKNOWN_METHOD);
 }
 
+TEST_F(DBusObjectTest, MethodStats) {
+  dbus::MethodCall add_call(kTestInterface1, kTestMethod_Add);
+  add_call.SetSerial(123);
+  dbus::MessageWriter add_writer(&add_call);
+  add_writer.AppendInt32(2);
+  add_writer.AppendInt32(3);
+  testing::CallMethod(*dbus_object_, &add_call);
+
+  dbus::MethodCall check_call(kTestInterface2, kTestMethod_CheckNonEmpty);
+  check_call.SetSerial(123);
+  dbus::MessageWriter check_writer(&check_call);
+  check_writer.AppendString("");
+  ExpectError(testing::CallMethod(*dbus_object_, &check_call).get(),
+              DBUS_ERROR_FAILED);
+
+  auto stats = dbus_object_->GetMethodStats();
+  const DBusMethodStats& add_stats =
+      stats[std::string{kTestInterface1} + "." + kTestMethod_Add];
+  EXPECT_EQ(1u, add_stats.calls);
+  EXPECT_EQ(0u, add_stats.errors);
+  const DBusMethodStats& check_stats =
+      stats[std::string{kTestInterface2} + "." + kTestMethod_CheckNonEmpty];
+  EXPECT_EQ(1u, check_stats.calls);
+  EXPECT_EQ(1u, check_stats.errors);
+  uint64_t histogram_calls = 0;
+  for (uint64_t count : check_stats.latency_histogram)
+    histogram_calls += count;
+  EXPECT_EQ(1u, histogram_calls);
+  EXPECT_EQ(0u, stats[std::string{kTestInterface1} + "." + kTestMethod_Negate]
+                    .calls);
+
+  // Query the statistics over D-Bus.
+  dbus_object_->AddMethodStatsInterface();
+  dbus::MethodCall stats_call(DBusObject::kMethodStatsInterface,
+                              DBusObject::kGetMethodStatsMethod);
+  stats_call.SetSerial(123);
+  auto response = testing::CallMethod(*dbus_object_, &stats_call);
+  dbus::MessageReader reader(response.get());
+  std::map<std::string, VariantDictionary> stats_dicts;
+  ASSERT_TRUE(PopValueFromReader(&reader, &stats_dicts));
+  const VariantDictionary& add_dict =
+      stats_dicts[std::string{kTestInterface1} + "." + kTestMethod_Add];
+  EXPECT_EQ(1u, add_dict.at("Calls").Get<uint64_t>());
+  EXPECT_EQ(0u, add_dict.at("Errors").Get<uint64_t>());
+  EXPECT_EQ(DBusMethodStats::kLatencyBucketCount,
+            add_dict.at("LatencyHistogram").Get<std::vector<uint64_t>>()
+                .size());
+}
+
+TEST(DBusMethodStats, GetLatencyBucket) {
+  EXPECT_EQ(0u, DBusMethodStats::GetLatencyBucket(
+                    base::TimeDelta::FromMicroseconds(999)));
+  EXPECT_EQ(1u, DBusMethodStats::GetLatencyBucket(
+                    base::TimeDelta::FromMilliseconds(1)));
+  EXPECT_EQ(2u, DBusMethodStats::GetLatencyBucket(
+                    base::TimeDelta::FromMilliseconds(15)));
+  EXPECT_EQ(5u, DBusMethodStats::GetLatencyBucket(
+                    base::TimeDelta::FromMilliseconds(1023)));
+  EXPECT_EQ(6u, DBusMethodStats::GetLatencyBucket(
+                    base::TimeDelta::FromSeconds(5)));
+}
+
 TEST_F(DBusObjectTest, ShouldReleaseOnlyClaimedInterfaces) {
   const dbus::ObjectPath kObjectManagerPath{std::string{"/"}};
   const dbus::ObjectPath kMethodsExportedOnPath{
@@ -412,6 +474,8 @@ TEST_F(DBusObjectTest, ShouldReleaseOnlyClaimedInterfaces) {
   dbus_object_ = std::unique_ptr<DBusObject>(
       new DBusObject(&mock_object_manager, bus_, kMethodsExportedOnPath));
   EXPECT_CALL(mock_object_manager, ClaimInterface(_, _, _)).Times(0);
+  EXPECT_CALL(mock_object_manager, ClaimInterfaceWithMessageWriter(_, _, _))
+      .Times(0);
   EXPECT_CALL(mock_object_manager, ReleaseInterface(_, _)).Times(0);
   DBusInterface* itf1 = dbus_object_->AddOrGetInterface(kTestInterface1);
   itf1->AddSimpleMethodHandler(
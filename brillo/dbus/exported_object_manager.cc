@@ -7,6 +7,7 @@
 #include <vector>
 
 #include <brillo/dbus/async_event_sequencer.h>
+#include <brillo/dbus/dbus_param_reader.h>
 #include <dbus/object_manager.h>
 
 using brillo::dbus_utils::AsyncEventSequencer;
@@ -15,6 +16,35 @@ namespace brillo {
 
 namespace dbus_utils {
 
+namespace {
+
+// Adapts a PropertyWriter to the PropertyMessageWriter interface.
+void WritePropertyDict(const ExportedPropertySet::PropertyWriter& writer,
+                       dbus::MessageWriter* message_writer) {
+  VariantDictionary property_dict;
+  writer.Run(&property_dict);
+  AppendValueToWriter(message_writer, property_dict);
+}
+
+// Writes a DICT<STRING,DICT<STRING,VARIANT>> of the interfaces and their
+// properties to |writer|.
+void WriteInterfaces(
+    const ExportedObjectManager::InterfaceProperties& interfaces,
+    dbus::MessageWriter* writer) {
+  dbus::MessageWriter dict_writer(nullptr);
+  writer->OpenArray("{sa{sv}}", &dict_writer);
+  for (const auto& pair : interfaces) {
+    dbus::MessageWriter entry_writer(nullptr);
+    dict_writer.OpenDictEntry(&entry_writer);
+    entry_writer.AppendString(pair.first);
+    pair.second.Run(&entry_writer);
+    dict_writer.CloseContainer(&entry_writer);
+  }
+  writer->CloseContainer(&dict_writer);
+}
+
+}  // anonymous namespace
+
 ExportedObjectManager::ExportedObjectManager(scoped_refptr<dbus::Bus> bus,
                                              const dbus::ObjectPath& path)
     : bus_(bus), dbus_object_(nullptr, bus, path) {
@@ -26,9 +56,9 @@ void ExportedObjectManager::RegisterAsync(
   bus_->AssertOnOriginThread();
   DBusInterface* itf =
       dbus_object_.AddOrGetInterface(dbus::kObjectManagerInterface);
-  itf->AddSimpleMethodHandler(dbus::kObjectManagerGetManagedObjects,
-                              base::Unretained(this),
-                              &ExportedObjectManager::HandleGetManagedObjects);
+  itf->AddRawMethodHandler(dbus::kObjectManagerGetManagedObjects,
+                           base::Unretained(this),
+                           &ExportedObjectManager::HandleGetManagedObjects);
 
   signal_itf_added_ = itf->RegisterSignalOfType<SignalInterfacesAdded>(
       dbus::kObjectManagerInterfacesAdded);
@@ -41,17 +71,29 @@ void ExportedObjectManager::ClaimInterface(
     const dbus::ObjectPath& path,
     const std::string& interface_name,
     const ExportedPropertySet::PropertyWriter& property_writer) {
+  ClaimInterfaceWithMessageWriter(
+      path, interface_name, base::Bind(&WritePropertyDict, property_writer));
+}
+
+void ExportedObjectManager::ClaimInterfaceWithMessageWriter(
+    const dbus::ObjectPath& path,
+    const std::string& interface_name,
+    const ExportedPropertySet::PropertyMessageWriter& property_writer) {
   bus_->AssertOnOriginThread();
   // We're sending signals that look like:
   //   org.freedesktop.DBus.ObjectManager.InterfacesAdded (
   //       OBJPATH object_path,
   //       DICT<STRING,DICT<STRING,VARIANT>> interfaces_and_properties);
-  VariantDictionary property_dict;
-  property_writer.Run(&property_dict);
-  std::map<std::string, VariantDictionary> interfaces_and_properties{
-      {interface_name, property_dict}
-  };
-  signal_itf_added_.lock()->Send(path, interfaces_and_properties);
+  // The signal is built by hand so the properties are written straight into
+  // it.
+  CHECK(!signal_itf_added_.expired()) << "Object manager is not registered";
+  dbus::Signal signal(dbus::kObjectManagerInterface,
+                      dbus::kObjectManagerInterfacesAdded);
+  dbus::MessageWriter writer(&signal);
+  writer.AppendObjectPath(path);
+  WriteInterfaces(InterfaceProperties{{interface_name, property_writer}},
+                  &writer);
+  dbus_object_.SendSignal(&signal);
   registered_objects_[path][interface_name] = property_writer;
 }
 
@@ -79,8 +121,8 @@ void ExportedObjectManager::ReleaseInterface(
                                    std::vector<std::string>{interface_name});
 }
 
-ExportedObjectManager::ObjectMap
-ExportedObjectManager::HandleGetManagedObjects() {
+void ExportedObjectManager::HandleGetManagedObjects(
+    dbus::MethodCall* method_call, ResponseSender sender) {
   // Implements the GetManagedObjects method:
   //
   // org.freedesktop.DBus.ObjectManager.GetManagedObjects (
@@ -88,16 +130,27 @@ ExportedObjectManager::HandleGetManagedObjects() {
   //              DICT<STRING,
   //                   DICT<STRING,VARIANT>>> )
   bus_->AssertOnOriginThread();
-  ExportedObjectManager::ObjectMap objects;
-  for (const auto path_pair : registered_objects_) {
-    std::map<std::string, VariantDictionary>& interfaces =
-        objects[path_pair.first];
-    const InterfaceProperties& interface2properties = path_pair.second;
-    for (const auto interface : interface2properties) {
-      interface.second.Run(&interfaces[interface.first]);
-    }
+  DBusMethodResponseBase method_response(method_call, sender);
+  dbus::MessageReader reader(method_call);
+  ErrorPtr error;
+  if (!DBusParamReader<false>::Invoke([] {}, &reader, &error)) {
+    method_response.ReplyWithError(error.get());
+    return;
+  }
+  std::unique_ptr<dbus::Response> response =
+      method_response.CreateCustomResponse();
+  dbus::MessageWriter writer(response.get());
+  dbus::MessageWriter dict_writer(nullptr);
+  writer.OpenArray("{oa{sa{sv}}}", &dict_writer);
+  for (const auto& path_pair : registered_objects_) {
+    dbus::MessageWriter entry_writer(nullptr);
+    dict_writer.OpenDictEntry(&entry_writer);
+    entry_writer.AppendObjectPath(path_pair.first);
+    WriteInterfaces(path_pair.second, &entry_writer);
+    dict_writer.CloseContainer(&entry_writer);
   }
-  return objects;
+  writer.CloseContainer(&dict_writer);
+  method_response.SendRawResponse(std::move(response));
 }
 
 }  // namespace dbus_utils
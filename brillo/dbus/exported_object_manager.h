@@ -82,7 +82,7 @@ class BRILLO_EXPORT ExportedObjectManager
   using ObjectMap =
       std::map<dbus::ObjectPath, std::map<std::string, VariantDictionary>>;
   using InterfaceProperties =
-      std::map<std::string, ExportedPropertySet::PropertyWriter>;
+      std::map<std::string, ExportedPropertySet::PropertyMessageWriter>;
 
   ExportedObjectManager(scoped_refptr<dbus::Bus> bus,
                         const dbus::ObjectPath& path);
@@ -102,6 +102,17 @@ class BRILLO_EXPORT ExportedObjectManager
       const std::string& interface_name,
       const ExportedPropertySet::PropertyWriter& writer);
 
+  // Same as ClaimInterface(), but |writer| serializes the properties straight
+  // into the signal and GetManagedObjects() responses. This is what DBusObject
+  // uses, and avoids copying the property values into VariantDictionary
+  // objects. Note that DBusObject no longer calls ClaimInterface(), so
+  // expectations on MockExportedObjectManager::ClaimInterface() for interfaces
+  // claimed by a DBusObject must be moved to this method.
+  virtual void ClaimInterfaceWithMessageWriter(
+      const dbus::ObjectPath& path,
+      const std::string& interface_name,
+      const ExportedPropertySet::PropertyMessageWriter& writer);
+
   // Trigger a signal that |path| has removed an interface |interface_name|.
   virtual void ReleaseInterface(const dbus::ObjectPath& path,
                                 const std::string& interface_name);
@@ -116,7 +127,10 @@ class BRILLO_EXPORT ExportedObjectManager
   brillo::dbus_utils::DBusObject* dbus_object() { return &dbus_object_; };
 
  private:
-  BRILLO_PRIVATE ObjectMap HandleGetManagedObjects();
+  // Handles GetManagedObjects() by writing the whole object tree directly
+  // into the response message.
+  BRILLO_PRIVATE void HandleGetManagedObjects(dbus::MethodCall* method_call,
+                                              ResponseSender sender);
 
   scoped_refptr<dbus::Bus> bus_;
   brillo::dbus_utils::DBusObject dbus_object_;
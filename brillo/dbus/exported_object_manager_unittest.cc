@@ -35,6 +35,12 @@ void WriteTestPropertyDict(VariantDictionary* dict) {
   dict->insert(std::make_pair(kTestPropertyName, Any(kTestPropertyValue)));
 }
 
+void WriteTestPropertyMessage(dbus::MessageWriter* writer) {
+  VariantDictionary dict;
+  WriteTestPropertyDict(&dict);
+  AppendValueToWriter(writer, dict);
+}
+
 void ReadTestPropertyDict(dbus::MessageReader* reader) {
   dbus::MessageReader all_properties(nullptr);
   dbus::MessageReader each_property(nullptr);
@@ -189,6 +195,36 @@ TEST_F(ExportedObjectManagerTest, GetManagedObjectsResponseCorrectness) {
   EXPECT_EQ(interface_name, kClaimedInterface);
 }
 
+TEST_F(ExportedObjectManagerTest, ClaimInterfaceWithMessageWriter) {
+  EXPECT_CALL(*mock_exported_object_, SendSignal(_))
+      .Times(1).WillOnce(Invoke(&VerifyInterfaceClaimSignal));
+  om_->ClaimInterfaceWithMessageWriter(kClaimedTestPath, kClaimedInterface,
+                                       base::Bind(&WriteTestPropertyMessage));
+
+  auto response = CallHandleGetManagedObjects();
+  dbus::MessageReader reader(response.get());
+  ExportedObjectManager::ObjectMap objects;
+  ASSERT_TRUE(PopValueFromReader(&reader, &objects));
+  EXPECT_FALSE(reader.HasMoreData());
+  ASSERT_EQ(1u, objects.size());
+  const VariantDictionary& properties =
+      objects[kClaimedTestPath][kClaimedInterface];
+  ASSERT_EQ(1u, properties.size());
+  EXPECT_EQ(kTestPropertyValue,
+            properties.at(kTestPropertyName).Get<std::string>());
+}
+
+TEST_F(ExportedObjectManagerTest, GetManagedObjectsExtraArgs) {
+  dbus::MethodCall method_call(dbus::kObjectManagerInterface,
+                               dbus::kObjectManagerGetManagedObjects);
+  method_call.SetSerial(1234);
+  dbus::MessageWriter writer(&method_call);
+  writer.AppendString("Extra param");
+  auto response = brillo::dbus_utils::testing::CallMethod(om_->dbus_object_,
+                                                          &method_call);
+  EXPECT_EQ(dbus::Message::MESSAGE_ERROR, response->GetMessageType());
+}
+
 }  // namespace dbus_utils
 
 }  // namespace brillo
@@ -4,13 +4,17 @@
 
 #include <brillo/dbus/exported_property_set.h>
 
+#include <algorithm>
+
 #include <base/bind.h>
 #include <dbus/bus.h>
 #include <dbus/property.h>  // For kPropertyInterface
 
 #include <brillo/dbus/async_event_sequencer.h>
 #include <brillo/dbus/dbus_object.h>
+#include <brillo/dbus/dbus_param_reader.h>
 #include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/message_loop.h>
 
 using brillo::dbus_utils::AsyncEventSequencer;
 
@@ -18,6 +22,45 @@ namespace brillo {
 
 namespace dbus_utils {
 
+namespace {
+
+// Returns the first entry of the sorted property |list| whose name is not
+// less than |name|.
+template<typename List>
+auto LowerBound(List* list, base::StringPiece name)
+    -> decltype(list->begin()) {
+  return std::lower_bound(
+      list->begin(), list->end(), name,
+      [](const typename List::value_type& entry, base::StringPiece name) {
+        return base::StringPiece{entry.first} < name;
+      });
+}
+
+void WriteInterfacePropertiesIfAlive(
+    const base::WeakPtr<ExportedPropertySet>& property_set,
+    const std::string& interface_name,
+    dbus::MessageWriter* writer) {
+  if (property_set) {
+    property_set->WriteInterfaceProperties(interface_name, writer);
+    return;
+  }
+  // Keep the message well-formed with an empty dictionary.
+  AppendValueToWriter(writer, VariantDictionary{});
+}
+
+}  // anonymous namespace
+
+ExportedPropertySet::Transaction::Transaction(
+    ExportedPropertySet* property_set)
+    : property_set_{property_set->weak_ptr_factory_.GetWeakPtr()} {
+  property_set->transaction_depth_++;
+}
+
+ExportedPropertySet::Transaction::~Transaction() {
+  if (property_set_ && --property_set_->transaction_depth_ == 0)
+    property_set_->FlushPendingSignals();
+}
+
 ExportedPropertySet::ExportedPropertySet(dbus::Bus* bus)
     : bus_(bus), weak_ptr_factory_(this) {
 }
@@ -36,14 +79,24 @@ ExportedPropertySet::PropertyWriter ExportedPropertySet::GetPropertyWriter(
                     interface_name);
 }
 
+ExportedPropertySet::PropertyMessageWriter
+ExportedPropertySet::GetPropertyMessageWriter(
+    const std::string& interface_name) {
+  return base::Bind(&WriteInterfacePropertiesIfAlive,
+                    weak_ptr_factory_.GetWeakPtr(),
+                    interface_name);
+}
+
 void ExportedPropertySet::RegisterProperty(
     const std::string& interface_name,
     const std::string& property_name,
     ExportedPropertyBase* exported_property) {
   bus_->AssertOnOriginThread();
-  auto& prop_map = properties_[interface_name];
-  auto res = prop_map.insert(std::make_pair(property_name, exported_property));
-  CHECK(res.second) << "Property '" << property_name << "' already exists";
+  PropertyList& prop_list = properties_[interface_name];
+  auto prop_iter = LowerBound(&prop_list, property_name);
+  CHECK(prop_iter == prop_list.end() || prop_iter->first != property_name)
+      << "Property '" << property_name << "' already exists";
+  prop_list.emplace(prop_iter, property_name, exported_property);
   // Technically, the property set exists longer than the properties themselves,
   // so we could use Unretained here rather than a weak pointer.
   ExportedPropertyBase::OnUpdateCallback cb =
@@ -57,12 +110,12 @@ void ExportedPropertySet::RegisterProperty(
 void ExportedPropertySet::UnregisterProperty(const std::string& interface_name,
                                              const std::string& property_name) {
   bus_->AssertOnOriginThread();
-  auto& prop_map = properties_[interface_name];
-  auto prop_iter = prop_map.find(property_name);
-  CHECK(prop_iter != prop_map.end())
+  PropertyList& prop_list = properties_[interface_name];
+  auto prop_iter = LowerBound(&prop_list, property_name);
+  CHECK(prop_iter != prop_list.end() && prop_iter->first == property_name)
       << "Property '" << property_name << "' doesn't exist";
   prop_iter->second->ClearUpdateCallback();
-  prop_map.erase(prop_iter);
+  prop_list.erase(prop_iter);
 }
 
 VariantDictionary ExportedPropertySet::HandleGetAll(
@@ -71,44 +124,100 @@ VariantDictionary ExportedPropertySet::HandleGetAll(
   return GetInterfaceProperties(interface_name);
 }
 
+void ExportedPropertySet::HandleGetAllMethodCall(dbus::MethodCall* method_call,
+                                                 ResponseSender sender) {
+  bus_->AssertOnOriginThread();
+  DBusMethodResponseBase method_response(method_call, sender);
+  std::string interface_name;
+  auto get_interface_name = [&interface_name](const std::string& name) {
+    interface_name = name;
+  };
+  dbus::MessageReader reader(method_call);
+  ErrorPtr error;
+  if (!DBusParamReader<false, std::string>::Invoke(
+          get_interface_name, &reader, &error)) {
+    method_response.ReplyWithError(error.get());
+    return;
+  }
+  VLOG(2) << "Getting all the properties of " << interface_name;
+  std::unique_ptr<dbus::Response> response =
+      method_response.CreateCustomResponse();
+  dbus::MessageWriter writer(response.get());
+  WriteInterfaceProperties(interface_name, &writer);
+  method_response.SendRawResponse(std::move(response));
+}
+
 VariantDictionary ExportedPropertySet::GetInterfaceProperties(
     const std::string& interface_name) const {
   VariantDictionary properties;
   auto property_map_itr = properties_.find(interface_name);
   if (property_map_itr != properties_.end()) {
-    for (const auto& kv : property_map_itr->second)
-      properties.insert(std::make_pair(kv.first, kv.second->GetValue()));
+    // The properties are sorted by name, so each one goes at the end.
+    for (const auto& kv : property_map_itr->second) {
+      properties.emplace_hint(properties.end(), kv.first,
+                              kv.second->GetValue());
+    }
   }
   return properties;
 }
 
+void ExportedPropertySet::WriteInterfaceProperties(
+    const std::string& interface_name,
+    dbus::MessageWriter* writer) const {
+  dbus::MessageWriter dict_writer(nullptr);
+  writer->OpenArray("{sv}", &dict_writer);
+  auto property_map_itr = properties_.find(interface_name);
+  if (property_map_itr != properties_.end()) {
+    for (const auto& kv : property_map_itr->second) {
+      dbus::MessageWriter entry_writer(nullptr);
+      dict_writer.OpenDictEntry(&entry_writer);
+      entry_writer.AppendString(kv.first);
+      kv.second->AppendValueAsVariant(&entry_writer);
+      dict_writer.CloseContainer(&entry_writer);
+    }
+  }
+  writer->CloseContainer(&dict_writer);
+}
+
 void ExportedPropertySet::WritePropertiesToDict(
     const std::string& interface_name,
     VariantDictionary* dict) {
   *dict = GetInterfaceProperties(interface_name);
 }
 
-bool ExportedPropertySet::HandleGet(brillo::ErrorPtr* error,
-                                    const std::string& interface_name,
-                                    const std::string& property_name,
-                                    brillo::Any* result) {
-  bus_->AssertOnOriginThread();
+ExportedPropertyBase* ExportedPropertySet::FindProperty(
+    const std::string& interface_name,
+    base::StringPiece property_name,
+    brillo::ErrorPtr* error) const {
   auto property_map_itr = properties_.find(interface_name);
   if (property_map_itr == properties_.end()) {
     brillo::Error::AddTo(error, FROM_HERE, errors::dbus::kDomain,
                          DBUS_ERROR_UNKNOWN_INTERFACE,
                          "No such interface on object.");
-    return false;
+    return nullptr;
   }
-  LOG(INFO) << "Looking for " << property_name << " on " << interface_name;
-  auto property_itr = property_map_itr->second.find(property_name);
-  if (property_itr == property_map_itr->second.end()) {
+  const PropertyList& prop_list = property_map_itr->second;
+  auto property_itr = LowerBound(&prop_list, property_name);
+  if (property_itr == prop_list.end() || property_itr->first != property_name) {
     brillo::Error::AddTo(error, FROM_HERE, errors::dbus::kDomain,
                          DBUS_ERROR_UNKNOWN_PROPERTY,
                          "No such property on interface.");
-    return false;
+    return nullptr;
   }
-  *result = property_itr->second->GetValue();
+  return property_itr->second;
+}
+
+bool ExportedPropertySet::HandleGet(brillo::ErrorPtr* error,
+                                    const std::string& interface_name,
+                                    const std::string& property_name,
+                                    brillo::Any* result) {
+  bus_->AssertOnOriginThread();
+  VLOG(2) << "Looking for " << property_name << " on " << interface_name;
+  ExportedPropertyBase* property =
+      FindProperty(interface_name, property_name, error);
+  if (!property)
+    return false;
+  *result = property->GetValue();
   return true;
 }
 
@@ -117,23 +226,10 @@ bool ExportedPropertySet::HandleSet(brillo::ErrorPtr* error,
                                     const std::string& property_name,
                                     const brillo::Any& value) {
   bus_->AssertOnOriginThread();
-  auto property_map_itr = properties_.find(interface_name);
-  if (property_map_itr == properties_.end()) {
-    brillo::Error::AddTo(error, FROM_HERE, errors::dbus::kDomain,
-                         DBUS_ERROR_UNKNOWN_INTERFACE,
-                         "No such interface on object.");
-    return false;
-  }
-  LOG(INFO) << "Looking for " << property_name << " on " << interface_name;
-  auto property_itr = property_map_itr->second.find(property_name);
-  if (property_itr == property_map_itr->second.end()) {
-    brillo::Error::AddTo(error, FROM_HERE, errors::dbus::kDomain,
-                         DBUS_ERROR_UNKNOWN_PROPERTY,
-                         "No such property on interface.");
-    return false;
-  }
-
-  return property_itr->second->SetValue(error, value);
+  VLOG(2) << "Looking for " << property_name << " on " << interface_name;
+  ExportedPropertyBase* property =
+      FindProperty(interface_name, property_name, error);
+  return property && property->SetValue(error, value);
 }
 
 void ExportedPropertySet::HandlePropertyUpdated(
@@ -144,16 +240,66 @@ void ExportedPropertySet::HandlePropertyUpdated(
   // Send signal only if the object has been exported successfully.
   // This could happen when a property value is changed (which triggers
   // the notification) before D-Bus interface is completely exported/claimed.
+  if (signal_properties_changed_.expired())
+    return;
+  if (exported_property->GetEmitsChangedSignal() ==
+      ExportedPropertyBase::EmitsChangedSignal::kFalse) {
+    return;
+  }
+  pending_changes_[interface_name].insert(property_name);
+  if (transaction_depth_ > 0 || flush_posted_)
+    return;
+  // Without a message loop there is no iteration to coalesce the changes in,
+  // so the signal is sent right away.
+  if (!MessageLoop::ThreadHasCurrent()) {
+    FlushPendingSignals();
+    return;
+  }
+  flush_posted_ = true;
+  MessageLoop::current()->PostTask(
+      FROM_HERE,
+      base::Bind(&ExportedPropertySet::OnFlushPendingSignals,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void ExportedPropertySet::OnFlushPendingSignals() {
+  flush_posted_ = false;
+  // The pending changes are sent when the transaction completes.
+  if (transaction_depth_ == 0)
+    FlushPendingSignals();
+}
+
+void ExportedPropertySet::FlushPendingSignals() {
+  std::map<std::string, std::set<std::string>> pending_changes;
+  pending_changes.swap(pending_changes_);
   auto signal = signal_properties_changed_.lock();
   if (!signal)
     return;
-  VariantDictionary changed_properties{
-      {property_name, exported_property->GetValue()}};
-  // The interface specification tells us to include this list of properties
-  // which have changed, but for whom no value is conveyed.  Currently, we
-  // don't do anything interesting here.
-  std::vector<std::string> invalidated_properties;  // empty.
-  signal->Send(interface_name, changed_properties, invalidated_properties);
+  for (const auto& pair : pending_changes) {
+    VariantDictionary changed_properties;
+    // Properties which have changed, but for whom no value is conveyed.
+    std::vector<std::string> invalidated_properties;
+    for (const std::string& property_name : pair.second) {
+      // The property may have been unregistered since it changed.
+      ExportedPropertyBase* property =
+          FindProperty(pair.first, property_name, nullptr);
+      if (!property)
+        continue;
+      switch (property->GetEmitsChangedSignal()) {
+        case ExportedPropertyBase::EmitsChangedSignal::kTrue:
+          changed_properties.emplace(property_name, property->GetValue());
+          break;
+        case ExportedPropertyBase::EmitsChangedSignal::kInvalidates:
+          invalidated_properties.push_back(property_name);
+          break;
+        case ExportedPropertyBase::EmitsChangedSignal::kFalse:
+          break;
+      }
+    }
+    if (changed_properties.empty() && invalidated_properties.empty())
+      continue;
+    signal->Send(pair.first, changed_properties, invalidated_properties);
+  }
 }
 
 void ExportedPropertyBase::NotifyPropertyChanged() {
@@ -167,6 +313,11 @@ void ExportedPropertyBase::NotifyPropertyChanged() {
   }
 }
 
+void ExportedPropertyBase::AppendValueAsVariant(
+    dbus::MessageWriter* writer) const {
+  AppendValueToWriterAsVariant(writer, GetValue());
+}
+
 void ExportedPropertyBase::SetUpdateCallback(const OnUpdateCallback& cb) {
   on_update_callback_ = cb;
 }
@@ -184,6 +335,16 @@ ExportedPropertyBase::Access ExportedPropertyBase::GetAccessMode() const {
   return access_mode_;
 }
 
+void ExportedPropertyBase::SetEmitsChangedSignal(
+    ExportedPropertyBase::EmitsChangedSignal emits_changed_signal) {
+  emits_changed_signal_ = emits_changed_signal;
+}
+
+ExportedPropertyBase::EmitsChangedSignal
+ExportedPropertyBase::GetEmitsChangedSignal() const {
+  return emits_changed_signal_;
+}
+
 }  // namespace dbus_utils
 
 }  // namespace brillo
@@ -8,12 +8,19 @@
 #include <stdint.h>
 
 #include <map>
+#include <set>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include <base/memory/weak_ptr.h>
+#include <base/strings/string_piece.h>
 #include <brillo/any.h>
 #include <brillo/brillo_export.h>
+#include <brillo/dbus/data_serialization.h>
+#include <brillo/dbus/dbus_method_response.h>
 #include <brillo/dbus/dbus_signal.h>
 #include <brillo/errors/error.h>
 #include <brillo/errors/error_codes.h>
@@ -47,6 +54,13 @@ namespace dbus_utils {
 //
 //  This class is very similar to the PropertySet class in Chrome, except that
 //  it allows objects to expose properties rather than to consume them.
+//
+//  Property updates are coalesced: all the changes made to the properties of
+//  an interface during the same message loop iteration (or within a
+//  Transaction) are sent in a single PropertiesChanged signal, which carries
+//  the latest value of each changed property. Properties whose values are
+//  expensive to send can be put in the invalidated_properties list instead,
+//  see ExportedPropertyBase::SetEmitsChangedSignal().
 //  It is used as part of DBusObject to implement D-Bus object properties on
 //  registered interfaces. See description of DBusObject class for more details.
 
@@ -61,6 +75,19 @@ class BRILLO_EXPORT ExportedPropertyBase {
     kReadWrite,
   };
 
+  // How changes of the property are reported in PropertiesChanged signals.
+  // Mirrors the org.freedesktop.DBus.Property.EmitsChangedSignal annotation.
+  enum class EmitsChangedSignal {
+    // The new value is sent in the signal.
+    kTrue,
+    // Only the name of the property is sent, in invalidated_properties.
+    // Clients have to call Get to retrieve the new value. Useful for large
+    // values that clients rarely need.
+    kInvalidates,
+    // No signal is sent.
+    kFalse,
+  };
+
   ExportedPropertyBase() = default;
   virtual ~ExportedPropertyBase() = default;
 
@@ -77,12 +104,19 @@ class BRILLO_EXPORT ExportedPropertyBase {
   // Returns the contained value as Any.
   virtual brillo::Any GetValue() const = 0;
 
+  // Appends the contained value to |writer| as a variant. Unlike GetValue(),
+  // this doesn't copy the value into an Any first.
+  virtual void AppendValueAsVariant(dbus::MessageWriter* writer) const;
+
   virtual bool SetValue(brillo::ErrorPtr* error,
                         const brillo::Any& value) = 0;
 
   void SetAccessMode(Access access_mode);
   Access GetAccessMode() const;
 
+  void SetEmitsChangedSignal(EmitsChangedSignal emits_changed_signal);
+  EmitsChangedSignal GetEmitsChangedSignal() const;
+
  protected:
   // Notify the listeners of OnUpdateCallback that the property has changed.
   void NotifyPropertyChanged();
@@ -91,11 +125,36 @@ class BRILLO_EXPORT ExportedPropertyBase {
   OnUpdateCallback on_update_callback_;
   // Default to read-only.
   Access access_mode_{Access::kReadOnly};
+  EmitsChangedSignal emits_changed_signal_{EmitsChangedSignal::kTrue};
 };
 
 class BRILLO_EXPORT ExportedPropertySet {
  public:
   using PropertyWriter = base::Callback<void(VariantDictionary* dict)>;
+  // Writes the properties straight into a D-Bus message, as "a{sv}".
+  using PropertyMessageWriter =
+      base::Callback<void(dbus::MessageWriter* writer)>;
+
+  // While a Transaction is alive, PropertiesChanged signals are held back and
+  // the pending changes are sent when the outermost Transaction is destroyed.
+  // Use it to group updates that should reach the clients together, e.g.:
+  //
+  //   {
+  //     ExportedPropertySet::Transaction transaction(
+  //         dbus_object->GetPropertySet());
+  //     state_.SetValue("connected");
+  //     address_.SetValue(address);
+  //   }  // A single PropertiesChanged signal is sent here.
+  class BRILLO_EXPORT Transaction {
+   public:
+    explicit Transaction(ExportedPropertySet* property_set);
+    ~Transaction();
+
+   private:
+    base::WeakPtr<ExportedPropertySet> property_set_;
+
+    DISALLOW_COPY_AND_ASSIGN(Transaction);
+  };
 
   explicit ExportedPropertySet(dbus::Bus* bus);
   virtual ~ExportedPropertySet() = default;
@@ -110,6 +169,12 @@ class BRILLO_EXPORT ExportedPropertySet {
   // only be invoked on the same thread as the rest of ExportedPropertySet.
   PropertyWriter GetPropertyWriter(const std::string& interface_name);
 
+  // Same as GetPropertyWriter(), but the callback serializes the properties
+  // directly into a message, without building a VariantDictionary. If this
+  // property set is destroyed, the callback writes an empty dictionary.
+  PropertyMessageWriter GetPropertyMessageWriter(
+      const std::string& interface_name);
+
   void RegisterProperty(const std::string& interface_name,
                         const std::string& property_name,
                         ExportedPropertyBase* exported_property);
@@ -120,6 +185,10 @@ class BRILLO_EXPORT ExportedPropertySet {
 
   // D-Bus methods for org.freedesktop.DBus.Properties interface.
   VariantDictionary HandleGetAll(const std::string& interface_name);
+  // Raw handler of Properties.GetAll, which writes the properties straight
+  // into the response message instead of building a VariantDictionary first.
+  void HandleGetAllMethodCall(dbus::MethodCall* method_call,
+                              ResponseSender sender);
   bool HandleGet(brillo::ErrorPtr* error,
                  const std::string& interface_name,
                  const std::string& property_name,
@@ -136,6 +205,14 @@ class BRILLO_EXPORT ExportedPropertySet {
   // interface and their values.
   VariantDictionary GetInterfaceProperties(
       const std::string& interface_name) const;
+  // Writes the properties of the given interface to |writer| as a
+  // string-to-variant dictionary ("a{sv}").
+  void WriteInterfaceProperties(const std::string& interface_name,
+                                dbus::MessageWriter* writer) const;
+
+  // Sends the PropertiesChanged signals for the pending property changes
+  // right away, even inside a Transaction.
+  void FlushPendingSignals();
 
  private:
   // Used to write the dictionary of string->variant to a message.
@@ -143,24 +220,42 @@ class BRILLO_EXPORT ExportedPropertySet {
   // given interface.
   BRILLO_PRIVATE void WritePropertiesToDict(const std::string& interface_name,
                                             VariantDictionary* dict);
+  // Returns the property |property_name| of |interface_name|. If there is no
+  // such property, adds a D-Bus error to |error| and returns nullptr.
+  BRILLO_PRIVATE ExportedPropertyBase* FindProperty(
+      const std::string& interface_name,
+      base::StringPiece property_name,
+      brillo::ErrorPtr* error) const;
   BRILLO_PRIVATE void HandlePropertyUpdated(
       const std::string& interface_name,
       const std::string& property_name,
       const ExportedPropertyBase* exported_property);
+  // Sends the pending signals if no Transaction is in progress.
+  BRILLO_PRIVATE void OnFlushPendingSignals();
 
   dbus::Bus* bus_;  // weak; owned by outer DBusObject containing this object.
-  // This is a map from interface name -> property name -> pointer to property.
-  std::map<std::string, std::map<std::string, ExportedPropertyBase*>>
-      properties_;
-
-  // D-Bus callbacks may last longer the property set exporting those methods.
-  base::WeakPtrFactory<ExportedPropertySet> weak_ptr_factory_;
+  // The properties of an interface, sorted by name. A sorted vector keeps the
+  // lookups cache-friendly and lets them use a base::StringPiece key.
+  using PropertyList =
+      std::vector<std::pair<std::string, ExportedPropertyBase*>>;
+  // This is a map from interface name -> list of properties.
+  std::unordered_map<std::string, PropertyList> properties_;
 
   using SignalPropertiesChanged =
       DBusSignal<std::string, VariantDictionary, std::vector<std::string>>;
 
   std::weak_ptr<SignalPropertiesChanged> signal_properties_changed_;
 
+  // Names of the changed properties not signaled yet, by interface name.
+  std::map<std::string, std::set<std::string>> pending_changes_;
+  // Whether a task to send the pending signals is posted on the message loop.
+  bool flush_posted_{false};
+  // Number of live Transaction objects.
+  int transaction_depth_{0};
+
+  // D-Bus callbacks may last longer the property set exporting those methods.
+  base::WeakPtrFactory<ExportedPropertySet> weak_ptr_factory_;
+
   friend class DBusObject;
   friend class ExportedPropertySetTest;
   DISALLOW_COPY_AND_ASSIGN(ExportedPropertySet);
@@ -194,6 +289,11 @@ class ExportedProperty : public ExportedPropertyBase {
   // Implementation provided by specialization.
   brillo::Any GetValue() const override { return value_; }
 
+  void AppendValueAsVariant(dbus::MessageWriter* writer) const override {
+    AppendValueAsVariantImpl(
+        writer, std::integral_constant<bool, IsTypeSupported<T>::value>{});
+  }
+
   bool SetValue(brillo::ErrorPtr* error,
                 const brillo::Any& value) override {
     if (GetAccessMode() == ExportedPropertyBase::Access::kReadOnly) {
@@ -220,6 +320,16 @@ class ExportedProperty : public ExportedPropertyBase {
   }
 
  private:
+  void AppendValueAsVariantImpl(dbus::MessageWriter* writer,
+                                std::true_type) const {
+    AppendValueToWriterAsVariant(writer, value_);
+  }
+  // Types without D-Bus serialization fail the same way as through Any.
+  void AppendValueAsVariantImpl(dbus::MessageWriter* writer,
+                                std::false_type) const {
+    ExportedPropertyBase::AppendValueAsVariant(writer);
+  }
+
   T value_{};
   base::Callback<bool(brillo::ErrorPtr*, const T&)> validator_;
 
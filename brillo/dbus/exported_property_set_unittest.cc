@@ -12,6 +12,7 @@
 #include <brillo/dbus/dbus_object.h>
 #include <brillo/dbus/dbus_object_test_helpers.h>
 #include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/fake_message_loop.h>
 #include <dbus/message.h>
 #include <dbus/property.h>
 #include <dbus/object_path.h>
@@ -285,6 +286,43 @@ TEST_F(ExportedPropertySetTest, GetAllCorrectness) {
   ASSERT_FALSE(response_reader.HasMoreData());
 }
 
+TEST_F(ExportedPropertySetTest, GetAllMatchesGetInterfaceProperties) {
+  p_->string_prop_.SetValue(kTestString);
+  dbus::MethodCall method_call(dbus::kPropertiesInterface,
+                               dbus::kPropertiesGetAll);
+  method_call.SetSerial(123);
+  dbus::MessageWriter writer(&method_call);
+  writer.AppendString(kTestInterface3);
+  auto response = testing::CallMethod(p_->dbus_object_, &method_call);
+  dbus::MessageReader response_reader(response.get());
+  VariantDictionary properties;
+  ASSERT_TRUE(PopValueFromReader(&response_reader, &properties));
+  ASSERT_FALSE(response_reader.HasMoreData());
+  VariantDictionary expected =
+      p_->dbus_object_.GetPropertySet()->GetInterfaceProperties(
+          kTestInterface3);
+  EXPECT_EQ(9u, properties.size());
+  EXPECT_EQ(expected, properties);
+}
+
+TEST_F(ExportedPropertySetTest, PropertyMessageWriter) {
+  p_->uint16_prop_.SetValue(7);
+  auto property_writer =
+      p_->dbus_object_.GetPropertySet()->GetPropertyMessageWriter(
+          kTestInterface2);
+  std::unique_ptr<dbus::Response> message = dbus::Response::CreateEmpty();
+  dbus::MessageWriter writer(message.get());
+  property_writer.Run(&writer);
+  EXPECT_EQ("a{sv}", message->GetSignature());
+
+  dbus::MessageReader reader(message.get());
+  VariantDictionary properties;
+  ASSERT_TRUE(PopValueFromReader(&reader, &properties));
+  ASSERT_EQ(2u, properties.size());
+  EXPECT_EQ(7, properties[kUint16PropName].Get<uint16_t>());
+  EXPECT_EQ(0, properties[kInt32PropName].Get<int32_t>());
+}
+
 TEST_F(ExportedPropertySetTest, GetNoArgs) {
   dbus::MethodCall method_call(dbus::kPropertiesInterface,
                                dbus::kPropertiesGet);
@@ -599,6 +637,104 @@ TEST_F(ExportedPropertySetTest, SignalsAreParsable) {
   p_->uint8_prop_.SetValue(57);
 }
 
+namespace {
+
+struct SignalArgs {
+  std::string interface_name;
+  VariantDictionary changed_properties;
+  std::vector<std::string> invalidated_properties;
+};
+
+void ParseSignal(std::vector<SignalArgs>* signals, dbus::Signal* signal) {
+  SignalArgs args;
+  dbus::MessageReader reader(signal);
+  EXPECT_TRUE(PopValueFromReader(&reader, &args.interface_name));
+  EXPECT_TRUE(PopValueFromReader(&reader, &args.changed_properties));
+  EXPECT_TRUE(PopValueFromReader(&reader, &args.invalidated_properties));
+  EXPECT_FALSE(reader.HasMoreData());
+  signals->push_back(std::move(args));
+}
+
+}  // namespace
+
+TEST_F(ExportedPropertySetTest, SignalsAreCoalescedInMessageLoop) {
+  FakeMessageLoop fake_loop{nullptr};
+  fake_loop.SetAsCurrent();
+  std::vector<SignalArgs> signals;
+  EXPECT_CALL(*mock_exported_object_, SendSignal(_))
+      .WillRepeatedly(Invoke([&signals](dbus::Signal* signal) {
+        ParseSignal(&signals, signal);
+      }));
+  p_->uint32_prop_.SetValue(1);
+  p_->int64_prop_.SetValue(2);
+  p_->uint32_prop_.SetValue(3);
+  p_->bool_prop_.SetValue(true);
+  EXPECT_TRUE(signals.empty());
+
+  fake_loop.Run();
+  // One signal per interface, with the latest value of each property.
+  ASSERT_EQ(2u, signals.size());
+  EXPECT_EQ(kTestInterface1, signals[0].interface_name);
+  EXPECT_EQ(1u, signals[0].changed_properties.size());
+  EXPECT_TRUE(signals[0].changed_properties[kBoolPropName].Get<bool>());
+  EXPECT_EQ(kTestInterface3, signals[1].interface_name);
+  EXPECT_EQ(2u, signals[1].changed_properties.size());
+  EXPECT_EQ(3u, signals[1].changed_properties[kUint32PropName].Get<uint32_t>());
+  EXPECT_EQ(2, signals[1].changed_properties[kInt64PropName].Get<int64_t>());
+  EXPECT_TRUE(signals[1].invalidated_properties.empty());
+}
+
+TEST_F(ExportedPropertySetTest, SignalsAreCoalescedInTransaction) {
+  std::vector<SignalArgs> signals;
+  EXPECT_CALL(*mock_exported_object_, SendSignal(_))
+      .WillRepeatedly(Invoke([&signals](dbus::Signal* signal) {
+        ParseSignal(&signals, signal);
+      }));
+  {
+    ExportedPropertySet::Transaction transaction(
+        p_->dbus_object_.GetPropertySet());
+    {
+      ExportedPropertySet::Transaction nested(
+          p_->dbus_object_.GetPropertySet());
+      p_->uint16_prop_.SetValue(1);
+    }
+    p_->int32_prop_.SetValue(2);
+    EXPECT_TRUE(signals.empty());
+  }
+  ASSERT_EQ(1u, signals.size());
+  EXPECT_EQ(kTestInterface2, signals[0].interface_name);
+  EXPECT_EQ(2u, signals[0].changed_properties.size());
+}
+
+TEST_F(ExportedPropertySetTest, InvalidatedProperties) {
+  std::vector<SignalArgs> signals;
+  EXPECT_CALL(*mock_exported_object_, SendSignal(_))
+      .WillRepeatedly(Invoke([&signals](dbus::Signal* signal) {
+        ParseSignal(&signals, signal);
+      }));
+  p_->uint8list_prop_.SetEmitsChangedSignal(
+      ExportedPropertyBase::EmitsChangedSignal::kInvalidates);
+  p_->string_prop_.SetEmitsChangedSignal(
+      ExportedPropertyBase::EmitsChangedSignal::kFalse);
+  {
+    ExportedPropertySet::Transaction transaction(
+        p_->dbus_object_.GetPropertySet());
+    p_->uint8list_prop_.SetValue(std::vector<uint8_t>(1024, 1));
+    p_->string_prop_.SetValue(kTestString);
+    p_->double_prop_.SetValue(1.0);
+  }
+  ASSERT_EQ(1u, signals.size());
+  EXPECT_EQ(kTestInterface3, signals[0].interface_name);
+  EXPECT_EQ(1u, signals[0].changed_properties.size());
+  EXPECT_EQ(1u, signals[0].changed_properties.count(kDoublePropName));
+  EXPECT_EQ(std::vector<std::string>{kUint8ListPropName},
+            signals[0].invalidated_properties);
+
+  // A property that doesn't emit the signal doesn't send an empty one.
+  p_->string_prop_.SetValue("");
+  EXPECT_EQ(1u, signals.size());
+}
+
 }  // namespace dbus_utils
 
 }  // namespace brillo
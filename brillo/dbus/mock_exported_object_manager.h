@@ -30,6 +30,10 @@ class MockExportedObjectManager : public ExportedObjectManager {
                void(const dbus::ObjectPath& path,
                     const std::string& interface_name,
                     const ExportedPropertySet::PropertyWriter& writer));
+  MOCK_METHOD3(ClaimInterfaceWithMessageWriter,
+               void(const dbus::ObjectPath& path,
+                    const std::string& interface_name,
+                    const ExportedPropertySet::PropertyMessageWriter& writer));
   MOCK_METHOD2(ReleaseInterface,
                void(const dbus::ObjectPath& path,
                     const std::string& interface_name));
@@ -0,0 +1,239 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/remote_object_manager.h>
+
+#include <utility>
+
+#include <base/bind.h>
+#include <base/bind_helpers.h>
+#include <base/logging.h>
+#include <brillo/dbus/dbus_method_invoker.h>
+#include <brillo/dbus/dbus_signal_handler.h>
+#include <dbus/property.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+RemoteObjectManager::RemoteObjectManager(const scoped_refptr<dbus::Bus>& bus,
+                                         const std::string& service_name,
+                                         const dbus::ObjectPath& manager_path)
+    : bus_{bus},
+      service_name_{service_name},
+      manager_proxy_{bus->GetObjectProxy(service_name, manager_path)} {}
+
+RemoteObjectManager::~RemoteObjectManager() = default;
+
+void RemoteObjectManager::ConnectSignals() {
+  ConnectToSignal(
+      manager_proxy_,
+      dbus::kObjectManagerInterface,
+      dbus::kObjectManagerInterfacesAdded,
+      base::Bind(&RemoteObjectManager::OnInterfacesAdded,
+                 weak_ptr_factory_.GetWeakPtr()),
+      base::Bind(&RemoteObjectManager::OnSignalConnected,
+                 weak_ptr_factory_.GetWeakPtr()));
+  ConnectToSignal(
+      manager_proxy_,
+      dbus::kObjectManagerInterface,
+      dbus::kObjectManagerInterfacesRemoved,
+      base::Bind(&RemoteObjectManager::OnInterfacesRemoved,
+                 weak_ptr_factory_.GetWeakPtr()),
+      base::Bind(&RemoteObjectManager::OnSignalConnected,
+                 weak_ptr_factory_.GetWeakPtr()));
+}
+
+void RemoteObjectManager::FetchAll(const FetchCallback& callback) {
+  CallMethod(manager_proxy_,
+             dbus::kObjectManagerInterface,
+             dbus::kObjectManagerGetManagedObjects,
+             base::Bind(&RemoteObjectManager::OnFetchAllSuccess,
+                        weak_ptr_factory_.GetWeakPtr(), callback),
+             base::Bind(&RemoteObjectManager::OnFetchAllError,
+                        weak_ptr_factory_.GetWeakPtr(), callback));
+}
+
+bool RemoteObjectManager::FetchAllAndBlock(ErrorPtr* error) {
+  auto response = CallMethodAndBlock(manager_proxy_,
+                                     dbus::kObjectManagerInterface,
+                                     dbus::kObjectManagerGetManagedObjects,
+                                     error);
+  ManagedObjects objects;
+  if (!response ||
+      !ExtractMethodCallResults(response.get(), error, &objects)) {
+    return false;
+  }
+  SetManagedObjects(objects);
+  return true;
+}
+
+std::vector<dbus::ObjectPath> RemoteObjectManager::GetObjectPaths() const {
+  std::vector<dbus::ObjectPath> paths;
+  paths.reserve(objects_.size());
+  for (const auto& pair : objects_)
+    paths.push_back(pair.first);
+  return paths;
+}
+
+std::vector<dbus::ObjectPath> RemoteObjectManager::GetObjectsWithInterface(
+    const std::string& interface_name) const {
+  std::vector<dbus::ObjectPath> paths;
+  for (const auto& pair : objects_) {
+    if (pair.second.interfaces.count(interface_name))
+      paths.push_back(pair.first);
+  }
+  return paths;
+}
+
+CachedPropertySet* RemoteObjectManager::GetProperties(
+    const dbus::ObjectPath& object_path,
+    const std::string& interface_name) const {
+  auto object = objects_.find(object_path);
+  if (object == objects_.end())
+    return nullptr;
+  const InterfaceMap& interfaces = object->second.interfaces;
+  auto itf = interfaces.find(interface_name);
+  return itf != interfaces.end() ? itf->second.get() : nullptr;
+}
+
+void RemoteObjectManager::OnSignalConnected(const std::string& interface_name,
+                                            const std::string& signal_name,
+                                            bool success) {
+  LOG_IF(ERROR, !success) << "Failed to connect to " << interface_name << "."
+                          << signal_name << " of " << service_name_;
+}
+
+void RemoteObjectManager::OnInterfacesAdded(
+    const dbus::ObjectPath& object_path,
+    const InterfaceProperties& interfaces) {
+  for (const auto& pair : interfaces)
+    AddInterface(object_path, pair.first, pair.second);
+}
+
+void RemoteObjectManager::OnInterfacesRemoved(
+    const dbus::ObjectPath& object_path,
+    const std::vector<std::string>& interfaces) {
+  for (const std::string& interface_name : interfaces)
+    RemoveInterface(object_path, interface_name);
+}
+
+void RemoteObjectManager::OnFetchAllSuccess(const FetchCallback& callback,
+                                            const ManagedObjects& objects) {
+  SetManagedObjects(objects);
+  if (!callback.is_null())
+    callback.Run(true);
+}
+
+void RemoteObjectManager::OnFetchAllError(const FetchCallback& callback,
+                                          Error* error) {
+  LOG(ERROR) << "Failed to get the objects managed by " << service_name_
+             << ": " << error->GetMessage();
+  if (!callback.is_null())
+    callback.Run(false);
+}
+
+void RemoteObjectManager::OnPropertiesChanged(
+    const dbus::ObjectPath& object_path,
+    const std::string& interface_name,
+    const VariantDictionary& changed_properties,
+    const std::vector<std::string>& invalidated_properties) {
+  CachedPropertySet* property_set =
+      GetProperties(object_path, interface_name);
+  if (property_set)
+    property_set->UpdateProperties(changed_properties, invalidated_properties);
+}
+
+void RemoteObjectManager::OnPropertyChanged(
+    const dbus::ObjectPath& object_path,
+    const std::string& interface_name,
+    const std::string& property_name) {
+  if (!property_changed_callback_.is_null())
+    property_changed_callback_.Run(object_path, interface_name, property_name);
+}
+
+void RemoteObjectManager::SetManagedObjects(const ManagedObjects& objects) {
+  // Drop the interfaces that are gone first, then add or update the others.
+  std::vector<std::pair<dbus::ObjectPath, std::string>> removed;
+  for (const auto& object : objects_) {
+    auto new_object = objects.find(object.first);
+    for (const auto& itf : object.second.interfaces) {
+      if (new_object == objects.end() || !new_object->second.count(itf.first))
+        removed.emplace_back(object.first, itf.first);
+    }
+  }
+  for (const auto& pair : removed)
+    RemoveInterface(pair.first, pair.second);
+
+  for (const auto& object : objects) {
+    for (const auto& itf : object.second)
+      AddInterface(object.first, itf.first, itf.second);
+  }
+}
+
+void RemoteObjectManager::AddInterface(const dbus::ObjectPath& object_path,
+                                       const std::string& interface_name,
+                                       const VariantDictionary& properties) {
+  Object& object = objects_[object_path];
+  std::unique_ptr<CachedPropertySet>& property_set =
+      object.interfaces[interface_name];
+  if (property_set) {
+    // The interface is already known, only refresh its properties and report
+    // the ones that differ.
+    std::vector<std::string> changed;
+    const VariantDictionary& old_properties = property_set->GetAll();
+    for (const auto& pair : properties) {
+      auto old_value = old_properties.find(pair.first);
+      if (old_value == old_properties.end() || old_value->second != pair.second)
+        changed.push_back(pair.first);
+    }
+    for (const auto& pair : old_properties) {
+      if (!properties.count(pair.first))
+        changed.push_back(pair.first);
+    }
+    property_set->SetAll(properties);
+    for (const std::string& property_name : changed)
+      OnPropertyChanged(object_path, interface_name, property_name);
+    return;
+  }
+
+  if (!object.proxy) {
+    // The PropertiesChanged signal carries the interface name, so one
+    // subscription serves all the interfaces of the object.
+    object.proxy = bus_->GetObjectProxy(service_name_, object_path);
+    ConnectToSignal(
+        object.proxy,
+        dbus::kPropertiesInterface,
+        dbus::kPropertiesChanged,
+        base::Bind(&RemoteObjectManager::OnPropertiesChanged,
+                   weak_ptr_factory_.GetWeakPtr(), object_path),
+        base::Bind(&RemoteObjectManager::OnSignalConnected,
+                   weak_ptr_factory_.GetWeakPtr()));
+  }
+  property_set.reset(new CachedPropertySet(object.proxy, interface_name));
+  property_set->SetAll(properties);
+  property_set->SetPropertyChangedCallback(
+      base::Bind(&RemoteObjectManager::OnPropertyChanged,
+                 weak_ptr_factory_.GetWeakPtr(), object_path, interface_name));
+  if (!interface_added_callback_.is_null())
+    interface_added_callback_.Run(object_path, interface_name);
+}
+
+void RemoteObjectManager::RemoveInterface(const dbus::ObjectPath& object_path,
+                                          const std::string& interface_name) {
+  auto object = objects_.find(object_path);
+  if (object == objects_.end() ||
+      !object->second.interfaces.erase(interface_name)) {
+    return;
+  }
+  if (object->second.interfaces.empty()) {
+    // Releasing the proxy also drops its signal subscription.
+    bus_->RemoveObjectProxy(service_name_, object_path, base::DoNothing());
+    objects_.erase(object);
+  }
+  if (!interface_removed_callback_.is_null())
+    interface_removed_callback_.Run(object_path, interface_name);
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
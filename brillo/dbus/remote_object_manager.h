@@ -0,0 +1,181 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// RemoteObjectManager is the client-side counterpart of ExportedObjectManager.
+// It keeps a local mirror of all the objects managed by a remote
+// org.freedesktop.DBus.ObjectManager along with the properties of their
+// interfaces. The whole tree is fetched once with GetManagedObjects and then
+// kept up to date from the InterfacesAdded, InterfacesRemoved and
+// PropertiesChanged signals, so clients don't need to poll
+// GetManagedObjects, which serializes the whole tree on every call.
+//
+// The properties of each interface are kept in a CachedPropertySet. A single
+// PropertiesChanged subscription per object feeds all its interfaces, and the
+// object proxy is released once the object has no interface left.
+//
+// Example:
+//
+//  RemoteObjectManager manager(bus, "org.chromium.MyService",
+//                              dbus::ObjectPath("/org/chromium/MyService"));
+//  manager.SetInterfaceAddedCallback(base::Bind(&OnDeviceAdded));
+//  manager.ConnectSignals();
+//  brillo::ErrorPtr error;
+//  if (!manager.FetchAllAndBlock(&error))
+//    return false;
+//  for (const auto& path :
+//       manager.GetObjectsWithInterface("org.chromium.Device")) {
+//    std::string name;
+//    manager.GetValue(path, "org.chromium.Device", "Name", &name);
+//  }
+
+#ifndef LIBBRILLO_BRILLO_DBUS_REMOTE_OBJECT_MANAGER_H_
+#define LIBBRILLO_BRILLO_DBUS_REMOTE_OBJECT_MANAGER_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/ref_counted.h>
+#include <base/memory/weak_ptr.h>
+#include <brillo/brillo_export.h>
+#include <brillo/dbus/cached_property_set.h>
+#include <brillo/errors/error.h>
+#include <brillo/variant_dictionary.h>
+#include <dbus/bus.h>
+#include <dbus/object_path.h>
+#include <dbus/object_proxy.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+class BRILLO_EXPORT RemoteObjectManager {
+ public:
+  // Called when |interface_name| is added to or removed from the object at
+  // |object_path|.
+  using InterfaceCallback =
+      base::Callback<void(const dbus::ObjectPath& object_path,
+                          const std::string& interface_name)>;
+  // Called when the cached value of a property has changed or has been
+  // invalidated.
+  using PropertyChangedCallback =
+      base::Callback<void(const dbus::ObjectPath& object_path,
+                          const std::string& interface_name,
+                          const std::string& property_name)>;
+  // Called when FetchAll() completes, with true if the objects were received.
+  using FetchCallback = base::Callback<void(bool success)>;
+
+  // Interface properties of the managed objects, as sent by the remote
+  // ObjectManager.
+  using InterfaceProperties = std::map<std::string, VariantDictionary>;
+  using ManagedObjects = std::map<dbus::ObjectPath, InterfaceProperties>;
+
+  RemoteObjectManager(const scoped_refptr<dbus::Bus>& bus,
+                      const std::string& service_name,
+                      const dbus::ObjectPath& manager_path);
+  ~RemoteObjectManager();
+
+  // Subscribes to the InterfacesAdded and InterfacesRemoved signals of the
+  // remote ObjectManager. Call it before fetching the objects, so no change
+  // is missed in between.
+  void ConnectSignals();
+
+  // Fetches all the managed objects and replaces the mirror with them.
+  // Interfaces are reported as added or removed as needed.
+  void FetchAll(const FetchCallback& callback);
+  bool FetchAllAndBlock(ErrorPtr* error);
+
+  void SetInterfaceAddedCallback(const InterfaceCallback& callback) {
+    interface_added_callback_ = callback;
+  }
+  void SetInterfaceRemovedCallback(const InterfaceCallback& callback) {
+    interface_removed_callback_ = callback;
+  }
+  void SetPropertyChangedCallback(const PropertyChangedCallback& callback) {
+    property_changed_callback_ = callback;
+  }
+
+  // Returns the paths of all the objects currently known.
+  std::vector<dbus::ObjectPath> GetObjectPaths() const;
+  // Returns the paths of the objects that implement |interface_name|.
+  std::vector<dbus::ObjectPath> GetObjectsWithInterface(
+      const std::string& interface_name) const;
+
+  // Returns the cached properties of |interface_name| on the object at
+  // |object_path|, or nullptr if the object doesn't implement it.
+  CachedPropertySet* GetProperties(const dbus::ObjectPath& object_path,
+                                   const std::string& interface_name) const;
+
+  // Copies the cached value of a property to |value|. Returns false if the
+  // property isn't known or isn't of type T.
+  template<typename T>
+  bool GetValue(const dbus::ObjectPath& object_path,
+                const std::string& interface_name,
+                const std::string& property_name,
+                T* value) const {
+    CachedPropertySet* properties =
+        GetProperties(object_path, interface_name);
+    return properties && properties->GetValue(property_name, value);
+  }
+
+ private:
+  using InterfaceMap =
+      std::map<std::string, std::unique_ptr<CachedPropertySet>>;
+
+  // A remote object and the properties of its interfaces.
+  struct Object {
+    dbus::ObjectProxy* proxy{nullptr};
+    InterfaceMap interfaces;
+  };
+
+  void OnSignalConnected(const std::string& interface_name,
+                         const std::string& signal_name,
+                         bool success);
+  void OnInterfacesAdded(const dbus::ObjectPath& object_path,
+                         const InterfaceProperties& interfaces);
+  void OnInterfacesRemoved(const dbus::ObjectPath& object_path,
+                           const std::vector<std::string>& interfaces);
+  void OnFetchAllSuccess(const FetchCallback& callback,
+                         const ManagedObjects& objects);
+  void OnFetchAllError(const FetchCallback& callback, Error* error);
+  // Routes a PropertiesChanged signal of the object at |object_path| to the
+  // properties of |interface_name|.
+  void OnPropertiesChanged(
+      const dbus::ObjectPath& object_path,
+      const std::string& interface_name,
+      const VariantDictionary& changed_properties,
+      const std::vector<std::string>& invalidated_properties);
+  void OnPropertyChanged(const dbus::ObjectPath& object_path,
+                         const std::string& interface_name,
+                         const std::string& property_name);
+
+  // Replaces the whole mirror with |objects|.
+  void SetManagedObjects(const ManagedObjects& objects);
+  // Adds the interface or updates its properties if it's already known.
+  void AddInterface(const dbus::ObjectPath& object_path,
+                    const std::string& interface_name,
+                    const VariantDictionary& properties);
+  void RemoveInterface(const dbus::ObjectPath& object_path,
+                       const std::string& interface_name);
+
+  scoped_refptr<dbus::Bus> bus_;
+  std::string service_name_;
+  dbus::ObjectProxy* manager_proxy_;
+  std::map<dbus::ObjectPath, Object> objects_;
+
+  InterfaceCallback interface_added_callback_;
+  InterfaceCallback interface_removed_callback_;
+  PropertyChangedCallback property_changed_callback_;
+
+  base::WeakPtrFactory<RemoteObjectManager> weak_ptr_factory_{this};
+
+  DISALLOW_COPY_AND_ASSIGN(RemoteObjectManager);
+};
+
+}  // namespace dbus_utils
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_DBUS_REMOTE_OBJECT_MANAGER_H_
@@ -0,0 +1,305 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/remote_object_manager.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <brillo/dbus/dbus_param_writer.h>
+#include <dbus/mock_bus.h>
+#include <dbus/mock_object_proxy.h>
+#include <dbus/property.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::AnyNumber;
+using testing::Invoke;
+using testing::Return;
+using testing::SaveArg;
+using testing::_;
+
+using dbus::MessageWriter;
+using dbus::Response;
+
+namespace brillo {
+namespace dbus_utils {
+
+namespace {
+
+const char kTestServiceName[] = "org.test.Service";
+const char kManagerPath[] = "/test";
+const char kObjectPath1[] = "/test/object1";
+const char kObjectPath2[] = "/test/object2";
+const char kTestInterface[] = "org.test.Interface";
+const char kOtherInterface[] = "org.test.OtherInterface";
+
+}  // namespace
+
+class RemoteObjectManagerTest : public testing::Test {
+ public:
+  void SetUp() override {
+    dbus::Bus::Options options;
+    options.bus_type = dbus::Bus::SYSTEM;
+    bus_ = new dbus::MockBus(options);
+    EXPECT_CALL(*bus_, AssertOnOriginThread()).Times(AnyNumber());
+    EXPECT_CALL(*bus_, AssertOnDBusThread()).Times(AnyNumber());
+    EXPECT_CALL(*bus_, RemoveObjectProxy(_, _, _)).Times(0);
+
+    manager_proxy_ = new dbus::MockObjectProxy(
+        bus_.get(), kTestServiceName, dbus::ObjectPath(kManagerPath));
+    EXPECT_CALL(*bus_, GetObjectProxy(kTestServiceName,
+                                      dbus::ObjectPath(kManagerPath)))
+        .WillRepeatedly(Return(manager_proxy_.get()));
+    EXPECT_CALL(*manager_proxy_,
+                ConnectToSignal(dbus::kObjectManagerInterface,
+                                dbus::kObjectManagerInterfacesAdded, _, _))
+        .WillOnce(SaveArg<2>(&interfaces_added_callback_));
+    EXPECT_CALL(*manager_proxy_,
+                ConnectToSignal(dbus::kObjectManagerInterface,
+                                dbus::kObjectManagerInterfacesRemoved, _, _))
+        .WillOnce(SaveArg<2>(&interfaces_removed_callback_));
+    EXPECT_CALL(*manager_proxy_,
+                MockCallMethodAndBlockWithErrorDetails(_, _, _))
+        .WillRepeatedly(
+            Invoke(this, &RemoteObjectManagerTest::HandleGetManagedObjects));
+
+    object_proxy_ = new dbus::MockObjectProxy(
+        bus_.get(), kTestServiceName, dbus::ObjectPath(kObjectPath1));
+    EXPECT_CALL(*bus_, GetObjectProxy(kTestServiceName,
+                                      dbus::ObjectPath(kObjectPath1)))
+        .WillRepeatedly(Return(object_proxy_.get()));
+    // A single subscription serves all the interfaces of an object.
+    EXPECT_CALL(*object_proxy_,
+                ConnectToSignal(dbus::kPropertiesInterface,
+                                dbus::kPropertiesChanged, _, _))
+        .WillOnce(SaveArg<2>(&properties_changed_callback_));
+
+    object_proxy2_ = new dbus::MockObjectProxy(
+        bus_.get(), kTestServiceName, dbus::ObjectPath(kObjectPath2));
+    EXPECT_CALL(*bus_, GetObjectProxy(kTestServiceName,
+                                      dbus::ObjectPath(kObjectPath2)))
+        .WillRepeatedly(Return(object_proxy2_.get()));
+    EXPECT_CALL(*object_proxy2_, ConnectToSignal(_, _, _, _))
+        .Times(AnyNumber());
+
+    manager_.reset(new RemoteObjectManager(bus_, kTestServiceName,
+                                           dbus::ObjectPath(kManagerPath)));
+    manager_->SetInterfaceAddedCallback(base::Bind(
+        &RemoteObjectManagerTest::OnInterfaceAdded, base::Unretained(this)));
+    manager_->SetInterfaceRemovedCallback(base::Bind(
+        &RemoteObjectManagerTest::OnInterfaceRemoved, base::Unretained(this)));
+    manager_->SetPropertyChangedCallback(base::Bind(
+        &RemoteObjectManagerTest::OnPropertyChanged, base::Unretained(this)));
+    manager_->ConnectSignals();
+  }
+
+  void TearDown() override {
+    manager_.reset();
+    bus_ = nullptr;
+  }
+
+  Response* HandleGetManagedObjects(dbus::MethodCall* method_call,
+                                    int /* timeout_ms */,
+                                    dbus::ScopedDBusError* /* dbus_error */) {
+    get_managed_objects_count_++;
+    EXPECT_EQ(dbus::kObjectManagerInterface, method_call->GetInterface());
+    EXPECT_EQ(dbus::kObjectManagerGetManagedObjects, method_call->GetMember());
+    auto response = Response::CreateEmpty();
+    MessageWriter writer(response.get());
+    DBusParamWriter::Append(&writer, remote_objects_);
+    return response.release();
+  }
+
+  void OnInterfaceAdded(const dbus::ObjectPath& object_path,
+                        const std::string& interface_name) {
+    events_.push_back("+" + object_path.value() + ":" + interface_name);
+  }
+
+  void OnInterfaceRemoved(const dbus::ObjectPath& object_path,
+                          const std::string& interface_name) {
+    events_.push_back("-" + object_path.value() + ":" + interface_name);
+  }
+
+  void OnPropertyChanged(const dbus::ObjectPath& object_path,
+                         const std::string& interface_name,
+                         const std::string& property_name) {
+    events_.push_back(object_path.value() + ":" + interface_name + "." +
+                      property_name);
+  }
+
+  template<typename... Args>
+  void SendSignal(const dbus::ObjectProxy::SignalCallback& callback,
+                  const std::string& interface_name,
+                  const std::string& signal_name,
+                  const Args&... args) {
+    dbus::Signal signal(interface_name, signal_name);
+    MessageWriter writer(&signal);
+    DBusParamWriter::Append(&writer, args...);
+    callback.Run(&signal);
+  }
+
+  scoped_refptr<dbus::MockBus> bus_;
+  scoped_refptr<dbus::MockObjectProxy> manager_proxy_;
+  scoped_refptr<dbus::MockObjectProxy> object_proxy_;
+  scoped_refptr<dbus::MockObjectProxy> object_proxy2_;
+  dbus::ObjectProxy::SignalCallback interfaces_added_callback_;
+  dbus::ObjectProxy::SignalCallback interfaces_removed_callback_;
+  dbus::ObjectProxy::SignalCallback properties_changed_callback_;
+  std::unique_ptr<RemoteObjectManager> manager_;
+  RemoteObjectManager::ManagedObjects remote_objects_{
+      {dbus::ObjectPath{kObjectPath1},
+       {{kTestInterface, {{"Name", std::string{"object1"}}}}}}};
+  std::vector<std::string> events_;
+  int get_managed_objects_count_{0};
+};
+
+TEST_F(RemoteObjectManagerTest, FetchAll) {
+  EXPECT_TRUE(manager_->FetchAllAndBlock(nullptr));
+  EXPECT_EQ(1, get_managed_objects_count_);
+  EXPECT_EQ(std::vector<std::string>{"+/test/object1:org.test.Interface"},
+            events_);
+
+  EXPECT_EQ(std::vector<dbus::ObjectPath>{dbus::ObjectPath{kObjectPath1}},
+            manager_->GetObjectPaths());
+  EXPECT_EQ(std::vector<dbus::ObjectPath>{dbus::ObjectPath{kObjectPath1}},
+            manager_->GetObjectsWithInterface(kTestInterface));
+  EXPECT_TRUE(manager_->GetObjectsWithInterface(kOtherInterface).empty());
+
+  std::string name;
+  EXPECT_TRUE(manager_->GetValue(dbus::ObjectPath{kObjectPath1},
+                                 kTestInterface, "Name", &name));
+  EXPECT_EQ("object1", name);
+  EXPECT_FALSE(manager_->GetValue(dbus::ObjectPath{kObjectPath2},
+                                  kTestInterface, "Name", &name));
+  EXPECT_EQ(nullptr, manager_->GetProperties(dbus::ObjectPath{kObjectPath1},
+                                             kOtherInterface));
+}
+
+TEST_F(RemoteObjectManagerTest, InterfacesAddedAndRemoved) {
+  EXPECT_TRUE(manager_->FetchAllAndBlock(nullptr));
+  events_.clear();
+  // The proxy is released along with the last interface of the object.
+  EXPECT_CALL(*bus_, RemoveObjectProxy(kTestServiceName,
+                                       dbus::ObjectPath(kObjectPath2), _))
+      .WillOnce(Return(true));
+
+  RemoteObjectManager::InterfaceProperties interfaces{
+      {kTestInterface, {{"Name", std::string{"object2"}}}},
+      {kOtherInterface, {}}};
+  SendSignal(interfaces_added_callback_, dbus::kObjectManagerInterface,
+             dbus::kObjectManagerInterfacesAdded,
+             dbus::ObjectPath{kObjectPath2}, interfaces);
+  EXPECT_EQ((std::vector<std::string>{
+                "+/test/object2:org.test.Interface",
+                "+/test/object2:org.test.OtherInterface"}),
+            events_);
+  std::string name;
+  EXPECT_TRUE(manager_->GetValue(dbus::ObjectPath{kObjectPath2},
+                                 kTestInterface, "Name", &name));
+  EXPECT_EQ("object2", name);
+  EXPECT_EQ(2u, manager_->GetObjectPaths().size());
+
+  events_.clear();
+  SendSignal(interfaces_removed_callback_, dbus::kObjectManagerInterface,
+             dbus::kObjectManagerInterfacesRemoved,
+             dbus::ObjectPath{kObjectPath2},
+             std::vector<std::string>{kTestInterface, kOtherInterface});
+  EXPECT_EQ((std::vector<std::string>{
+                "-/test/object2:org.test.Interface",
+                "-/test/object2:org.test.OtherInterface"}),
+            events_);
+  EXPECT_EQ(1u, manager_->GetObjectPaths().size());
+  // The mirror is kept up to date without polling.
+  EXPECT_EQ(1, get_managed_objects_count_);
+}
+
+TEST_F(RemoteObjectManagerTest, PropertiesChanged) {
+  EXPECT_TRUE(manager_->FetchAllAndBlock(nullptr));
+  events_.clear();
+
+  SendSignal(properties_changed_callback_, dbus::kPropertiesInterface,
+             dbus::kPropertiesChanged, std::string{kTestInterface},
+             VariantDictionary{{"Name", std::string{"renamed"}}},
+             std::vector<std::string>{});
+  EXPECT_EQ(std::vector<std::string>{"/test/object1:org.test.Interface.Name"},
+            events_);
+  std::string name;
+  EXPECT_TRUE(manager_->GetValue(dbus::ObjectPath{kObjectPath1},
+                                 kTestInterface, "Name", &name));
+  EXPECT_EQ("renamed", name);
+}
+
+TEST_F(RemoteObjectManagerTest, PropertiesChangedRoutedByInterface) {
+  remote_objects_[dbus::ObjectPath{kObjectPath1}][kOtherInterface] = {
+      {"Count", 1}};
+  EXPECT_TRUE(manager_->FetchAllAndBlock(nullptr));
+  events_.clear();
+
+  SendSignal(properties_changed_callback_, dbus::kPropertiesInterface,
+             dbus::kPropertiesChanged, std::string{kOtherInterface},
+             VariantDictionary{{"Count", 2}}, std::vector<std::string>{});
+  EXPECT_EQ(
+      std::vector<std::string>{"/test/object1:org.test.OtherInterface.Count"},
+      events_);
+  int count = 0;
+  EXPECT_TRUE(manager_->GetValue(dbus::ObjectPath{kObjectPath1},
+                                 kOtherInterface, "Count", &count));
+  EXPECT_EQ(2, count);
+  EXPECT_FALSE(manager_->GetValue(dbus::ObjectPath{kObjectPath1},
+                                  kTestInterface, "Count", &count));
+
+  // Signals for interfaces that aren't known are ignored.
+  events_.clear();
+  SendSignal(properties_changed_callback_, dbus::kPropertiesInterface,
+             dbus::kPropertiesChanged, std::string{"org.test.Unknown"},
+             VariantDictionary{{"Count", 3}}, std::vector<std::string>{});
+  EXPECT_TRUE(events_.empty());
+}
+
+TEST_F(RemoteObjectManagerTest, InterfacesAddedForKnownInterface) {
+  EXPECT_TRUE(manager_->FetchAllAndBlock(nullptr));
+  events_.clear();
+
+  RemoteObjectManager::InterfaceProperties interfaces{
+      {kTestInterface, {{"Name", std::string{"object1"}}}}};
+  SendSignal(interfaces_added_callback_, dbus::kObjectManagerInterface,
+             dbus::kObjectManagerInterfacesAdded,
+             dbus::ObjectPath{kObjectPath1}, interfaces);
+  EXPECT_TRUE(events_.empty());
+
+  interfaces[kTestInterface] = {{"Extra", 1}};
+  SendSignal(interfaces_added_callback_, dbus::kObjectManagerInterface,
+             dbus::kObjectManagerInterfacesAdded,
+             dbus::ObjectPath{kObjectPath1}, interfaces);
+  EXPECT_EQ((std::vector<std::string>{"/test/object1:org.test.Interface.Extra",
+                                      "/test/object1:org.test.Interface.Name"}),
+            events_);
+  int extra = 0;
+  EXPECT_TRUE(manager_->GetValue(dbus::ObjectPath{kObjectPath1},
+                                 kTestInterface, "Extra", &extra));
+  EXPECT_EQ(1, extra);
+}
+
+TEST_F(RemoteObjectManagerTest, FetchAllAgainReportsDifferences) {
+  EXPECT_TRUE(manager_->FetchAllAndBlock(nullptr));
+  events_.clear();
+
+  remote_objects_.clear();
+  remote_objects_[dbus::ObjectPath{kObjectPath2}][kTestInterface] = {};
+  EXPECT_CALL(*bus_, RemoveObjectProxy(kTestServiceName,
+                                       dbus::ObjectPath(kObjectPath1), _))
+      .WillOnce(Return(true));
+  EXPECT_TRUE(manager_->FetchAllAndBlock(nullptr));
+  EXPECT_EQ((std::vector<std::string>{"-/test/object1:org.test.Interface",
+                                      "+/test/object2:org.test.Interface"}),
+            events_);
+  EXPECT_EQ(std::vector<dbus::ObjectPath>{dbus::ObjectPath{kObjectPath2}},
+            manager_->GetObjectPaths());
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
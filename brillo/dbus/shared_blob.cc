@@ -0,0 +1,184 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/shared_blob.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <base/files/file_util.h>
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+
+// Older C libraries don't define the memfd and file sealing constants.
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+#ifndef F_ADD_SEALS
+#define F_ADD_SEALS 1033
+#define F_GET_SEALS 1034
+#define F_SEAL_SEAL 0x0001
+#define F_SEAL_SHRINK 0x0002
+#define F_SEAL_GROW 0x0004
+#define F_SEAL_WRITE 0x0008
+#endif
+
+namespace brillo {
+namespace dbus_utils {
+
+namespace {
+
+// Seals that guarantee that the content of a memfd can't change anymore.
+const int kRequiredSeals = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+
+}  // anonymous namespace
+
+const size_t SharedBlob::kDefaultMemfdThreshold;
+
+SharedBlob::SharedBlob(Blob data, size_t memfd_threshold)
+    : data_{std::move(data)}, memfd_threshold_{memfd_threshold} {}
+
+SharedBlob::SharedBlob(SharedBlob&& other) {
+  *this = std::move(other);
+}
+
+SharedBlob::~SharedBlob() {
+  Reset();
+}
+
+SharedBlob& SharedBlob::operator=(SharedBlob&& other) {
+  if (this == &other)
+    return *this;
+  Reset();
+  data_ = std::move(other.data_);
+  memfd_threshold_ = other.memfd_threshold_;
+  mapping_ = other.mapping_;
+  mapping_size_ = other.mapping_size_;
+  other.mapping_ = nullptr;
+  other.mapping_size_ = 0;
+  return *this;
+}
+
+const uint8_t* SharedBlob::data() const {
+  return mapping_ ? static_cast<const uint8_t*>(mapping_) : data_.data();
+}
+
+size_t SharedBlob::size() const {
+  return mapping_ ? mapping_size_ : data_.size();
+}
+
+Blob SharedBlob::ToBlob() const {
+  return Blob(data(), data() + size());
+}
+
+bool SharedBlob::MapMemfd(base::ScopedFD fd) {
+  int seals = fcntl(fd.get(), F_GET_SEALS);
+  if (seals < 0 || (seals & kRequiredSeals) != kRequiredSeals) {
+    LOG(ERROR) << "Refusing to map a memfd that is not sealed";
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd.get(), &st) < 0) {
+    PLOG(ERROR) << "Failed to get the size of the memfd";
+    return false;
+  }
+
+  Reset();
+  data_.clear();
+  if (st.st_size == 0)
+    return true;
+
+  size_t size = static_cast<size_t>(st.st_size);
+  void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd.get(), 0);
+  if (mapping == MAP_FAILED) {
+    PLOG(ERROR) << "Failed to map the memfd";
+    return false;
+  }
+  // The mapping stays valid after the descriptor is closed.
+  mapping_ = mapping;
+  mapping_size_ = size;
+  return true;
+}
+
+void SharedBlob::Reset() {
+  if (mapping_)
+    munmap(mapping_, mapping_size_);
+  mapping_ = nullptr;
+  mapping_size_ = 0;
+}
+
+base::ScopedFD CreateSealedMemfd(const void* data, size_t size) {
+  // Use the system call directly, since older C libraries have no wrapper.
+  base::ScopedFD fd(static_cast<int>(syscall(
+      __NR_memfd_create, "brillo_shared_blob",
+      MFD_CLOEXEC | MFD_ALLOW_SEALING)));
+  if (!fd.is_valid()) {
+    PLOG(WARNING) << "Failed to create a memfd";
+    return fd;
+  }
+  if (!base::WriteFileDescriptor(fd.get(), static_cast<const char*>(data),
+                                 size)) {
+    PLOG(ERROR) << "Failed to write to the memfd";
+    return base::ScopedFD();
+  }
+  if (HANDLE_EINTR(fcntl(fd.get(), F_ADD_SEALS,
+                         kRequiredSeals | F_SEAL_SEAL)) < 0) {
+    PLOG(ERROR) << "Failed to seal the memfd";
+    return base::ScopedFD();
+  }
+  return fd;
+}
+
+void AppendValueToWriter(dbus::MessageWriter* writer,
+                         const SharedBlob& value) {
+  base::ScopedFD fd;
+  if (value.size() >= value.memfd_threshold() &&
+      dbus::IsDBusTypeUnixFdSupported()) {
+    fd = CreateSealedMemfd(value.data(), value.size());
+  }
+
+  // Fall back to sending the data inline if the memfd couldn't be created.
+  dbus::MessageWriter variant_writer(nullptr);
+  if (fd.is_valid()) {
+    writer->OpenVariant(DBUS_TYPE_UNIX_FD_AS_STRING, &variant_writer);
+    variant_writer.AppendFileDescriptor(fd.get());
+  } else {
+    writer->OpenVariant(DBUS_TYPE_ARRAY_AS_STRING DBUS_TYPE_BYTE_AS_STRING,
+                        &variant_writer);
+    variant_writer.AppendArrayOfBytes(value.data(), value.size());
+  }
+  writer->CloseContainer(&variant_writer);
+}
+
+bool PopValueFromReader(dbus::MessageReader* reader, SharedBlob* value) {
+  dbus::MessageReader variant_reader(nullptr);
+  if (!reader->PopVariant(&variant_reader))
+    return false;
+
+  switch (variant_reader.GetDataType()) {
+    case dbus::Message::ARRAY: {
+      const uint8_t* bytes = nullptr;
+      size_t size = 0;
+      if (!variant_reader.PopArrayOfBytes(&bytes, &size))
+        return false;
+      *value = SharedBlob{Blob(bytes, bytes + size)};
+      return true;
+    }
+    case dbus::Message::UNIX_FD: {
+      base::ScopedFD fd;
+      return variant_reader.PopFileDescriptor(&fd) &&
+             value->MapMemfd(std::move(fd));
+    }
+    default:
+      return false;
+  }
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
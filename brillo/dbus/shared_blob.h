@@ -0,0 +1,104 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_DBUS_SHARED_BLOB_H_
+#define LIBBRILLO_BRILLO_DBUS_SHARED_BLOB_H_
+
+#include <string>
+
+#include <base/files/scoped_file.h>
+#include <base/macros.h>
+#include <brillo/brillo_export.h>
+#include <brillo/dbus/data_serialization.h>
+#include <brillo/secure_blob.h>
+
+namespace brillo {
+namespace dbus_utils {
+
+// SharedBlob is a binary blob that can be passed over D-Bus efficiently
+// regardless of its size. Its D-Bus signature is a variant ("v"):
+//  - blobs smaller than the memfd threshold are sent inline as a byte array
+//    ("ay"), like a regular brillo::Blob.
+//  - larger blobs are written to a memfd which is then sealed against any
+//    modification, and only the file descriptor ("h") is sent. The receiver
+//    maps the memfd read-only, so the data isn't copied through libdbus and
+//    is not subject to the D-Bus message size limits.
+// The choice is made when the value is serialized, so a method or signal
+// taking a SharedBlob handles both forms transparently with DBusParamWriter
+// and DBusParamReader. If the connection doesn't support passing file
+// descriptors, the data is always sent inline.
+class BRILLO_EXPORT SharedBlob {
+ public:
+  // Blobs of at least this size are sent in a memfd by default.
+  static const size_t kDefaultMemfdThreshold = 64 * 1024;
+
+  SharedBlob() = default;
+  // Creates a blob holding |data|. Blobs of at least |memfd_threshold| bytes
+  // are sent in a memfd.
+  explicit SharedBlob(Blob data,
+                      size_t memfd_threshold = kDefaultMemfdThreshold);
+  SharedBlob(SharedBlob&& other);
+  ~SharedBlob();
+
+  SharedBlob& operator=(SharedBlob&& other);
+
+  // The content of the blob. For a blob received in a memfd, this points to
+  // the read-only mapping of the memfd.
+  const uint8_t* data() const;
+  size_t size() const;
+  bool empty() const { return size() == 0; }
+
+  // Returns a copy of the data.
+  Blob ToBlob() const;
+
+  // Returns true if the data was received in a memfd.
+  bool is_mapped() const { return mapping_ != nullptr; }
+
+  size_t memfd_threshold() const { return memfd_threshold_; }
+
+  // Replaces the content of the blob with a read-only mapping of the memfd
+  // |fd|. Fails if the memfd isn't sealed against writing, shrinking and
+  // growing, since its sender could otherwise still modify the data.
+  bool MapMemfd(base::ScopedFD fd);
+
+ private:
+  // Unmaps the memfd mapping, if any.
+  void Reset();
+
+  Blob data_;
+  size_t memfd_threshold_{kDefaultMemfdThreshold};
+  void* mapping_{nullptr};
+  size_t mapping_size_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(SharedBlob);
+};
+
+// Creates a memfd holding a copy of |size| bytes at |data| and seals it, so
+// that neither the content nor the size can change anymore. Returns an invalid
+// descriptor on failure (e.g. if the kernel doesn't support memfd).
+BRILLO_EXPORT base::ScopedFD CreateSealedMemfd(const void* data, size_t size);
+
+BRILLO_EXPORT void AppendValueToWriter(dbus::MessageWriter* writer,
+                                       const SharedBlob& value);
+BRILLO_EXPORT bool PopValueFromReader(dbus::MessageReader* reader,
+                                      SharedBlob* value);
+
+template<>
+struct DBusType<SharedBlob> {
+  inline static std::string GetSignature() {
+    return DBUS_TYPE_VARIANT_AS_STRING;
+  }
+  inline static void Write(dbus::MessageWriter* writer,
+                           const SharedBlob& value) {
+    AppendValueToWriter(writer, value);
+  }
+  inline static bool Read(dbus::MessageReader* reader, SharedBlob* value) {
+    return PopValueFromReader(reader, value);
+  }
+};
+
+}  // namespace dbus_utils
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_DBUS_SHARED_BLOB_H_
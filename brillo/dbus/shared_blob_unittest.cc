@@ -0,0 +1,106 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/dbus/shared_blob.h>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <brillo/dbus/dbus_param_reader.h>
+#include <brillo/dbus/dbus_param_writer.h>
+#include <gtest/gtest.h>
+
+using dbus::MessageReader;
+using dbus::MessageWriter;
+using dbus::Response;
+
+namespace brillo {
+namespace dbus_utils {
+
+TEST(SharedBlob, SmallBlobIsInline) {
+  std::unique_ptr<Response> message = Response::CreateEmpty();
+  MessageWriter writer(message.get());
+  SharedBlob blob{Blob{1, 2, 3}};
+  AppendValueToWriter(&writer, blob);
+  EXPECT_EQ("v", message->GetSignature());
+
+  MessageReader reader(message.get());
+  MessageReader variant_reader(nullptr);
+  ASSERT_TRUE(reader.PopVariant(&variant_reader));
+  EXPECT_EQ("ay", variant_reader.GetDataSignature());
+
+  MessageReader reader2(message.get());
+  SharedBlob blob_out;
+  EXPECT_TRUE(PopValueFromReader(&reader2, &blob_out));
+  EXPECT_FALSE(blob_out.is_mapped());
+  EXPECT_EQ((Blob{1, 2, 3}), blob_out.ToBlob());
+}
+
+TEST(SharedBlob, LargeBlobUsesMemfd) {
+  if (!dbus::IsDBusTypeUnixFdSupported()) {
+    LOG(WARNING) << "FD passing is not supported";
+    return;
+  }
+  if (!CreateSealedMemfd("", 1).is_valid()) {
+    LOG(WARNING) << "memfd is not supported";
+    return;
+  }
+
+  Blob data(100);
+  for (size_t i = 0; i < data.size(); i++)
+    data[i] = static_cast<uint8_t>(i);
+  std::unique_ptr<Response> message = Response::CreateEmpty();
+  MessageWriter writer(message.get());
+  // Use a small threshold so the test doesn't need a large blob.
+  DBusParamWriter::Append(&writer, SharedBlob{data, 64}, int32_t{5});
+  EXPECT_EQ("vi", message->GetSignature());
+
+  MessageReader reader(message.get());
+  SharedBlob blob_out;
+  int32_t int_out = 0;
+  auto callback = [&blob_out, &int_out](const SharedBlob& blob,
+                                        int32_t value) {
+    blob_out = SharedBlob{blob.ToBlob()};
+    EXPECT_TRUE(blob.is_mapped());
+    int_out = value;
+  };
+  EXPECT_TRUE((DBusParamReader<false, const SharedBlob&, int32_t>::Invoke(
+      callback, &reader, nullptr)));
+  EXPECT_EQ(data, blob_out.ToBlob());
+  EXPECT_EQ(5, int_out);
+}
+
+TEST(SharedBlob, CreateSealedMemfd) {
+  const char kData[] = "data";
+  base::ScopedFD fd = CreateSealedMemfd(kData, sizeof(kData));
+  if (!fd.is_valid()) {
+    LOG(WARNING) << "memfd is not supported";
+    return;
+  }
+  // The content can't be modified anymore.
+  EXPECT_EQ(-1, write(fd.get(), "x", 1));
+  EXPECT_EQ(-1, ftruncate(fd.get(), 0));
+
+  SharedBlob blob;
+  EXPECT_TRUE(blob.MapMemfd(std::move(fd)));
+  EXPECT_TRUE(blob.is_mapped());
+  ASSERT_EQ(sizeof(kData), blob.size());
+  EXPECT_STREQ(kData, reinterpret_cast<const char*>(blob.data()));
+}
+
+TEST(SharedBlob, RejectsUnsealedMemfd) {
+  base::ScopedFD fd(static_cast<int>(
+      syscall(__NR_memfd_create, "test", 0)));
+  if (!fd.is_valid()) {
+    LOG(WARNING) << "memfd is not supported";
+    return;
+  }
+  ASSERT_EQ(4, write(fd.get(), "data", 4));
+  SharedBlob blob;
+  EXPECT_FALSE(blob.MapMemfd(std::move(fd)));
+}
+
+}  // namespace dbus_utils
+}  // namespace brillo
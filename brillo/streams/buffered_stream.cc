@@ -0,0 +1,554 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/buffered_stream.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <base/bind.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace brillo {
+
+namespace {
+
+bool ErrorAsyncFlushPending(const base::Location& location, ErrorPtr* error) {
+  Error::AddTo(error, location, errors::stream::kDomain,
+               errors::stream::kOperationNotSupported,
+               "Another asynchronous operation is still pending");
+  return false;
+}
+
+}  // anonymous namespace
+
+const size_t BufferedStream::kDefaultBufferSize;
+
+BufferedStream::BufferedStream(StreamPtr stream,
+                               size_t read_buffer_size,
+                               size_t write_buffer_size)
+    : stream_{std::move(stream)},
+      read_buffer_(read_buffer_size),
+      write_buffer_capacity_{write_buffer_size} {
+  write_buffer_.reserve(write_buffer_capacity_);
+}
+
+BufferedStream::~BufferedStream() {
+  // Try not to lose any output that hasn't been flushed yet.
+  if (IsOpen() && !async_flush_pending_ && GetBufferedWriteSize() > 0)
+    DrainWriteBufferBlocking(nullptr);
+}
+
+StreamPtr BufferedStream::Create(StreamPtr stream,
+                                 size_t read_buffer_size,
+                                 size_t write_buffer_size,
+                                 ErrorPtr* error) {
+  StreamPtr buffered_stream;
+  if (!stream || !stream->IsOpen()) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "The underlying stream must be open");
+    return buffered_stream;
+  }
+
+  if (!stream->CanRead())
+    read_buffer_size = 0;
+  if (!stream->CanWrite())
+    write_buffer_size = 0;
+
+  buffered_stream.reset(
+      new BufferedStream{std::move(stream), read_buffer_size,
+                         write_buffer_size});
+  return buffered_stream;
+}
+
+StreamPtr BufferedStream::Create(StreamPtr stream, ErrorPtr* error) {
+  return Create(std::move(stream), kDefaultBufferSize, kDefaultBufferSize,
+                error);
+}
+
+bool BufferedStream::PeekNonBlocking(void* buffer,
+                                     size_t size_to_peek,
+                                     size_t* size_peeked,
+                                     bool* end_of_stream,
+                                     ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (!PrepareForRead(error))
+    return false;
+
+  // An empty buffer is topped up even for a zero-size peek, so that the end of
+  // stream can be detected without consuming any data.
+  bool eos = false;
+  if ((GetBufferedReadSize() < size_to_peek || GetBufferedReadSize() == 0) &&
+      GetBufferedReadSize() < read_buffer_.size() &&
+      !FillReadBuffer(&eos, error)) {
+    return false;
+  }
+
+  size_t size = std::min(size_to_peek, GetBufferedReadSize());
+  if (size > 0)
+    std::memcpy(buffer, read_buffer_.data() + read_begin_, size);
+  *size_peeked = size;
+  if (end_of_stream)
+    *end_of_stream = (GetBufferedReadSize() == 0 && eos);
+  return true;
+}
+
+bool BufferedStream::ReadUntilBlocking(char delimiter,
+                                       std::string* data,
+                                       ErrorPtr* error) {
+  data->clear();
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  // Scanning for the delimiter requires a read buffer.
+  if (read_buffer_.empty())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  if (!PrepareForRead(error))
+    return false;
+
+  for (;;) {
+    size_t available = GetBufferedReadSize();
+    if (available > 0) {
+      const char* begin =
+          reinterpret_cast<const char*>(read_buffer_.data() + read_begin_);
+      const char* found =
+          static_cast<const char*>(std::memchr(begin, delimiter, available));
+      size_t size = found ? (found - begin + 1) : available;
+      data->append(begin, size);
+      ConsumeReadBuffer(size);
+      if (found)
+        return true;
+    }
+
+    bool eos = false;
+    if (!FillReadBuffer(&eos, error))
+      return false;
+
+    if (GetBufferedReadSize() == 0) {
+      if (eos)
+        return true;
+      if (!stream_->WaitForDataBlocking(AccessMode::READ,
+                                        base::TimeDelta::Max(), nullptr,
+                                        error)) {
+        return false;
+      }
+    }
+  }
+}
+
+bool BufferedStream::IsOpen() const {
+  return stream_ && stream_->IsOpen();
+}
+
+bool BufferedStream::CanRead() const {
+  return IsOpen() && stream_->CanRead();
+}
+
+bool BufferedStream::CanWrite() const {
+  return IsOpen() && stream_->CanWrite();
+}
+
+bool BufferedStream::CanSeek() const {
+  return IsOpen() && stream_->CanSeek();
+}
+
+bool BufferedStream::CanGetSize() const {
+  return IsOpen() && stream_->CanGetSize();
+}
+
+uint64_t BufferedStream::GetSize() const {
+  if (!IsOpen())
+    return 0;
+  uint64_t size = stream_->GetSize();
+  // Account for the data that would extend the stream once flushed.
+  if (stream_->CanSeek() && GetBufferedWriteSize() > 0)
+    size = std::max(size, GetPosition());
+  return size;
+}
+
+bool BufferedStream::SetSizeBlocking(uint64_t size, ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (!DrainWriteBufferBlocking(error) || !DiscardReadBuffer(error))
+    return false;
+
+  return stream_->SetSizeBlocking(size, error);
+}
+
+uint64_t BufferedStream::GetRemainingSize() const {
+  if (!IsOpen())
+    return 0;
+  return stream_->GetRemainingSize() + GetBufferedReadSize();
+}
+
+uint64_t BufferedStream::GetPosition() const {
+  if (!IsOpen())
+    return 0;
+  uint64_t position = stream_->GetPosition();
+  position += GetBufferedWriteSize() + async_flush_buffer_.size();
+  uint64_t unread = GetBufferedReadSize();
+  return (position > unread) ? (position - unread) : 0;
+}
+
+bool BufferedStream::Seek(int64_t offset,
+                          Whence whence,
+                          uint64_t* new_position,
+                          ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  // Fail before touching the buffers, so that the read-ahead data isn't lost.
+  if (!stream_->CanSeek())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  if (!DrainWriteBufferBlocking(error))
+    return false;
+
+  // The read-ahead data has already been consumed from the underlying stream,
+  // so relative seeks must take it into account.
+  if (whence == Whence::FROM_CURRENT)
+    offset -= static_cast<int64_t>(GetBufferedReadSize());
+  read_begin_ = read_end_ = 0;
+
+  return stream_->Seek(offset, whence, new_position, error);
+}
+
+bool BufferedStream::ReadNonBlocking(void* buffer,
+                                     size_t size_to_read,
+                                     size_t* size_read,
+                                     bool* end_of_stream,
+                                     ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (!PrepareForRead(error))
+    return false;
+
+  if (GetBufferedReadSize() == 0) {
+    if (size_to_read == 0) {
+      *size_read = 0;
+      if (end_of_stream)
+        *end_of_stream = false;
+      return true;
+    }
+
+    // Large reads go straight to the underlying stream to avoid an extra copy.
+    if (size_to_read >= read_buffer_.size()) {
+      return stream_->ReadNonBlocking(buffer, size_to_read, size_read,
+                                      end_of_stream, error);
+    }
+
+    bool eos = false;
+    if (!FillReadBuffer(&eos, error))
+      return false;
+
+    if (GetBufferedReadSize() == 0) {
+      *size_read = 0;
+      if (end_of_stream)
+        *end_of_stream = eos;
+      return true;
+    }
+  }
+
+  size_t size = std::min(size_to_read, GetBufferedReadSize());
+  std::memcpy(buffer, read_buffer_.data() + read_begin_, size);
+  ConsumeReadBuffer(size);
+  *size_read = size;
+  if (end_of_stream)
+    *end_of_stream = false;
+  return true;
+}
+
+bool BufferedStream::ReadAtBlocking(uint64_t offset,
+                                    void* buffer,
+                                    size_t size_to_read,
+                                    size_t* size_read,
+                                    ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  // The read-ahead data stays valid, the stream position doesn't change.
+  if (!PrepareForRead(error))
+    return false;
+
+  return stream_->ReadAtBlocking(offset, buffer, size_to_read, size_read,
+                                 error);
+}
+
+bool BufferedStream::WriteNonBlocking(const void* buffer,
+                                      size_t size_to_write,
+                                      size_t* size_written,
+                                      ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (!DiscardReadBuffer(error))
+    return false;
+
+  if (!async_flush_pending_) {
+    if (write_buffer_.size() + size_to_write > write_buffer_capacity_ &&
+        !DrainWriteBufferNonBlocking(error)) {
+      return false;
+    }
+    // Large writes go straight to the underlying stream once everything
+    // buffered before them has been written out.
+    if (GetBufferedWriteSize() == 0 &&
+        size_to_write >= write_buffer_capacity_) {
+      return stream_->WriteNonBlocking(buffer, size_to_write, size_written,
+                                       error);
+    }
+  }
+
+  if (write_begin_ > 0 &&
+      write_buffer_.size() + size_to_write > write_buffer_capacity_) {
+    write_buffer_.erase(write_buffer_.begin(),
+                        write_buffer_.begin() + write_begin_);
+    write_begin_ = 0;
+  }
+
+  size_t space = 0;
+  if (write_buffer_capacity_ > write_buffer_.size())
+    space = write_buffer_capacity_ - write_buffer_.size();
+  size_t size = std::min(size_to_write, space);
+  const uint8_t* data = static_cast<const uint8_t*>(buffer);
+  write_buffer_.insert(write_buffer_.end(), data, data + size);
+  *size_written = size;
+  return true;
+}
+
+bool BufferedStream::WriteAtBlocking(uint64_t offset,
+                                     const void* buffer,
+                                     size_t size_to_write,
+                                     size_t* size_written,
+                                     ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (!DrainWriteBufferBlocking(error) || !DiscardReadBuffer(error))
+    return false;
+
+  return stream_->WriteAtBlocking(offset, buffer, size_to_write, size_written,
+                                  error);
+}
+
+bool BufferedStream::FlushBlocking(ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (async_flush_pending_)
+    return ErrorAsyncFlushPending(FROM_HERE, error);
+
+  return DrainWriteBufferBlocking(error) && stream_->FlushBlocking(error);
+}
+
+bool BufferedStream::FlushAsync(const base::Closure& success_callback,
+                                const ErrorCallback& error_callback,
+                                ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (async_flush_pending_)
+    return ErrorAsyncFlushPending(FROM_HERE, error);
+
+  if (GetBufferedWriteSize() == 0)
+    return stream_->FlushAsync(success_callback, error_callback, error);
+
+  // Move the pending output aside so the caller can keep writing while it is
+  // being sent to the underlying stream.
+  write_buffer_.erase(write_buffer_.begin(),
+                      write_buffer_.begin() + write_begin_);
+  write_begin_ = 0;
+  async_flush_buffer_.swap(write_buffer_);
+  write_buffer_.reserve(write_buffer_capacity_);
+  async_flush_pending_ = true;
+
+  bool success = stream_->WriteAllAsync(
+      async_flush_buffer_.data(), async_flush_buffer_.size(),
+      base::Bind(&BufferedStream::OnFlushAsyncWriteDone,
+                 weak_ptr_factory_.GetWeakPtr(), success_callback,
+                 error_callback),
+      base::Bind(&BufferedStream::OnFlushAsyncError,
+                 weak_ptr_factory_.GetWeakPtr(), error_callback),
+      error);
+  if (!success) {
+    async_flush_buffer_.swap(write_buffer_);
+    async_flush_buffer_.clear();
+    async_flush_pending_ = false;
+  }
+  return success;
+}
+
+bool BufferedStream::CloseBlocking(ErrorPtr* error) {
+  if (!stream_)
+    return true;
+
+  bool success = true;
+  if (!async_flush_pending_ && !DrainWriteBufferBlocking(error))
+    success = false;  // Still close the underlying stream.
+  if (!stream_->CloseBlocking(error))
+    success = false;
+
+  CancelPendingAsyncOperations();
+  stream_.reset();
+  read_begin_ = read_end_ = 0;
+  write_buffer_.clear();
+  write_begin_ = 0;
+  async_flush_buffer_.clear();
+  return success;
+}
+
+bool BufferedStream::WaitForData(
+    AccessMode mode,
+    const base::Callback<void(AccessMode)>& callback,
+    ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  bool can_read =
+      stream_utils::IsReadAccessMode(mode) && GetBufferedReadSize() > 0;
+  bool can_write = stream_utils::IsWriteAccessMode(mode) &&
+                   write_buffer_.size() < write_buffer_capacity_;
+  if (can_read || can_write) {
+    MessageLoop::current()->PostTask(
+        FROM_HERE,
+        base::Bind(callback, stream_utils::MakeAccessMode(can_read,
+                                                          can_write)));
+    return true;
+  }
+  return stream_->WaitForData(mode, callback, error);
+}
+
+bool BufferedStream::WaitForDataBlocking(AccessMode in_mode,
+                                         base::TimeDelta timeout,
+                                         AccessMode* out_mode,
+                                         ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  bool can_read =
+      stream_utils::IsReadAccessMode(in_mode) && GetBufferedReadSize() > 0;
+  bool can_write = stream_utils::IsWriteAccessMode(in_mode) &&
+                   write_buffer_.size() < write_buffer_capacity_;
+  if (can_read || can_write) {
+    if (out_mode)
+      *out_mode = stream_utils::MakeAccessMode(can_read, can_write);
+    return true;
+  }
+  return stream_->WaitForDataBlocking(in_mode, timeout, out_mode, error);
+}
+
+void BufferedStream::CancelPendingAsyncOperations() {
+  if (IsOpen())
+    stream_->CancelPendingAsyncOperations();
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  if (async_flush_pending_) {
+    async_flush_buffer_.clear();
+    async_flush_pending_ = false;
+  }
+  Stream::CancelPendingAsyncOperations();
+}
+
+bool BufferedStream::FillReadBuffer(bool* end_of_stream, ErrorPtr* error) {
+  if (read_begin_ > 0) {
+    std::memmove(read_buffer_.data(), read_buffer_.data() + read_begin_,
+                 GetBufferedReadSize());
+    read_end_ -= read_begin_;
+    read_begin_ = 0;
+  }
+  size_t size_read = 0;
+  if (!stream_->ReadNonBlocking(read_buffer_.data() + read_end_,
+                                read_buffer_.size() - read_end_, &size_read,
+                                end_of_stream, error)) {
+    return false;
+  }
+  read_end_ += size_read;
+  return true;
+}
+
+void BufferedStream::ConsumeReadBuffer(size_t size) {
+  read_begin_ += size;
+  if (read_begin_ == read_end_)
+    read_begin_ = read_end_ = 0;
+}
+
+bool BufferedStream::DiscardReadBuffer(ErrorPtr* error) {
+  // Sequential duplex streams (e.g. sockets) have independent input and output
+  // channels, so the read-ahead data stays valid across writes.
+  if (GetBufferedReadSize() == 0 || !stream_->CanSeek())
+    return true;
+
+  int64_t offset = -static_cast<int64_t>(GetBufferedReadSize());
+  read_begin_ = read_end_ = 0;
+  return stream_->Seek(offset, Whence::FROM_CURRENT, nullptr, error);
+}
+
+bool BufferedStream::PrepareForRead(ErrorPtr* error) {
+  if (GetBufferedWriteSize() == 0 || !stream_->CanSeek())
+    return true;
+  if (async_flush_pending_)
+    return ErrorAsyncFlushPending(FROM_HERE, error);
+  return DrainWriteBufferBlocking(error);
+}
+
+bool BufferedStream::DrainWriteBufferNonBlocking(ErrorPtr* error) {
+  while (GetBufferedWriteSize() > 0) {
+    size_t size_written = 0;
+    if (!stream_->WriteNonBlocking(write_buffer_.data() + write_begin_,
+                                   GetBufferedWriteSize(), &size_written,
+                                   error)) {
+      return false;
+    }
+    if (size_written == 0)
+      break;
+    write_begin_ += size_written;
+  }
+  if (write_begin_ == write_buffer_.size()) {
+    write_buffer_.clear();
+    write_begin_ = 0;
+  }
+  return true;
+}
+
+bool BufferedStream::DrainWriteBufferBlocking(ErrorPtr* error) {
+  if (GetBufferedWriteSize() == 0)
+    return true;
+  if (async_flush_pending_)
+    return ErrorAsyncFlushPending(FROM_HERE, error);
+  if (!stream_->WriteAllBlocking(write_buffer_.data() + write_begin_,
+                                 GetBufferedWriteSize(), error)) {
+    return false;
+  }
+  write_buffer_.clear();
+  write_begin_ = 0;
+  return true;
+}
+
+void BufferedStream::OnFlushAsyncWriteDone(
+    const base::Closure& success_callback,
+    const ErrorCallback& error_callback) {
+  async_flush_buffer_.clear();
+  async_flush_pending_ = false;
+  // More data could have been written while the flush was in progress. If so,
+  // FlushAsync() sends it out before flushing the underlying stream.
+  ErrorPtr error;
+  if (!FlushAsync(success_callback, error_callback, &error))
+    error_callback.Run(error.get());
+}
+
+void BufferedStream::OnFlushAsyncError(const ErrorCallback& error_callback,
+                                       const Error* error) {
+  // It is unknown how much of the data has been written, so drop it.
+  async_flush_buffer_.clear();
+  async_flush_pending_ = false;
+  error_callback.Run(error);
+}
+
+}  // namespace brillo
@@ -0,0 +1,209 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_BUFFERED_STREAM_H_
+#define LIBBRILLO_BRILLO_STREAMS_BUFFERED_STREAM_H_
+
+#include <string>
+#include <vector>
+
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <brillo/brillo_export.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+// BufferedStream is a stream adapter that adds user-space read-ahead and
+// write-behind buffers on top of any other brillo::Stream.
+// Small reads are served from a read buffer that is refilled with one large
+// read from the underlying stream, and small writes are coalesced in a write
+// buffer until it fills up or the stream is explicitly flushed. Requests that
+// are at least as large as the corresponding buffer bypass it and go directly
+// to the underlying stream.
+//
+// In addition to the standard Stream interface, BufferedStream provides
+// PeekNonBlocking() to look at buffered data without consuming it and
+// ReadUntilBlocking() to read delimited records (e.g. text lines).
+//
+// Data written to a BufferedStream is not guaranteed to reach the underlying
+// stream until FlushBlocking(), FlushAsync() or CloseBlocking() is called.
+// Destroying the stream with pending output attempts a blocking flush.
+class BRILLO_EXPORT BufferedStream : public Stream {
+ public:
+  // Default size of the read-ahead and write-behind buffers.
+  static const size_t kDefaultBufferSize = 4096;
+
+  ~BufferedStream() override;
+
+  // Creates a buffered stream on top of |stream|, taking ownership of it.
+  // |read_buffer_size| and |write_buffer_size| specify the size of the
+  // respective buffers. Setting either of them to 0 disables buffering for
+  // that direction.
+  static StreamPtr Create(StreamPtr stream,
+                          size_t read_buffer_size,
+                          size_t write_buffer_size,
+                          ErrorPtr* error);
+
+  // Creates a buffered stream using the default buffer sizes.
+  static StreamPtr Create(StreamPtr stream, ErrorPtr* error);
+
+  // Copies up to |size_to_peek| bytes of the data available for reading into
+  // |buffer| without advancing the stream pointer. If the read buffer is not
+  // full, one non-blocking read from the underlying stream is attempted to
+  // top it up. At most the size of the read buffer can be peeked at.
+  // |end_of_stream| is set to true if no more data is available, which a
+  // zero-size peek can be used to check for.
+  bool PeekNonBlocking(void* buffer,
+                       size_t size_to_peek,
+                       size_t* size_peeked,
+                       bool* end_of_stream,
+                       ErrorPtr* error);
+
+  // Reads data from the stream into |data| until |delimiter| is encountered
+  // (the delimiter itself is included in |data|) or until the end of stream is
+  // reached. Blocks while waiting for more data. |data| is cleared first.
+  bool ReadUntilBlocking(char delimiter, std::string* data, ErrorPtr* error);
+
+  // Returns the number of bytes currently held in the read buffer.
+  size_t GetBufferedReadSize() const { return read_end_ - read_begin_; }
+
+  // Returns the number of bytes written but not yet passed to the underlying
+  // stream.
+  size_t GetBufferedWriteSize() const {
+    return write_buffer_.size() - write_begin_;
+  }
+
+  // == Stream capabilities ===================================================
+  bool IsOpen() const override;
+  bool CanRead() const override;
+  bool CanWrite() const override;
+  bool CanSeek() const override;
+  bool CanGetSize() const override;
+
+  // == Stream size operations ================================================
+  uint64_t GetSize() const override;
+  bool SetSizeBlocking(uint64_t size, ErrorPtr* error) override;
+  uint64_t GetRemainingSize() const override;
+
+  // == Seek operations =======================================================
+  uint64_t GetPosition() const override;
+  bool Seek(int64_t offset,
+            Whence whence,
+            uint64_t* new_position,
+            ErrorPtr* error) override;
+
+  // == Read operations =======================================================
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       ErrorPtr* error) override;
+  // Positional I/O goes straight to the underlying stream. Buffered output is
+  // written out first, and the read-ahead data is dropped before a positional
+  // write, since it might overlap.
+  bool ReadAtBlocking(uint64_t offset,
+                      void* buffer,
+                      size_t size_to_read,
+                      size_t* size_read,
+                      ErrorPtr* error) override;
+
+  // == Write operations ======================================================
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        ErrorPtr* error) override;
+  bool WriteAtBlocking(uint64_t offset,
+                       const void* buffer,
+                       size_t size_to_write,
+                       size_t* size_written,
+                       ErrorPtr* error) override;
+
+  // == Finalizing/closing streams  ===========================================
+  bool FlushBlocking(ErrorPtr* error) override;
+  // Writes the buffered output to the underlying stream asynchronously and then
+  // calls FlushAsync() on it.
+  bool FlushAsync(const base::Closure& success_callback,
+                  const ErrorCallback& error_callback,
+                  ErrorPtr* error) override;
+  bool CloseBlocking(ErrorPtr* error) override;
+
+  // == Data availability monitoring ==========================================
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   ErrorPtr* error) override;
+
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta timeout,
+                           AccessMode* out_mode,
+                           ErrorPtr* error) override;
+
+  void CancelPendingAsyncOperations() override;
+
+ private:
+  friend class BufferedStreamTest;
+
+  // Internal constructor used by the Create() factory methods.
+  BufferedStream(StreamPtr stream,
+                 size_t read_buffer_size,
+                 size_t write_buffer_size);
+
+  // Reads more data from the underlying stream into the free space of the read
+  // buffer without blocking. Unread data is moved to the front of the buffer
+  // first.
+  bool FillReadBuffer(bool* end_of_stream, ErrorPtr* error);
+
+  // Consumes |size| bytes from the front of the read buffer.
+  void ConsumeReadBuffer(size_t size);
+
+  // Discards any read-ahead data. On seekable streams the position of the
+  // underlying stream is moved back so it matches the logical position of
+  // this stream. Used before writing to or resizing a seekable stream.
+  bool DiscardReadBuffer(ErrorPtr* error);
+
+  // Makes sure that all the buffered output reaches a seekable underlying
+  // stream before data is read from it.
+  bool PrepareForRead(ErrorPtr* error);
+
+  // Passes as much of the buffered output to the underlying stream as can be
+  // written without blocking.
+  bool DrainWriteBufferNonBlocking(ErrorPtr* error);
+
+  // Writes all the buffered output to the underlying stream, blocking if
+  // necessary.
+  bool DrainWriteBufferBlocking(ErrorPtr* error);
+
+  // Completion callback for the asynchronous write started by FlushAsync().
+  void OnFlushAsyncWriteDone(const base::Closure& success_callback,
+                             const ErrorCallback& error_callback);
+  void OnFlushAsyncError(const ErrorCallback& error_callback,
+                         const Error* error);
+
+  // The underlying stream.
+  StreamPtr stream_;
+
+  // Read-ahead buffer. Unread data is in [read_begin_, read_end_).
+  std::vector<uint8_t> read_buffer_;
+  size_t read_begin_{0};
+  size_t read_end_{0};
+
+  // Write-behind buffer. Data not yet written to the underlying stream is in
+  // [write_begin_, write_buffer_.size()).
+  std::vector<uint8_t> write_buffer_;
+  size_t write_buffer_capacity_{0};
+  size_t write_begin_{0};
+
+  // Data being written to the underlying stream by FlushAsync(). While this is
+  // non-empty, new output is only appended to |write_buffer_| to preserve the
+  // order of the data.
+  std::vector<uint8_t> async_flush_buffer_;
+  bool async_flush_pending_{false};
+
+  base::WeakPtrFactory<BufferedStream> weak_ptr_factory_{this};
+  DISALLOW_COPY_AND_ASSIGN(BufferedStream);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_BUFFERED_STREAM_H_
@@ -0,0 +1,255 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/buffered_stream.h>
+
+#include <cstring>
+#include <string>
+
+#include <brillo/streams/memory_stream.h>
+#include <brillo/streams/mock_stream.h>
+#include <brillo/streams/stream_errors.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+using testing::DoAll;
+using testing::Return;
+using testing::SetArgPointee;
+using testing::StrictMock;
+using testing::_;
+
+namespace brillo {
+
+namespace {
+
+// Copies |data| into the read buffer passed to Stream::ReadNonBlocking().
+ACTION_P(ReadData, data) {
+  std::string str = data;
+  CHECK_LE(str.size(), arg1);
+  memcpy(arg0, str.data(), str.size());
+  *arg2 = str.size();
+  if (arg3)
+    *arg3 = false;
+  return true;
+}
+
+}  // anonymous namespace
+
+class BufferedStreamTest : public testing::Test {
+ public:
+  void SetUp() override {
+    mock_stream_ = new StrictMock<MockStream>{};
+    EXPECT_CALL(*mock_stream_, IsOpen()).WillRepeatedly(Return(true));
+    EXPECT_CALL(*mock_stream_, CanSeek()).WillRepeatedly(Return(false));
+    stream_.reset(new BufferedStream{StreamPtr{mock_stream_}, 16, 16});
+  }
+
+  void TearDown() override {
+    EXPECT_CALL(*mock_stream_, CloseBlocking(_)).WillOnce(Return(true));
+    EXPECT_TRUE(stream_->CloseBlocking(nullptr));
+    stream_.reset();
+  }
+
+  // Owned by |stream_|.
+  StrictMock<MockStream>* mock_stream_{nullptr};
+  std::unique_ptr<BufferedStream> stream_;
+};
+
+TEST_F(BufferedStreamTest, SmallReadsAreCoalesced) {
+  EXPECT_CALL(*mock_stream_, ReadNonBlocking(_, 16, _, _, _))
+      .WillOnce(ReadData("abcdef"));
+  char buffer[2];
+  size_t size = 0;
+  bool eos = true;
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 2, &size, &eos, nullptr));
+  EXPECT_EQ(2u, size);
+  EXPECT_FALSE(eos);
+  EXPECT_EQ("ab", std::string(buffer, size));
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 2, &size, &eos, nullptr));
+  EXPECT_EQ("cd", std::string(buffer, size));
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 2, &size, &eos, nullptr));
+  EXPECT_EQ("ef", std::string(buffer, size));
+  EXPECT_EQ(0u, stream_->GetBufferedReadSize());
+}
+
+TEST_F(BufferedStreamTest, LargeReadsBypassBuffer) {
+  char buffer[32];
+  size_t size = 0;
+  EXPECT_CALL(*mock_stream_, ReadNonBlocking(buffer, 32, _, _, _))
+      .WillOnce(ReadData("0123456789abcdefghij"));
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 32, &size, nullptr, nullptr));
+  EXPECT_EQ(20u, size);
+  EXPECT_EQ(0u, stream_->GetBufferedReadSize());
+}
+
+TEST_F(BufferedStreamTest, Peek) {
+  EXPECT_CALL(*mock_stream_, ReadNonBlocking(_, 16, _, _, _))
+      .WillOnce(ReadData("xyz"));
+  char buffer[4];
+  size_t size = 0;
+  EXPECT_TRUE(stream_->PeekNonBlocking(buffer, 2, &size, nullptr, nullptr));
+  EXPECT_EQ("xy", std::string(buffer, size));
+  EXPECT_TRUE(stream_->PeekNonBlocking(buffer, 2, &size, nullptr, nullptr));
+  EXPECT_EQ("xy", std::string(buffer, size));
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 4, &size, nullptr, nullptr));
+  EXPECT_EQ("xyz", std::string(buffer, size));
+}
+
+TEST_F(BufferedStreamTest, PeekEndOfStream) {
+  EXPECT_CALL(*mock_stream_, ReadNonBlocking(_, 16, _, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(0), SetArgPointee<3>(true),
+                      Return(true)));
+  size_t size = 1;
+  bool eos = false;
+  EXPECT_TRUE(stream_->PeekNonBlocking(nullptr, 0, &size, &eos, nullptr));
+  EXPECT_EQ(0u, size);
+  EXPECT_TRUE(eos);
+}
+
+TEST_F(BufferedStreamTest, SeekNotSupported) {
+  EXPECT_CALL(*mock_stream_, ReadNonBlocking(_, 16, _, _, _))
+      .WillOnce(ReadData("xyz"));
+  char buffer[4];
+  size_t size = 0;
+  EXPECT_TRUE(stream_->PeekNonBlocking(buffer, 1, &size, nullptr, nullptr));
+
+  ErrorPtr error;
+  EXPECT_FALSE(stream_->Seek(0, Stream::Whence::FROM_BEGIN, nullptr, &error));
+  EXPECT_EQ(errors::stream::kOperationNotSupported, error->GetCode());
+  EXPECT_EQ(3u, stream_->GetBufferedReadSize());
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 4, &size, nullptr, nullptr));
+  EXPECT_EQ("xyz", std::string(buffer, size));
+}
+
+TEST_F(BufferedStreamTest, ReadUntil) {
+  EXPECT_CALL(*mock_stream_, ReadNonBlocking(_, _, _, _, _))
+      .WillOnce(ReadData("line1\nli"))
+      .WillOnce(DoAll(SetArgPointee<2>(0), SetArgPointee<3>(false),
+                      Return(true)))
+      .WillOnce(ReadData("ne2\nlast"))
+      .WillOnce(DoAll(SetArgPointee<2>(0), SetArgPointee<3>(true),
+                      Return(true)));
+  EXPECT_CALL(*mock_stream_, WaitForDataBlocking(Stream::AccessMode::READ, _,
+                                                 _, _))
+      .WillOnce(Return(true));
+  std::string line;
+  EXPECT_TRUE(stream_->ReadUntilBlocking('\n', &line, nullptr));
+  EXPECT_EQ("line1\n", line);
+  EXPECT_TRUE(stream_->ReadUntilBlocking('\n', &line, nullptr));
+  EXPECT_EQ("line2\n", line);
+  EXPECT_TRUE(stream_->ReadUntilBlocking('\n', &line, nullptr));
+  EXPECT_EQ("last", line);
+}
+
+TEST_F(BufferedStreamTest, SmallWritesAreCoalesced) {
+  size_t size = 0;
+  EXPECT_TRUE(stream_->WriteNonBlocking("abc", 3, &size, nullptr));
+  EXPECT_EQ(3u, size);
+  EXPECT_TRUE(stream_->WriteNonBlocking("def", 3, &size, nullptr));
+  EXPECT_EQ(3u, size);
+  EXPECT_EQ(6u, stream_->GetBufferedWriteSize());
+
+  EXPECT_CALL(*mock_stream_, WriteAllBlocking(_, 6, _)).WillOnce(Return(true));
+  EXPECT_CALL(*mock_stream_, FlushBlocking(_)).WillOnce(Return(true));
+  EXPECT_TRUE(stream_->FlushBlocking(nullptr));
+  EXPECT_EQ(0u, stream_->GetBufferedWriteSize());
+}
+
+TEST_F(BufferedStreamTest, FullWriteBufferIsDrained) {
+  const std::string data(12, 'a');
+  size_t size = 0;
+  EXPECT_TRUE(stream_->WriteNonBlocking(data.data(), data.size(), &size,
+                                        nullptr));
+  EXPECT_EQ(12u, size);
+
+  // The underlying stream accepts only part of the buffered data.
+  EXPECT_CALL(*mock_stream_, WriteNonBlocking(_, 12, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(8), Return(true)));
+  EXPECT_CALL(*mock_stream_, WriteNonBlocking(_, 4, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(0), Return(true)));
+  EXPECT_TRUE(stream_->WriteNonBlocking(data.data(), data.size(), &size,
+                                        nullptr));
+  EXPECT_EQ(12u, size);
+  EXPECT_EQ(16u, stream_->GetBufferedWriteSize());
+
+  EXPECT_CALL(*mock_stream_, WriteAllBlocking(_, 16, _))
+      .WillOnce(Return(true));
+}
+
+TEST_F(BufferedStreamTest, LargeWritesBypassBuffer) {
+  const std::string data(20, 'a');
+  size_t size = 0;
+  EXPECT_CALL(*mock_stream_, WriteNonBlocking(data.data(), 20, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(20), Return(true)));
+  EXPECT_TRUE(stream_->WriteNonBlocking(data.data(), data.size(), &size,
+                                        nullptr));
+  EXPECT_EQ(20u, size);
+  EXPECT_EQ(0u, stream_->GetBufferedWriteSize());
+}
+
+TEST(BufferedStream, SeekableStream) {
+  std::string storage = "0123456789";
+  StreamPtr stream = BufferedStream::Create(
+      MemoryStream::CreateRef(&storage, nullptr), 4, 4, nullptr);
+  ASSERT_NE(nullptr, stream.get());
+
+  char buffer[2];
+  EXPECT_TRUE(stream->ReadAllBlocking(buffer, 2, nullptr));
+  EXPECT_EQ("01", std::string(buffer, 2));
+  EXPECT_EQ(2u, stream->GetPosition());
+  EXPECT_EQ(8u, stream->GetRemainingSize());
+
+  // Writing after a read must happen at the logical stream position.
+  EXPECT_TRUE(stream->WriteAllBlocking("ab", 2, nullptr));
+  EXPECT_EQ(4u, stream->GetPosition());
+  EXPECT_EQ("0123456789", storage);
+  EXPECT_TRUE(stream->ReadAllBlocking(buffer, 2, nullptr));
+  EXPECT_EQ("45", std::string(buffer, 2));
+  EXPECT_EQ("01ab456789", storage);
+
+  EXPECT_TRUE(stream->Seek(-1, Stream::Whence::FROM_CURRENT, nullptr,
+                           nullptr));
+  EXPECT_TRUE(stream->ReadAllBlocking(buffer, 2, nullptr));
+  EXPECT_EQ("56", std::string(buffer, 2));
+
+  EXPECT_TRUE(stream->SetPosition(10, nullptr));
+  EXPECT_TRUE(stream->WriteAllBlocking("X", 1, nullptr));
+  EXPECT_EQ(11u, stream->GetSize());
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+  EXPECT_EQ("01ab456789X", storage);
+}
+
+TEST(BufferedStream, PositionalIO) {
+  std::string storage = "0123456789";
+  StreamPtr stream = BufferedStream::Create(
+      MemoryStream::CreateRef(&storage, nullptr), 4, 4, nullptr);
+  ASSERT_NE(nullptr, stream.get());
+
+  // Buffered output is visible to positional reads.
+  EXPECT_TRUE(stream->WriteAllBlocking("ab", 2, nullptr));
+  char buffer[4];
+  size_t size = 0;
+  EXPECT_TRUE(stream->ReadAtBlocking(0, buffer, 4, &size, nullptr));
+  EXPECT_EQ("ab23", std::string(buffer, size));
+  EXPECT_EQ(2u, stream->GetPosition());
+
+  // Positional writes replace the read-ahead data they might overlap.
+  EXPECT_TRUE(stream->ReadAllBlocking(buffer, 1, nullptr));
+  EXPECT_EQ('2', buffer[0]);
+  EXPECT_TRUE(stream->WriteAtBlocking(3, "X", 1, &size, nullptr));
+  EXPECT_EQ(1u, size);
+  EXPECT_EQ(3u, stream->GetPosition());
+  EXPECT_TRUE(stream->ReadAllBlocking(buffer, 2, nullptr));
+  EXPECT_EQ("X4", std::string(buffer, 2));
+  EXPECT_EQ("ab2X456789", storage);
+}
+
+TEST(BufferedStream, CreateOnClosedStream) {
+  ErrorPtr error;
+  StreamPtr stream = BufferedStream::Create(nullptr, &error);
+  EXPECT_EQ(nullptr, stream.get());
+  EXPECT_EQ(errors::stream::kInvalidParameter, error->GetCode());
+}
+
+}  // namespace brillo
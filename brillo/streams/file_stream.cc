@@ -9,6 +9,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <cstring>
+#include <vector>
+
 #include <base/bind.h>
 #include <base/files/file_util.h>
 #include <base/posix/eintr_wrapper.h>
@@ -19,6 +22,9 @@
 
 namespace brillo {
 
+const size_t FileStream::kDirectIoAlignment;
+const size_t FileStream::kDirectIoBufferSize;
+
 // FileDescriptor is a helper class that serves two purposes:
 // 1. It wraps low-level system APIs (as FileDescriptorInterface) to allow
 //    mocking calls to them in tests.
@@ -28,7 +34,14 @@ namespace brillo {
 // contained file descriptor.
 class FileDescriptor : public FileStream::FileDescriptorInterface {
  public:
-  FileDescriptor(int fd, bool own) : fd_{fd}, own_{own} {}
+  // |buffered_fd|, used with OpenOptions::direct_io only, is a second
+  // descriptor of the same file opened without O_DIRECT, for the requests
+  // that can't be done with direct I/O. It is owned by this object.
+  FileDescriptor(int fd,
+                 bool own,
+                 const FileStream::OpenOptions& options,
+                 int buffered_fd = -1)
+      : fd_{fd}, own_{own}, options_(options), buffered_fd_{buffered_fd} {}
   ~FileDescriptor() override {
     if (IsOpen()) {
       Close();
@@ -38,16 +51,37 @@ class FileDescriptor : public FileStream::FileDescriptorInterface {
   // Overrides for FileStream::FileDescriptorInterface methods.
   bool IsOpen() const override { return fd_ >= 0; }
 
+  int GetFd() const override { return fd_; }
+
   ssize_t Read(void* buf, size_t nbyte) override {
-    return HANDLE_EINTR(read(fd_, buf, nbyte));
+    return DoRead(buf, nbyte, -1);
   }
 
   ssize_t Write(const void* buf, size_t nbyte) override {
-    return HANDLE_EINTR(write(fd_, buf, nbyte));
+    return DoWrite(buf, nbyte, -1);
+  }
+
+  ssize_t ReadAt(void* buf, size_t nbyte, off64_t offset) override {
+    return DoRead(buf, nbyte, offset);
+  }
+
+  ssize_t WriteAt(const void* buf, size_t nbyte, off64_t offset) override {
+    return DoWrite(buf, nbyte, offset);
   }
 
   off64_t Seek(off64_t offset, int whence) override {
-    return lseek64(fd_, offset, whence);
+    if (!options_.direct_io)
+      return lseek64(fd_, offset, whence);
+    // With direct I/O, the file position is kept in |position_| and all the
+    // requests are positional, so the position of |fd_| may be stale.
+    if (whence == SEEK_CUR) {
+      offset += position_;
+      whence = SEEK_SET;
+    }
+    off64_t res = lseek64(fd_, offset, whence);
+    if (res >= 0)
+      position_ = res;
+    return res;
   }
 
   mode_t GetFileMode() const override {
@@ -68,7 +102,25 @@ class FileDescriptor : public FileStream::FileDescriptorInterface {
     return HANDLE_EINTR(ftruncate(fd_, length));
   }
 
+  int Allocate(off64_t length) override {
+    return HANDLE_EINTR(fallocate64(fd_, 0, 0, length));
+  }
+
+  int Advise(off64_t offset, off64_t length, int advice) override {
+    // posix_fadvise() returns the error code instead of setting errno.
+    int res = posix_fadvise64(fd_, offset, length, advice);
+    if (res == 0)
+      return 0;
+    errno = res;
+    return -1;
+  }
+
   int Close() override {
+    // Clean pages are dropped from the cache right away. Dirty pages are not
+    // affected, but they will be after the kernel writes them back.
+    if (options_.drop_cache_after_write && written_end_ > 0)
+      posix_fadvise64(fd_, 0, 0, POSIX_FADV_DONTNEED);
+
     int fd = -1;
     // The stream may or may not own the file descriptor stored in |fd_|.
     // Despite that, we will need to set |fd_| to -1 when Close() finished.
@@ -76,6 +128,10 @@ class FileDescriptor : public FileStream::FileDescriptorInterface {
     // it before exiting.
     std::swap(fd, fd_);
     CancelPendingAsyncOperations();
+    if (buffered_fd_ >= 0) {
+      IGNORE_EINTR(close(buffered_fd_));
+      buffered_fd_ = -1;
+    }
     return own_ ? IGNORE_EINTR(close(fd)) : 0;
   }
 
@@ -184,6 +240,135 @@ class FileDescriptor : public FileStream::FileDescriptorInterface {
   }
 
  private:
+  // Size of the written data ranges after which the written data is dropped
+  // from the page cache with OpenOptions::drop_cache_after_write.
+  static const off64_t kWritebackWindow = 8 * 1024 * 1024;
+
+  // read()/pread64() depending on whether |offset| is specified (>= 0).
+  ssize_t RawRead(void* buf, size_t nbyte, off64_t offset) {
+    if (offset < 0)
+      return HANDLE_EINTR(read(fd_, buf, nbyte));
+    return HANDLE_EINTR(pread64(fd_, buf, nbyte, offset));
+  }
+
+  // write()/pwrite64() depending on whether |offset| is specified (>= 0).
+  ssize_t RawWrite(const void* buf, size_t nbyte, off64_t offset) {
+    if (offset < 0)
+      return HANDLE_EINTR(write(fd_, buf, nbyte));
+    return HANDLE_EINTR(pwrite64(fd_, buf, nbyte, offset));
+  }
+
+  ssize_t DoRead(void* buf, size_t nbyte, off64_t offset) {
+    if (!options_.direct_io)
+      return RawRead(buf, nbyte, offset);
+
+    off64_t position = (offset < 0) ? position_ : offset;
+    ssize_t res = 0;
+    size_t size = GetDirectIoSize(nbyte, position);
+    if (size == 0) {
+      res = HANDLE_EINTR(pread64(buffered_fd_, buf, nbyte, position));
+    } else if (IsAligned(buf)) {
+      res = HANDLE_EINTR(pread64(fd_, buf, size, position));
+    } else {
+      uint8_t* bounce_buffer = GetBounceBuffer();
+      size = std::min(size, FileStream::kDirectIoBufferSize);
+      res = HANDLE_EINTR(pread64(fd_, bounce_buffer, size, position));
+      if (res > 0)
+        memcpy(buf, bounce_buffer, res);
+    }
+    if (res > 0 && offset < 0)
+      position_ += res;
+    return res;
+  }
+
+  ssize_t DoWrite(const void* buf, size_t nbyte, off64_t offset) {
+    if (!options_.direct_io) {
+      ssize_t res = RawWrite(buf, nbyte, offset);
+      if (res > 0 && options_.drop_cache_after_write) {
+        off64_t end = (offset < 0) ? lseek64(fd_, 0, SEEK_CUR) : offset + res;
+        if (end >= 0)
+          OnDataWritten(end - res, end);
+      }
+      return res;
+    }
+
+    off64_t position = (offset < 0) ? position_ : offset;
+    ssize_t res = 0;
+    size_t size = GetDirectIoSize(nbyte, position);
+    if (size == 0) {
+      res = HANDLE_EINTR(pwrite64(buffered_fd_, buf, nbyte, position));
+    } else if (IsAligned(buf)) {
+      res = HANDLE_EINTR(pwrite64(fd_, buf, size, position));
+    } else {
+      uint8_t* bounce_buffer = GetBounceBuffer();
+      size = std::min(size, FileStream::kDirectIoBufferSize);
+      memcpy(bounce_buffer, buf, size);
+      res = HANDLE_EINTR(pwrite64(fd_, bounce_buffer, size, position));
+    }
+    if (res > 0) {
+      if (offset < 0)
+        position_ += res;
+      if (options_.drop_cache_after_write)
+        OnDataWritten(position, position + res);
+    }
+    return res;
+  }
+
+  // Returns the number of bytes of a |nbyte| request at |offset| that can be
+  // transferred with O_DIRECT, or 0 if the request must go through the page
+  // cache.
+  static size_t GetDirectIoSize(size_t nbyte, off64_t offset) {
+    if (offset % FileStream::kDirectIoAlignment != 0)
+      return 0;
+    return nbyte - nbyte % FileStream::kDirectIoAlignment;
+  }
+
+  static bool IsAligned(const void* buf) {
+    return reinterpret_cast<uintptr_t>(buf) %
+               FileStream::kDirectIoAlignment == 0;
+  }
+
+  // Returns an aligned buffer of FileStream::kDirectIoBufferSize bytes.
+  uint8_t* GetBounceBuffer() {
+    if (bounce_buffer_.empty()) {
+      bounce_buffer_.resize(FileStream::kDirectIoBufferSize +
+                            FileStream::kDirectIoAlignment);
+    }
+    uintptr_t address = reinterpret_cast<uintptr_t>(bounce_buffer_.data());
+    uintptr_t misalignment = address % FileStream::kDirectIoAlignment;
+    if (misalignment)
+      address += FileStream::kDirectIoAlignment - misalignment;
+    return reinterpret_cast<uint8_t*>(address);
+  }
+
+  // Tracks the written data for OpenOptions::drop_cache_after_write. Once
+  // kWritebackWindow bytes have been written, their writeback is started and
+  // the previous window, most likely written back by now, is dropped from the
+  // page cache. Nothing here waits for the writeback, so pages still under
+  // writeback are simply left in the cache. The hints are best-effort, so
+  // their errors are ignored.
+  void OnDataWritten(off64_t begin, off64_t end) {
+    if (written_end_ == written_begin_) {
+      written_begin_ = begin;
+      written_end_ = end;
+    } else {
+      written_begin_ = std::min(written_begin_, begin);
+      written_end_ = std::max(written_end_, end);
+    }
+    if (written_end_ - written_begin_ < kWritebackWindow)
+      return;
+
+    sync_file_range(fd_, written_begin_, written_end_ - written_begin_,
+                    SYNC_FILE_RANGE_WRITE);
+    if (writeback_end_ > writeback_begin_) {
+      posix_fadvise64(fd_, writeback_begin_, writeback_end_ - writeback_begin_,
+                      POSIX_FADV_DONTNEED);
+    }
+    writeback_begin_ = written_begin_;
+    writeback_end_ = written_end_;
+    written_begin_ = written_end_;
+  }
+
   // The actual file descriptor we are working with. Will contain -1 if the
   // file stream has been closed.
   int fd_;
@@ -202,6 +387,22 @@ class FileDescriptor : public FileStream::FileDescriptorInterface {
   MessageLoop::TaskId read_watcher_{MessageLoop::kTaskIdNull};
   MessageLoop::TaskId write_watcher_{MessageLoop::kTaskIdNull};
 
+  FileStream::OpenOptions options_;
+  // Descriptor of the same file without O_DIRECT, for unaligned requests.
+  // Turning O_DIRECT off on |fd_| instead would affect all the duplicates of
+  // the descriptor and race with concurrent positional requests.
+  int buffered_fd_;
+  // File position with OpenOptions::direct_io, see Seek().
+  off64_t position_{0};
+  // Aligned buffer for direct I/O requests, see GetBounceBuffer().
+  std::vector<uint8_t> bounce_buffer_;
+  // Written data range not yet sent to writeback, and the range whose
+  // writeback was started last (OpenOptions::drop_cache_after_write).
+  off64_t written_begin_{0};
+  off64_t written_end_{0};
+  off64_t writeback_begin_{0};
+  off64_t writeback_end_{0};
+
   DISALLOW_COPY_AND_ASSIGN(FileDescriptor);
 };
 
@@ -209,8 +410,18 @@ StreamPtr FileStream::Open(const base::FilePath& path,
                            AccessMode mode,
                            Disposition disposition,
                            ErrorPtr* error) {
-  StreamPtr stream;
+  return Open(path, mode, disposition, OpenOptions{}, error);
+}
+
+StreamPtr FileStream::Open(const base::FilePath& path,
+                           AccessMode mode,
+                           Disposition disposition,
+                           const OpenOptions& options,
+                           ErrorPtr* error) {
+  std::unique_ptr<FileStream> stream;
   int open_flags = O_CLOEXEC;
+  if (options.direct_io)
+    open_flags |= O_DIRECT;
   switch (mode) {
     case AccessMode::READ:
       open_flags |= O_RDONLY;
@@ -242,19 +453,59 @@ StreamPtr FileStream::Open(const base::FilePath& path,
   int fd = HANDLE_EINTR(open(path.value().c_str(), open_flags, creation_mode));
   if (fd < 0) {
     brillo::errors::system::AddSystemError(error, FROM_HERE, errno);
-    return stream;
+    return nullptr;
   }
   if (HANDLE_EINTR(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)) < 0) {
     brillo::errors::system::AddSystemError(error, FROM_HERE, errno);
     IGNORE_EINTR(close(fd));
-    return stream;
+    return nullptr;
   }
 
+  // Unaligned direct I/O requests go through a second descriptor of the same
+  // file opened without O_DIRECT. O_CREAT and O_TRUNC were handled above.
+  int buffered_fd = -1;
+  if (options.direct_io) {
+    int buffered_flags = open_flags & ~(O_DIRECT | O_CREAT | O_EXCL | O_TRUNC);
+    buffered_fd = HANDLE_EINTR(open(path.value().c_str(), buffered_flags));
+    struct stat file_stat;
+    struct stat buffered_stat;
+    if (buffered_fd >= 0 &&
+        (fstat(fd, &file_stat) < 0 || fstat(buffered_fd, &buffered_stat) < 0 ||
+         file_stat.st_dev != buffered_stat.st_dev ||
+         file_stat.st_ino != buffered_stat.st_ino)) {
+      // The file was replaced in between.
+      IGNORE_EINTR(close(buffered_fd));
+      buffered_fd = -1;
+      errno = ENOENT;
+    }
+    if (buffered_fd < 0) {
+      brillo::errors::system::AddSystemError(error, FROM_HERE, errno);
+      IGNORE_EINTR(close(fd));
+      return nullptr;
+    }
+  }
+
+  int advice = POSIX_FADV_NORMAL;
+  switch (options.access_pattern) {
+    case AccessPattern::NORMAL:
+      break;
+    case AccessPattern::SEQUENTIAL:
+      advice = POSIX_FADV_SEQUENTIAL;
+      break;
+    case AccessPattern::RANDOM:
+      advice = POSIX_FADV_RANDOM;
+      break;
+  }
+  // This is only a hint, so failures don't matter.
+  if (advice != POSIX_FADV_NORMAL)
+    posix_fadvise64(fd, 0, 0, advice);
+
   std::unique_ptr<FileDescriptorInterface> fd_interface{
-      new FileDescriptor{fd, true}};
+      new FileDescriptor{fd, true, options, buffered_fd}};
 
   stream.reset(new FileStream{std::move(fd_interface), mode});
-  return stream;
+  stream->preallocate_ = options.preallocate;
+  return std::move(stream);
 }
 
 StreamPtr FileStream::CreateTemporary(ErrorPtr* error) {
@@ -318,7 +569,7 @@ StreamPtr FileStream::FromFileDescriptor(int file_descriptor,
   }
 
   std::unique_ptr<FileDescriptorInterface> fd_interface{
-      new FileDescriptor{file_descriptor, own_descriptor}};
+      new FileDescriptor{file_descriptor, own_descriptor, OpenOptions{}}};
 
   stream.reset(new FileStream{std::move(fd_interface), access_mode});
   return stream;
@@ -350,6 +601,21 @@ FileStream::FileStream(std::unique_ptr<FileDescriptorInterface> fd_interface,
   }
 }
 
+bool FileStream::Prefetch(uint64_t offset, uint64_t size, ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!stream_utils::CheckInt64Overflow(FROM_HERE, offset, 0, error) ||
+      !stream_utils::CheckInt64Overflow(FROM_HERE, size, 0, error)) {
+    return false;
+  }
+
+  if (fd_interface_->Advise(offset, size, POSIX_FADV_WILLNEED) >= 0)
+    return true;
+
+  errors::system::AddSystemError(error, FROM_HERE, errno);
+  return false;
+}
+
 bool FileStream::IsOpen() const {
   return fd_interface_->IsOpen();
 }
@@ -370,6 +636,10 @@ bool FileStream::CanGetSize() const {
   return IsOpen() && can_get_size_;
 }
 
+int FileStream::GetFileDescriptor() const {
+  return IsOpen() ? fd_interface_->GetFd() : -1;
+}
+
 uint64_t FileStream::GetSize() const {
   return IsOpen() ? fd_interface_->GetSize() : 0;
 }
@@ -381,6 +651,17 @@ bool FileStream::SetSizeBlocking(uint64_t size, ErrorPtr* error) {
   if (!stream_utils::CheckInt64Overflow(FROM_HERE, size, 0, error))
     return false;
 
+  if (preallocate_ && size > GetSize()) {
+    if (fd_interface_->Allocate(size) >= 0)
+      return true;
+    // Not all file systems and kernels support fallocate(), fall back to
+    // ftruncate().
+    if (errno != EOPNOTSUPP && errno != ENOSYS) {
+      errors::system::AddSystemError(error, FROM_HERE, errno);
+      return false;
+    }
+  }
+
   if (fd_interface_->Truncate(size) >= 0)
     return true;
 
@@ -467,6 +748,27 @@ bool FileStream::ReadNonBlocking(void* buffer,
   return true;
 }
 
+bool FileStream::ReadAtBlocking(uint64_t offset,
+                                void* buffer,
+                                size_t size_to_read,
+                                size_t* size_read,
+                                ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!CanSeek())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+  if (!stream_utils::CheckInt64Overflow(FROM_HERE, offset, 0, error))
+    return false;
+
+  ssize_t read = fd_interface_->ReadAt(buffer, size_to_read, offset);
+  if (read < 0) {
+    errors::system::AddSystemError(error, FROM_HERE, errno);
+    return false;
+  }
+  *size_read = read;
+  return true;
+}
+
 bool FileStream::WriteNonBlocking(const void* buffer,
                                   size_t size_to_write,
                                   size_t* size_written,
@@ -490,6 +792,27 @@ bool FileStream::WriteNonBlocking(const void* buffer,
   return true;
 }
 
+bool FileStream::WriteAtBlocking(uint64_t offset,
+                                 const void* buffer,
+                                 size_t size_to_write,
+                                 size_t* size_written,
+                                 ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!CanSeek())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+  if (!stream_utils::CheckInt64Overflow(FROM_HERE, offset, 0, error))
+    return false;
+
+  ssize_t written = fd_interface_->WriteAt(buffer, size_to_write, offset);
+  if (written < 0) {
+    errors::system::AddSystemError(error, FROM_HERE, errno);
+    return false;
+  }
+  *size_written = written;
+  return true;
+}
+
 bool FileStream::FlushBlocking(ErrorPtr* error) {
   if (!IsOpen())
     return stream_utils::ErrorStreamClosed(FROM_HERE, error);
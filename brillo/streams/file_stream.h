@@ -30,6 +30,40 @@ class BRILLO_EXPORT FileStream : public Stream {
     TRUNCATE_EXISTING,  // Open/truncate existing file. Fail if doesn't exist.
   };
 
+  // Alignment of the file offsets, sizes and memory buffers for direct I/O.
+  static const size_t kDirectIoAlignment = 4096;
+  // Size of the aligned buffer used to stage direct I/O requests whose
+  // memory buffer is not aligned.
+  static const size_t kDirectIoBufferSize = 256 * 1024;
+
+  // Expected access pattern, passed on to the kernel with posix_fadvise().
+  enum class AccessPattern {
+    NORMAL,      // No particular pattern.
+    SEQUENTIAL,  // The file is read from start to end (more read-ahead).
+    RANDOM,      // Accesses are random (no read-ahead).
+  };
+
+  // Extra options for FileStream::Open(), mostly useful for large one-shot
+  // transfers (image copies, log rotation) that should not evict the data
+  // other processes keep in the page cache.
+  struct OpenOptions {
+    // Open the file with O_DIRECT, bypassing the page cache. The stream takes
+    // care of the alignment requirements: requests at aligned offsets go
+    // directly to the device (staged through an internal aligned buffer if the
+    // caller's buffer is not aligned), and unaligned parts such as the tail of
+    // the file go through the page cache, using a second descriptor of the
+    // file opened without O_DIRECT.
+    bool direct_io{false};
+    AccessPattern access_pattern{AccessPattern::NORMAL};
+    // Drop the written data from the page cache once it has been written back
+    // to storage, so that writing a large file doesn't fill the cache.
+    bool drop_cache_after_write{false};
+    // Allocate the storage with fallocate() when SetSizeBlocking() grows the
+    // file, so the blocks are reserved upfront (and the file is less
+    // fragmented) instead of being allocated as the data is written.
+    bool preallocate{false};
+  };
+
   // Simple interface to wrap native library calls so that they can be mocked
   // out for testing.
   struct FileDescriptorInterface {
@@ -38,12 +72,17 @@ class BRILLO_EXPORT FileStream : public Stream {
     virtual ~FileDescriptorInterface() = default;
 
     virtual bool IsOpen() const = 0;
+    virtual int GetFd() const = 0;
     virtual ssize_t Read(void* buf, size_t nbyte) = 0;
     virtual ssize_t Write(const void* buf, size_t nbyte) = 0;
+    virtual ssize_t ReadAt(void* buf, size_t nbyte, off64_t offset) = 0;
+    virtual ssize_t WriteAt(const void* buf, size_t nbyte, off64_t offset) = 0;
     virtual off64_t Seek(off64_t offset, int whence) = 0;
     virtual mode_t GetFileMode() const = 0;
     virtual uint64_t GetSize() const = 0;
     virtual int Truncate(off64_t length) const = 0;
+    virtual int Allocate(off64_t length) = 0;
+    virtual int Advise(off64_t offset, off64_t length, int advice) = 0;
     virtual int Close() = 0;
     virtual bool WaitForData(AccessMode mode,
                              const DataCallback& data_callback,
@@ -74,6 +113,13 @@ class BRILLO_EXPORT FileStream : public Stream {
                         Disposition disposition,
                         ErrorPtr* error);
 
+  // Same as above, with extra |options|.
+  static StreamPtr Open(const base::FilePath& path,
+                        AccessMode mode,
+                        Disposition disposition,
+                        const OpenOptions& options,
+                        ErrorPtr* error);
+
   // Creates a temporary unnamed file and returns a stream to it. The file will
   // be deleted when the stream is destroyed.
   static StreamPtr CreateTemporary(ErrorPtr* error);
@@ -92,12 +138,18 @@ class BRILLO_EXPORT FileStream : public Stream {
                                       bool own_descriptor,
                                       ErrorPtr* error);
 
+  // Asks the kernel to start reading |size| bytes at |offset| into the page
+  // cache in the background (POSIX_FADV_WILLNEED), so that reading them later
+  // doesn't block.
+  bool Prefetch(uint64_t offset, uint64_t size, ErrorPtr* error);
+
   // == Stream capabilities ===================================================
   bool IsOpen() const override;
   bool CanRead() const override;
   bool CanWrite() const override;
   bool CanSeek() const override;
   bool CanGetSize() const override;
+  int GetFileDescriptor() const override;
 
   // == Stream size operations ================================================
   uint64_t GetSize() const override;
@@ -118,12 +170,28 @@ class BRILLO_EXPORT FileStream : public Stream {
                        bool* end_of_stream,
                        ErrorPtr* error) override;
 
+  // Reads from the file using pread64(), without touching the file position.
+  bool ReadAtBlocking(uint64_t offset,
+                      void* buffer,
+                      size_t size_to_read,
+                      size_t* size_read,
+                      ErrorPtr* error) override;
+
   // == Write operations ======================================================
   bool WriteNonBlocking(const void* buffer,
                         size_t size_to_write,
                         size_t* size_written,
                         ErrorPtr* error) override;
 
+  // Writes to the file using pwrite64(), without touching the file position.
+  // Note that on Linux, files opened with O_APPEND ignore |offset| and always
+  // append the data.
+  bool WriteAtBlocking(uint64_t offset,
+                       const void* buffer,
+                       size_t size_to_write,
+                       size_t* size_written,
+                       ErrorPtr* error) override;
+
   // == Finalizing/closing streams  ===========================================
   bool FlushBlocking(ErrorPtr* error) override;
   bool CloseBlocking(ErrorPtr* error) override;
@@ -167,6 +235,9 @@ class BRILLO_EXPORT FileStream : public Stream {
   // Set to false for streams that have unknown size.
   bool can_get_size_{false};
 
+  // Set to use fallocate() when growing the file (OpenOptions::preallocate).
+  bool preallocate_{false};
+
   DISALLOW_COPY_AND_ASSIGN(FileStream);
 };
 
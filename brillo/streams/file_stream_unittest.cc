@@ -4,6 +4,8 @@
 
 #include <brillo/streams/file_stream.h>
 
+#include <algorithm>
+#include <fcntl.h>
 #include <limits>
 #include <numeric>
 #include <string>
@@ -12,6 +14,7 @@
 
 #include <base/files/file_util.h>
 #include <base/files/scoped_temp_dir.h>
+#include <base/logging.h>
 #include <base/message_loop/message_loop.h>
 #include <base/rand_util.h>
 #include <base/run_loop.h>
@@ -131,12 +134,17 @@ void SetToTrue(bool* target, const Error* /* error */) {
 class MockFileDescriptor : public FileStream::FileDescriptorInterface {
  public:
   MOCK_CONST_METHOD0(IsOpen, bool());
+  MOCK_CONST_METHOD0(GetFd, int());
   MOCK_METHOD2(Read, ssize_t(void*, size_t));
   MOCK_METHOD2(Write, ssize_t(const void*, size_t));
+  MOCK_METHOD3(ReadAt, ssize_t(void*, size_t, off64_t));
+  MOCK_METHOD3(WriteAt, ssize_t(const void*, size_t, off64_t));
   MOCK_METHOD2(Seek, off64_t(off64_t, int));
   MOCK_CONST_METHOD0(GetFileMode, mode_t());
   MOCK_CONST_METHOD0(GetSize, uint64_t());
   MOCK_CONST_METHOD1(Truncate, int(off64_t));
+  MOCK_METHOD1(Allocate, int(off64_t));
+  MOCK_METHOD3(Advise, int(off64_t, off64_t, int));
   MOCK_METHOD0(Flush, int());
   MOCK_METHOD0(Close, int());
   MOCK_METHOD3(WaitForData,
@@ -306,6 +314,56 @@ TEST_F(FileStreamTest, SetSizeBlocking_Fail) {
   ExpectStreamClosed(error);
 }
 
+TEST_F(FileStreamTest, SetSizeBlocking_Preallocate) {
+  stream_->preallocate_ = true;
+  EXPECT_CALL(fd_mock(), GetSize()).WillRepeatedly(Return(100));
+  EXPECT_CALL(fd_mock(), Truncate(_)).Times(0);
+  EXPECT_CALL(fd_mock(), Allocate(4096)).WillOnce(Return(0));
+  EXPECT_TRUE(stream_->SetSizeBlocking(4096, nullptr));
+  testing::Mock::VerifyAndClearExpectations(&fd_mock());
+
+  // Shrinking the file doesn't need allocation.
+  EXPECT_CALL(fd_mock(), IsOpen()).WillRepeatedly(Return(true));
+  EXPECT_CALL(fd_mock(), GetSize()).WillRepeatedly(Return(100));
+  EXPECT_CALL(fd_mock(), Allocate(_)).Times(0);
+  EXPECT_CALL(fd_mock(), Truncate(10)).WillOnce(Return(0));
+  EXPECT_TRUE(stream_->SetSizeBlocking(10, nullptr));
+  testing::Mock::VerifyAndClearExpectations(&fd_mock());
+
+  // Falls back to ftruncate() if the file system doesn't support fallocate().
+  EXPECT_CALL(fd_mock(), IsOpen()).WillRepeatedly(Return(true));
+  EXPECT_CALL(fd_mock(), GetSize()).WillRepeatedly(Return(100));
+  EXPECT_CALL(fd_mock(), Allocate(4096))
+      .WillOnce(SetErrnoAndReturn(EOPNOTSUPP, -1));
+  EXPECT_CALL(fd_mock(), Truncate(4096)).WillOnce(Return(0));
+  EXPECT_TRUE(stream_->SetSizeBlocking(4096, nullptr));
+
+  // ... or if the kernel doesn't implement it at all.
+  EXPECT_CALL(fd_mock(), Allocate(4096))
+      .WillOnce(SetErrnoAndReturn(ENOSYS, -1));
+  EXPECT_CALL(fd_mock(), Truncate(4096)).WillOnce(Return(0));
+  EXPECT_TRUE(stream_->SetSizeBlocking(4096, nullptr));
+
+  brillo::ErrorPtr error;
+  EXPECT_CALL(fd_mock(), Allocate(4096))
+      .WillOnce(SetErrnoAndReturn(ENOSPC, -1));
+  EXPECT_FALSE(stream_->SetSizeBlocking(4096, &error));
+  EXPECT_EQ(errors::system::kDomain, error->GetDomain());
+  EXPECT_EQ("ENOSPC", error->GetCode());
+}
+
+TEST_F(FileStreamTest, Prefetch) {
+  EXPECT_CALL(fd_mock(), Advise(4096, 65536, POSIX_FADV_WILLNEED))
+      .WillOnce(Return(0));
+  EXPECT_TRUE(stream_->Prefetch(4096, 65536, nullptr));
+
+  brillo::ErrorPtr error;
+  EXPECT_CALL(fd_mock(), Advise(0, 10, POSIX_FADV_WILLNEED))
+      .WillOnce(SetErrnoAndReturn(ESPIPE, -1));
+  EXPECT_FALSE(stream_->Prefetch(0, 10, &error));
+  EXPECT_EQ("ESPIPE", error->GetCode());
+}
+
 TEST_F(FileStreamTest, GetRemainingSize) {
   EXPECT_CALL(fd_mock(), Seek(0, SEEK_CUR)).WillOnce(Return(234));
   EXPECT_CALL(fd_mock(), GetSize()).WillOnce(Return(1234));
@@ -439,6 +497,40 @@ TEST_F(FileStreamTest, ReadNonBlocking_Fail) {
   EXPECT_EQ("EACCES", error->GetCode());
 }
 
+TEST_F(FileStreamTest, ReadAtBlocking) {
+  size_t size = 0;
+  // Positional reads never touch the file position.
+  EXPECT_CALL(fd_mock(), Seek(_, _)).Times(0);
+  EXPECT_CALL(fd_mock(), ReadAt(test_read_buffer_, 100, 1000))
+      .WillOnce(Return(20));
+  EXPECT_TRUE(stream_->ReadAtBlocking(1000, test_read_buffer_, 100, &size,
+                                      nullptr));
+  EXPECT_EQ(20u, size);
+
+  brillo::ErrorPtr error;
+  EXPECT_CALL(fd_mock(), ReadAt(test_read_buffer_, 100, 0))
+      .WillOnce(SetErrnoAndReturn(EIO, -1));
+  EXPECT_FALSE(stream_->ReadAtBlocking(0, test_read_buffer_, 100, &size,
+                                       &error));
+  EXPECT_EQ(errors::system::kDomain, error->GetDomain());
+  EXPECT_EQ("EIO", error->GetCode());
+
+  error.reset();
+  EXPECT_FALSE(stream_->ReadAtBlocking(kTooLargeSize, test_read_buffer_, 100,
+                                       &size, &error));
+  ExpectStreamOffsetTooLarge(error);
+}
+
+TEST_F(FileStreamTest, ReadAtBlocking_NotSeekable) {
+  CreateStream(S_IFIFO, Stream::AccessMode::READ);
+  size_t size = 0;
+  brillo::ErrorPtr error;
+  EXPECT_CALL(fd_mock(), ReadAt(_, _, _)).Times(0);
+  EXPECT_FALSE(stream_->ReadAtBlocking(0, test_read_buffer_, 100, &size,
+                                       &error));
+  EXPECT_EQ(errors::stream::kOperationNotSupported, error->GetCode());
+}
+
 TEST_F(FileStreamTest, ReadBlocking) {
   size_t size = 0;
   EXPECT_CALL(fd_mock(), Read(test_read_buffer_, 100)).WillOnce(Return(20));
@@ -570,6 +662,24 @@ TEST_F(FileStreamTest, WriteNonBlocking_Fail) {
   EXPECT_EQ("EACCES", error->GetCode());
 }
 
+TEST_F(FileStreamTest, WriteAtBlocking) {
+  size_t size = 0;
+  EXPECT_CALL(fd_mock(), Seek(_, _)).Times(0);
+  EXPECT_CALL(fd_mock(), WriteAt(test_write_buffer_, 100, 4096))
+      .WillOnce(Return(100));
+  EXPECT_TRUE(stream_->WriteAtBlocking(4096, test_write_buffer_, 100, &size,
+                                       nullptr));
+  EXPECT_EQ(100u, size);
+
+  brillo::ErrorPtr error;
+  EXPECT_CALL(fd_mock(), WriteAt(test_write_buffer_, 100, 0))
+      .WillOnce(SetErrnoAndReturn(ENOSPC, -1));
+  EXPECT_FALSE(stream_->WriteAtBlocking(0, test_write_buffer_, 100, &size,
+                                        &error));
+  EXPECT_EQ(errors::system::kDomain, error->GetDomain());
+  EXPECT_EQ("ENOSPC", error->GetCode());
+}
+
 TEST_F(FileStreamTest, WriteBlocking) {
   size_t size = 0;
   EXPECT_CALL(fd_mock(), Write(test_write_buffer_, 100)).WillOnce(Return(20));
@@ -705,6 +815,82 @@ TEST_F(FileStreamTest, CreateTemporary) {
   TestCreateFile(stream.get());
 }
 
+TEST_F(FileStreamTest, PositionalIO) {
+  StreamPtr stream = FileStream::CreateTemporary(nullptr);
+  ASSERT_NE(nullptr, stream.get());
+  const std::string data = "0123456789";
+  ASSERT_TRUE(stream->WriteAllBlocking(data.data(), data.size(), nullptr));
+  ASSERT_TRUE(stream->SetPosition(2, nullptr));
+
+  size_t size = 0;
+  EXPECT_TRUE(stream->WriteAtBlocking(12, "ab", 2, &size, nullptr));
+  EXPECT_EQ(2u, size);
+  EXPECT_EQ(14u, stream->GetSize());
+
+  char buffer[4] = {};
+  EXPECT_TRUE(stream->ReadAtBlocking(4, buffer, sizeof(buffer), &size,
+                                     nullptr));
+  EXPECT_EQ("4567", std::string(buffer, size));
+  EXPECT_TRUE(stream->ReadAtBlocking(14, buffer, sizeof(buffer), &size,
+                                     nullptr));
+  EXPECT_EQ(0u, size);
+
+  // The file position is left alone.
+  EXPECT_EQ(2u, stream->GetPosition());
+  EXPECT_TRUE(stream->ReadAllBlocking(buffer, 2, nullptr));
+  EXPECT_EQ("23", std::string(buffer, 2));
+}
+
+TEST_F(FileStreamTest, Open_Options) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.GetPath().Append(base::FilePath{"test.dat"});
+  // Use a size that is not a multiple of the direct I/O alignment, and an
+  // unaligned buffer, to go through both the direct and the buffered paths.
+  std::vector<char> buffer(3 * FileStream::kDirectIoAlignment + 1001);
+  base::RandBytes(buffer.data(), buffer.size());
+
+  FileStream::OpenOptions options;
+  options.direct_io = true;
+  options.access_pattern = FileStream::AccessPattern::SEQUENTIAL;
+  options.drop_cache_after_write = true;
+  options.preallocate = true;
+  ErrorPtr error;
+  StreamPtr stream = FileStream::Open(path, Stream::AccessMode::READ_WRITE,
+                                      FileStream::Disposition::CREATE_ALWAYS,
+                                      options, &error);
+  if (!stream && error->GetCode() == "EINVAL") {
+    LOG(WARNING) << "The file system does not support direct I/O";
+    options.direct_io = false;
+    stream = FileStream::Open(path, Stream::AccessMode::READ_WRITE,
+                              FileStream::Disposition::CREATE_ALWAYS, options,
+                              nullptr);
+  }
+  ASSERT_NE(nullptr, stream.get());
+  EXPECT_TRUE(stream->SetSizeBlocking(buffer.size() - 1, nullptr));
+  EXPECT_EQ(buffer.size() - 1, stream->GetSize());
+  EXPECT_TRUE(stream->WriteAllBlocking(buffer.data() + 1, buffer.size() - 1,
+                                       nullptr));
+  EXPECT_EQ(buffer.size() - 1, stream->GetSize());
+  EXPECT_EQ(buffer.size() - 1, stream->GetPosition());
+  // The unaligned tail didn't turn O_DIRECT off on the stream's descriptor.
+  if (options.direct_io)
+    EXPECT_NE(0, fcntl(stream->GetFileDescriptor(), F_GETFL) & O_DIRECT);
+
+  std::vector<char> buffer2(buffer.size() - 1);
+  EXPECT_TRUE(stream->SetPosition(0, nullptr));
+  EXPECT_TRUE(stream->ReadAllBlocking(buffer2.data(), buffer2.size(),
+                                      nullptr));
+  EXPECT_EQ(std::vector<char>(buffer.begin() + 1, buffer.end()), buffer2);
+  size_t size = 0;
+  EXPECT_TRUE(stream->ReadAtBlocking(FileStream::kDirectIoAlignment,
+                                     buffer2.data(), 100, &size, nullptr));
+  EXPECT_EQ(100u, size);
+  EXPECT_TRUE(std::equal(buffer2.begin(), buffer2.begin() + 100,
+                         buffer.begin() + 1 + FileStream::kDirectIoAlignment));
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+}
+
 TEST_F(FileStreamTest, OpenRead) {
   base::ScopedTempDir temp_dir;
   ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
@@ -924,6 +1110,9 @@ TEST_F(FileStreamTest, FromFileDescriptor_StdIn) {
   EXPECT_TRUE(stream->CanRead());
   EXPECT_FALSE(stream->CanSeek());
   EXPECT_FALSE(stream->CanGetSize());
+  EXPECT_EQ(STDIN_FILENO, stream->GetFileDescriptor());
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+  EXPECT_EQ(-1, stream->GetFileDescriptor());
 }
 
 TEST_F(FileStreamTest, FromFileDescriptor_StdOut) {
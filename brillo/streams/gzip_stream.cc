@@ -0,0 +1,354 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/gzip_stream.h>
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+
+#include <base/bind.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace brillo {
+
+namespace {
+
+const char kZlibErrorDomain[] = "zlib";
+
+// zlib counts the buffer sizes in uInt, which may be narrower than size_t.
+uInt ClampToUInt(size_t size) {
+  return static_cast<uInt>(
+      std::min<size_t>(size, std::numeric_limits<uInt>::max()));
+}
+
+bool AddZlibError(const base::Location& location,
+                  int code,
+                  const z_stream& zstream,
+                  ErrorPtr* error) {
+  Error::AddTo(error, location, kZlibErrorDomain, std::to_string(code),
+               zstream.msg ? zstream.msg : "zlib operation failed");
+  return false;
+}
+
+}  // anonymous namespace
+
+const size_t GzipStream::kBufferSize;
+
+GzipStream::GzipStream(StreamPtr stream, AccessMode mode)
+    : stream_{std::move(stream)},
+      mode_{mode},
+      zstream_{new z_stream{}},
+      buffer_(kBufferSize) {}
+
+GzipStream::~GzipStream() {
+  CloseBlocking(nullptr);
+  EndZStream();
+}
+
+StreamPtr GzipStream::OpenForRead(StreamPtr stream, ErrorPtr* error) {
+  if (!stream || !stream->CanRead()) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "The underlying stream must be open for reading");
+    return nullptr;
+  }
+
+  std::unique_ptr<GzipStream> gzip_stream{
+      new GzipStream{std::move(stream), AccessMode::READ}};
+  // Adding 32 to the window size enables automatic gzip/zlib header detection.
+  int ret = inflateInit2(gzip_stream->zstream_.get(), 32 + MAX_WBITS);
+  if (ret != Z_OK) {
+    AddZlibError(FROM_HERE, ret, *gzip_stream->zstream_, error);
+    gzip_stream->zstream_.reset();
+    return nullptr;
+  }
+  return std::move(gzip_stream);
+}
+
+StreamPtr GzipStream::OpenForWrite(StreamPtr stream,
+                                   int level,
+                                   ErrorPtr* error) {
+  if (!stream || !stream->CanWrite()) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "The underlying stream must be open for writing");
+    return nullptr;
+  }
+
+  std::unique_ptr<GzipStream> gzip_stream{
+      new GzipStream{std::move(stream), AccessMode::WRITE}};
+  // Adding 16 to the window size makes zlib produce a gzip header.
+  int ret = deflateInit2(gzip_stream->zstream_.get(), level, Z_DEFLATED,
+                         16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+  if (ret != Z_OK) {
+    AddZlibError(FROM_HERE, ret, *gzip_stream->zstream_, error);
+    gzip_stream->zstream_.reset();
+    return nullptr;
+  }
+  return std::move(gzip_stream);
+}
+
+bool GzipStream::IsOpen() const {
+  return zstream_ && stream_ && stream_->IsOpen();
+}
+
+bool GzipStream::CanRead() const {
+  return IsOpen() && mode_ == AccessMode::READ;
+}
+
+bool GzipStream::CanWrite() const {
+  return IsOpen() && mode_ == AccessMode::WRITE;
+}
+
+bool GzipStream::SetSizeBlocking(uint64_t /* size */, ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+uint64_t GzipStream::GetPosition() const {
+  if (!zstream_)
+    return 0;
+  return mode_ == AccessMode::READ ? zstream_->total_out : zstream_->total_in;
+}
+
+bool GzipStream::Seek(int64_t /* offset */,
+                      Whence /* whence */,
+                      uint64_t* /* new_position */,
+                      ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool GzipStream::ReadNonBlocking(void* buffer,
+                                 size_t size_to_read,
+                                 size_t* size_read,
+                                 bool* end_of_stream,
+                                 ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!CanRead())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  *size_read = 0;
+  if (end_of_stream)
+    *end_of_stream = false;
+  if (size_to_read == 0)
+    return true;
+
+  for (;;) {
+    if (zstream_end_) {
+      if (end_of_stream)
+        *end_of_stream = true;
+      return true;
+    }
+
+    if (zstream_->avail_in == 0 && !input_eos_) {
+      size_t read = 0;
+      if (!stream_->ReadNonBlocking(buffer_.data(), buffer_.size(), &read,
+                                    &input_eos_, error)) {
+        return false;
+      }
+      zstream_->next_in = buffer_.data();
+      zstream_->avail_in = static_cast<uInt>(read);
+      if (read == 0 && !input_eos_)
+        return true;  // No data available, would block.
+    }
+
+    uInt size = ClampToUInt(size_to_read);
+    zstream_->next_out = static_cast<Bytef*>(buffer);
+    zstream_->avail_out = size;
+    int ret = inflate(zstream_.get(), Z_NO_FLUSH);
+    if (ret == Z_STREAM_END)
+      zstream_end_ = true;
+    else if (ret != Z_OK && ret != Z_BUF_ERROR)
+      return AddZlibError(FROM_HERE, ret, *zstream_, error);
+
+    *size_read = size - zstream_->avail_out;
+    if (*size_read > 0)
+      return true;
+
+    if (!zstream_end_ && input_eos_ && zstream_->avail_in == 0) {
+      Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                   errors::stream::kPartialData,
+                   "Compressed data is truncated");
+      return false;
+    }
+  }
+}
+
+bool GzipStream::WriteNonBlocking(const void* buffer,
+                                  size_t size_to_write,
+                                  size_t* size_written,
+                                  ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!CanWrite())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  *size_written = 0;
+  if (!DrainOutputNonBlocking(error))
+    return false;
+  if (output_end_ == buffer_.size())
+    return true;  // The underlying stream is not accepting data, would block.
+
+  uInt size = ClampToUInt(size_to_write);
+  zstream_->next_in =
+      const_cast<Bytef*>(static_cast<const Bytef*>(buffer));
+  zstream_->avail_in = size;
+  zstream_->next_out = buffer_.data() + output_end_;
+  zstream_->avail_out = static_cast<uInt>(buffer_.size() - output_end_);
+  int ret = deflate(zstream_.get(), Z_NO_FLUSH);
+  if (ret != Z_OK && ret != Z_BUF_ERROR)
+    return AddZlibError(FROM_HERE, ret, *zstream_, error);
+
+  output_end_ = buffer_.size() - zstream_->avail_out;
+  *size_written = size - zstream_->avail_in;
+  zstream_->next_in = nullptr;
+  zstream_->avail_in = 0;
+  return DrainOutputNonBlocking(error);
+}
+
+bool GzipStream::FlushBlocking(ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (mode_ == AccessMode::WRITE && !DeflateBlocking(Z_SYNC_FLUSH, error))
+    return false;
+  return stream_->FlushBlocking(error);
+}
+
+bool GzipStream::CloseBlocking(ErrorPtr* error) {
+  if (!stream_)
+    return true;
+
+  bool success = true;
+  // Write the remaining compressed data and the gzip trailer.
+  if (IsOpen() && mode_ == AccessMode::WRITE &&
+      !DeflateBlocking(Z_FINISH, error)) {
+    success = false;  // Still close the underlying stream.
+  }
+  EndZStream();
+  if (!stream_->CloseBlocking(error))
+    success = false;
+
+  CancelPendingAsyncOperations();
+  stream_.reset();
+  return success;
+}
+
+bool GzipStream::WaitForData(
+    AccessMode mode,
+    const base::Callback<void(AccessMode)>& callback,
+    ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  bool is_reader = (mode_ == AccessMode::READ);
+  if (is_reader ? !stream_utils::IsReadAccessMode(mode)
+                : !stream_utils::IsWriteAccessMode(mode)) {
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+  }
+
+  if (IsReady()) {
+    MessageLoop::current()->PostTask(FROM_HERE, base::Bind(callback, mode_));
+    return true;
+  }
+  return stream_->WaitForData(mode_, callback, error);
+}
+
+bool GzipStream::WaitForDataBlocking(AccessMode in_mode,
+                                     base::TimeDelta timeout,
+                                     AccessMode* out_mode,
+                                     ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  bool is_reader = (mode_ == AccessMode::READ);
+  if (is_reader ? !stream_utils::IsReadAccessMode(in_mode)
+                : !stream_utils::IsWriteAccessMode(in_mode)) {
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+  }
+
+  if (IsReady()) {
+    if (out_mode)
+      *out_mode = mode_;
+    return true;
+  }
+  return stream_->WaitForDataBlocking(mode_, timeout, out_mode, error);
+}
+
+void GzipStream::CancelPendingAsyncOperations() {
+  if (IsOpen())
+    stream_->CancelPendingAsyncOperations();
+  Stream::CancelPendingAsyncOperations();
+}
+
+bool GzipStream::IsReady() const {
+  if (mode_ == AccessMode::READ)
+    return zstream_end_ || input_eos_ || zstream_->avail_in > 0;
+  return output_end_ < buffer_.size();
+}
+
+bool GzipStream::DrainOutputNonBlocking(ErrorPtr* error) {
+  while (output_begin_ < output_end_) {
+    size_t written = 0;
+    if (!stream_->WriteNonBlocking(buffer_.data() + output_begin_,
+                                   output_end_ - output_begin_, &written,
+                                   error)) {
+      return false;
+    }
+    if (written == 0)
+      break;
+    output_begin_ += written;
+  }
+
+  // Move the data that is still pending to the front of the buffer to make
+  // room for more output.
+  if (output_begin_ > 0) {
+    std::memmove(buffer_.data(), buffer_.data() + output_begin_,
+                 output_end_ - output_begin_);
+    output_end_ -= output_begin_;
+    output_begin_ = 0;
+  }
+  return true;
+}
+
+bool GzipStream::DeflateBlocking(int flush, ErrorPtr* error) {
+  if (!stream_->WriteAllBlocking(buffer_.data() + output_begin_,
+                                 output_end_ - output_begin_, error)) {
+    return false;
+  }
+  output_begin_ = output_end_ = 0;
+
+  for (;;) {
+    zstream_->next_out = buffer_.data();
+    zstream_->avail_out = static_cast<uInt>(buffer_.size());
+    int ret = deflate(zstream_.get(), flush);
+    if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+      return AddZlibError(FROM_HERE, ret, *zstream_, error);
+
+    size_t size = buffer_.size() - zstream_->avail_out;
+    if (!stream_->WriteAllBlocking(buffer_.data(), size, error))
+      return false;
+    // zlib has flushed everything once it stops filling up the whole buffer.
+    if (ret == Z_STREAM_END || (flush != Z_FINISH && zstream_->avail_out > 0))
+      return true;
+  }
+}
+
+void GzipStream::EndZStream() {
+  if (!zstream_)
+    return;
+  if (mode_ == AccessMode::READ)
+    inflateEnd(zstream_.get());
+  else
+    deflateEnd(zstream_.get());
+  zstream_.reset();
+}
+
+}  // namespace brillo
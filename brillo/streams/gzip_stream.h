@@ -0,0 +1,143 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_GZIP_STREAM_H_
+#define LIBBRILLO_BRILLO_STREAMS_GZIP_STREAM_H_
+
+#include <memory>
+#include <vector>
+
+#include <base/macros.h>
+#include <brillo/brillo_export.h>
+#include <brillo/streams/stream.h>
+
+struct z_stream_s;
+
+namespace brillo {
+
+// GzipStream is a stream adapter that compresses or decompresses data on the
+// fly while it is passed to or from another brillo::Stream.
+// A stream opened for reading (OpenForRead()) reads compressed data from the
+// underlying stream and returns the decompressed data. Both gzip and zlib
+// formats are recognized. A stream opened for writing (OpenForWrite()) accepts
+// uncompressed data and writes it to the underlying stream in gzip format.
+//
+// Non-blocking and asynchronous operations are supported as long as the
+// underlying stream supports them: WaitForData() completes as soon as data can
+// be produced or accepted without blocking, and otherwise waits on the
+// underlying stream.
+//
+// The compressed output is only complete after CloseBlocking() has been
+// called. FlushBlocking() makes all the data written so far decodable by the
+// reader (at a small cost in compression ratio).
+class BRILLO_EXPORT GzipStream : public Stream {
+ public:
+  // Size of the internal buffer for the compressed data.
+  static const size_t kBufferSize = 16 * 1024;
+
+  ~GzipStream() override;
+
+  // Creates a stream that decompresses the data read from |stream|, taking
+  // ownership of it.
+  static StreamPtr OpenForRead(StreamPtr stream, ErrorPtr* error);
+
+  // Creates a stream that compresses the data written to it and writes the
+  // result to |stream|, taking ownership of it. |level| is the zlib
+  // compression level from 0 (no compression) to 9 (best compression), or -1
+  // for the default level.
+  static StreamPtr OpenForWrite(StreamPtr stream, int level, ErrorPtr* error);
+
+  // == Stream capabilities ===================================================
+  bool IsOpen() const override;
+  bool CanRead() const override;
+  bool CanWrite() const override;
+  bool CanSeek() const override { return false; }
+  bool CanGetSize() const override { return false; }
+
+  // == Stream size operations ================================================
+  uint64_t GetSize() const override { return 0; }
+  bool SetSizeBlocking(uint64_t size, ErrorPtr* error) override;
+  uint64_t GetRemainingSize() const override { return 0; }
+
+  // == Seek operations =======================================================
+  // Returns the amount of uncompressed data read or written so far.
+  uint64_t GetPosition() const override;
+  bool Seek(int64_t offset,
+            Whence whence,
+            uint64_t* new_position,
+            ErrorPtr* error) override;
+
+  // == Read operations =======================================================
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       ErrorPtr* error) override;
+
+  // == Write operations ======================================================
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        ErrorPtr* error) override;
+
+  // == Finalizing/closing streams  ===========================================
+  bool FlushBlocking(ErrorPtr* error) override;
+  bool CloseBlocking(ErrorPtr* error) override;
+
+  // == Data availability monitoring ==========================================
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   ErrorPtr* error) override;
+
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta timeout,
+                           AccessMode* out_mode,
+                           ErrorPtr* error) override;
+
+  void CancelPendingAsyncOperations() override;
+
+ private:
+  // Internal constructor used by the OpenForRead/OpenForWrite() methods.
+  GzipStream(StreamPtr stream, AccessMode mode);
+
+  // Returns true if the next read/write call can make progress without
+  // touching the underlying stream.
+  bool IsReady() const;
+
+  // Writes as much of the pending compressed data to the underlying stream as
+  // possible without blocking.
+  bool DrainOutputNonBlocking(ErrorPtr* error);
+
+  // Compresses all the data buffered by zlib using |flush| mode and writes the
+  // result to the underlying stream, blocking if necessary.
+  bool DeflateBlocking(int flush, ErrorPtr* error);
+
+  // Releases the zlib state.
+  void EndZStream();
+
+  // The underlying stream.
+  StreamPtr stream_;
+  // READ for decompressing streams and WRITE for compressing streams.
+  AccessMode mode_;
+
+  std::unique_ptr<z_stream_s> zstream_;
+  // Set when the end of the compressed data has been reached while reading.
+  bool zstream_end_{false};
+  // Set when the underlying stream reported the end of stream.
+  bool input_eos_{false};
+
+  // Compressed data. When reading, it holds the data read from the underlying
+  // stream that hasn't been consumed by zlib yet (tracked by |zstream_|).
+  // When writing, [output_begin_, output_end_) is the data produced by zlib
+  // that hasn't been written to the underlying stream yet.
+  std::vector<uint8_t> buffer_;
+  size_t output_begin_{0};
+  size_t output_end_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(GzipStream);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_GZIP_STREAM_H_
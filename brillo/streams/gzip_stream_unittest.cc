@@ -0,0 +1,122 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/gzip_stream.h>
+
+#include <algorithm>
+#include <string>
+
+#include <brillo/streams/memory_stream.h>
+#include <brillo/streams/stream_errors.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+
+namespace {
+
+// Returns |size| bytes of poorly compressible text, so the compressed data
+// does not fit in a single internal buffer.
+std::string GenerateData(size_t size) {
+  std::string data;
+  data.reserve(size);
+  uint32_t seed = 1;
+  for (size_t i = 0; i < size; i++) {
+    seed = seed * 1103515245 + 12345;
+    data.push_back('a' + (seed >> 16) % 26);
+  }
+  return data;
+}
+
+std::string Compress(const std::string& data) {
+  std::string compressed;
+  StreamPtr stream = GzipStream::OpenForWrite(
+      MemoryStream::CreateRef(&compressed, nullptr), -1, nullptr);
+  EXPECT_NE(nullptr, stream.get());
+  // Write in odd-sized pieces to exercise the buffering.
+  for (size_t pos = 0; pos < data.size(); pos += 1000) {
+    size_t size = std::min<size_t>(1000, data.size() - pos);
+    EXPECT_TRUE(stream->WriteAllBlocking(data.data() + pos, size, nullptr));
+  }
+  EXPECT_EQ(data.size(), stream->GetPosition());
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+  return compressed;
+}
+
+bool Decompress(const std::string& compressed,
+                std::string* data,
+                ErrorPtr* error) {
+  StreamPtr stream =
+      GzipStream::OpenForRead(MemoryStream::OpenRef(compressed, nullptr),
+                              error);
+  if (!stream)
+    return false;
+  data->clear();
+  char buffer[1024];
+  size_t size = 0;
+  do {
+    if (!stream->ReadBlocking(buffer, sizeof(buffer), &size, error))
+      return false;
+    data->append(buffer, size);
+  } while (size > 0);
+  return true;
+}
+
+}  // anonymous namespace
+
+TEST(GzipStream, RoundTrip) {
+  const std::string data = GenerateData(100000);
+  std::string compressed = Compress(data);
+  ASSERT_GT(compressed.size(), GzipStream::kBufferSize);
+  EXPECT_LT(compressed.size(), data.size());
+  // Check for the gzip magic number.
+  EXPECT_EQ('\x1f', compressed[0]);
+  EXPECT_EQ('\x8b', compressed[1]);
+
+  std::string decompressed;
+  EXPECT_TRUE(Decompress(compressed, &decompressed, nullptr));
+  EXPECT_EQ(data, decompressed);
+}
+
+TEST(GzipStream, EmptyData) {
+  std::string compressed = Compress("");
+  EXPECT_FALSE(compressed.empty());
+  std::string decompressed = "x";
+  EXPECT_TRUE(Decompress(compressed, &decompressed, nullptr));
+  EXPECT_EQ("", decompressed);
+}
+
+TEST(GzipStream, TruncatedData) {
+  std::string compressed = Compress(GenerateData(1000));
+  compressed.resize(compressed.size() / 2);
+  std::string decompressed;
+  ErrorPtr error;
+  EXPECT_FALSE(Decompress(compressed, &decompressed, &error));
+  EXPECT_EQ(errors::stream::kPartialData, error->GetCode());
+}
+
+TEST(GzipStream, CorruptData) {
+  std::string decompressed;
+  ErrorPtr error;
+  EXPECT_FALSE(Decompress("not compressed data", &decompressed, &error));
+  EXPECT_EQ("zlib", error->GetDomain());
+}
+
+TEST(GzipStream, Capabilities) {
+  StreamPtr stream =
+      GzipStream::OpenForRead(MemoryStream::OpenRef("", nullptr), nullptr);
+  ASSERT_NE(nullptr, stream.get());
+  EXPECT_TRUE(stream->CanRead());
+  EXPECT_FALSE(stream->CanWrite());
+  EXPECT_FALSE(stream->CanSeek());
+  EXPECT_FALSE(stream->CanGetSize());
+
+  // A read-only stream can't be used for compression.
+  ErrorPtr error;
+  stream = GzipStream::OpenForWrite(MemoryStream::OpenRef("", nullptr), -1,
+                                    &error);
+  EXPECT_EQ(nullptr, stream.get());
+  EXPECT_EQ(errors::stream::kInvalidParameter, error->GetCode());
+}
+
+}  // namespace brillo
@@ -0,0 +1,216 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/hashing_stream.h>
+
+#include <array>
+
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace brillo {
+
+namespace {
+
+using Crc32cTable = std::array<uint32_t, 256>;
+
+// Builds the lookup table for the reflected Castagnoli polynomial.
+Crc32cTable MakeCrc32cTable() {
+  const uint32_t kPolynomial = 0x82F63B78;
+  Crc32cTable table;
+  for (uint32_t i = 0; i < table.size(); i++) {
+    uint32_t value = i;
+    for (int bit = 0; bit < 8; bit++)
+      value = (value & 1) ? (value >> 1) ^ kPolynomial : (value >> 1);
+    table[i] = value;
+  }
+  return table;
+}
+
+// Updates a running CRC32C value |crc| (0 for empty data) with |size| bytes
+// from |data|.
+uint32_t Crc32cUpdate(uint32_t crc, const uint8_t* data, size_t size) {
+  static const Crc32cTable table = MakeCrc32cTable();
+  crc = ~crc;
+  for (size_t i = 0; i < size; i++)
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+}  // anonymous namespace
+
+HashingStream::HashingStream(StreamPtr stream, Algorithm algorithm)
+    : stream_{std::move(stream)}, algorithm_{algorithm} {
+  SHA1_Init(&sha1_context_);
+  SHA256_Init(&sha256_context_);
+}
+
+std::unique_ptr<HashingStream> HashingStream::Create(StreamPtr stream,
+                                                     Algorithm algorithm,
+                                                     ErrorPtr* error) {
+  std::unique_ptr<HashingStream> hashing_stream;
+  if (!stream || !stream->IsOpen()) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "The underlying stream must be open");
+    return hashing_stream;
+  }
+  hashing_stream.reset(new HashingStream{std::move(stream), algorithm});
+  return hashing_stream;
+}
+
+Blob HashingStream::GetDigest() const {
+  Blob digest;
+  switch (algorithm_) {
+    case Algorithm::SHA1: {
+      SHA_CTX context = sha1_context_;
+      digest.resize(SHA_DIGEST_LENGTH);
+      SHA1_Final(digest.data(), &context);
+      break;
+    }
+    case Algorithm::SHA256: {
+      SHA256_CTX context = sha256_context_;
+      digest.resize(SHA256_DIGEST_LENGTH);
+      SHA256_Final(digest.data(), &context);
+      break;
+    }
+    case Algorithm::CRC32C:
+      digest = {static_cast<uint8_t>(crc32c_ >> 24),
+                static_cast<uint8_t>(crc32c_ >> 16),
+                static_cast<uint8_t>(crc32c_ >> 8),
+                static_cast<uint8_t>(crc32c_)};
+      break;
+  }
+  return digest;
+}
+
+bool HashingStream::IsOpen() const {
+  return stream_ && stream_->IsOpen();
+}
+
+bool HashingStream::CanRead() const {
+  return IsOpen() && stream_->CanRead();
+}
+
+bool HashingStream::CanWrite() const {
+  return IsOpen() && stream_->CanWrite();
+}
+
+bool HashingStream::CanGetSize() const {
+  return IsOpen() && stream_->CanGetSize();
+}
+
+uint64_t HashingStream::GetSize() const {
+  return IsOpen() ? stream_->GetSize() : 0;
+}
+
+bool HashingStream::SetSizeBlocking(uint64_t size, ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  return stream_->SetSizeBlocking(size, error);
+}
+
+uint64_t HashingStream::GetRemainingSize() const {
+  return IsOpen() ? stream_->GetRemainingSize() : 0;
+}
+
+uint64_t HashingStream::GetPosition() const {
+  return IsOpen() ? stream_->GetPosition() : 0;
+}
+
+bool HashingStream::Seek(int64_t /* offset */,
+                         Whence /* whence */,
+                         uint64_t* /* new_position */,
+                         ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool HashingStream::ReadNonBlocking(void* buffer,
+                                    size_t size_to_read,
+                                    size_t* size_read,
+                                    bool* end_of_stream,
+                                    ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (!stream_->ReadNonBlocking(buffer, size_to_read, size_read, end_of_stream,
+                                error)) {
+    return false;
+  }
+  Update(buffer, *size_read);
+  return true;
+}
+
+bool HashingStream::WriteNonBlocking(const void* buffer,
+                                     size_t size_to_write,
+                                     size_t* size_written,
+                                     ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  if (!stream_->WriteNonBlocking(buffer, size_to_write, size_written, error))
+    return false;
+  Update(buffer, *size_written);
+  return true;
+}
+
+bool HashingStream::FlushBlocking(ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  return stream_->FlushBlocking(error);
+}
+
+bool HashingStream::CloseBlocking(ErrorPtr* error) {
+  if (!stream_)
+    return true;
+
+  bool success = stream_->CloseBlocking(error);
+  CancelPendingAsyncOperations();
+  stream_.reset();
+  return success;
+}
+
+bool HashingStream::WaitForData(
+    AccessMode mode,
+    const base::Callback<void(AccessMode)>& callback,
+    ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  return stream_->WaitForData(mode, callback, error);
+}
+
+bool HashingStream::WaitForDataBlocking(AccessMode in_mode,
+                                        base::TimeDelta timeout,
+                                        AccessMode* out_mode,
+                                        ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  return stream_->WaitForDataBlocking(in_mode, timeout, out_mode, error);
+}
+
+void HashingStream::CancelPendingAsyncOperations() {
+  if (IsOpen())
+    stream_->CancelPendingAsyncOperations();
+  Stream::CancelPendingAsyncOperations();
+}
+
+void HashingStream::Update(const void* data, size_t size) {
+  if (size == 0)
+    return;
+
+  switch (algorithm_) {
+    case Algorithm::SHA1:
+      SHA1_Update(&sha1_context_, data, size);
+      break;
+    case Algorithm::SHA256:
+      SHA256_Update(&sha256_context_, data, size);
+      break;
+    case Algorithm::CRC32C:
+      crc32c_ = Crc32cUpdate(crc32c_, static_cast<const uint8_t*>(data), size);
+      break;
+  }
+  hashed_size_ += size;
+}
+
+}  // namespace brillo
@@ -0,0 +1,126 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_HASHING_STREAM_H_
+#define LIBBRILLO_BRILLO_STREAMS_HASHING_STREAM_H_
+
+#include <openssl/sha.h>
+
+#include <memory>
+
+#include <base/macros.h>
+#include <brillo/brillo_export.h>
+#include <brillo/secure_blob.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+// HashingStream is a stream adapter that computes a digest of all the data
+// that passes through it. Every byte successfully read from or written to the
+// underlying stream is fed to the hash function, so a download or a file can
+// be verified in the same pass that copies it, e.g. by wrapping the source or
+// the destination stream passed to stream_utils::CopyData().
+//
+// The digest is defined over the sequence of bytes as they were transferred,
+// so the stream is not seekable even if the underlying stream is. Data read
+// and data written are hashed together in the order of the calls; a stream is
+// normally used in one direction only.
+class BRILLO_EXPORT HashingStream : public Stream {
+ public:
+  enum class Algorithm {
+    SHA1,
+    SHA256,
+    CRC32C,  // Castagnoli CRC, digest is 4 bytes in big-endian byte order.
+  };
+
+  ~HashingStream() override = default;
+
+  // Creates a hashing stream on top of |stream|, taking ownership of it.
+  // The concrete type is returned so the digest can be queried; the result
+  // converts to a StreamPtr when the stream is handed over to other code.
+  static std::unique_ptr<HashingStream> Create(StreamPtr stream,
+                                               Algorithm algorithm,
+                                               ErrorPtr* error);
+
+  // Returns the digest of the data transferred so far. This does not reset
+  // the hash, so it can be called at any time, typically once the end of the
+  // stream has been reached or all the data has been written.
+  Blob GetDigest() const;
+
+  // Returns the number of bytes that have been hashed.
+  uint64_t GetHashedSize() const { return hashed_size_; }
+
+  Algorithm algorithm() const { return algorithm_; }
+
+  // == Stream capabilities ===================================================
+  bool IsOpen() const override;
+  bool CanRead() const override;
+  bool CanWrite() const override;
+  bool CanSeek() const override { return false; }
+  bool CanGetSize() const override;
+
+  // == Stream size operations ================================================
+  uint64_t GetSize() const override;
+  bool SetSizeBlocking(uint64_t size, ErrorPtr* error) override;
+  uint64_t GetRemainingSize() const override;
+
+  // == Seek operations =======================================================
+  uint64_t GetPosition() const override;
+  bool Seek(int64_t offset,
+            Whence whence,
+            uint64_t* new_position,
+            ErrorPtr* error) override;
+
+  // == Read operations =======================================================
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       ErrorPtr* error) override;
+
+  // == Write operations ======================================================
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        ErrorPtr* error) override;
+
+  // == Finalizing/closing streams  ===========================================
+  bool FlushBlocking(ErrorPtr* error) override;
+  bool CloseBlocking(ErrorPtr* error) override;
+
+  // == Data availability monitoring ==========================================
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   ErrorPtr* error) override;
+
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta timeout,
+                           AccessMode* out_mode,
+                           ErrorPtr* error) override;
+
+  void CancelPendingAsyncOperations() override;
+
+ private:
+  // Internal constructor used by the Create() factory method.
+  HashingStream(StreamPtr stream, Algorithm algorithm);
+
+  // Feeds |size| bytes from |data| to the hash function.
+  void Update(const void* data, size_t size);
+
+  // The underlying stream.
+  StreamPtr stream_;
+  Algorithm algorithm_;
+  uint64_t hashed_size_{0};
+
+  // Hash state. Only the member matching |algorithm_| is used.
+  SHA_CTX sha1_context_;
+  SHA256_CTX sha256_context_;
+  uint32_t crc32c_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(HashingStream);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_HASHING_STREAM_H_
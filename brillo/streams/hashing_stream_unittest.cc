@@ -0,0 +1,89 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/hashing_stream.h>
+
+#include <string>
+
+#include <base/strings/string_number_conversions.h>
+#include <brillo/streams/memory_stream.h>
+#include <brillo/streams/stream_errors.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+
+namespace {
+
+// Reads all the data from |stream| in small chunks and returns the hex-encoded
+// digest.
+std::string ReadAndHash(HashingStream* stream) {
+  char buffer[4];
+  size_t size = 0;
+  bool eos = false;
+  while (!eos) {
+    EXPECT_TRUE(stream->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                        nullptr));
+  }
+  Blob digest = stream->GetDigest();
+  return base::HexEncode(digest.data(), digest.size());
+}
+
+}  // anonymous namespace
+
+TEST(HashingStream, Read) {
+  const std::string data = "123456789";
+  auto stream = HashingStream::Create(MemoryStream::OpenRef(data, nullptr),
+                                      HashingStream::Algorithm::CRC32C,
+                                      nullptr);
+  ASSERT_NE(nullptr, stream.get());
+  EXPECT_TRUE(stream->CanRead());
+  EXPECT_FALSE(stream->CanSeek());
+  EXPECT_EQ("E3069283", ReadAndHash(stream.get()));
+  EXPECT_EQ(9u, stream->GetHashedSize());
+
+  stream = HashingStream::Create(MemoryStream::OpenRef("abc", nullptr),
+                                 HashingStream::Algorithm::SHA1, nullptr);
+  EXPECT_EQ("A9993E364706816ABA3E25717850C26C9CD0D89D",
+            ReadAndHash(stream.get()));
+
+  stream = HashingStream::Create(MemoryStream::OpenRef("abc", nullptr),
+                                 HashingStream::Algorithm::SHA256, nullptr);
+  EXPECT_EQ("BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD",
+            ReadAndHash(stream.get()));
+}
+
+TEST(HashingStream, Write) {
+  std::string output;
+  auto stream = HashingStream::Create(MemoryStream::CreateRef(&output, nullptr),
+                                      HashingStream::Algorithm::SHA256,
+                                      nullptr);
+  ASSERT_NE(nullptr, stream.get());
+  EXPECT_TRUE(stream->WriteAllBlocking("a", 1, nullptr));
+  EXPECT_TRUE(stream->WriteAllBlocking("bc", 2, nullptr));
+  // The digest can be queried without finishing the hash.
+  Blob digest = stream->GetDigest();
+  EXPECT_EQ(digest, stream->GetDigest());
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+  EXPECT_EQ("abc", output);
+  EXPECT_EQ("BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD",
+            base::HexEncode(digest.data(), digest.size()));
+}
+
+TEST(HashingStream, SeekNotSupported) {
+  auto stream = HashingStream::Create(MemoryStream::OpenRef("abc", nullptr),
+                                      HashingStream::Algorithm::SHA1, nullptr);
+  ErrorPtr error;
+  EXPECT_FALSE(stream->SetPosition(1, &error));
+  EXPECT_EQ(errors::stream::kOperationNotSupported, error->GetCode());
+}
+
+TEST(HashingStream, CreateOnClosedStream) {
+  ErrorPtr error;
+  auto stream = HashingStream::Create(nullptr, HashingStream::Algorithm::SHA1,
+                                      &error);
+  EXPECT_EQ(nullptr, stream.get());
+  EXPECT_EQ(errors::stream::kInvalidParameter, error->GetCode());
+}
+
+}  // namespace brillo
@@ -4,7 +4,11 @@
 
 #include <brillo/streams/input_stream_set.h>
 
+#include <algorithm>
+#include <cstring>
+
 #include <base/bind.h>
+#include <base/logging.h>
 #include <brillo/message_loops/message_loop.h>
 #include <brillo/streams/stream_errors.h>
 #include <brillo/streams/stream_utils.h>
@@ -15,10 +19,15 @@ InputStreamSet::InputStreamSet(
     std::vector<Stream*> source_streams,
     std::vector<StreamPtr> owned_source_streams,
     uint64_t initial_stream_size)
-    : source_streams_{std::move(source_streams)},
+    : source_streams_(source_streams.begin(), source_streams.end()),
       owned_source_streams_{std::move(owned_source_streams)},
       initial_stream_size_{initial_stream_size} {}
 
+InputStreamSet::~InputStreamSet() {
+  // Make sure a pending read-ahead doesn't write to the freed buffer.
+  ResetReadAhead();
+}
+
 StreamPtr InputStreamSet::Create(std::vector<Stream*> source_streams,
                                  std::vector<StreamPtr> owned_source_streams,
                                  ErrorPtr* error) {
@@ -69,6 +78,11 @@ StreamPtr InputStreamSet::Create(std::vector<StreamPtr> owned_source_streams,
                 error);
 }
 
+void InputStreamSet::EnableReadAhead(size_t size) {
+  // A read-ahead already in progress is allowed to complete.
+  read_ahead_size_ = size;
+}
+
 bool InputStreamSet::IsOpen() const {
   return !closed_;
 }
@@ -96,7 +110,8 @@ uint64_t InputStreamSet::GetRemainingSize() const {
   uint64_t size = 0;
   for (const Stream* stream : source_streams_)
     size += stream->GetRemainingSize();
-  return size;
+  // Data read ahead is no longer accounted for by its source stream.
+  return size + read_ahead_end_ - read_ahead_begin_;
 }
 
 bool InputStreamSet::Seek(int64_t /* offset */,
@@ -117,16 +132,23 @@ bool InputStreamSet::ReadNonBlocking(void* buffer,
   while (!source_streams_.empty()) {
     Stream* stream = source_streams_.front();
     bool eos = false;
-    if (!stream->ReadNonBlocking(buffer, size_to_read, size_read, &eos, error))
+    if (stream == read_ahead_stream_) {
+      if (!ReadFromReadAhead(buffer, size_to_read, size_read, &eos, error))
+        return false;
+    } else if (!stream->ReadNonBlocking(buffer, size_to_read, size_read, &eos,
+                                        error)) {
       return false;
+    }
 
     if (*size_read > 0 || !eos) {
       if (end_of_stream)
         *end_of_stream = false;
+      // Prepare the next stream while this one is being drained.
+      StartReadAhead();
       return true;
     }
 
-    source_streams_.erase(source_streams_.begin());
+    source_streams_.pop_front();
   }
   *size_read = 0;
   if (end_of_stream)
@@ -142,6 +164,10 @@ bool InputStreamSet::WriteNonBlocking(const void* /* buffer */,
 }
 
 bool InputStreamSet::CloseBlocking(ErrorPtr* error) {
+  ResetReadAhead();
+  read_ahead_buffer_.clear();
+  read_ahead_buffer_.shrink_to_fit();
+
   bool success = true;
   // We want to close only the owned streams.
   for (StreamPtr& stream_ptr : owned_source_streams_) {
@@ -165,7 +191,14 @@ bool InputStreamSet::WaitForData(
   if (stream_utils::IsWriteAccessMode(mode))
     return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
 
-  if (!source_streams_.empty()) {
+  if (IsWaitingForReadAhead()) {
+    read_ahead_wait_callback_ = callback;
+    return true;
+  }
+
+  // When the front stream has been read ahead, its data (or error) is ready.
+  if (!source_streams_.empty() &&
+      source_streams_.front() != read_ahead_stream_) {
     Stream* stream = source_streams_.front();
     return stream->WaitForData(mode, callback, error);
   }
@@ -184,7 +217,13 @@ bool InputStreamSet::WaitForDataBlocking(AccessMode in_mode,
   if (stream_utils::IsWriteAccessMode(in_mode))
     return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
 
-  if (!source_streams_.empty()) {
+  // Nothing has been read ahead while the read-ahead is pending, so it can be
+  // dropped to wait on the stream directly, without running the message loop.
+  if (IsWaitingForReadAhead())
+    ResetReadAhead();
+
+  if (!source_streams_.empty() &&
+      source_streams_.front() != read_ahead_stream_) {
     Stream* stream = source_streams_.front();
     return stream->WaitForDataBlocking(in_mode, timeout, out_mode, error);
   }
@@ -195,11 +234,148 @@ bool InputStreamSet::WaitForDataBlocking(AccessMode in_mode,
 }
 
 void InputStreamSet::CancelPendingAsyncOperations() {
-  if (IsOpen() && !source_streams_.empty()) {
+  read_ahead_wait_callback_.Reset();
+  // The read-ahead itself is not affected, its data will still be needed.
+  if (IsOpen() && !source_streams_.empty() &&
+      source_streams_.front() != read_ahead_stream_) {
     Stream* stream = source_streams_.front();
     stream->CancelPendingAsyncOperations();
   }
   Stream::CancelPendingAsyncOperations();
 }
 
+void InputStreamSet::StartReadAhead() {
+  if (read_ahead_size_ == 0 || read_ahead_stream_ ||
+      source_streams_.size() < 2) {
+    return;
+  }
+
+  read_ahead_stream_ = source_streams_[1];
+  read_ahead_buffer_.resize(read_ahead_size_);
+  read_ahead_begin_ = 0;
+  read_ahead_end_ = 0;
+  read_ahead_eos_ = false;
+  read_ahead_state_ = ReadAheadState::PENDING;
+  ErrorPtr error;
+  if (!read_ahead_stream_->WaitForData(
+          AccessMode::READ,
+          base::Bind(&InputStreamSet::OnReadAheadAvailable,
+                     weak_ptr_factory_.GetWeakPtr()),
+          &error)) {
+    // Read-ahead is only an optimization. The stream will be read directly
+    // once it becomes current.
+    VLOG(1) << "Failed to start reading ahead from the next source stream";
+    read_ahead_state_ = ReadAheadState::DONE;
+  }
+}
+
+bool InputStreamSet::ReadFromReadAhead(void* buffer,
+                                       size_t size_to_read,
+                                       size_t* size_read,
+                                       bool* end_of_stream,
+                                       ErrorPtr* error) {
+  *size_read = 0;
+  *end_of_stream = false;
+  switch (read_ahead_state_) {
+    case ReadAheadState::PENDING:
+      return true;  // Would block until the read-ahead completes.
+
+    case ReadAheadState::FAILED:
+      if (error)
+        *error = std::move(read_ahead_error_);
+      ResetReadAhead();
+      return false;
+
+    case ReadAheadState::DONE:
+      if (read_ahead_begin_ < read_ahead_end_) {
+        *size_read =
+            std::min(size_to_read, read_ahead_end_ - read_ahead_begin_);
+        std::memcpy(buffer, read_ahead_buffer_.data() + read_ahead_begin_,
+                    *size_read);
+        read_ahead_begin_ += *size_read;
+        return true;
+      }
+      if (read_ahead_eos_) {
+        *end_of_stream = true;
+        ResetReadAhead();
+        return true;
+      }
+      break;
+
+    case ReadAheadState::NONE:
+      NOTREACHED();
+      break;
+  }
+
+  // All the data read ahead has been consumed, read the stream directly.
+  Stream* stream = read_ahead_stream_;
+  ResetReadAhead();
+  return stream->ReadNonBlocking(buffer, size_to_read, size_read,
+                                 end_of_stream, error);
+}
+
+bool InputStreamSet::IsWaitingForReadAhead() const {
+  return !source_streams_.empty() &&
+         source_streams_.front() == read_ahead_stream_ &&
+         read_ahead_state_ == ReadAheadState::PENDING;
+}
+
+void InputStreamSet::OnReadAheadAvailable(AccessMode /* mode */) {
+  size_t size_read = 0;
+  bool eos = false;
+  ErrorPtr error;
+  if (!read_ahead_stream_->ReadNonBlocking(read_ahead_buffer_.data(),
+                                           read_ahead_buffer_.size(),
+                                           &size_read, &eos, &error)) {
+    OnReadAheadError(error.get());
+    return;
+  }
+  if (size_read == 0 && !eos) {
+    if (!read_ahead_stream_->WaitForData(
+            AccessMode::READ,
+            base::Bind(&InputStreamSet::OnReadAheadAvailable,
+                       weak_ptr_factory_.GetWeakPtr()),
+            &error)) {
+      OnReadAheadError(error.get());
+    }
+    return;
+  }
+  OnReadAheadDone(size_read, eos);
+}
+
+void InputStreamSet::OnReadAheadDone(size_t size_read, bool eos) {
+  read_ahead_state_ = ReadAheadState::DONE;
+  read_ahead_end_ = size_read;
+  read_ahead_eos_ = eos;
+  if (!read_ahead_wait_callback_.is_null()) {
+    base::Callback<void(AccessMode)> callback = read_ahead_wait_callback_;
+    read_ahead_wait_callback_.Reset();
+    callback.Run(AccessMode::READ);
+  }
+}
+
+void InputStreamSet::OnReadAheadError(const Error* error) {
+  read_ahead_state_ = ReadAheadState::FAILED;
+  read_ahead_error_ = error ? error->Clone() : nullptr;
+  if (!read_ahead_wait_callback_.is_null()) {
+    base::Callback<void(AccessMode)> callback = read_ahead_wait_callback_;
+    read_ahead_wait_callback_.Reset();
+    callback.Run(AccessMode::READ);
+  }
+}
+
+void InputStreamSet::ResetReadAhead() {
+  if (read_ahead_state_ == ReadAheadState::PENDING) {
+    read_ahead_stream_->CancelPendingAsyncOperations();
+    weak_ptr_factory_.InvalidateWeakPtrs();
+  }
+  read_ahead_stream_ = nullptr;
+  read_ahead_state_ = ReadAheadState::NONE;
+  read_ahead_begin_ = 0;
+  read_ahead_end_ = 0;
+  read_ahead_eos_ = false;
+  read_ahead_error_.reset();
+  read_ahead_wait_callback_.Reset();
+}
+
 }  // namespace brillo
@@ -5,9 +5,11 @@
 #ifndef LIBBRILLO_BRILLO_STREAMS_INPUT_STREAM_SET_H_
 #define LIBBRILLO_BRILLO_STREAMS_INPUT_STREAM_SET_H_
 
+#include <deque>
 #include <vector>
 
 #include <base/macros.h>
+#include <base/memory/weak_ptr.h>
 #include <brillo/brillo_export.h>
 #include <brillo/streams/stream.h>
 
@@ -28,8 +30,15 @@ namespace brillo {
 // Referenced source streams' life time is maintained elsewhere and they must
 // be valid for the duration of InputStreamSet's life. Closing the
 // muliplexer stream does not close the referenced streams.
+//
+// With read-ahead enabled (see EnableReadAhead()), the beginning of the next
+// source stream is read asynchronously while the current one is being read,
+// so that moving from one source to the next doesn't stall on slow storage or
+// remote streams.
 class BRILLO_EXPORT InputStreamSet : public Stream {
  public:
+  ~InputStreamSet() override;
+
   // == Construction ==========================================================
 
   // Generic method that constructs a multiplexer stream on a list of source
@@ -57,6 +66,16 @@ class BRILLO_EXPORT InputStreamSet : public Stream {
   static StreamPtr Create(std::vector<StreamPtr> owned_source_streams,
                           ErrorPtr* error);
 
+  // Enables reading up to |size| bytes from the next source stream from the
+  // message loop while the current one is being read. The data is kept in an
+  // internal buffer until the current stream reaches its end. Passing 0
+  // disables read-ahead (the default).
+  // Read-ahead requires a MessageLoop on the current thread, and the source
+  // streams must not be read asynchronously by anyone else. A read-ahead that
+  // hasn't received any data yet when WaitForDataBlocking() is called is
+  // dropped, and the source stream is waited on directly.
+  void EnableReadAhead(size_t size);
+
   // == Stream capabilities ===================================================
   bool IsOpen() const override;
   bool CanRead() const override { return true; }
@@ -108,13 +127,42 @@ class BRILLO_EXPORT InputStreamSet : public Stream {
  private:
   friend class InputStreamSetTest;
 
+  // State of the read-ahead on |read_ahead_stream_|.
+  enum class ReadAheadState { NONE, PENDING, DONE, FAILED };
+
   // Internal constructor used by the Create() factory methods.
   InputStreamSet(std::vector<Stream*> source_streams,
                  std::vector<StreamPtr> owned_source_streams,
                  uint64_t initial_stream_size);
 
+  // Starts reading ahead from the next source stream, if enabled and not done
+  // yet.
+  void StartReadAhead();
+
+  // Reads from the front source stream while it is being read ahead: returns
+  // the read-ahead data first, then switches back to reading the stream
+  // directly.
+  bool ReadFromReadAhead(void* buffer,
+                         size_t size_to_read,
+                         size_t* size_read,
+                         bool* end_of_stream,
+                         ErrorPtr* error);
+
+  // Returns true if the read-ahead of the front source stream is in progress.
+  bool IsWaitingForReadAhead() const;
+
+  // Called when |read_ahead_stream_| has data to read ahead. The data is
+  // only read from the stream once available, so that a pending read-ahead
+  // can be dropped without losing any.
+  void OnReadAheadAvailable(AccessMode mode);
+  void OnReadAheadDone(size_t size_read, bool eos);
+  void OnReadAheadError(const Error* error);
+
+  // Stops any read-ahead in progress and frees its buffer.
+  void ResetReadAhead();
+
   // List of streams to read data from.
-  std::vector<Stream*> source_streams_;
+  std::deque<Stream*> source_streams_;
 
   // List of source streams this stream owns. Owned source streams will be
   // closed when InputStreamSet::CloseBlocking() is called and will be
@@ -124,6 +172,23 @@ class BRILLO_EXPORT InputStreamSet : public Stream {
   uint64_t initial_stream_size_{0};
   bool closed_{false};
 
+  // Read-ahead settings and state. |read_ahead_stream_| is the source stream
+  // being read ahead (the one after the front stream, until the front stream
+  // is done), and [read_ahead_begin_, read_ahead_end_) is the data from it
+  // still in |read_ahead_buffer_|.
+  size_t read_ahead_size_{0};
+  Stream* read_ahead_stream_{nullptr};
+  ReadAheadState read_ahead_state_{ReadAheadState::NONE};
+  std::vector<uint8_t> read_ahead_buffer_;
+  size_t read_ahead_begin_{0};
+  size_t read_ahead_end_{0};
+  bool read_ahead_eos_{false};
+  ErrorPtr read_ahead_error_;
+  // Callback to run once the read-ahead completes, set by WaitForData().
+  base::Callback<void(AccessMode)> read_ahead_wait_callback_;
+
+  base::WeakPtrFactory<InputStreamSet> weak_ptr_factory_{this};
+
   DISALLOW_COPY_AND_ASSIGN(InputStreamSet);
 };
 
@@ -4,6 +4,9 @@
 
 #include <brillo/streams/input_stream_set.h>
 
+#include <cstring>
+#include <string>
+
 #include <brillo/errors/error_codes.h>
 #include <brillo/streams/mock_stream.h>
 #include <brillo/streams/stream_errors.h>
@@ -13,7 +16,9 @@
 using testing::An;
 using testing::DoAll;
 using testing::InSequence;
+using testing::Invoke;
 using testing::Return;
+using testing::SaveArg;
 using testing::SetArgPointee;
 using testing::StrictMock;
 using testing::_;
@@ -167,4 +172,108 @@ TEST_F(InputStreamSetTest, ReadBlocking) {
   EXPECT_EQ(0, read);
 }
 
+TEST_F(InputStreamSetTest, ReadAhead) {
+  stream_->EnableReadAhead(50);
+  char buffer[100];
+  size_t read = 0;
+  bool eos = false;
+  base::Callback<void(Stream::AccessMode)> read_ahead_callback;
+
+  // Reading from the first stream starts reading ahead from the second one.
+  EXPECT_CALL(*itf1_, ReadNonBlocking(buffer, 100, _, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(10),
+                      SetArgPointee<3>(false),
+                      Return(true)));
+  EXPECT_CALL(*itf2_, WaitForData(Stream::AccessMode::READ, _, _))
+      .WillOnce(DoAll(SaveArg<1>(&read_ahead_callback), Return(true)));
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 100, &read, &eos, nullptr));
+  EXPECT_EQ(10, read);
+  EXPECT_FALSE(eos);
+  testing::Mock::VerifyAndClearExpectations(itf2_.get());
+
+  // The first stream ends before the read-ahead completes, so the read would
+  // block and WaitForData() waits for the read-ahead.
+  EXPECT_CALL(*itf1_, ReadNonBlocking(buffer, 100, _, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(0), SetArgPointee<3>(true),
+                      Return(true)));
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 100, &read, &eos, nullptr));
+  EXPECT_EQ(0, read);
+  EXPECT_FALSE(eos);
+  bool data_available = false;
+  EXPECT_TRUE(stream_->WaitForData(
+      Stream::AccessMode::READ,
+      base::Bind([](bool* data_available, Stream::AccessMode /* mode */) {
+        *data_available = true;
+      }, &data_available),
+      nullptr));
+  EXPECT_FALSE(data_available);
+
+  // The data is read once the second stream has some.
+  const std::string data = "read ahead data";
+  EXPECT_CALL(*itf2_, ReadNonBlocking(_, 50, _, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(0), SetArgPointee<3>(false),
+                      Return(true)))
+      .WillOnce(DoAll(Invoke([&data](void* buffer, size_t, size_t*, bool*,
+                                     ErrorPtr*) {
+                        std::memcpy(buffer, data.data(), data.size());
+                      }),
+                      SetArgPointee<2>(data.size()),
+                      SetArgPointee<3>(false),
+                      Return(true)));
+  EXPECT_CALL(*itf2_, WaitForData(Stream::AccessMode::READ, _, _))
+      .WillOnce(Return(true));
+  read_ahead_callback.Run(Stream::AccessMode::READ);
+  EXPECT_FALSE(data_available);
+  read_ahead_callback.Run(Stream::AccessMode::READ);
+  EXPECT_TRUE(data_available);
+  // The data read ahead counts as remaining.
+  EXPECT_CALL(*itf2_, GetRemainingSize()).WillOnce(Return(5));
+  EXPECT_EQ(5 + data.size(), stream_->GetRemainingSize());
+
+  // The data read ahead is returned first, then the stream is read directly.
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 100, &read, &eos, nullptr));
+  EXPECT_EQ(data, std::string(buffer, read));
+  EXPECT_FALSE(eos);
+
+  EXPECT_CALL(*itf2_, ReadNonBlocking(buffer, 100, _, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(0), SetArgPointee<3>(true),
+                      Return(true)));
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 100, &read, &eos, nullptr));
+  EXPECT_EQ(0, read);
+  EXPECT_TRUE(eos);
+}
+
+TEST_F(InputStreamSetTest, WaitForDataBlockingDuringReadAhead) {
+  stream_->EnableReadAhead(50);
+  char buffer[100];
+  size_t read = 0;
+  bool eos = false;
+
+  EXPECT_CALL(*itf1_, ReadNonBlocking(buffer, 100, _, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(10), SetArgPointee<3>(false),
+                      Return(true)))
+      .WillOnce(DoAll(SetArgPointee<2>(0), SetArgPointee<3>(true),
+                      Return(true)));
+  EXPECT_CALL(*itf2_, WaitForData(Stream::AccessMode::READ, _, _))
+      .WillOnce(Return(true));
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 100, &read, &eos, nullptr));
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 100, &read, &eos, nullptr));
+  EXPECT_EQ(0, read);
+  EXPECT_FALSE(eos);
+
+  // The pending read-ahead is dropped and the second stream is waited on
+  // directly, without any message loop.
+  EXPECT_CALL(*itf2_, WaitForDataBlocking(Stream::AccessMode::READ, _, _, _))
+      .WillOnce(Return(true));
+  EXPECT_TRUE(stream_->WaitForDataBlocking(Stream::AccessMode::READ,
+                                           base::TimeDelta::Max(), nullptr,
+                                           nullptr));
+
+  EXPECT_CALL(*itf2_, ReadNonBlocking(buffer, 100, _, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(20), SetArgPointee<3>(false),
+                      Return(true)));
+  EXPECT_TRUE(stream_->ReadNonBlocking(buffer, 100, &read, &eos, nullptr));
+  EXPECT_EQ(20, read);
+}
+
 }  // namespace brillo
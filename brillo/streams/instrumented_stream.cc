@@ -0,0 +1,403 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/instrumented_stream.h>
+
+#include <set>
+
+#include <base/bind.h>
+#include <base/format_macros.h>
+#include <base/lazy_instance.h>
+#include <base/logging.h>
+#include <base/strings/stringprintf.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace brillo {
+
+namespace {
+
+// Keeps track of the live instrumented streams and of the statistics of the
+// streams that have been destroyed.
+class StreamRegistry {
+ public:
+  using Stats = InstrumentedStream::Stats;
+
+  StreamRegistry() = default;
+
+  void Register(InstrumentedStream* stream) {
+    base::AutoLock lock(lock_);
+    streams_.insert(stream);
+  }
+
+  // Removes |stream| from the registry, keeping its final |stats|.
+  void Unregister(InstrumentedStream* stream, const Stats& stats) {
+    base::AutoLock lock(lock_);
+    streams_.erase(stream);
+    retired_stats_[stream->name()].Add(stats);
+  }
+
+  std::map<std::string, Stats> GetStats() {
+    base::AutoLock lock(lock_);
+    std::map<std::string, Stats> stats = retired_stats_;
+    for (const InstrumentedStream* stream : streams_)
+      stats[stream->name()].Add(stream->GetStats());
+    return stats;
+  }
+
+  void Reset() {
+    base::AutoLock lock(lock_);
+    retired_stats_.clear();
+  }
+
+ private:
+  base::Lock lock_;
+  std::set<InstrumentedStream*> streams_;
+  std::map<std::string, Stats> retired_stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(StreamRegistry);
+};
+
+base::LazyInstance<StreamRegistry>::Leaky g_registry =
+    LAZY_INSTANCE_INITIALIZER;
+
+}  // anonymous namespace
+
+void InstrumentedStream::Stats::Add(const Stats& other) {
+  streams += other.streams;
+  bytes_read += other.bytes_read;
+  bytes_written += other.bytes_written;
+  read_calls += other.read_calls;
+  write_calls += other.write_calls;
+  read_would_block += other.read_would_block;
+  write_would_block += other.write_would_block;
+  flush_calls += other.flush_calls;
+  wait_calls += other.wait_calls;
+  wait_time += other.wait_time;
+  for (const auto& pair : other.errors)
+    errors[pair.first] += pair.second;
+}
+
+InstrumentedStream::InstrumentedStream(StreamPtr stream,
+                                       const std::string& name)
+    : stream_{std::move(stream)}, name_{name} {
+  stats_.streams = 1;
+  g_registry.Get().Register(this);
+}
+
+InstrumentedStream::~InstrumentedStream() {
+  g_registry.Get().Unregister(this, GetStats());
+}
+
+std::unique_ptr<InstrumentedStream> InstrumentedStream::Create(
+    StreamPtr stream,
+    const std::string& name,
+    ErrorPtr* error) {
+  std::unique_ptr<InstrumentedStream> instrumented_stream;
+  if (!stream || !stream->IsOpen()) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "The underlying stream must be open");
+    return instrumented_stream;
+  }
+  instrumented_stream.reset(new InstrumentedStream{std::move(stream), name});
+  return instrumented_stream;
+}
+
+InstrumentedStream::Stats InstrumentedStream::GetStats() const {
+  base::AutoLock lock(stats_lock_);
+  return stats_;
+}
+
+std::map<std::string, InstrumentedStream::Stats>
+InstrumentedStream::GetRegistryStats() {
+  return g_registry.Get().GetStats();
+}
+
+std::string InstrumentedStream::DumpRegistryStats() {
+  std::string dump;
+  for (const auto& pair : GetRegistryStats()) {
+    const Stats& stats = pair.second;
+    base::StringAppendF(
+        &dump,
+        "%s: streams=%" PRIu64 " read=%" PRIu64 "B/%" PRIu64
+        " calls (%" PRIu64 " EAGAIN) written=%" PRIu64 "B/%" PRIu64
+        " calls (%" PRIu64 " EAGAIN) flushes=%" PRIu64 " waits=%" PRIu64
+        " (%" PRId64 " ms)",
+        pair.first.c_str(), stats.streams, stats.bytes_read, stats.read_calls,
+        stats.read_would_block, stats.bytes_written, stats.write_calls,
+        stats.write_would_block, stats.flush_calls, stats.wait_calls,
+        stats.wait_time.InMilliseconds());
+    for (const auto& error : stats.errors) {
+      base::StringAppendF(&dump, " %s=%" PRIu64, error.first.c_str(),
+                          error.second);
+    }
+    dump += '\n';
+  }
+  return dump;
+}
+
+void InstrumentedStream::LogRegistryStats() {
+  LOG(INFO) << "Stream statistics:\n" << DumpRegistryStats();
+}
+
+void InstrumentedStream::ResetRegistryStats() {
+  g_registry.Get().Reset();
+}
+
+bool InstrumentedStream::IsOpen() const {
+  return stream_ && stream_->IsOpen();
+}
+
+bool InstrumentedStream::CanRead() const {
+  return IsOpen() && stream_->CanRead();
+}
+
+bool InstrumentedStream::CanWrite() const {
+  return IsOpen() && stream_->CanWrite();
+}
+
+bool InstrumentedStream::CanSeek() const {
+  return IsOpen() && stream_->CanSeek();
+}
+
+bool InstrumentedStream::CanGetSize() const {
+  return IsOpen() && stream_->CanGetSize();
+}
+
+uint64_t InstrumentedStream::GetSize() const {
+  return IsOpen() ? stream_->GetSize() : 0;
+}
+
+bool InstrumentedStream::SetSizeBlocking(uint64_t size, ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  ErrorPtr local_error;
+  ErrorPtr* out_error = error ? error : &local_error;
+  if (stream_->SetSizeBlocking(size, out_error))
+    return true;
+  base::AutoLock lock(stats_lock_);
+  RecordError(out_error->get());
+  return false;
+}
+
+uint64_t InstrumentedStream::GetRemainingSize() const {
+  return IsOpen() ? stream_->GetRemainingSize() : 0;
+}
+
+uint64_t InstrumentedStream::GetPosition() const {
+  return IsOpen() ? stream_->GetPosition() : 0;
+}
+
+bool InstrumentedStream::Seek(int64_t offset,
+                              Whence whence,
+                              uint64_t* new_position,
+                              ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  ErrorPtr local_error;
+  ErrorPtr* out_error = error ? error : &local_error;
+  if (stream_->Seek(offset, whence, new_position, out_error))
+    return true;
+  base::AutoLock lock(stats_lock_);
+  RecordError(out_error->get());
+  return false;
+}
+
+bool InstrumentedStream::ReadNonBlocking(void* buffer,
+                                         size_t size_to_read,
+                                         size_t* size_read,
+                                         bool* end_of_stream,
+                                         ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  ErrorPtr local_error;
+  ErrorPtr* out_error = error ? error : &local_error;
+  // |end_of_stream| may be nullptr, but the flag is needed to tell an empty
+  // read at the end of the stream from one that would block.
+  bool eos = false;
+  bool success = stream_->ReadNonBlocking(buffer, size_to_read, size_read,
+                                          &eos, out_error);
+  if (end_of_stream)
+    *end_of_stream = eos;
+  base::AutoLock lock(stats_lock_);
+  stats_.read_calls++;
+  if (!success) {
+    RecordError(out_error->get());
+    return false;
+  }
+  stats_.bytes_read += *size_read;
+  if (*size_read == 0 && size_to_read > 0 && !eos)
+    stats_.read_would_block++;
+  return true;
+}
+
+bool InstrumentedStream::ReadAtBlocking(uint64_t offset,
+                                        void* buffer,
+                                        size_t size_to_read,
+                                        size_t* size_read,
+                                        ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  ErrorPtr local_error;
+  ErrorPtr* out_error = error ? error : &local_error;
+  bool success = stream_->ReadAtBlocking(offset, buffer, size_to_read,
+                                         size_read, out_error);
+  base::AutoLock lock(stats_lock_);
+  stats_.read_calls++;
+  if (!success) {
+    RecordError(out_error->get());
+    return false;
+  }
+  stats_.bytes_read += *size_read;
+  return true;
+}
+
+bool InstrumentedStream::WriteNonBlocking(const void* buffer,
+                                          size_t size_to_write,
+                                          size_t* size_written,
+                                          ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  ErrorPtr local_error;
+  ErrorPtr* out_error = error ? error : &local_error;
+  bool success = stream_->WriteNonBlocking(buffer, size_to_write, size_written,
+                                           out_error);
+  base::AutoLock lock(stats_lock_);
+  stats_.write_calls++;
+  if (!success) {
+    RecordError(out_error->get());
+    return false;
+  }
+  stats_.bytes_written += *size_written;
+  if (*size_written == 0 && size_to_write > 0)
+    stats_.write_would_block++;
+  return true;
+}
+
+bool InstrumentedStream::WriteAtBlocking(uint64_t offset,
+                                         const void* buffer,
+                                         size_t size_to_write,
+                                         size_t* size_written,
+                                         ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  ErrorPtr local_error;
+  ErrorPtr* out_error = error ? error : &local_error;
+  bool success = stream_->WriteAtBlocking(offset, buffer, size_to_write,
+                                          size_written, out_error);
+  base::AutoLock lock(stats_lock_);
+  stats_.write_calls++;
+  if (!success) {
+    RecordError(out_error->get());
+    return false;
+  }
+  stats_.bytes_written += *size_written;
+  return true;
+}
+
+bool InstrumentedStream::FlushBlocking(ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  ErrorPtr local_error;
+  ErrorPtr* out_error = error ? error : &local_error;
+  bool success = stream_->FlushBlocking(out_error);
+  base::AutoLock lock(stats_lock_);
+  stats_.flush_calls++;
+  if (!success)
+    RecordError(out_error->get());
+  return success;
+}
+
+bool InstrumentedStream::CloseBlocking(ErrorPtr* error) {
+  if (!stream_)
+    return true;
+
+  ErrorPtr local_error;
+  ErrorPtr* out_error = error ? error : &local_error;
+  bool success = stream_->CloseBlocking(out_error);
+  if (!success) {
+    base::AutoLock lock(stats_lock_);
+    RecordError(out_error->get());
+  }
+  CancelPendingAsyncOperations();
+  stream_.reset();
+  return success;
+}
+
+bool InstrumentedStream::WaitForData(
+    AccessMode mode,
+    const base::Callback<void(AccessMode)>& callback,
+    ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  ErrorPtr local_error;
+  ErrorPtr* out_error = error ? error : &local_error;
+  bool success = stream_->WaitForData(
+      mode,
+      base::Bind(&InstrumentedStream::OnDataAvailable,
+                 weak_ptr_factory_.GetWeakPtr(), base::TimeTicks::Now(),
+                 callback),
+      out_error);
+  base::AutoLock lock(stats_lock_);
+  stats_.wait_calls++;
+  if (!success)
+    RecordError(out_error->get());
+  return success;
+}
+
+bool InstrumentedStream::WaitForDataBlocking(AccessMode in_mode,
+                                             base::TimeDelta timeout,
+                                             AccessMode* out_mode,
+                                             ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  ErrorPtr local_error;
+  ErrorPtr* out_error = error ? error : &local_error;
+  base::TimeTicks start_time = base::TimeTicks::Now();
+  bool success =
+      stream_->WaitForDataBlocking(in_mode, timeout, out_mode, out_error);
+  base::AutoLock lock(stats_lock_);
+  stats_.wait_calls++;
+  stats_.wait_time += base::TimeTicks::Now() - start_time;
+  if (!success)
+    RecordError(out_error->get());
+  return success;
+}
+
+void InstrumentedStream::CancelPendingAsyncOperations() {
+  if (IsOpen())
+    stream_->CancelPendingAsyncOperations();
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  Stream::CancelPendingAsyncOperations();
+}
+
+void InstrumentedStream::RecordError(const Error* error) {
+  stats_lock_.AssertAcquired();
+  if (!error)
+    return;
+  stats_.errors[error->GetDomain() + "/" + error->GetCode()]++;
+}
+
+void InstrumentedStream::OnDataAvailable(
+    base::TimeTicks start_time,
+    const base::Callback<void(AccessMode)>& callback,
+    AccessMode mode) {
+  {
+    base::AutoLock lock(stats_lock_);
+    stats_.wait_time += base::TimeTicks::Now() - start_time;
+  }
+  callback.Run(mode);
+}
+
+}  // namespace brillo
@@ -0,0 +1,179 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_INSTRUMENTED_STREAM_H_
+#define LIBBRILLO_BRILLO_STREAMS_INSTRUMENTED_STREAM_H_
+
+#include <map>
+#include <memory>
+#include <string>
+
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <base/synchronization/lock.h>
+#include <base/time/time.h>
+#include <brillo/brillo_export.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+// InstrumentedStream is a stream adapter that passes all the operations
+// through to the underlying stream and keeps counters of what it sees: bytes
+// transferred, number of calls, calls that could not make progress (EAGAIN),
+// time spent waiting for data, and the errors returned.
+//
+// Every instrumented stream has a name and is tracked by a process-wide
+// registry, which aggregates the statistics of all the streams with the same
+// name, including the streams that have already been destroyed. Use a name
+// per kind of stream (e.g. "download" or "log_upload") rather than per
+// instance. The registry can be queried with GetRegistryStats(), written to
+// the log with LogRegistryStats(), or formatted with DumpRegistryStats(), for
+// example to be returned by a debugging D-Bus method of a daemon.
+//
+// The instrumentation is opt-in: only the streams explicitly wrapped with
+// InstrumentedStream::Create() are counted.
+class BRILLO_EXPORT InstrumentedStream : public Stream {
+ public:
+  struct Stats {
+    // Number of streams these statistics are accumulated from.
+    uint64_t streams{0};
+    uint64_t bytes_read{0};
+    uint64_t bytes_written{0};
+    // Calls of the read/write operations on the underlying stream, including
+    // the positional ones.
+    uint64_t read_calls{0};
+    uint64_t write_calls{0};
+    // Non-blocking reads/writes that didn't transfer any data because the
+    // underlying stream wasn't ready (EAGAIN).
+    uint64_t read_would_block{0};
+    uint64_t write_would_block{0};
+    uint64_t flush_calls{0};
+    // Calls of WaitForData() and WaitForDataBlocking(), and the total time
+    // spent until the stream became ready (or the wait failed).
+    uint64_t wait_calls{0};
+    base::TimeDelta wait_time;
+    // Number of failed operations for each error, keyed by "domain/code".
+    std::map<std::string, uint64_t> errors;
+
+    // Adds the counters from |other| to this object.
+    void Add(const Stats& other);
+  };
+
+  ~InstrumentedStream() override;
+
+  // Creates an instrumented stream on top of |stream|, taking ownership of
+  // it. |name| identifies the statistics of this stream in the registry.
+  // The concrete type is returned so the statistics can be queried; the result
+  // converts to a StreamPtr when the stream is handed over to other code.
+  static std::unique_ptr<InstrumentedStream> Create(StreamPtr stream,
+                                                    const std::string& name,
+                                                    ErrorPtr* error);
+
+  const std::string& name() const { return name_; }
+
+  // Returns the statistics of this stream only.
+  Stats GetStats() const;
+
+  // Returns the statistics of all the instrumented streams of the process,
+  // aggregated by name. Can be called from any thread.
+  static std::map<std::string, Stats> GetRegistryStats();
+
+  // Returns GetRegistryStats() formatted as text, one line per name.
+  static std::string DumpRegistryStats();
+
+  // Writes DumpRegistryStats() to the log.
+  static void LogRegistryStats();
+
+  // Forgets the statistics of the streams that have been destroyed. The
+  // statistics of the live streams are kept.
+  static void ResetRegistryStats();
+
+  // == Stream capabilities ===================================================
+  bool IsOpen() const override;
+  bool CanRead() const override;
+  bool CanWrite() const override;
+  bool CanSeek() const override;
+  bool CanGetSize() const override;
+
+  // == Stream size operations ================================================
+  uint64_t GetSize() const override;
+  bool SetSizeBlocking(uint64_t size, ErrorPtr* error) override;
+  uint64_t GetRemainingSize() const override;
+
+  // == Seek operations =======================================================
+  uint64_t GetPosition() const override;
+  bool Seek(int64_t offset,
+            Whence whence,
+            uint64_t* new_position,
+            ErrorPtr* error) override;
+
+  // == Read operations =======================================================
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       ErrorPtr* error) override;
+  bool ReadAtBlocking(uint64_t offset,
+                      void* buffer,
+                      size_t size_to_read,
+                      size_t* size_read,
+                      ErrorPtr* error) override;
+
+  // == Write operations ======================================================
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        ErrorPtr* error) override;
+  bool WriteAtBlocking(uint64_t offset,
+                       const void* buffer,
+                       size_t size_to_write,
+                       size_t* size_written,
+                       ErrorPtr* error) override;
+
+  // == Finalizing/closing streams  ===========================================
+  bool FlushBlocking(ErrorPtr* error) override;
+  bool CloseBlocking(ErrorPtr* error) override;
+
+  // == Data availability monitoring ==========================================
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   ErrorPtr* error) override;
+
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta timeout,
+                           AccessMode* out_mode,
+                           ErrorPtr* error) override;
+
+  void CancelPendingAsyncOperations() override;
+
+ private:
+  // Internal constructor used by the Create() factory method.
+  InstrumentedStream(StreamPtr stream, const std::string& name);
+
+  // Counts the error returned in |error| by a failed operation. Must be
+  // called with |stats_lock_| held.
+  void RecordError(const Error* error);
+
+  // Called when the underlying stream becomes ready after WaitForData() was
+  // called at |start_time|.
+  void OnDataAvailable(base::TimeTicks start_time,
+                       const base::Callback<void(AccessMode)>& callback,
+                       AccessMode mode);
+
+  // The underlying stream.
+  StreamPtr stream_;
+  std::string name_;
+
+  // The registry may read the statistics from another thread.
+  mutable base::Lock stats_lock_;
+  Stats stats_;
+
+  base::WeakPtrFactory<InstrumentedStream> weak_ptr_factory_{this};
+
+  DISALLOW_COPY_AND_ASSIGN(InstrumentedStream);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_INSTRUMENTED_STREAM_H_
@@ -0,0 +1,161 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/instrumented_stream.h>
+
+#include <string>
+
+#include <base/bind.h>
+#include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/streams/memory_pipe_stream.h>
+#include <brillo/streams/memory_stream.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+
+TEST(InstrumentedStream, ReadWrite) {
+  auto input = InstrumentedStream::Create(
+      MemoryStream::OpenRef("abcdef", nullptr), "test_input", nullptr);
+  ASSERT_NE(nullptr, input.get());
+  EXPECT_TRUE(input->CanRead());
+  EXPECT_TRUE(input->CanSeek());
+
+  char buffer[4];
+  size_t size = 0;
+  bool eos = false;
+  EXPECT_TRUE(input->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                     nullptr));
+  EXPECT_TRUE(input->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                     nullptr));
+  EXPECT_TRUE(input->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                     nullptr));
+  EXPECT_TRUE(eos);
+  EXPECT_TRUE(input->ReadAtBlocking(1, buffer, 2, &size, nullptr));
+  EXPECT_EQ("bc", std::string(buffer, size));
+
+  InstrumentedStream::Stats stats = input->GetStats();
+  EXPECT_EQ(8u, stats.bytes_read);
+  EXPECT_EQ(4u, stats.read_calls);
+  // Reaching the end of the stream is not counted as blocking.
+  EXPECT_EQ(0u, stats.read_would_block);
+  EXPECT_EQ(0u, stats.bytes_written);
+  EXPECT_TRUE(stats.errors.empty());
+
+  std::string data;
+  auto output = InstrumentedStream::Create(
+      MemoryStream::CreateRef(&data, nullptr), "test_output", nullptr);
+  EXPECT_TRUE(output->WriteAllBlocking("foo", 3, nullptr));
+  EXPECT_TRUE(output->FlushBlocking(nullptr));
+  stats = output->GetStats();
+  EXPECT_EQ(3u, stats.bytes_written);
+  EXPECT_EQ(1u, stats.write_calls);
+  EXPECT_EQ(1u, stats.flush_calls);
+  EXPECT_EQ("foo", data);
+}
+
+TEST(InstrumentedStream, ReadWithoutEndOfStream) {
+  auto input = InstrumentedStream::Create(
+      MemoryStream::OpenRef("ab", nullptr), "test_input", nullptr);
+  ASSERT_NE(nullptr, input.get());
+
+  // |end_of_stream| is optional.
+  char buffer[4];
+  size_t size = 0;
+  EXPECT_TRUE(input->ReadNonBlocking(buffer, sizeof(buffer), &size, nullptr,
+                                     nullptr));
+  EXPECT_EQ(2u, size);
+  EXPECT_TRUE(input->ReadNonBlocking(buffer, sizeof(buffer), &size, nullptr,
+                                     nullptr));
+  EXPECT_EQ(0u, size);
+
+  InstrumentedStream::Stats stats = input->GetStats();
+  EXPECT_EQ(2u, stats.bytes_read);
+  EXPECT_EQ(2u, stats.read_calls);
+  EXPECT_EQ(0u, stats.read_would_block);
+
+  StreamPtr reader;
+  StreamPtr writer;
+  ASSERT_TRUE(MemoryPipeStream::CreatePair(2, &reader, &writer, nullptr));
+  auto pipe =
+      InstrumentedStream::Create(std::move(reader), "test_pipe", nullptr);
+  EXPECT_TRUE(pipe->ReadNonBlocking(buffer, sizeof(buffer), &size, nullptr,
+                                    nullptr));
+  EXPECT_EQ(0u, size);
+  EXPECT_EQ(1u, pipe->GetStats().read_would_block);
+}
+
+TEST(InstrumentedStream, WouldBlockAndErrors) {
+  FakeMessageLoop fake_loop{nullptr};
+  fake_loop.SetAsCurrent();
+  StreamPtr reader;
+  StreamPtr writer;
+  ASSERT_TRUE(MemoryPipeStream::CreatePair(2, &reader, &writer, nullptr));
+  auto stream =
+      InstrumentedStream::Create(std::move(writer), "test_pipe", nullptr);
+  ASSERT_NE(nullptr, stream.get());
+
+  size_t size = 0;
+  EXPECT_TRUE(stream->WriteNonBlocking("abc", 3, &size, nullptr));
+  EXPECT_EQ(2u, size);
+  EXPECT_TRUE(stream->WriteNonBlocking("c", 1, &size, nullptr));
+  EXPECT_EQ(0u, size);
+
+  bool called = false;
+  EXPECT_TRUE(stream->WaitForData(
+      Stream::AccessMode::WRITE,
+      base::Bind([](bool* called, Stream::AccessMode) { *called = true; },
+                 &called),
+      nullptr));
+  char buffer[2];
+  bool eos = false;
+  EXPECT_TRUE(reader->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                      nullptr));
+  fake_loop.Run();
+  EXPECT_TRUE(called);
+
+  EXPECT_TRUE(reader->CloseBlocking(nullptr));
+  EXPECT_FALSE(stream->WriteNonBlocking("c", 1, &size, nullptr));
+  EXPECT_FALSE(stream->WriteNonBlocking("c", 1, &size, nullptr));
+
+  InstrumentedStream::Stats stats = stream->GetStats();
+  EXPECT_EQ(2u, stats.bytes_written);
+  EXPECT_EQ(4u, stats.write_calls);
+  EXPECT_EQ(1u, stats.write_would_block);
+  EXPECT_EQ(1u, stats.wait_calls);
+  ASSERT_EQ(1u, stats.errors.size());
+  EXPECT_EQ(errors::system::kDomain + std::string{"/EPIPE"},
+            stats.errors.begin()->first);
+  EXPECT_EQ(2u, stats.errors.begin()->second);
+}
+
+TEST(InstrumentedStream, Registry) {
+  InstrumentedStream::ResetRegistryStats();
+  std::string data;
+  for (int i = 0; i < 2; i++) {
+    auto stream = InstrumentedStream::Create(
+        MemoryStream::CreateRef(&data, nullptr), "test_registry", nullptr);
+    EXPECT_TRUE(stream->WriteAllBlocking("ab", 2, nullptr));
+  }
+  auto live_stream = InstrumentedStream::Create(
+      MemoryStream::CreateRef(&data, nullptr), "test_registry", nullptr);
+  EXPECT_TRUE(live_stream->WriteAllBlocking("c", 1, nullptr));
+
+  auto stats = InstrumentedStream::GetRegistryStats();
+  ASSERT_EQ(1u, stats.count("test_registry"));
+  EXPECT_EQ(3u, stats["test_registry"].streams);
+  EXPECT_EQ(5u, stats["test_registry"].bytes_written);
+  EXPECT_NE(std::string::npos,
+            InstrumentedStream::DumpRegistryStats().find(
+                "test_registry: streams=3 read=0B/0 calls (0 EAGAIN) "
+                "written=5B/3 calls"));
+
+  // Only the statistics of the destroyed streams are dropped.
+  InstrumentedStream::ResetRegistryStats();
+  stats = InstrumentedStream::GetRegistryStats();
+  EXPECT_EQ(1u, stats["test_registry"].streams);
+  EXPECT_EQ(1u, stats["test_registry"].bytes_written);
+}
+
+}  // namespace brillo
@@ -4,7 +4,10 @@
 
 #include <brillo/streams/memory_containers.h>
 
+#include <algorithm>
+
 #include <base/callback.h>
+#include <base/logging.h>
 #include <brillo/streams/stream_errors.h>
 
 namespace brillo {
@@ -128,5 +131,154 @@ const void* ReadOnlyStringRef::GetReadOnlyBuffer(size_t offset,
 ReadOnlyStringCopy::ReadOnlyStringCopy(std::string string)
     : ReadOnlyStringRef(string_copy_), string_copy_(std::move(string)) {}
 
+const size_t ChunkedBuffer::kDefaultChunkSize;
+
+ChunkedBuffer::ChunkedBuffer(size_t chunk_size) : chunk_size_(chunk_size) {
+  CHECK_GT(chunk_size_, 0u);
+}
+
+bool ChunkedBuffer::Read(void* buffer,
+                         size_t size_to_read,
+                         size_t offset,
+                         size_t* size_read,
+                         ErrorPtr* /* error */) {
+  size_t size = 0;
+  if (offset < size_)
+    size = std::min(size_to_read, size_ - offset);
+
+  uint8_t* dest = static_cast<uint8_t*>(buffer);
+  size_t remaining = size;
+  while (remaining > 0) {
+    size_t index = offset / chunk_size_;
+    size_t chunk_offset = offset % chunk_size_;
+    size_t copy_size = std::min(remaining, chunk_size_ - chunk_offset);
+    memcpy(dest, chunks_[index].get() + chunk_offset, copy_size);
+    dest += copy_size;
+    offset += copy_size;
+    remaining -= copy_size;
+  }
+  if (size_read)
+    *size_read = size;
+  return true;
+}
+
+bool ChunkedBuffer::Write(const void* buffer,
+                          size_t size_to_write,
+                          size_t offset,
+                          size_t* size_written,
+                          ErrorPtr* error) {
+  size_t new_size = offset + size_to_write;
+  if (size_ < new_size && !Resize(new_size, error))
+    return false;
+
+  const uint8_t* src = static_cast<const uint8_t*>(buffer);
+  size_t remaining = size_to_write;
+  while (remaining > 0) {
+    size_t index = offset / chunk_size_;
+    size_t chunk_offset = offset % chunk_size_;
+    size_t copy_size = std::min(remaining, chunk_size_ - chunk_offset);
+    memcpy(chunks_[index].get() + chunk_offset, src, copy_size);
+    src += copy_size;
+    offset += copy_size;
+    remaining -= copy_size;
+  }
+  if (size_written)
+    *size_written = size_to_write;
+  return true;
+}
+
+bool ChunkedBuffer::Resize(size_t new_size, ErrorPtr* /* error */) {
+  size_t chunk_count = (new_size + chunk_size_ - 1) / chunk_size_;
+  if (new_size > size_ && size_ % chunk_size_ != 0) {
+    // Clear the stale data left in the last chunk by an earlier shrink.
+    size_t chunk_offset = size_ % chunk_size_;
+    size_t clear_size = std::min(chunk_size_ - chunk_offset, new_size - size_);
+    memset(chunks_[size_ / chunk_size_].get() + chunk_offset, 0, clear_size);
+  }
+  while (chunks_.size() < chunk_count)
+    chunks_.emplace_back(new uint8_t[chunk_size_]());
+  chunks_.resize(chunk_count);
+  size_ = new_size;
+  return true;
+}
+
+size_t ChunkedBuffer::GetChunkSize(size_t index) const {
+  size_t chunk_begin = index * chunk_size_;
+  return std::min(chunk_size_, size_ - chunk_begin);
+}
+
+RingBuffer::RingBuffer(size_t capacity) : buffer_(capacity) {}
+
+size_t RingBuffer::GetIndex(size_t offset) const {
+  size_t index = head_ + offset;
+  return (index < buffer_.size()) ? index : index - buffer_.size();
+}
+
+bool RingBuffer::Read(void* buffer,
+                      size_t size_to_read,
+                      size_t offset,
+                      size_t* size_read,
+                      ErrorPtr* /* error */) {
+  size_t size = 0;
+  if (offset < size_) {
+    size = std::min(size_to_read, size_ - offset);
+    // The data may wrap around the end of the buffer.
+    size_t index = GetIndex(offset);
+    size_t first = std::min(size, buffer_.size() - index);
+    memcpy(buffer, buffer_.data() + index, first);
+    memcpy(static_cast<uint8_t*>(buffer) + first, buffer_.data(),
+           size - first);
+  }
+  if (size_read)
+    *size_read = size;
+  return true;
+}
+
+bool RingBuffer::Write(const void* buffer,
+                       size_t size_to_write,
+                       size_t offset,
+                       size_t* size_written,
+                       ErrorPtr* error) {
+  if (offset > size_) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "Cannot write past the end of a ring buffer");
+    return false;
+  }
+  size_t size = std::min(size_to_write, buffer_.size() - offset);
+  if (size) {
+    size_t index = GetIndex(offset);
+    size_t first = std::min(size, buffer_.size() - index);
+    memcpy(buffer_.data() + index, buffer, first);
+    memcpy(buffer_.data(), static_cast<const uint8_t*>(buffer) + first,
+           size - first);
+    size_ = std::max(size_, offset + size);
+  }
+  if (size_written)
+    *size_written = size;
+  return true;
+}
+
+bool RingBuffer::Resize(size_t new_size, ErrorPtr* error) {
+  if (new_size > buffer_.size()) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "Size exceeds the capacity of the ring buffer");
+    return false;
+  }
+  for (size_t offset = size_; offset < new_size; offset++)
+    buffer_[GetIndex(offset)] = 0;
+  size_ = new_size;
+  return true;
+}
+
+void RingBuffer::Consume(size_t size) {
+  size = std::min(size, size_);
+  head_ = GetIndex(size);
+  size_ -= size;
+  if (size_ == 0)
+    head_ = 0;
+}
+
 }  // namespace data_container
 }  // namespace brillo
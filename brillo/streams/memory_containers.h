@@ -5,6 +5,7 @@
 #ifndef LIBBRILLO_BRILLO_STREAMS_MEMORY_CONTAINERS_H_
 #define LIBBRILLO_BRILLO_STREAMS_MEMORY_CONTAINERS_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -282,6 +283,143 @@ class BRILLO_EXPORT ReadOnlyStringCopy : public ReadOnlyStringRef {
   DISALLOW_COPY_AND_ASSIGN(ReadOnlyStringCopy);
 };
 
+// ChunkedBuffer is a read/write container that manages its own storage as
+// a list of fixed-size memory chunks instead of one contiguous block. Growing
+// the container only allocates new chunks and never moves the data already
+// stored, which avoids the reallocation copies (and the 2x peak memory use)
+// that vector- or string-based containers incur for large payloads.
+// The data can be accessed chunk by chunk without flattening it into
+// a contiguous buffer by using GetChunkCount(), GetChunkData() and
+// GetChunkSize().
+class BRILLO_EXPORT ChunkedBuffer : public DataContainerInterface {
+ public:
+  // Default size of a single chunk.
+  static const size_t kDefaultChunkSize = 64 * 1024;
+
+  // |chunk_size| must not be zero.
+  explicit ChunkedBuffer(size_t chunk_size);
+  ChunkedBuffer() : ChunkedBuffer(kDefaultChunkSize) {}
+
+  // Implementation of DataContainerInterface.
+  bool Read(void* buffer,
+            size_t size_to_read,
+            size_t offset,
+            size_t* size_read,
+            ErrorPtr* error) override;
+  bool Write(const void* buffer,
+             size_t size_to_write,
+             size_t offset,
+             size_t* size_written,
+             ErrorPtr* error) override;
+  // Growing the container fills the new space with zeros.
+  bool Resize(size_t new_size, ErrorPtr* error) override;
+  size_t GetSize() const override { return size_; }
+  bool IsReadOnly() const override { return false; }
+
+  // Returns the number of chunks holding the data of the container.
+  size_t GetChunkCount() const { return chunks_.size(); }
+  // Returns the pointer to the data of the chunk at |index|.
+  const uint8_t* GetChunkData(size_t index) const {
+    return chunks_[index].get();
+  }
+  // Returns the amount of data stored in the chunk at |index|. Only the last
+  // chunk can be partially filled.
+  size_t GetChunkSize(size_t index) const;
+
+  size_t chunk_size() const { return chunk_size_; }
+
+ private:
+  size_t chunk_size_;
+  size_t size_{0};
+  std::vector<std::unique_ptr<uint8_t[]>> chunks_;
+
+  DISALLOW_COPY_AND_ASSIGN(ChunkedBuffer);
+};
+
+// ChunkedBufferPtr is a read/write container based on an external
+// ChunkedBuffer, which must outlive the container.
+class BRILLO_EXPORT ChunkedBufferPtr : public DataContainerInterface {
+ public:
+  explicit ChunkedBufferPtr(ChunkedBuffer* buffer) : buffer_ptr_(buffer) {}
+
+  bool Read(void* buffer,
+            size_t size_to_read,
+            size_t offset,
+            size_t* size_read,
+            ErrorPtr* error) override {
+    return buffer_ptr_->Read(buffer, size_to_read, offset, size_read, error);
+  }
+  bool Write(const void* buffer,
+             size_t size_to_write,
+             size_t offset,
+             size_t* size_written,
+             ErrorPtr* error) override {
+    return buffer_ptr_->Write(buffer, size_to_write, offset, size_written,
+                              error);
+  }
+  bool Resize(size_t new_size, ErrorPtr* error) override {
+    return buffer_ptr_->Resize(new_size, error);
+  }
+  size_t GetSize() const override { return buffer_ptr_->GetSize(); }
+  bool IsReadOnly() const override { return false; }
+
+ protected:
+  ChunkedBuffer* buffer_ptr_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ChunkedBufferPtr);
+};
+
+// RingBuffer is a read/write container of a fixed capacity that stores its
+// data in a circular buffer. Offsets passed to Read() and Write() are relative
+// to the oldest byte in the container, and Consume() discards data from the
+// front without moving the remaining bytes. This makes the container suitable
+// for bounded producer/consumer queues where memory use must stay constant.
+// Writes that do not fit in the remaining capacity are truncated.
+class BRILLO_EXPORT RingBuffer : public DataContainerInterface {
+ public:
+  explicit RingBuffer(size_t capacity);
+
+  // Implementation of DataContainerInterface.
+  bool Read(void* buffer,
+            size_t size_to_read,
+            size_t offset,
+            size_t* size_read,
+            ErrorPtr* error) override;
+  bool Write(const void* buffer,
+             size_t size_to_write,
+             size_t offset,
+             size_t* size_written,
+             ErrorPtr* error) override;
+  // Fails if |new_size| exceeds the capacity of the buffer. Growing the
+  // container fills the new space with zeros.
+  bool Resize(size_t new_size, ErrorPtr* error) override;
+  size_t GetSize() const override { return size_; }
+  bool IsReadOnly() const override { return false; }
+
+  // Discards up to |size| bytes from the front of the container.
+  void Consume(size_t size);
+
+  // Returns the maximum amount of data the container can hold.
+  size_t GetCapacity() const { return buffer_.size(); }
+
+  // Returns the amount of data that can still be written to the container.
+  size_t GetFreeSpace() const { return buffer_.size() - size_; }
+
+ private:
+  // Converts a logical |offset| from the front of the data into an index into
+  // |buffer_|.
+  size_t GetIndex(size_t offset) const;
+
+  std::vector<uint8_t> buffer_;
+  // Index of the first byte of data in |buffer_|.
+  size_t head_{0};
+  // Amount of data currently stored.
+  size_t size_{0};
+
+  DISALLOW_COPY_AND_ASSIGN(RingBuffer);
+};
+
 }  // namespace data_container
 }  // namespace brillo
 
@@ -4,8 +4,10 @@
 
 #include <brillo/streams/memory_containers.h>
 
+#include <cstring>
 #include <limits>
 #include <memory>
+#include <string>
 
 #include <brillo/streams/mock_stream.h>
 #include <brillo/streams/stream_errors.h>
@@ -210,5 +212,66 @@ TEST_F(MemoryContainerTest, Write_Error) {
   EXPECT_EQ("write error", error->GetMessage());
 }
 
+TEST(ChunkedBuffer, ReadWriteAcrossChunks) {
+  data_container::ChunkedBuffer buffer{4};
+  size_t size = 0;
+  EXPECT_TRUE(buffer.Write("0123456789", 10, 0, &size, nullptr));
+  EXPECT_EQ(10u, size);
+  EXPECT_EQ(10u, buffer.GetSize());
+  ASSERT_EQ(3u, buffer.GetChunkCount());
+  EXPECT_EQ(4u, buffer.GetChunkSize(0));
+  EXPECT_EQ(2u, buffer.GetChunkSize(2));
+  EXPECT_EQ(0, memcmp("4567", buffer.GetChunkData(1), 4));
+
+  char data[16];
+  EXPECT_TRUE(buffer.Read(data, sizeof(data), 3, &size, nullptr));
+  EXPECT_EQ("3456789", std::string(data, size));
+  EXPECT_TRUE(buffer.Read(data, sizeof(data), 10, &size, nullptr));
+  EXPECT_EQ(0u, size);
+
+  // Writing past the end fills the gap with zeros.
+  EXPECT_TRUE(buffer.Write("x", 1, 12, &size, nullptr));
+  EXPECT_EQ(13u, buffer.GetSize());
+  EXPECT_EQ(4u, buffer.GetChunkCount());
+  EXPECT_TRUE(buffer.Read(data, sizeof(data), 9, &size, nullptr));
+  EXPECT_EQ(std::string("9\0\0x", 4), std::string(data, size));
+
+  // Shrinking and growing again must not expose stale data.
+  EXPECT_TRUE(buffer.Resize(5, nullptr));
+  EXPECT_EQ(2u, buffer.GetChunkCount());
+  EXPECT_TRUE(buffer.Resize(8, nullptr));
+  EXPECT_TRUE(buffer.Read(data, sizeof(data), 0, &size, nullptr));
+  EXPECT_EQ(std::string("01234\0\0\0", 8), std::string(data, size));
+}
+
+TEST(RingBuffer, ReadWriteWrapAround) {
+  data_container::RingBuffer buffer{8};
+  EXPECT_EQ(8u, buffer.GetCapacity());
+  size_t size = 0;
+  EXPECT_TRUE(buffer.Write("abcdef", 6, 0, &size, nullptr));
+  EXPECT_EQ(6u, size);
+  buffer.Consume(4);
+  EXPECT_EQ(2u, buffer.GetSize());
+  EXPECT_EQ(6u, buffer.GetFreeSpace());
+
+  // This write wraps around the end of the internal buffer.
+  EXPECT_TRUE(buffer.Write("0123456789", 10, buffer.GetSize(), &size,
+                           nullptr));
+  EXPECT_EQ(6u, size);
+  EXPECT_EQ(0u, buffer.GetFreeSpace());
+
+  char data[8];
+  EXPECT_TRUE(buffer.Read(data, sizeof(data), 0, &size, nullptr));
+  EXPECT_EQ("ef012345", std::string(data, size));
+  EXPECT_TRUE(buffer.Read(data, sizeof(data), 5, &size, nullptr));
+  EXPECT_EQ("345", std::string(data, size));
+
+  EXPECT_FALSE(buffer.Write("x", 1, 9, &size, nullptr));
+  EXPECT_FALSE(buffer.Resize(9, nullptr));
+  EXPECT_TRUE(buffer.Resize(3, nullptr));
+  EXPECT_TRUE(buffer.Read(data, sizeof(data), 0, &size, nullptr));
+  EXPECT_EQ("ef0", std::string(data, size));
+}
+
 }  // namespace brillo
 
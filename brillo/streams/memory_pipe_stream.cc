@@ -0,0 +1,228 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/memory_pipe_stream.h>
+
+#include <errno.h>
+
+#include <base/bind.h>
+#include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/streams/memory_containers.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace brillo {
+
+using DataCallback = base::Callback<void(Stream::AccessMode)>;
+
+struct MemoryPipeStream::Pipe {
+  explicit Pipe(size_t capacity) : buffer{capacity} {}
+
+  data_container::RingBuffer buffer;
+  bool reader_open{true};
+  bool writer_open{true};
+  // Callbacks of the pending WaitForData() calls on each end of the pipe.
+  DataCallback read_callback;
+  DataCallback write_callback;
+};
+
+namespace {
+
+// Schedules the pending |callback|, if any, to be called from the message loop.
+void NotifyWaiter(DataCallback* callback, Stream::AccessMode mode) {
+  if (callback->is_null())
+    return;
+  DataCallback cb = *callback;
+  callback->Reset();
+  MessageLoop::current()->PostTask(FROM_HERE, base::Bind(cb, mode));
+}
+
+}  // anonymous namespace
+
+MemoryPipeStream::MemoryPipeStream(std::shared_ptr<Pipe> pipe, AccessMode mode)
+    : pipe_{std::move(pipe)}, mode_{mode} {}
+
+MemoryPipeStream::~MemoryPipeStream() {
+  CloseBlocking(nullptr);
+}
+
+bool MemoryPipeStream::CreatePair(size_t capacity,
+                                  StreamPtr* read_stream,
+                                  StreamPtr* write_stream,
+                                  ErrorPtr* error) {
+  if (capacity == 0) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "Pipe capacity must not be zero");
+    return false;
+  }
+  auto pipe = std::make_shared<Pipe>(capacity);
+  read_stream->reset(new MemoryPipeStream{pipe, AccessMode::READ});
+  write_stream->reset(new MemoryPipeStream{pipe, AccessMode::WRITE});
+  return true;
+}
+
+bool MemoryPipeStream::IsOpen() const {
+  return pipe_ != nullptr;
+}
+
+bool MemoryPipeStream::CanRead() const {
+  return IsOpen() && mode_ == AccessMode::READ;
+}
+
+bool MemoryPipeStream::CanWrite() const {
+  return IsOpen() && mode_ == AccessMode::WRITE;
+}
+
+bool MemoryPipeStream::SetSizeBlocking(uint64_t /* size */, ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+uint64_t MemoryPipeStream::GetRemainingSize() const {
+  return IsOpen() ? pipe_->buffer.GetSize() : 0;
+}
+
+bool MemoryPipeStream::Seek(int64_t /* offset */,
+                            Whence /* whence */,
+                            uint64_t* /* new_position */,
+                            ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool MemoryPipeStream::ReadNonBlocking(void* buffer,
+                                       size_t size_to_read,
+                                       size_t* size_read,
+                                       bool* end_of_stream,
+                                       ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!CanRead())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  size_t read = 0;
+  if (!pipe_->buffer.Read(buffer, size_to_read, 0, &read, error))
+    return false;
+  pipe_->buffer.Consume(read);
+  if (read > 0)
+    NotifyWaiter(&pipe_->write_callback, AccessMode::WRITE);
+
+  *size_read = read;
+  if (end_of_stream)
+    *end_of_stream = (read == 0 && size_to_read != 0 && !pipe_->writer_open);
+  return true;
+}
+
+bool MemoryPipeStream::WriteNonBlocking(const void* buffer,
+                                        size_t size_to_write,
+                                        size_t* size_written,
+                                        ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!CanWrite())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  if (!pipe_->reader_open) {
+    errors::system::AddSystemError(error, FROM_HERE, EPIPE);
+    return false;
+  }
+
+  if (!pipe_->buffer.Write(buffer, size_to_write, pipe_->buffer.GetSize(),
+                           size_written, error)) {
+    return false;
+  }
+  if (*size_written > 0)
+    NotifyWaiter(&pipe_->read_callback, AccessMode::READ);
+  return true;
+}
+
+bool MemoryPipeStream::FlushBlocking(ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  // Written data is immediately available to the reader.
+  return true;
+}
+
+bool MemoryPipeStream::CloseBlocking(ErrorPtr* /* error */) {
+  if (!IsOpen())
+    return true;
+
+  // Wake up the other end so it can observe the end of stream (reader) or
+  // the broken pipe (writer).
+  if (mode_ == AccessMode::READ) {
+    pipe_->reader_open = false;
+    pipe_->read_callback.Reset();
+    NotifyWaiter(&pipe_->write_callback, AccessMode::WRITE);
+  } else {
+    pipe_->writer_open = false;
+    pipe_->write_callback.Reset();
+    NotifyWaiter(&pipe_->read_callback, AccessMode::READ);
+  }
+  pipe_.reset();
+  return true;
+}
+
+bool MemoryPipeStream::WaitForData(AccessMode mode,
+                                   const DataCallback& callback,
+                                   ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  bool is_reader = (mode_ == AccessMode::READ);
+  if (is_reader ? !stream_utils::IsReadAccessMode(mode)
+                : !stream_utils::IsWriteAccessMode(mode)) {
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+  }
+
+  DataCallback* pending_callback =
+      is_reader ? &pipe_->read_callback : &pipe_->write_callback;
+  *pending_callback = callback;
+  if (IsReady(mode_))
+    NotifyWaiter(pending_callback, mode_);
+  return true;
+}
+
+bool MemoryPipeStream::WaitForDataBlocking(AccessMode in_mode,
+                                           base::TimeDelta /* timeout */,
+                                           AccessMode* out_mode,
+                                           ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  bool is_reader = (mode_ == AccessMode::READ);
+  if (is_reader ? !stream_utils::IsReadAccessMode(in_mode)
+                : !stream_utils::IsWriteAccessMode(in_mode)) {
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+  }
+
+  // The other end of the pipe lives on the same thread, so nothing can change
+  // the state of the pipe while we are blocked here.
+  if (!IsReady(mode_)) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kOperationNotSupported,
+                 "Blocking on a memory pipe would never complete");
+    return false;
+  }
+  if (out_mode)
+    *out_mode = mode_;
+  return true;
+}
+
+void MemoryPipeStream::CancelPendingAsyncOperations() {
+  if (IsOpen()) {
+    if (mode_ == AccessMode::READ)
+      pipe_->read_callback.Reset();
+    else
+      pipe_->write_callback.Reset();
+  }
+  Stream::CancelPendingAsyncOperations();
+}
+
+bool MemoryPipeStream::IsReady(AccessMode mode) const {
+  if (mode == AccessMode::READ)
+    return pipe_->buffer.GetSize() > 0 || !pipe_->writer_open;
+  return pipe_->buffer.GetFreeSpace() > 0 || !pipe_->reader_open;
+}
+
+}  // namespace brillo
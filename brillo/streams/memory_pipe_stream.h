@@ -0,0 +1,112 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_MEMORY_PIPE_STREAM_H_
+#define LIBBRILLO_BRILLO_STREAMS_MEMORY_PIPE_STREAM_H_
+
+#include <memory>
+
+#include <base/macros.h>
+#include <brillo/brillo_export.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+// MemoryPipeStream is one end of an in-process, bounded pipe. A pipe consists
+// of a pair of streams created by CreatePair(): data written to the write end
+// becomes available for reading from the read end. The data is kept in
+// a fixed-capacity ring buffer (data_container::RingBuffer), so memory use
+// stays constant no matter how much data passes through the pipe.
+//
+// Both ends support non-blocking and asynchronous I/O. WaitForData() on the
+// read end completes when data is written (or the write end is closed) and
+// on the write end when the reader frees some space (or the read end is
+// closed). Once the write end is closed, the reader gets the end-of-stream
+// indication after draining the buffered data. Writing to a pipe whose read end
+// has been closed fails with EPIPE.
+//
+// Both ends are expected to be used on the same thread (typically from the
+// same message loop), so blocking waits that cannot be satisfied immediately
+// fail instead of deadlocking.
+class BRILLO_EXPORT MemoryPipeStream : public Stream {
+ public:
+  ~MemoryPipeStream() override;
+
+  // Creates a new pipe with a buffer of |capacity| bytes and returns its read
+  // and write ends in |read_stream| and |write_stream|.
+  static bool CreatePair(size_t capacity,
+                         StreamPtr* read_stream,
+                         StreamPtr* write_stream,
+                         ErrorPtr* error);
+
+  // == Stream capabilities ===================================================
+  bool IsOpen() const override;
+  bool CanRead() const override;
+  bool CanWrite() const override;
+  bool CanSeek() const override { return false; }
+  bool CanGetSize() const override { return false; }
+
+  // == Stream size operations ================================================
+  uint64_t GetSize() const override { return 0; }
+  bool SetSizeBlocking(uint64_t size, ErrorPtr* error) override;
+  // Returns the amount of data currently buffered in the pipe.
+  uint64_t GetRemainingSize() const override;
+
+  // == Seek operations =======================================================
+  uint64_t GetPosition() const override { return 0; }
+  bool Seek(int64_t offset,
+            Whence whence,
+            uint64_t* new_position,
+            ErrorPtr* error) override;
+
+  // == Read operations =======================================================
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       ErrorPtr* error) override;
+
+  // == Write operations ======================================================
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        ErrorPtr* error) override;
+
+  // == Finalizing/closing streams  ===========================================
+  bool FlushBlocking(ErrorPtr* error) override;
+  bool CloseBlocking(ErrorPtr* error) override;
+
+  // == Data availability monitoring ==========================================
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   ErrorPtr* error) override;
+
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta timeout,
+                           AccessMode* out_mode,
+                           ErrorPtr* error) override;
+
+  void CancelPendingAsyncOperations() override;
+
+ private:
+  // State shared by both ends of the pipe.
+  struct Pipe;
+
+  // Private constructor used by CreatePair().
+  MemoryPipeStream(std::shared_ptr<Pipe> pipe, AccessMode mode);
+
+  // Returns true if the operation specified in |mode| can be performed without
+  // blocking.
+  bool IsReady(AccessMode mode) const;
+
+  std::shared_ptr<Pipe> pipe_;
+  // READ for the read end and WRITE for the write end of the pipe.
+  AccessMode mode_;
+
+  DISALLOW_COPY_AND_ASSIGN(MemoryPipeStream);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_MEMORY_PIPE_STREAM_H_
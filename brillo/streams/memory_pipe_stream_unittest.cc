@@ -0,0 +1,132 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/memory_pipe_stream.h>
+
+#include <string>
+
+#include <base/bind.h>
+#include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+
+class MemoryPipeStreamTest : public testing::Test {
+ public:
+  void SetUp() override {
+    fake_loop_.SetAsCurrent();
+    ASSERT_TRUE(MemoryPipeStream::CreatePair(4, &reader_, &writer_, nullptr));
+  }
+
+  void ReadNext() {
+    EXPECT_TRUE(reader_->ReadAsync(
+        read_buffer_, sizeof(read_buffer_),
+        base::Bind(&MemoryPipeStreamTest::OnRead, base::Unretained(this)),
+        base::Bind(&MemoryPipeStreamTest::OnError, base::Unretained(this)),
+        nullptr));
+  }
+
+  void OnRead(size_t size) {
+    if (size == 0) {
+      read_done_ = true;
+      return;
+    }
+    output_.append(read_buffer_, size);
+    ReadNext();
+  }
+
+  void OnError(const Error* /* error */) { ADD_FAILURE(); }
+
+  FakeMessageLoop fake_loop_{nullptr};
+  StreamPtr reader_;
+  StreamPtr writer_;
+
+  char read_buffer_[3];
+  std::string output_;
+  bool read_done_{false};
+};
+
+TEST_F(MemoryPipeStreamTest, Capabilities) {
+  EXPECT_TRUE(reader_->CanRead());
+  EXPECT_FALSE(reader_->CanWrite());
+  EXPECT_FALSE(writer_->CanRead());
+  EXPECT_TRUE(writer_->CanWrite());
+  EXPECT_FALSE(reader_->CanSeek());
+  EXPECT_FALSE(writer_->CanGetSize());
+  EXPECT_FALSE(MemoryPipeStream::CreatePair(0, &reader_, &writer_, nullptr));
+}
+
+TEST_F(MemoryPipeStreamTest, NonBlocking) {
+  size_t size = 0;
+  bool eos = true;
+  char buffer[8];
+  EXPECT_TRUE(reader_->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                       nullptr));
+  EXPECT_EQ(0u, size);
+  EXPECT_FALSE(eos);
+
+  EXPECT_TRUE(writer_->WriteNonBlocking("123456", 6, &size, nullptr));
+  EXPECT_EQ(4u, size);
+  EXPECT_EQ(4u, reader_->GetRemainingSize());
+  EXPECT_TRUE(writer_->WriteNonBlocking("56", 2, &size, nullptr));
+  EXPECT_EQ(0u, size);
+
+  EXPECT_TRUE(reader_->ReadNonBlocking(buffer, 3, &size, &eos, nullptr));
+  EXPECT_EQ("123", std::string(buffer, size));
+  EXPECT_TRUE(writer_->WriteNonBlocking("56", 2, &size, nullptr));
+  EXPECT_EQ(2u, size);
+  EXPECT_TRUE(writer_->CloseBlocking(nullptr));
+
+  EXPECT_TRUE(reader_->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                       nullptr));
+  EXPECT_EQ("456", std::string(buffer, size));
+  EXPECT_FALSE(eos);
+  EXPECT_TRUE(reader_->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                       nullptr));
+  EXPECT_EQ(0u, size);
+  EXPECT_TRUE(eos);
+}
+
+TEST_F(MemoryPipeStreamTest, BrokenPipe) {
+  EXPECT_TRUE(reader_->CloseBlocking(nullptr));
+  ErrorPtr error;
+  size_t size = 0;
+  EXPECT_FALSE(writer_->WriteNonBlocking("a", 1, &size, &error));
+  EXPECT_EQ(errors::system::kDomain, error->GetDomain());
+  EXPECT_EQ("EPIPE", error->GetCode());
+}
+
+TEST_F(MemoryPipeStreamTest, BlockingWaitFailsWhenEmpty) {
+  ErrorPtr error;
+  EXPECT_FALSE(reader_->WaitForDataBlocking(Stream::AccessMode::READ,
+                                            base::TimeDelta::Max(), nullptr,
+                                            &error));
+  EXPECT_EQ(errors::stream::kOperationNotSupported, error->GetCode());
+  EXPECT_TRUE(writer_->WaitForDataBlocking(Stream::AccessMode::WRITE,
+                                           base::TimeDelta::Max(), nullptr,
+                                           nullptr));
+}
+
+TEST_F(MemoryPipeStreamTest, CopyThroughPipe) {
+  const std::string data = "The quick brown fox jumps over the lazy dog";
+
+  // Pump the data through the 4 byte pipe asynchronously, so both ends keep
+  // waking each other up.
+  EXPECT_TRUE(writer_->WriteAllAsync(
+      data.data(), data.size(),
+      base::Bind([](Stream* writer) { writer->CloseBlocking(nullptr); },
+                 writer_.get()),
+      base::Bind(&MemoryPipeStreamTest::OnError, base::Unretained(this)),
+      nullptr));
+  ReadNext();
+
+  while (!read_done_ && fake_loop_.RunOnce(false)) {}
+  EXPECT_TRUE(read_done_);
+  EXPECT_EQ(data, output_);
+}
+
+}  // namespace brillo
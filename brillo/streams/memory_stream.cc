@@ -61,6 +61,18 @@ StreamPtr MemoryStream::Create(size_t reserve_size, ErrorPtr* error) {
   return CreateEx(std::move(container), 0, error);
 }
 
+StreamPtr MemoryStream::CreateChunked(size_t chunk_size, ErrorPtr* error) {
+  if (chunk_size == 0) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "The chunk size must not be zero");
+    return nullptr;
+  }
+  std::unique_ptr<data_container::ChunkedBuffer> container{
+      new data_container::ChunkedBuffer{chunk_size}};
+  return CreateEx(std::move(container), 0, error);
+}
+
 StreamPtr MemoryStream::CreateRef(std::string* buffer, ErrorPtr* error) {
   std::unique_ptr<data_container::StringPtr> container{
       new data_container::StringPtr{buffer}};
@@ -74,6 +86,21 @@ StreamPtr MemoryStream::CreateRefForAppend(std::string* buffer,
   return CreateEx(std::move(container), buffer->size(), error);
 }
 
+StreamPtr MemoryStream::CreateRef(data_container::ChunkedBuffer* buffer,
+                                  ErrorPtr* error) {
+  std::unique_ptr<data_container::ChunkedBufferPtr> container{
+      new data_container::ChunkedBufferPtr{buffer}};
+  return CreateEx(std::move(container), 0, error);
+}
+
+StreamPtr MemoryStream::CreateRefForAppend(
+    data_container::ChunkedBuffer* buffer,
+    ErrorPtr* error) {
+  std::unique_ptr<data_container::ChunkedBufferPtr> container{
+      new data_container::ChunkedBufferPtr{buffer}};
+  return CreateEx(std::move(container), buffer->GetSize(), error);
+}
+
 StreamPtr MemoryStream::CreateEx(
     std::unique_ptr<data_container::DataContainerInterface> container,
     size_t stream_position,
@@ -154,6 +181,17 @@ bool MemoryStream::ReadNonBlocking(void* buffer,
   return true;
 }
 
+bool MemoryStream::ReadAtBlocking(uint64_t offset,
+                                  void* buffer,
+                                  size_t size_to_read,
+                                  size_t* size_read,
+                                  ErrorPtr* error) {
+  if (!CheckContainer(error) || !CheckOffset(offset, error))
+    return false;
+  return container_->Read(buffer, size_to_read, static_cast<size_t>(offset),
+                          size_read, error);
+}
+
 bool MemoryStream::WriteNonBlocking(const void* buffer,
                                     size_t size_to_write,
                                     size_t* size_written,
@@ -168,6 +206,17 @@ bool MemoryStream::WriteNonBlocking(const void* buffer,
   return true;
 }
 
+bool MemoryStream::WriteAtBlocking(uint64_t offset,
+                                   const void* buffer,
+                                   size_t size_to_write,
+                                   size_t* size_written,
+                                   ErrorPtr* error) {
+  if (!CheckContainer(error) || !CheckOffset(offset, error))
+    return false;
+  return container_->Write(buffer, size_to_write, static_cast<size_t>(offset),
+                           size_written, error);
+}
+
 bool MemoryStream::FlushBlocking(ErrorPtr* error) {
   return CheckContainer(error);
 }
@@ -182,6 +231,17 @@ bool MemoryStream::CheckContainer(ErrorPtr* error) const {
   return container_ || stream_utils::ErrorStreamClosed(FROM_HERE, error);
 }
 
+bool MemoryStream::CheckOffset(uint64_t offset, ErrorPtr* error) const {
+  if (offset > static_cast<uint64_t>(std::numeric_limits<size_t>::max())) {
+    // This can only be the case on 32 bit systems.
+    brillo::Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                         errors::stream::kInvalidParameter,
+                         "Stream offset is outside allowed limits");
+    return false;
+  }
+  return true;
+}
+
 bool MemoryStream::WaitForData(AccessMode mode,
                                const base::Callback<void(AccessMode)>& callback,
                                ErrorPtr* /* error */) {
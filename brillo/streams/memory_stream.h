@@ -48,6 +48,10 @@ namespace brillo {
 //                 positions the stream seek pointer at the end of the data,
 //                 which makes it possible to append more data to the existing
 //                 container.
+//  - CreateChunked - similar to Create but stores the data in a list of
+//                 fixed-size chunks (data_container::ChunkedBuffer), so that
+//                 growing the stream never copies the data already written.
+//                 Preferred for very large in-memory streams.
 class BRILLO_EXPORT MemoryStream : public Stream {
  public:
   // == Construction ==========================================================
@@ -93,6 +97,11 @@ class BRILLO_EXPORT MemoryStream : public Stream {
 
   inline static StreamPtr Create(ErrorPtr* error) { return Create(0, error); }
 
+  // Creates new stream for reading/writing that stores its data in an internal
+  // chunked buffer made of |chunk_size| byte chunks. |chunk_size| must not be
+  // zero.
+  static StreamPtr CreateChunked(size_t chunk_size, ErrorPtr* error);
+
   // Creates new stream for reading/writing stored in a string. The string
   // |buffer| must remain valid during the lifetime of the stream.
   // The stream pointer will be at the beginning of the string and the string's
@@ -129,6 +138,17 @@ class BRILLO_EXPORT MemoryStream : public Stream {
     return CreateEx(std::move(container), buffer->size() * sizeof(T), error);
   }
 
+  // Creates new stream for reading/writing stored in a chunked buffer. The
+  // |buffer| must remain valid during the lifetime of the stream. The data
+  // can be accessed chunk by chunk through |buffer| after it has been written.
+  // The stream pointer will be at the beginning of the data.
+  static StreamPtr CreateRef(data_container::ChunkedBuffer* buffer,
+                             ErrorPtr* error);
+
+  // Same as above, but the stream pointer will be at the end of the data.
+  static StreamPtr CreateRefForAppend(data_container::ChunkedBuffer* buffer,
+                                      ErrorPtr* error);
+
   ///------------------------------------------------------------------------
   // Generic stream creation on a data container. Takes an arbitrary |container|
   // and constructs a stream using it. The container determines the traits of
@@ -165,12 +185,22 @@ class BRILLO_EXPORT MemoryStream : public Stream {
                        size_t* size_read,
                        bool* end_of_stream,
                        ErrorPtr* error) override;
+  bool ReadAtBlocking(uint64_t offset,
+                      void* buffer,
+                      size_t size_to_read,
+                      size_t* size_read,
+                      ErrorPtr* error) override;
 
   // == Write operations ======================================================
   bool WriteNonBlocking(const void* buffer,
                         size_t size_to_write,
                         size_t* size_written,
                         ErrorPtr* error) override;
+  bool WriteAtBlocking(uint64_t offset,
+                       const void* buffer,
+                       size_t size_to_write,
+                       size_t* size_written,
+                       ErrorPtr* error) override;
 
   // == Finalizing/closing streams  ===========================================
   bool FlushBlocking(ErrorPtr* error) override;
@@ -198,6 +228,9 @@ class BRILLO_EXPORT MemoryStream : public Stream {
   // Checks if the stream has a valid container.
   bool CheckContainer(ErrorPtr* error) const;
 
+  // Makes sure |offset| can be used to index the container.
+  bool CheckOffset(uint64_t offset, ErrorPtr* error) const;
+
   // Data container the stream is using to write and/or read data.
   std::unique_ptr<data_container::DataContainerInterface> container_;
 
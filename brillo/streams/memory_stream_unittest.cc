@@ -199,6 +199,26 @@ TEST_F(MemoryStreamTest, WriteNonBlocking) {
   EXPECT_EQ(115, stream_->GetPosition());
 }
 
+TEST_F(MemoryStreamTest, ReadAtBlocking) {
+  size_t read = 0;
+  EXPECT_CALL(container_mock(), Read(test_read_buffer_, 10, 200, _, nullptr))
+    .WillOnce(DoAll(SetArgPointee<3>(10), Return(true)));
+  EXPECT_TRUE(stream_->ReadAtBlocking(200, test_read_buffer_, 10, &read,
+                                      nullptr));
+  EXPECT_EQ(10, read);
+  EXPECT_EQ(0, stream_->GetPosition());
+}
+
+TEST_F(MemoryStreamTest, WriteAtBlocking) {
+  size_t written = 0;
+  EXPECT_CALL(container_mock(), Write(test_write_buffer_, 10, 200, _, nullptr))
+    .WillOnce(DoAll(SetArgPointee<3>(10), Return(true)));
+  EXPECT_TRUE(stream_->WriteAtBlocking(200, test_write_buffer_, 10, &written,
+                                       nullptr));
+  EXPECT_EQ(10, written);
+  EXPECT_EQ(0, stream_->GetPosition());
+}
+
 //////////////////////////////////////////////////////////////////////////////
 // Factory method tests.
 TEST(MemoryStream, OpenBinary) {
@@ -379,4 +399,44 @@ TEST(MemoryStream, CreateString) {
   EXPECT_EQ("abcd_1234", buffer);
 }
 
+TEST(MemoryStream, CreateChunked) {
+  data_container::ChunkedBuffer buffer{4};
+  StreamPtr stream = MemoryStream::CreateRef(&buffer, nullptr);
+  EXPECT_EQ(0, stream->GetSize());
+  EXPECT_TRUE(stream->WriteAllBlocking("abcdefghij", 10, nullptr));
+  EXPECT_EQ(10, stream->GetPosition());
+  EXPECT_EQ(10, stream->GetSize());
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+
+  stream = MemoryStream::CreateRefForAppend(&buffer, nullptr);
+  EXPECT_EQ(10, stream->GetPosition());
+  EXPECT_TRUE(stream->WriteAllBlocking("kl", 2, nullptr));
+  EXPECT_TRUE(stream->SetPosition(2, nullptr));
+  char data[12];
+  EXPECT_TRUE(stream->ReadAllBlocking(data, 10, nullptr));
+  EXPECT_EQ("cdefghijkl", std::string(data, 10));
+  EXPECT_TRUE(stream->CloseBlocking(nullptr));
+
+  // The data can be accessed without flattening it.
+  std::string chunks;
+  for (size_t i = 0; i < buffer.GetChunkCount(); i++) {
+    chunks += '[';
+    chunks.append(reinterpret_cast<const char*>(buffer.GetChunkData(i)),
+                  buffer.GetChunkSize(i));
+    chunks += ']';
+  }
+  EXPECT_EQ("[abcd][efgh][ijkl]", chunks);
+
+  stream = MemoryStream::CreateChunked(4, nullptr);
+  EXPECT_TRUE(stream->WriteAllBlocking("abc", 3, nullptr));
+  EXPECT_TRUE(stream->SetPosition(0, nullptr));
+  EXPECT_EQ('a', ReadByte(stream.get(), nullptr));
+
+  ErrorPtr error;
+  EXPECT_EQ(nullptr, MemoryStream::CreateChunked(0, &error));
+  ASSERT_NE(nullptr, error.get());
+  EXPECT_EQ(errors::stream::kDomain, error->GetDomain());
+  EXPECT_EQ(errors::stream::kInvalidParameter, error->GetCode());
+}
+
 }  // namespace brillo
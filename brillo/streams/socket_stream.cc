@@ -0,0 +1,395 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/socket_stream.h>
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/files/scoped_file.h>
+#include <base/logging.h>
+#include <base/posix/eintr_wrapper.h>
+#include <base/threading/platform_thread.h>
+#include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/streams/file_stream.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace brillo {
+
+namespace {
+
+const char kResolverErrorDomain[] = "getaddrinfo";
+
+// The result of a name resolution, shared between the resolver thread and the
+// connecting thread.
+struct ResolveResult {
+  ~ResolveResult() {
+    if (addresses)
+      freeaddrinfo(addresses);
+  }
+
+  int error{0};
+  addrinfo* addresses{nullptr};
+};
+
+// Thread running the blocking getaddrinfo() call. Once the name is resolved,
+// one byte is written to |notify_fd| to wake up the connecting thread. The
+// object deletes itself when done.
+class ResolverThread : public base::PlatformThread::Delegate {
+ public:
+  ResolverThread(const std::string& host,
+                 const std::string& service,
+                 const std::shared_ptr<ResolveResult>& result,
+                 base::ScopedFD notify_fd)
+      : host_{host},
+        service_{service},
+        result_{result},
+        notify_fd_{std::move(notify_fd)} {}
+
+  void ThreadMain() override {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_ADDRCONFIG | AI_NUMERICSERV;
+    result_->error = getaddrinfo(host_.c_str(), service_.c_str(), &hints,
+                                 &result_->addresses);
+    // The other end may already be gone if the connection timed out, so
+    // make sure this does not raise SIGPIPE.
+    char byte = 0;
+    HANDLE_EINTR(send(notify_fd_.get(), &byte, sizeof(byte), MSG_NOSIGNAL));
+    delete this;
+  }
+
+ private:
+  std::string host_;
+  std::string service_;
+  std::shared_ptr<ResolveResult> result_;
+  base::ScopedFD notify_fd_;
+
+  DISALLOW_COPY_AND_ASSIGN(ResolverThread);
+};
+
+struct Address {
+  sockaddr_storage storage;
+  socklen_t length;
+};
+
+// A connection attempt in progress.
+struct Attempt {
+  base::ScopedFD socket;
+  MessageLoop::TaskId watch_task{MessageLoop::kTaskIdNull};
+};
+
+struct ConnectState {
+  std::string host;
+  std::string service;
+  SocketStream::Options options;
+  SocketStream::SuccessCallback success_callback;
+  Stream::ErrorCallback error_callback;
+
+  // Name resolution in progress, if any.
+  std::shared_ptr<ResolveResult> resolve_result;
+  base::ScopedFD resolve_notify_fd;
+  MessageLoop::TaskId resolve_task{MessageLoop::kTaskIdNull};
+
+  // Addresses to connect to, in the order to try them.
+  std::vector<Address> addresses;
+  size_t next_address{0};
+  std::vector<Attempt> attempts;
+  // errno of the last failed connection attempt.
+  int last_error{0};
+
+  MessageLoop::TaskId attempt_delay_task{MessageLoop::kTaskIdNull};
+  MessageLoop::TaskId timeout_task{MessageLoop::kTaskIdNull};
+  // Set once one of the callbacks has been called.
+  bool done{false};
+};
+
+// Forward declarations.
+void StartNextAttempt(const std::shared_ptr<ConnectState>& state);
+
+void CancelTask(MessageLoop::TaskId* task_id) {
+  if (*task_id != MessageLoop::kTaskIdNull) {
+    MessageLoop::current()->CancelTask(*task_id);
+    *task_id = MessageLoop::kTaskIdNull;
+  }
+}
+
+// Cancels everything still in progress, which also releases all the
+// references to |state| held by the pending tasks.
+void Cleanup(const std::shared_ptr<ConnectState>& state) {
+  state->done = true;
+  CancelTask(&state->resolve_task);
+  state->resolve_notify_fd.reset();
+  for (Attempt& attempt : state->attempts)
+    CancelTask(&attempt.watch_task);
+  state->attempts.clear();
+  CancelTask(&state->attempt_delay_task);
+  CancelTask(&state->timeout_task);
+}
+
+void ReportError(const std::shared_ptr<ConnectState>& state,
+                 const ErrorPtr& error) {
+  Cleanup(state);
+  state->error_callback.Run(error.get());
+}
+
+void ReportSuccess(const std::shared_ptr<ConnectState>& state,
+                   base::ScopedFD socket) {
+  Cleanup(state);
+
+  int value = 1;
+  if (state->options.no_delay &&
+      setsockopt(socket.get(), IPPROTO_TCP, TCP_NODELAY, &value,
+                 sizeof(value)) < 0) {
+    PLOG(WARNING) << "Failed to set TCP_NODELAY";
+  }
+  if (state->options.keep_alive &&
+      setsockopt(socket.get(), SOL_SOCKET, SO_KEEPALIVE, &value,
+                 sizeof(value)) < 0) {
+    PLOG(WARNING) << "Failed to set SO_KEEPALIVE";
+  }
+
+  ErrorPtr error;
+  StreamPtr stream = FileStream::FromFileDescriptor(socket.get(), true, &error);
+  if (!stream) {
+    state->error_callback.Run(error.get());
+    return;
+  }
+  ignore_result(socket.release());  // Now owned by |stream|.
+  state->success_callback.Run(std::move(stream));
+}
+
+// Fails the whole operation after trying all the addresses.
+void ReportConnectError(const std::shared_ptr<ConnectState>& state) {
+  ErrorPtr error;
+  errors::system::AddSystemError(&error, FROM_HERE,
+                                 state->last_error ? state->last_error
+                                                   : EHOSTUNREACH);
+  ReportError(state, error);
+}
+
+// Stores the resolved |addresses| in |state|, interleaving the address
+// families as recommended by RFC 8305, section 4.
+void SetAddresses(const std::shared_ptr<ConnectState>& state,
+                  const addrinfo* addresses) {
+  std::vector<Address> primary;
+  std::vector<Address> secondary;
+  for (const addrinfo* info = addresses; info; info = info->ai_next) {
+    if (info->ai_addrlen > sizeof(sockaddr_storage))
+      continue;
+    Address address;
+    memcpy(&address.storage, info->ai_addr, info->ai_addrlen);
+    address.length = info->ai_addrlen;
+    if (primary.empty() ||
+        primary.front().storage.ss_family == address.storage.ss_family) {
+      primary.push_back(address);
+    } else {
+      secondary.push_back(address);
+    }
+  }
+
+  state->addresses.clear();
+  for (size_t i = 0; i < std::max(primary.size(), secondary.size()); i++) {
+    if (i < primary.size())
+      state->addresses.push_back(primary[i]);
+    if (i < secondary.size())
+      state->addresses.push_back(secondary[i]);
+  }
+  state->next_address = 0;
+}
+
+void OnTimeout(const std::shared_ptr<ConnectState>& state) {
+  state->timeout_task = MessageLoop::kTaskIdNull;
+  ErrorPtr error;
+  stream_utils::ErrorOperationTimeout(FROM_HERE, &error);
+  ReportError(state, error);
+}
+
+void OnAttemptDelayExpired(const std::shared_ptr<ConnectState>& state) {
+  state->attempt_delay_task = MessageLoop::kTaskIdNull;
+  StartNextAttempt(state);
+}
+
+void OnAttemptReady(const std::shared_ptr<ConnectState>& state, int fd) {
+  auto it = state->attempts.begin();
+  while (it != state->attempts.end() && it->socket.get() != fd)
+    ++it;
+  if (it == state->attempts.end())
+    return;
+
+  it->watch_task = MessageLoop::kTaskIdNull;
+  int socket_error = 0;
+  socklen_t length = sizeof(socket_error);
+  if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &socket_error, &length) < 0)
+    socket_error = errno;
+
+  if (socket_error == 0) {
+    base::ScopedFD socket = std::move(it->socket);
+    state->attempts.erase(it);
+    ReportSuccess(state, std::move(socket));
+    return;
+  }
+
+  VLOG(1) << "Connection attempt to " << state->host << " failed: "
+          << strerror(socket_error);
+  state->last_error = socket_error;
+  state->attempts.erase(it);
+  // Don't wait for the attempt delay to expire to try the next address.
+  CancelTask(&state->attempt_delay_task);
+  StartNextAttempt(state);
+}
+
+void StartNextAttempt(const std::shared_ptr<ConnectState>& state) {
+  while (state->next_address < state->addresses.size()) {
+    const Address& address = state->addresses[state->next_address++];
+    base::ScopedFD socket{
+        ::socket(address.storage.ss_family,
+                 SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP)};
+    if (!socket.is_valid()) {
+      state->last_error = errno;
+      continue;
+    }
+
+    int ret = HANDLE_EINTR(
+        connect(socket.get(),
+                reinterpret_cast<const sockaddr*>(&address.storage),
+                address.length));
+    if (ret == 0) {
+      ReportSuccess(state, std::move(socket));
+      return;
+    }
+    if (errno != EINPROGRESS) {
+      state->last_error = errno;
+      continue;
+    }
+
+    Attempt attempt;
+    attempt.watch_task = MessageLoop::current()->WatchFileDescriptor(
+        FROM_HERE, socket.get(), MessageLoop::kWatchWrite, false,
+        base::Bind(&OnAttemptReady, state, socket.get()));
+    attempt.socket = std::move(socket);
+    state->attempts.push_back(std::move(attempt));
+
+    if (state->next_address < state->addresses.size()) {
+      state->attempt_delay_task = MessageLoop::current()->PostDelayedTask(
+          FROM_HERE, base::Bind(&OnAttemptDelayExpired, state),
+          state->options.attempt_delay);
+    }
+    return;
+  }
+
+  // All the addresses have been tried; fail once the last pending attempt
+  // has failed too.
+  if (state->attempts.empty())
+    ReportConnectError(state);
+}
+
+void OnResolved(const std::shared_ptr<ConnectState>& state) {
+  state->resolve_task = MessageLoop::kTaskIdNull;
+  state->resolve_notify_fd.reset();
+  std::shared_ptr<ResolveResult> result = std::move(state->resolve_result);
+  if (result->error != 0) {
+    ErrorPtr error;
+    Error::AddTo(&error, FROM_HERE, kResolverErrorDomain,
+                 std::to_string(result->error), gai_strerror(result->error));
+    ReportError(state, error);
+    return;
+  }
+  SetAddresses(state, result->addresses);
+  StartNextAttempt(state);
+}
+
+void StartResolve(const std::shared_ptr<ConnectState>& state) {
+  if (state->done)
+    return;  // Timed out before the operation could start.
+
+  // Numeric addresses don't need a trip to the resolver thread.
+  addrinfo hints;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
+  addrinfo* addresses = nullptr;
+  if (getaddrinfo(state->host.c_str(), state->service.c_str(), &hints,
+                  &addresses) == 0) {
+    SetAddresses(state, addresses);
+    freeaddrinfo(addresses);
+    StartNextAttempt(state);
+    return;
+  }
+
+  ErrorPtr error;
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+    errors::system::AddSystemError(&error, FROM_HERE, errno);
+    ReportError(state, error);
+    return;
+  }
+  base::ScopedFD read_fd{fds[0]};
+  base::ScopedFD write_fd{fds[1]};
+
+  state->resolve_result = std::make_shared<ResolveResult>();
+  ResolverThread* resolver =
+      new ResolverThread{state->host, state->service, state->resolve_result,
+                         std::move(write_fd)};
+  if (!base::PlatformThread::CreateNonJoinable(0, resolver)) {
+    delete resolver;
+    Error::AddTo(&error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kOperationNotSupported,
+                 "Failed to start the name resolver thread");
+    ReportError(state, error);
+    return;
+  }
+
+  state->resolve_task = MessageLoop::current()->WatchFileDescriptor(
+      FROM_HERE, read_fd.get(), MessageLoop::kWatchRead, false,
+      base::Bind(&OnResolved, state));
+  state->resolve_notify_fd = std::move(read_fd);
+}
+
+}  // anonymous namespace
+
+void SocketStream::ConnectAsync(const std::string& host,
+                                uint16_t port,
+                                const Options& options,
+                                const SuccessCallback& success_callback,
+                                const Stream::ErrorCallback& error_callback) {
+  auto state = std::make_shared<ConnectState>();
+  state->host = host;
+  state->service = std::to_string(port);
+  state->options = options;
+  state->success_callback = success_callback;
+  state->error_callback = error_callback;
+
+  state->timeout_task = MessageLoop::current()->PostDelayedTask(
+      FROM_HERE, base::Bind(&OnTimeout, state), options.timeout);
+  // Start from the message loop so the callbacks are never called before
+  // ConnectAsync() returns.
+  MessageLoop::current()->PostTask(FROM_HERE,
+                                   base::Bind(&StartResolve, state));
+}
+
+void SocketStream::ConnectAsync(const std::string& host,
+                                uint16_t port,
+                                const SuccessCallback& success_callback,
+                                const Stream::ErrorCallback& error_callback) {
+  ConnectAsync(host, port, Options{}, success_callback, error_callback);
+}
+
+}  // namespace brillo
@@ -0,0 +1,69 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_SOCKET_STREAM_H_
+#define LIBBRILLO_BRILLO_STREAMS_SOCKET_STREAM_H_
+
+#include <string>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/time/time.h>
+#include <brillo/brillo_export.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+// SocketStream creates streams connected to remote TCP servers.
+// ConnectAsync() resolves the host name without blocking the calling thread,
+// connects to the resulting addresses using the "Happy Eyeballs" algorithm
+// (RFC 8305): the addresses are tried in the order returned by the resolver
+// with the address families interleaved, and if a connection attempt does not
+// complete within Options::attempt_delay, the next address is tried in
+// parallel. The first connection to be established wins.
+//
+// The resulting stream is a FileStream owning the socket, so it supports
+// non-blocking and asynchronous I/O and can be passed to TlsStream::Connect()
+// to establish a secure connection.
+//
+// ConnectAsync() must be called on a thread with a current MessageLoop, and
+// the callbacks are invoked from that message loop.
+class BRILLO_EXPORT SocketStream {
+ public:
+  // Parameters of the connection.
+  struct Options {
+    // Maximum time for the whole operation, including name resolution.
+    base::TimeDelta timeout{base::TimeDelta::FromSeconds(30)};
+    // Time to wait for a connection attempt before starting the next one.
+    base::TimeDelta attempt_delay{base::TimeDelta::FromMilliseconds(250)};
+    // Disable Nagle's algorithm (TCP_NODELAY) on the connected socket.
+    bool no_delay{true};
+    // Enable TCP keep-alive probes (SO_KEEPALIVE) on the connected socket.
+    bool keep_alive{false};
+  };
+
+  using SuccessCallback = base::Callback<void(StreamPtr)>;
+
+  // Connects to |port| at |host|, which may be a host name or a numeric IPv4
+  // or IPv6 address. Calls |success_callback| with the connected stream, or
+  // |error_callback| if the connection could not be established.
+  static void ConnectAsync(const std::string& host,
+                           uint16_t port,
+                           const Options& options,
+                           const SuccessCallback& success_callback,
+                           const Stream::ErrorCallback& error_callback);
+
+  // Same as above, using the default options.
+  static void ConnectAsync(const std::string& host,
+                           uint16_t port,
+                           const SuccessCallback& success_callback,
+                           const Stream::ErrorCallback& error_callback);
+
+ private:
+  DISALLOW_IMPLICIT_CONSTRUCTORS(SocketStream);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_SOCKET_STREAM_H_
@@ -0,0 +1,139 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/socket_stream.h>
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+
+#include <base/bind.h>
+#include <base/files/scoped_file.h>
+#include <base/message_loop/message_loop.h>
+#include <brillo/errors/error_codes.h>
+#include <brillo/message_loops/base_message_loop.h>
+#include <brillo/message_loops/message_loop_utils.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+
+namespace {
+
+// Creates a TCP socket listening on an ephemeral loopback port and returns it
+// in |socket|, along with the port number.
+void Listen(base::ScopedFD* socket, uint16_t* port) {
+  socket->reset(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+  ASSERT_TRUE(socket->is_valid());
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(0, bind(socket->get(), reinterpret_cast<sockaddr*>(&address),
+                    sizeof(address)));
+  ASSERT_EQ(0, listen(socket->get(), 1));
+  socklen_t length = sizeof(address);
+  ASSERT_EQ(0, getsockname(socket->get(), reinterpret_cast<sockaddr*>(&address),
+                           &length));
+  *port = ntohs(address.sin_port);
+}
+
+}  // anonymous namespace
+
+class SocketStreamTest : public testing::Test {
+ public:
+  void SetUp() override {
+    brillo_loop_.SetAsCurrent();
+  }
+
+  // Connects to |host|:|port| and runs the message loop until the operation
+  // completes.
+  void Connect(const std::string& host, uint16_t port) {
+    SocketStream::Options options;
+    options.timeout = base::TimeDelta::FromSeconds(5);
+    SocketStream::ConnectAsync(
+        host, port, options,
+        base::Bind(&SocketStreamTest::OnSuccess, base::Unretained(this)),
+        base::Bind(&SocketStreamTest::OnError, base::Unretained(this)));
+    MessageLoopRunUntil(&brillo_loop_, base::TimeDelta::FromSeconds(10),
+                        base::Bind(&SocketStreamTest::IsDone,
+                                   base::Unretained(this)));
+  }
+
+  void OnSuccess(StreamPtr stream) {
+    stream_ = std::move(stream);
+    done_ = true;
+  }
+
+  void OnError(const Error* error) {
+    ASSERT_NE(nullptr, error);
+    error_ = error->Clone();
+    done_ = true;
+  }
+
+  bool IsDone() { return done_; }
+
+ protected:
+  base::MessageLoopForIO base_loop_;
+  BaseMessageLoop brillo_loop_{&base_loop_};
+
+  bool done_{false};
+  StreamPtr stream_;
+  ErrorPtr error_;
+};
+
+TEST_F(SocketStreamTest, ConnectNumericAddress) {
+  base::ScopedFD server;
+  uint16_t port = 0;
+  Listen(&server, &port);
+
+  Connect("127.0.0.1", port);
+  ASSERT_NE(nullptr, stream_.get());
+  EXPECT_EQ(nullptr, error_.get());
+  EXPECT_TRUE(stream_->CanRead());
+  EXPECT_TRUE(stream_->CanWrite());
+  EXPECT_FALSE(stream_->CanSeek());
+
+  base::ScopedFD client{accept(server.get(), nullptr, nullptr)};
+  ASSERT_TRUE(client.is_valid());
+  const std::string data = "hello";
+  EXPECT_TRUE(stream_->WriteAllBlocking(data.data(), data.size(), nullptr));
+  char buffer[16] = {};
+  ASSERT_EQ(static_cast<ssize_t>(data.size()),
+            recv(client.get(), buffer, data.size(), MSG_WAITALL));
+  EXPECT_EQ(data, std::string(buffer, data.size()));
+  EXPECT_TRUE(stream_->CloseBlocking(nullptr));
+}
+
+TEST_F(SocketStreamTest, ConnectHostName) {
+  base::ScopedFD server;
+  uint16_t port = 0;
+  Listen(&server, &port);
+
+  // "localhost" is not numeric so it goes through the resolver thread. It may
+  // resolve to ::1 first, in which case the connection falls back to IPv4.
+  Connect("localhost", port);
+  ASSERT_NE(nullptr, stream_.get());
+  EXPECT_EQ(nullptr, error_.get());
+  base::ScopedFD client{accept(server.get(), nullptr, nullptr)};
+  EXPECT_TRUE(client.is_valid());
+}
+
+TEST_F(SocketStreamTest, ConnectionRefused) {
+  base::ScopedFD server;
+  uint16_t port = 0;
+  Listen(&server, &port);
+  // Free the port so nothing is listening on it anymore.
+  server.reset();
+
+  Connect("127.0.0.1", port);
+  EXPECT_EQ(nullptr, stream_.get());
+  ASSERT_NE(nullptr, error_.get());
+  EXPECT_EQ(errors::system::kDomain, error_->GetDomain());
+  EXPECT_EQ("ECONNREFUSED", error_->GetCode());
+}
+
+}  // namespace brillo
@@ -14,6 +14,8 @@
 
 namespace brillo {
 
+const size_t Stream::kMaxChunksPerDispatch;
+
 bool Stream::TruncateBlocking(ErrorPtr* error) {
   return SetSizeBlocking(GetPosition(), error);
 }
@@ -62,6 +64,37 @@ bool Stream::ReadAllAsync(void* buffer,
                        true);
 }
 
+bool Stream::ReadChunksAsync(void* buffer,
+                             size_t buffer_size,
+                             const ReadChunkCallback& chunk_callback,
+                             const ErrorCallback& error_callback,
+                             ErrorPtr* error) {
+  if (is_async_read_pending_) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kOperationNotSupported,
+                 "Another asynchronous operation is still pending");
+    return false;
+  }
+  if (buffer_size == 0) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "The read buffer must not be empty");
+    return false;
+  }
+
+  is_async_read_pending_ = true;
+  chunk_buffer_ = buffer;
+  chunk_buffer_size_ = buffer_size;
+  chunk_callback_ = chunk_callback;
+  chunk_error_callback_ = error_callback;
+  on_chunks_available_ = base::Bind(&Stream::OnReadChunksAvailable,
+                                    weak_ptr_factory_.GetWeakPtr());
+  // Like ReadAsync(), never call back before this method returns.
+  MessageLoop::current()->PostTask(
+      FROM_HERE, base::Bind(on_chunks_available_, AccessMode::READ));
+  return true;
+}
+
 bool Stream::ReadBlocking(void* buffer,
                           size_t size_to_read,
                           size_t* size_read,
@@ -99,6 +132,35 @@ bool Stream::ReadAllBlocking(void* buffer,
   return true;
 }
 
+bool Stream::ReadAtBlocking(uint64_t /* offset */,
+                            void* /* buffer */,
+                            size_t /* size_to_read */,
+                            size_t* /* size_read */,
+                            ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool Stream::ReadAtAsync(uint64_t offset,
+                         void* buffer,
+                         size_t size_to_read,
+                         const base::Callback<void(size_t)>& success_callback,
+                         const ErrorCallback& error_callback,
+                         ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!CanSeek())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  // Seekable streams are backed by storage which is always ready, so there is
+  // no need to wait for data before doing the I/O.
+  MessageLoop::current()->PostTask(
+      FROM_HERE,
+      base::Bind(&Stream::ReadAtAsyncCallback, weak_ptr_factory_.GetWeakPtr(),
+                 offset, buffer, size_to_read, success_callback,
+                 error_callback));
+  return true;
+}
+
 bool Stream::WriteAsync(const void* buffer,
                         size_t size_to_write,
                         const base::Callback<void(size_t)>& success_callback,
@@ -174,6 +236,37 @@ bool Stream::WriteAllBlocking(const void* buffer,
   return true;
 }
 
+bool Stream::WriteAtBlocking(uint64_t /* offset */,
+                             const void* /* buffer */,
+                             size_t /* size_to_write */,
+                             size_t* /* size_written */,
+                             ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool Stream::WriteAtAsync(uint64_t offset,
+                          const void* buffer,
+                          size_t size_to_write,
+                          const base::Callback<void(size_t)>& success_callback,
+                          const ErrorCallback& error_callback,
+                          ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!CanSeek())
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  MessageLoop::current()->PostTask(
+      FROM_HERE,
+      base::Bind(&Stream::WriteAtAsyncCallback, weak_ptr_factory_.GetWeakPtr(),
+                 offset, buffer, size_to_write, success_callback,
+                 error_callback));
+  return true;
+}
+
+int Stream::GetFileDescriptor() const {
+  return -1;
+}
+
 bool Stream::FlushAsync(const base::Closure& success_callback,
                         const ErrorCallback& error_callback,
                         ErrorPtr* /* error */) {
@@ -256,6 +349,62 @@ void Stream::OnReadAvailable(
   }
 }
 
+void Stream::OnReadChunksAvailable(AccessMode mode) {
+  CHECK(stream_utils::IsReadAccessMode(mode));
+  CHECK(is_async_read_pending_);
+  base::WeakPtr<Stream> self = weak_ptr_factory_.GetWeakPtr();
+  ErrorPtr error;
+  for (size_t chunk = 0; chunk < kMaxChunksPerDispatch; chunk++) {
+    size_t read = 0;
+    bool eos = false;
+    if (!ReadNonBlocking(chunk_buffer_, chunk_buffer_size_, &read, &eos,
+                         &error)) {
+      ErrorCallback error_callback = chunk_error_callback_;
+      EndReadChunks();
+      error_callback.Run(error.get());
+      return;
+    }
+
+    if (read == 0 && !eos) {
+      // No more data for now. The same callback is reused for every wait.
+      if (!WaitForData(AccessMode::READ, on_chunks_available_, &error)) {
+        ErrorCallback error_callback = chunk_error_callback_;
+        EndReadChunks();
+        error_callback.Run(error.get());
+      }
+      return;
+    }
+
+    // Copy the callback since it might destroy the stream (and the member).
+    ReadChunkCallback chunk_callback = chunk_callback_;
+    if (eos) {
+      EndReadChunks();
+      chunk_callback.Run(read, true);
+      return;
+    }
+    bool keep_reading = chunk_callback.Run(read, false);
+    if (!self)
+      return;  // The stream was destroyed or the operation cancelled.
+    if (!keep_reading) {
+      EndReadChunks();
+      return;
+    }
+  }
+
+  // Let the other message loop sources run before delivering more data.
+  MessageLoop::current()->PostTask(
+      FROM_HERE, base::Bind(on_chunks_available_, AccessMode::READ));
+}
+
+void Stream::EndReadChunks() {
+  is_async_read_pending_ = false;
+  chunk_buffer_ = nullptr;
+  chunk_buffer_size_ = 0;
+  chunk_callback_.Reset();
+  chunk_error_callback_.Reset();
+  on_chunks_available_.Reset();
+}
+
 bool Stream::WriteAsyncImpl(
     const void* buffer,
     size_t size_to_write,
@@ -373,6 +522,36 @@ void Stream::WriteAllAsyncCallback(const void* buffer,
   }
 }
 
+void Stream::ReadAtAsyncCallback(
+    uint64_t offset,
+    void* buffer,
+    size_t size_to_read,
+    const base::Callback<void(size_t)>& success_callback,
+    const ErrorCallback& error_callback) {
+  ErrorPtr error;
+  size_t size_read = 0;
+  if (ReadAtBlocking(offset, buffer, size_to_read, &size_read, &error)) {
+    success_callback.Run(size_read);
+  } else {
+    error_callback.Run(error.get());
+  }
+}
+
+void Stream::WriteAtAsyncCallback(
+    uint64_t offset,
+    const void* buffer,
+    size_t size_to_write,
+    const base::Callback<void(size_t)>& success_callback,
+    const ErrorCallback& error_callback) {
+  ErrorPtr error;
+  size_t size_written = 0;
+  if (WriteAtBlocking(offset, buffer, size_to_write, &size_written, &error)) {
+    success_callback.Run(size_written);
+  } else {
+    error_callback.Run(error.get());
+  }
+}
+
 void Stream::FlushAsyncCallback(const base::Closure& success_callback,
                                 const ErrorCallback& error_callback) {
   ErrorPtr error;
@@ -385,7 +564,7 @@ void Stream::FlushAsyncCallback(const base::Closure& success_callback,
 
 void Stream::CancelPendingAsyncOperations() {
   weak_ptr_factory_.InvalidateWeakPtrs();
-  is_async_read_pending_ = false;
+  EndReadChunks();
   is_async_write_pending_ = false;
 }
 
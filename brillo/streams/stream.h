@@ -90,6 +90,9 @@ class BRILLO_EXPORT Stream {
 
   // Standard error callback for asynchronous operations.
   using ErrorCallback = base::Callback<void(const Error*)>;
+  // Callback receiving the data read by ReadChunksAsync(). Returns false to
+  // stop reading.
+  using ReadChunkCallback = base::Callback<bool(size_t size_read, bool eos)>;
 
   virtual ~Stream() = default;
 
@@ -135,6 +138,14 @@ class BRILLO_EXPORT Stream {
   // method can be used to check how reliable a call to GetSize() is.
   virtual bool CanGetSize() const = 0;
 
+  // Returns the file descriptor backing the stream, or -1 if the stream is not
+  // based on a file descriptor. This lets code that needs to talk to the
+  // kernel directly (e.g. to set socket options) operate on the stream.
+  // Data buffered by the stream in user space is not visible through the
+  // descriptor, so the descriptor must not be used for I/O while such data
+  // might be present.
+  virtual int GetFileDescriptor() const;
+
   // == Stream size operations ================================================
 
   // Returns the size of stream data.
@@ -219,6 +230,31 @@ class BRILLO_EXPORT Stream {
                             const ErrorCallback& error_callback,
                             ErrorPtr* error);
 
+  // Reads the stream continuously into |buffer|, one chunk at a time, until
+  // the end of the stream is reached, an error occurs or |chunk_callback|
+  // returns false. |chunk_callback| is called with the size of each chunk
+  // read into |buffer| (up to |buffer_size|) and the end-of-stream flag; the
+  // data must be consumed before returning, since the next chunk is read into
+  // the same buffer. The return value of |chunk_callback| is ignored at the
+  // end of the stream.
+  // Unlike repeated calls to ReadAsync(), this reuses the same callbacks for
+  // the whole operation and delivers all the data available without returning
+  // to the message loop (up to kMaxChunksPerDispatch chunks at a time), so
+  // reading a stream in many small pieces doesn't allocate per chunk.
+  // The operation counts as a pending asynchronous read until it finishes. It
+  // can also be stopped with CancelPendingAsyncOperations(), including from
+  // |chunk_callback|.
+  // Uses ReadNonBlocking() and WaitForData().
+  virtual bool ReadChunksAsync(void* buffer,
+                               size_t buffer_size,
+                               const ReadChunkCallback& chunk_callback,
+                               const ErrorCallback& error_callback,
+                               ErrorPtr* error);
+
+  // Maximum number of chunks ReadChunksAsync() delivers before yielding to
+  // the message loop.
+  static const size_t kMaxChunksPerDispatch = 16;
+
   // -- Synchronous non-blocking ----------------------------------------------
 
   // Reads up to |size_to_read| bytes from the stream without blocking.
@@ -264,6 +300,33 @@ class BRILLO_EXPORT Stream {
                                size_t size_to_read,
                                ErrorPtr* error);
 
+  // -- Positional ------------------------------------------------------------
+
+  // Reads up to |size_to_read| bytes at |offset| bytes from the beginning of
+  // the stream. The stream position is neither used nor changed, so several
+  // users can read different parts of the same stream without seeking. Blocks
+  // until at least one byte is read or the end of stream is reached, in which
+  // case |size_read| is 0.
+  // Only seekable streams can support positional I/O. The default
+  // implementation fails with "operation_not_supported".
+  virtual bool ReadAtBlocking(uint64_t offset,
+                              void* buffer,
+                              size_t size_to_read,
+                              size_t* size_read,
+                              ErrorPtr* error);
+
+  // Runs ReadAtBlocking() from the message loop and calls |success_callback|
+  // with the amount of data read, or |error_callback| on failure. Since they
+  // don't use the stream position, any number of positional operations can be
+  // pending at the same time, alongside a ReadAsync() or WriteAsync() call.
+  // CancelPendingAsyncOperations() cancels them as well.
+  virtual bool ReadAtAsync(uint64_t offset,
+                           void* buffer,
+                           size_t size_to_read,
+                           const base::Callback<void(size_t)>& success_callback,
+                           const ErrorCallback& error_callback,
+                           ErrorPtr* error);
+
   // == Write operations ======================================================
 
   // -- Asynchronous ----------------------------------------------------------
@@ -338,6 +401,26 @@ class BRILLO_EXPORT Stream {
                                 size_t size_to_write,
                                 ErrorPtr* error);
 
+  // -- Positional ------------------------------------------------------------
+
+  // Writes up to |size_to_write| bytes at |offset| bytes from the beginning of
+  // the stream, without using or changing the stream position. The stream is
+  // extended if needed. The rest of ReadAtBlocking() applies here as well.
+  virtual bool WriteAtBlocking(uint64_t offset,
+                               const void* buffer,
+                               size_t size_to_write,
+                               size_t* size_written,
+                               ErrorPtr* error);
+
+  // Asynchronous version of WriteAtBlocking(). See ReadAtAsync() for details.
+  virtual bool WriteAtAsync(
+      uint64_t offset,
+      const void* buffer,
+      size_t size_to_write,
+      const base::Callback<void(size_t)>& success_callback,
+      const ErrorCallback& error_callback,
+      ErrorPtr* error);
+
   // == Finalizing/closing streams  ===========================================
 
   // Flushes all the user-space data from cache output buffers to storage
@@ -435,6 +518,14 @@ class BRILLO_EXPORT Stream {
       const ErrorCallback& error_callback,
       AccessMode mode);
 
+  // Called when data can be read for ReadChunksAsync(), either from
+  // WaitForData() or from a task posted to the main loop. Reads and delivers
+  // chunks until the read would block.
+  BRILLO_PRIVATE void OnReadChunksAvailable(AccessMode mode);
+
+  // Ends the ReadChunksAsync() operation and releases its callbacks.
+  BRILLO_PRIVATE void EndReadChunks();
+
   // The internal implementation of WriteAsync() and WriteAllAsync().
   // Calls WriteNonBlocking and if the write would block for it to not block
   // calling WaitForData(). The extra |force_async_callback| tell whether the
@@ -483,6 +574,20 @@ class BRILLO_EXPORT Stream {
       const ErrorCallback& error_callback,
       size_t size_written);
 
+  // Helper callbacks to implement ReadAtAsync() and WriteAtAsync().
+  BRILLO_PRIVATE void ReadAtAsyncCallback(
+      uint64_t offset,
+      void* buffer,
+      size_t size_to_read,
+      const base::Callback<void(size_t)>& success_callback,
+      const ErrorCallback& error_callback);
+  BRILLO_PRIVATE void WriteAtAsyncCallback(
+      uint64_t offset,
+      const void* buffer,
+      size_t size_to_write,
+      const base::Callback<void(size_t)>& success_callback,
+      const ErrorCallback& error_callback);
+
   // Helper callbacks to implement FlushAsync().
   BRILLO_PRIVATE void FlushAsyncCallback(
       const base::Closure& success_callback,
@@ -491,6 +596,14 @@ class BRILLO_EXPORT Stream {
   // Data members for asynchronous read operations.
   bool is_async_read_pending_{false};
 
+  // State of the ReadChunksAsync() operation in progress. The WaitForData()
+  // callback is bound once per operation and reused for every chunk.
+  void* chunk_buffer_{nullptr};
+  size_t chunk_buffer_size_{0};
+  ReadChunkCallback chunk_callback_;
+  ErrorCallback chunk_error_callback_;
+  base::Callback<void(AccessMode)> on_chunks_available_;
+
   // Data members for asynchronous write operations.
   bool is_async_write_pending_{false};
 
@@ -5,13 +5,19 @@
 #include <brillo/streams/stream.h>
 
 #include <limits>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <base/callback.h>
+#include <base/logging.h>
+#include <base/time/time.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
 #include <brillo/bind_lambda.h>
 #include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/streams/memory_stream.h>
 #include <brillo/streams/stream_errors.h>
 
 using testing::DoAll;
@@ -277,6 +283,230 @@ TEST(Stream, ReadAllAsync_EOS) {
   EXPECT_TRUE(failed);
 }
 
+TEST(Stream, ReadChunksAsync) {
+  MockStreamImpl stream_mock;
+  FakeMessageLoop fake_loop{nullptr};
+  fake_loop.SetAsCurrent();
+  char buf[10];
+  std::vector<std::pair<size_t, bool>> chunks;
+  auto chunk_callback = base::Bind(
+      [](std::vector<std::pair<size_t, bool>>* chunks, size_t size, bool eos) {
+        chunks->emplace_back(size, eos);
+        return true;
+      },
+      &chunks);
+  bool failed = false;
+  auto error_callback = base::Bind(&SetToTrue, &failed);
+
+  EXPECT_CALL(stream_mock, ReadNonBlocking(_, _, _, _, _)).Times(0);
+  EXPECT_TRUE(stream_mock.ReadChunksAsync(buf, sizeof(buf), chunk_callback,
+                                          error_callback, nullptr));
+  // Another read can't be started while the chunks are being read.
+  EXPECT_FALSE(stream_mock.ReadAsync(buf, sizeof(buf),
+                                     base::Bind([](size_t /* size */) {}),
+                                     error_callback, nullptr));
+  testing::Mock::VerifyAndClearExpectations(&stream_mock);
+
+  // All the available data is delivered, then the stream waits for more.
+  base::Callback<void(AccessMode)> data_callback;
+  {
+    InSequence seq;
+    EXPECT_CALL(stream_mock, ReadNonBlocking(buf, 10, _, _, _))
+        .WillOnce(DoAll(SetArgPointee<2>(10), SetArgPointee<3>(false),
+                        Return(true)));
+    EXPECT_CALL(stream_mock, ReadNonBlocking(buf, 10, _, _, _))
+        .WillOnce(DoAll(SetArgPointee<2>(4), SetArgPointee<3>(false),
+                        Return(true)));
+    EXPECT_CALL(stream_mock, ReadNonBlocking(buf, 10, _, _, _))
+        .WillOnce(DoAll(SetArgPointee<2>(0), SetArgPointee<3>(false),
+                        Return(true)));
+    EXPECT_CALL(stream_mock, WaitForData(AccessMode::READ, _, _))
+        .WillOnce(DoAll(SaveArg<1>(&data_callback), Return(true)));
+  }
+  fake_loop.Run();
+  EXPECT_EQ((std::vector<std::pair<size_t, bool>>{{10, false}, {4, false}}),
+            chunks);
+  testing::Mock::VerifyAndClearExpectations(&stream_mock);
+
+  EXPECT_CALL(stream_mock, ReadNonBlocking(buf, 10, _, _, _))
+      .WillOnce(DoAll(SetArgPointee<2>(3), SetArgPointee<3>(true),
+                      Return(true)));
+  data_callback.Run(AccessMode::READ);
+  EXPECT_EQ(3u, chunks.size());
+  EXPECT_EQ(std::make_pair<size_t, bool>(3, true), chunks.back());
+  EXPECT_FALSE(failed);
+
+  // The operation is over, so a new one can be started.
+  EXPECT_TRUE(stream_mock.ReadChunksAsync(buf, sizeof(buf), chunk_callback,
+                                          error_callback, nullptr));
+  stream_mock.CancelPendingAsyncOperations();
+  fake_loop.Run();
+  EXPECT_EQ(3u, chunks.size());
+}
+
+TEST(Stream, ReadChunksAsync_Stop) {
+  MockStreamImpl stream_mock;
+  FakeMessageLoop fake_loop{nullptr};
+  fake_loop.SetAsCurrent();
+  char buf[10];
+  int chunks = 0;
+  auto chunk_callback = base::Bind(
+      [](int* chunks, size_t /* size */, bool /* eos */) {
+        return ++*chunks < 2;
+      },
+      &chunks);
+  bool failed = false;
+  auto error_callback = base::Bind(&SetToTrue, &failed);
+
+  EXPECT_CALL(stream_mock, ReadNonBlocking(buf, 10, _, _, _))
+      .Times(2)
+      .WillRepeatedly(DoAll(SetArgPointee<2>(10), SetArgPointee<3>(false),
+                            Return(true)));
+  EXPECT_CALL(stream_mock, WaitForData(_, _, _)).Times(0);
+  EXPECT_TRUE(stream_mock.ReadChunksAsync(buf, sizeof(buf), chunk_callback,
+                                          error_callback, nullptr));
+  fake_loop.Run();
+  EXPECT_EQ(2, chunks);
+  EXPECT_FALSE(failed);
+  EXPECT_FALSE(fake_loop.PendingTasks());
+}
+
+TEST(Stream, ReadChunksAsync_Error) {
+  MockStreamImpl stream_mock;
+  FakeMessageLoop fake_loop{nullptr};
+  fake_loop.SetAsCurrent();
+  char buf[10];
+  auto chunk_callback = base::Bind([](size_t /* size */, bool /* eos */) {
+    ADD_FAILURE();
+    return true;
+  });
+  bool failed = false;
+  auto error_callback = base::Bind(&SetToTrue, &failed);
+
+  EXPECT_CALL(stream_mock, ReadNonBlocking(buf, 10, _, _, _))
+      .WillOnce(Return(false));
+  EXPECT_TRUE(stream_mock.ReadChunksAsync(buf, sizeof(buf), chunk_callback,
+                                          error_callback, nullptr));
+  fake_loop.Run();
+  EXPECT_TRUE(failed);
+}
+
+// Compares reading a stream in small pieces using repeated ReadAsync() calls
+// and using ReadChunksAsync(). Each ReadAsync() goes through the message loop
+// and binds new callbacks, while ReadChunksAsync() only returns to the loop
+// every kMaxChunksPerDispatch chunks.
+TEST(Stream, ReadChunksAsync_Benchmark) {
+  const size_t kDataSize = 1024 * 1024;
+  const size_t kChunkSize = 64;
+  const std::string data(kDataSize, 'x');
+  char buf[kChunkSize];
+  FakeMessageLoop fake_loop{nullptr};
+  fake_loop.SetAsCurrent();
+
+  struct ReadAsyncState {
+    Stream* stream;
+    char* buffer;
+    size_t buffer_size;
+    size_t total;
+    bool done;
+  };
+  StreamPtr stream = MemoryStream::OpenRef(data, nullptr);
+  ReadAsyncState state{stream.get(), buf, sizeof(buf), 0, false};
+  base::Callback<void(ReadAsyncState*, size_t)> on_read;
+  on_read = base::Bind(
+      [](base::Callback<void(ReadAsyncState*, size_t)>* on_read,
+         ReadAsyncState* state, size_t size) {
+        state->total += size;
+        if (size == 0) {
+          state->done = true;
+          return;
+        }
+        EXPECT_TRUE(state->stream->ReadAsync(
+            state->buffer, state->buffer_size, base::Bind(*on_read, state),
+            base::Bind([](const Error*) { ADD_FAILURE(); }), nullptr));
+      },
+      &on_read);
+  base::TimeTicks start = base::TimeTicks::Now();
+  EXPECT_TRUE(stream->ReadAsync(
+      buf, sizeof(buf), base::Bind(on_read, &state),
+      base::Bind([](const Error*) { ADD_FAILURE(); }), nullptr));
+  size_t read_async_iterations = 0;
+  while (!state.done && fake_loop.RunOnce(false))
+    read_async_iterations++;
+  base::TimeDelta read_async_time = base::TimeTicks::Now() - start;
+  EXPECT_EQ(kDataSize, state.total);
+
+  stream = MemoryStream::OpenRef(data, nullptr);
+  size_t total = 0;
+  bool done = false;
+  auto chunk_callback = base::Bind(
+      [](size_t* total, bool* done, size_t size, bool eos) {
+        *total += size;
+        *done = eos;
+        return true;
+      },
+      &total, &done);
+  start = base::TimeTicks::Now();
+  EXPECT_TRUE(stream->ReadChunksAsync(
+      buf, sizeof(buf), chunk_callback,
+      base::Bind([](const Error*) { ADD_FAILURE(); }), nullptr));
+  size_t read_chunks_iterations = 0;
+  while (!done && fake_loop.RunOnce(false))
+    read_chunks_iterations++;
+  base::TimeDelta read_chunks_time = base::TimeTicks::Now() - start;
+  EXPECT_EQ(kDataSize, total);
+
+  LOG(INFO) << "ReadAsync(): " << read_async_iterations << " loop iterations, "
+            << read_async_time.InMicroseconds() << " us";
+  LOG(INFO) << "ReadChunksAsync(): " << read_chunks_iterations
+            << " loop iterations, " << read_chunks_time.InMicroseconds()
+            << " us";
+  EXPECT_LT(read_chunks_iterations * 4, read_async_iterations);
+}
+
+TEST(Stream, ReadAtAsync) {
+  class MockReadAtBlocking : public MockStreamImpl {
+   public:
+    MOCK_METHOD5(ReadAtBlocking,
+                 bool(uint64_t, void*, size_t, size_t*, ErrorPtr*));
+  } stream_mock;
+  FakeMessageLoop fake_loop{nullptr};
+  fake_loop.SetAsCurrent();
+  char buf[10];
+  size_t read_size = 0;
+  auto success_callback = base::Bind(
+      [](size_t* read_size, size_t size) { *read_size = size; }, &read_size);
+  bool failed = false;
+  auto error_callback = base::Bind(&SetToTrue, &failed);
+
+  EXPECT_CALL(stream_mock, IsOpen()).WillRepeatedly(Return(true));
+  EXPECT_CALL(stream_mock, CanSeek()).WillRepeatedly(Return(true));
+  EXPECT_CALL(stream_mock, ReadAtBlocking(_, _, _, _, _)).Times(0);
+  // Several positional reads can be pending at once.
+  EXPECT_TRUE(stream_mock.ReadAtAsync(100, buf, 5, success_callback,
+                                      error_callback, nullptr));
+  EXPECT_TRUE(stream_mock.ReadAtAsync(0, buf + 5, 5, success_callback,
+                                      error_callback, nullptr));
+  testing::Mock::VerifyAndClearExpectations(&stream_mock);
+
+  EXPECT_CALL(stream_mock, ReadAtBlocking(100, buf, 5, _, _))
+      .WillOnce(DoAll(SetArgPointee<3>(5), Return(true)));
+  EXPECT_CALL(stream_mock, ReadAtBlocking(0, buf + 5, 5, _, _))
+      .WillOnce(Return(false));
+  EXPECT_TRUE(fake_loop.RunOnce(false));
+  EXPECT_EQ(5u, read_size);
+  EXPECT_FALSE(failed);
+  EXPECT_TRUE(fake_loop.RunOnce(false));
+  EXPECT_TRUE(failed);
+
+  // Non-seekable streams don't support positional I/O.
+  EXPECT_CALL(stream_mock, CanSeek()).WillRepeatedly(Return(false));
+  ErrorPtr error;
+  EXPECT_FALSE(stream_mock.ReadAtAsync(0, buf, 5, success_callback,
+                                       error_callback, &error));
+  EXPECT_EQ(errors::stream::kOperationNotSupported, error->GetCode());
+}
+
 TEST(Stream, ReadBlocking) {
   MockStreamImpl stream_mock;
   char buf[1024];
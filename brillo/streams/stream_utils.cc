@@ -4,9 +4,14 @@
 
 #include <brillo/streams/stream_utils.h>
 
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+
 #include <limits>
 
 #include <base/bind.h>
+#include <base/posix/eintr_wrapper.h>
+#include <brillo/errors/error_codes.h>
 #include <brillo/message_loops/message_loop.h>
 #include <brillo/streams/stream_errors.h>
 
@@ -22,6 +27,9 @@ struct CopyDataState {
   std::vector<uint8_t> buffer;
   uint64_t remaining_to_copy;
   uint64_t size_copied;
+  // Whether the data is copied by the kernel with sendfile(), see
+  // CanUseSendfile().
+  bool use_sendfile;
   CopyDataSuccessCallback success_callback;
   CopyDataErrorCallback error_callback;
 };
@@ -58,10 +66,85 @@ void PerformWrite(const std::shared_ptr<CopyDataState>& state, size_t size) {
     OnCopyDataError(state, error.get());
 }
 
+// Maximum amount of data copied by a single sendfile() call, so the message
+// loop gets to run other tasks in between.
+const size_t kMaxSendfileSize = 1024 * 1024;
+
+// Returns true if the data can be copied from |in_stream| to |out_stream| with
+// sendfile(), without going through user space: the input must be a seekable
+// regular file and the output a descriptor that doesn't keep its own position
+// (a socket or a pipe, including a socket with kernel TLS offload).
+bool CanUseSendfile(Stream* in_stream, Stream* out_stream) {
+  int in_fd = in_stream->GetFileDescriptor();
+  int out_fd = out_stream->GetFileDescriptor();
+  if (in_fd < 0 || out_fd < 0 || !in_stream->CanSeek())
+    return false;
+  struct stat in_stat;
+  struct stat out_stat;
+  if (fstat(in_fd, &in_stat) < 0 || fstat(out_fd, &out_stat) < 0)
+    return false;
+  return S_ISREG(in_stat.st_mode) && !S_ISREG(out_stat.st_mode);
+}
+
+void PerformSendfile(const std::shared_ptr<CopyDataState>& state);
+
+// Called when the output stream of a sendfile() copy can be written again.
+void OnSendfileReady(const std::shared_ptr<CopyDataState>& state,
+                     Stream::AccessMode /* mode */) {
+  PerformSendfile(state);
+}
+
+// Copies the next chunk of data with sendfile(). The file position of the
+// input stream is passed explicitly, since the stream may track it on its
+// own, and is updated once the data is sent.
+void PerformSendfile(const std::shared_ptr<CopyDataState>& state) {
+  size_t size_to_copy =
+      static_cast<size_t>(std::min<uint64_t>(kMaxSendfileSize,
+                                             state->remaining_to_copy));
+  if (size_to_copy == 0)
+    return PerformWrite(state, 0);  // Nothing more to copy. Finish operation.
+
+  brillo::ErrorPtr error;
+  off64_t offset = state->in_stream->GetPosition();
+  ssize_t res = HANDLE_EINTR(sendfile64(state->out_stream->GetFileDescriptor(),
+                                        state->in_stream->GetFileDescriptor(),
+                                        &offset, size_to_copy));
+  if (res < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      if (!state->out_stream->WaitForData(
+              Stream::AccessMode::WRITE, base::Bind(&OnSendfileReady, state),
+              &error)) {
+        OnCopyDataError(state, error.get());
+      }
+      return;
+    }
+    if (state->size_copied == 0 && (errno == EINVAL || errno == ENOSYS)) {
+      // The descriptors turned out not to support sendfile() (e.g. O_DIRECT
+      // files on some file systems), copy the data in user space instead.
+      state->use_sendfile = false;
+      return PerformRead(state);
+    }
+    errors::system::AddSystemError(&error, FROM_HERE, errno);
+    return OnCopyDataError(state, error.get());
+  }
+  if (res == 0)
+    return PerformWrite(state, 0);  // End of the input file.
+
+  if (!state->in_stream->SetPosition(offset, &error))
+    return OnCopyDataError(state, error.get());
+  state->size_copied += res;
+  state->remaining_to_copy -= res;
+  brillo::MessageLoop::current()->PostTask(
+      FROM_HERE, base::Bind(&PerformSendfile, state));
+}
+
 // Performs the read part of asynchronous CopyData operation. Reads the data
 // from input stream and invokes PerformWrite when done to write the data to
 // the output stream.
 void PerformRead(const std::shared_ptr<CopyDataState>& state) {
+  if (state->use_sendfile)
+    return PerformSendfile(state);
+
   brillo::ErrorPtr error;
   const uint64_t buffer_size = state->buffer.size();
   // |buffer_size| is guaranteed to fit in size_t, so |size_to_read| value will
@@ -206,6 +289,8 @@ void CopyData(StreamPtr in_stream,
   state->buffer.resize(buffer_size);
   state->remaining_to_copy = max_size_to_copy;
   state->size_copied = 0;
+  state->use_sendfile =
+      CanUseSendfile(state->in_stream.get(), state->out_stream.get());
   state->success_callback = success_callback;
   state->error_callback = error_callback;
   brillo::MessageLoop::current()->PostTask(FROM_HERE,
@@ -101,6 +101,9 @@ BRILLO_EXPORT void CopyData(StreamPtr in_stream,
 // either the |success_callback| or |error_callback| is called.
 // |success_callback| also provides the number of bytes actually copied.
 // |buffer_size| specifies the size of the read buffer to use for the operation.
+// When the input stream is a regular file and the output stream is backed by a
+// socket or a pipe (see Stream::GetFileDescriptor()), the data is copied by
+// the kernel with sendfile() and the buffer is not used.
 BRILLO_EXPORT void CopyData(StreamPtr in_stream,
                             StreamPtr out_stream,
                             uint64_t max_size_to_copy,
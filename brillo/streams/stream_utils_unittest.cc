@@ -4,11 +4,21 @@
 
 #include <brillo/streams/stream_utils.h>
 
+#include <sys/socket.h>
+#include <unistd.h>
+
 #include <limits>
+#include <string>
 
 #include <base/bind.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/posix/eintr_wrapper.h>
+#include <base/rand_util.h>
+#include <brillo/bind_lambda.h>
 #include <brillo/message_loops/fake_message_loop.h>
 #include <brillo/message_loops/message_loop.h>
+#include <brillo/streams/file_stream.h>
 #include <brillo/streams/mock_stream.h>
 #include <brillo/streams/stream_errors.h>
 #include <gmock/gmock.h>
@@ -297,4 +307,46 @@ TEST_F(CopyStreamDataTest, ErrorWrite) {
   ExpectFailure();
 }
 
+TEST_F(CopyStreamDataTest, CopyFileToSocket) {
+  base::ScopedTempDir temp_dir;
+  ASSERT_TRUE(temp_dir.CreateUniqueTempDir());
+  base::FilePath path = temp_dir.GetPath().Append(base::FilePath{"test.dat"});
+  std::string data = base::RandBytesAsString(3000);
+  ASSERT_EQ(static_cast<int>(data.size()),
+            base::WriteFile(path, data.data(), data.size()));
+  StreamPtr in_stream = FileStream::Open(path, Stream::AccessMode::READ,
+                                         FileStream::Disposition::OPEN_EXISTING,
+                                         nullptr);
+  ASSERT_NE(nullptr, in_stream.get());
+  ASSERT_TRUE(in_stream->SetPosition(100, nullptr));
+
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  StreamPtr out_stream = FileStream::FromFileDescriptor(fds[0], true, nullptr);
+  ASSERT_NE(nullptr, out_stream.get());
+
+  // The file data goes straight to the socket, starting at the stream
+  // position, and the position is updated.
+  uint64_t copied = 0;
+  uint64_t position = 0;
+  auto on_success = [](uint64_t* copied, uint64_t* position, StreamPtr in,
+                       StreamPtr /* out */, uint64_t size) {
+    *copied = size;
+    *position = in->GetPosition();
+  };
+  stream_utils::CopyData(
+      std::move(in_stream), std::move(out_stream), 2000, 16,
+      base::Bind(on_success, &copied, &position),
+      base::Bind(&CopyStreamDataTest::OnError, base::Unretained(this), ""));
+  fake_loop_.Run();
+  EXPECT_FALSE(failed_);
+  EXPECT_EQ(2000u, copied);
+  EXPECT_EQ(2100u, position);
+
+  std::string received(2000, 0);
+  EXPECT_EQ(2000, HANDLE_EINTR(read(fds[1], &received[0], received.size())));
+  EXPECT_EQ(data.substr(100, 2000), received);
+  IGNORE_EINTR(close(fds[1]));
+}
+
 }  // namespace brillo
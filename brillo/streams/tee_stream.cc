@@ -0,0 +1,324 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/tee_stream.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/time/time.h>
+#include <brillo/message_loops/message_loop.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+
+namespace brillo {
+
+namespace {
+
+bool ErrorInvalidSink(const base::Location& location, ErrorPtr* error) {
+  Error::AddTo(error, location, errors::stream::kDomain,
+               errors::stream::kInvalidParameter,
+               "The sink stream must be open for writing");
+  return false;
+}
+
+}  // anonymous namespace
+
+const size_t TeeStream::kDefaultBufferSize;
+
+TeeStream::TeeStream(size_t buffer_size) : buffer_size_{buffer_size} {}
+
+TeeStream::~TeeStream() {
+  // Try not to lose any output that hasn't been written to the sinks yet.
+  if (IsOpen()) {
+    for (Sink& sink : sinks_) {
+      if (sink.end > sink.begin) {
+        sink.stream->WriteAllBlocking(sink.buffer.data() + sink.begin,
+                                      sink.end - sink.begin, nullptr);
+      }
+    }
+  }
+}
+
+std::unique_ptr<TeeStream> TeeStream::Create(std::vector<StreamPtr> sinks,
+                                             size_t buffer_size,
+                                             ErrorPtr* error) {
+  std::unique_ptr<TeeStream> tee_stream;
+  if (buffer_size == 0) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "The buffer size must not be zero");
+    return tee_stream;
+  }
+
+  tee_stream.reset(new TeeStream{buffer_size});
+  for (StreamPtr& sink : sinks) {
+    if (!tee_stream->AddSink(std::move(sink), error)) {
+      tee_stream.reset();
+      break;
+    }
+  }
+  return tee_stream;
+}
+
+std::unique_ptr<TeeStream> TeeStream::Create(std::vector<StreamPtr> sinks,
+                                             ErrorPtr* error) {
+  return Create(std::move(sinks), kDefaultBufferSize, error);
+}
+
+bool TeeStream::AddSink(StreamPtr sink, ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!sink || !sink->CanWrite())
+    return ErrorInvalidSink(FROM_HERE, error);
+
+  sinks_.emplace_back();
+  sinks_.back().stream = std::move(sink);
+  return true;
+}
+
+size_t TeeStream::GetBufferedSize() const {
+  size_t size = 0;
+  for (const Sink& sink : sinks_)
+    size += sink.end - sink.begin;
+  return size;
+}
+
+bool TeeStream::IsOpen() const {
+  return is_open_;
+}
+
+bool TeeStream::CanWrite() const {
+  return IsOpen();
+}
+
+bool TeeStream::SetSizeBlocking(uint64_t /* size */, ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool TeeStream::Seek(int64_t /* offset */,
+                     Whence /* whence */,
+                     uint64_t* /* new_position */,
+                     ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool TeeStream::ReadNonBlocking(void* /* buffer */,
+                                size_t /* size_to_read */,
+                                size_t* /* size_read */,
+                                bool* /* end_of_stream */,
+                                ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+bool TeeStream::WriteNonBlocking(const void* buffer,
+                                 size_t size_to_write,
+                                 size_t* size_written,
+                                 ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  Sink* full_sink = nullptr;
+  if (!DrainSinks(&full_sink, error))
+    return false;
+
+  // Accept only as much data as every sink can take, either directly or by
+  // buffering it, so that the slowest sink governs the write rate.
+  size_t size = size_to_write;
+  for (const Sink& sink : sinks_)
+    size = std::min(size, buffer_size_ - (sink.end - sink.begin));
+
+  const uint8_t* data = static_cast<const uint8_t*>(buffer);
+  for (Sink& sink : sinks_) {
+    size_t size_sent = 0;
+    // Sinks that still have buffered data get the new data appended to the
+    // buffer to preserve the ordering.
+    if (size > 0 && sink.begin == sink.end &&
+        !sink.stream->WriteNonBlocking(data, size, &size_sent, error)) {
+      return false;
+    }
+    AppendToBuffer(&sink, data + size_sent, size - size_sent);
+  }
+  position_ += size;
+  *size_written = size;
+  return true;
+}
+
+bool TeeStream::FlushBlocking(ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+
+  for (Sink& sink : sinks_) {
+    if (sink.end > sink.begin &&
+        !sink.stream->WriteAllBlocking(sink.buffer.data() + sink.begin,
+                                       sink.end - sink.begin, error)) {
+      return false;
+    }
+    sink.begin = sink.end = 0;
+    if (!sink.stream->FlushBlocking(error))
+      return false;
+  }
+  return true;
+}
+
+bool TeeStream::CloseBlocking(ErrorPtr* error) {
+  if (!IsOpen())
+    return true;
+
+  // Close all the sinks, even if some of them fail. Only the first error is
+  // reported.
+  bool success = true;
+  for (Sink& sink : sinks_) {
+    ErrorPtr* sink_error = success ? error : nullptr;
+    bool sink_success =
+        sink.end == sink.begin ||
+        sink.stream->WriteAllBlocking(sink.buffer.data() + sink.begin,
+                                      sink.end - sink.begin, sink_error);
+    if (!sink.stream->CloseBlocking(sink_success ? sink_error : nullptr))
+      sink_success = false;
+    success = success && sink_success;
+  }
+  CancelPendingAsyncOperations();
+  sinks_.clear();
+  is_open_ = false;
+  return success;
+}
+
+bool TeeStream::WaitForData(
+    AccessMode mode,
+    const base::Callback<void(AccessMode)>& callback,
+    ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!stream_utils::IsWriteAccessMode(mode))
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  Sink* full_sink = nullptr;
+  if (!DrainSinks(&full_sink, error))
+    return false;
+
+  if (!full_sink) {
+    MessageLoop::current()->PostTask(
+        FROM_HERE, base::Bind(callback, AccessMode::WRITE));
+    return true;
+  }
+  return full_sink->stream->WaitForData(
+      AccessMode::WRITE,
+      base::Bind(&TeeStream::OnSinkWritable, weak_ptr_factory_.GetWeakPtr(),
+                 callback),
+      error);
+}
+
+bool TeeStream::WaitForDataBlocking(AccessMode in_mode,
+                                    base::TimeDelta timeout,
+                                    AccessMode* out_mode,
+                                    ErrorPtr* error) {
+  if (!IsOpen())
+    return stream_utils::ErrorStreamClosed(FROM_HERE, error);
+  if (!stream_utils::IsWriteAccessMode(in_mode))
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+
+  base::TimeTicks deadline;
+  if (!timeout.is_max())
+    deadline = base::TimeTicks::Now() + timeout;
+
+  // Wait for the full sinks one by one until all of them have buffer space.
+  for (;;) {
+    Sink* full_sink = nullptr;
+    if (!DrainSinks(&full_sink, error))
+      return false;
+    if (!full_sink)
+      break;
+
+    base::TimeDelta remaining = timeout;
+    if (!timeout.is_max()) {
+      remaining = std::max(deadline - base::TimeTicks::Now(),
+                           base::TimeDelta());
+    }
+    if (!full_sink->stream->WaitForDataBlocking(AccessMode::WRITE, remaining,
+                                                nullptr, error)) {
+      return false;
+    }
+  }
+
+  if (out_mode)
+    *out_mode = AccessMode::WRITE;
+  return true;
+}
+
+void TeeStream::CancelPendingAsyncOperations() {
+  for (Sink& sink : sinks_)
+    sink.stream->CancelPendingAsyncOperations();
+  weak_ptr_factory_.InvalidateWeakPtrs();
+  Stream::CancelPendingAsyncOperations();
+}
+
+bool TeeStream::DrainSink(Sink* sink, ErrorPtr* error) {
+  while (sink->begin < sink->end) {
+    size_t size_written = 0;
+    if (!sink->stream->WriteNonBlocking(sink->buffer.data() + sink->begin,
+                                        sink->end - sink->begin,
+                                        &size_written, error)) {
+      return false;
+    }
+    if (size_written == 0)
+      break;
+    sink->begin += size_written;
+  }
+  if (sink->begin == sink->end)
+    sink->begin = sink->end = 0;
+  return true;
+}
+
+bool TeeStream::DrainSinks(Sink** full_sink, ErrorPtr* error) {
+  *full_sink = nullptr;
+  for (Sink& sink : sinks_) {
+    if (!DrainSink(&sink, error))
+      return false;
+    if (!*full_sink && sink.end - sink.begin == buffer_size_)
+      *full_sink = &sink;
+  }
+  return true;
+}
+
+void TeeStream::AppendToBuffer(Sink* sink, const uint8_t* data, size_t size) {
+  if (size == 0)
+    return;
+
+  DCHECK_LE(sink->end - sink->begin + size, buffer_size_);
+  // The buffer is allocated only for the sinks that fall behind.
+  if (sink->buffer.empty())
+    sink->buffer.resize(buffer_size_);
+  if (sink->end + size > sink->buffer.size()) {
+    std::memmove(sink->buffer.data(), sink->buffer.data() + sink->begin,
+                 sink->end - sink->begin);
+    sink->end -= sink->begin;
+    sink->begin = 0;
+  }
+  std::memcpy(sink->buffer.data() + sink->end, data, size);
+  sink->end += size;
+}
+
+void TeeStream::OnSinkWritable(
+    const base::Callback<void(AccessMode)>& callback,
+    AccessMode /* mode */) {
+  ErrorPtr error;
+  Sink* full_sink = nullptr;
+  if (DrainSinks(&full_sink, &error) && full_sink &&
+      full_sink->stream->WaitForData(
+          AccessMode::WRITE,
+          base::Bind(&TeeStream::OnSinkWritable,
+                     weak_ptr_factory_.GetWeakPtr(), callback),
+          &error)) {
+    // Another sink is still full, keep waiting.
+    return;
+  }
+  // Either all the sinks can take more data now, or one of them failed, in
+  // which case the error is reported by the next write.
+  callback.Run(AccessMode::WRITE);
+}
+
+}  // namespace brillo
@@ -0,0 +1,158 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_TEE_STREAM_H_
+#define LIBBRILLO_BRILLO_STREAMS_TEE_STREAM_H_
+
+#include <memory>
+#include <vector>
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/memory/weak_ptr.h>
+#include <brillo/brillo_export.h>
+#include <brillo/streams/stream.h>
+
+namespace brillo {
+
+// TeeStream is a write-only stream that duplicates all the data written to it
+// into several downstream streams ("sinks"), so that the same data can be,
+// for example, saved to a file, hashed and uploaded in a single pass without
+// holding all of it in memory. Since TeeStream is a regular output stream, it
+// can be used as the destination of stream_utils::CopyData().
+//
+// Each sink has a bounded buffer. A write is accepted only up to the amount
+// of data that every sink can either take immediately or keep in its buffer,
+// so the stream applies backpressure as soon as the slowest sink falls behind
+// by more than the buffer size, and the memory used is never more than
+// |buffer_size| per sink. Buffered data is pushed to the sinks on the
+// subsequent writes and when waiting for the stream to become writable.
+//
+// Since data may remain buffered after a write has completed, FlushBlocking()
+// or CloseBlocking() must be called once all the data has been written (e.g.
+// in the success callback of stream_utils::CopyData()). These write out the
+// buffered data and flush/close all the sinks.
+class BRILLO_EXPORT TeeStream : public Stream {
+ public:
+  // Default size of the per-sink buffer.
+  static const size_t kDefaultBufferSize = 64 * 1024;
+
+  ~TeeStream() override;
+
+  // Creates a tee stream writing to |sinks|, taking ownership of them. The
+  // sinks must be open and writable. |buffer_size| specifies how much data
+  // may be kept for each sink that cannot accept it right away and must not be
+  // zero: sinks accepting different amounts of data can only be kept in step
+  // without blocking by buffering the difference. The concrete type is
+  // returned so the stream can be given more sinks later; the result converts
+  // to a StreamPtr when passed to other code.
+  static std::unique_ptr<TeeStream> Create(std::vector<StreamPtr> sinks,
+                                           size_t buffer_size,
+                                           ErrorPtr* error);
+
+  // Same as above, using kDefaultBufferSize.
+  static std::unique_ptr<TeeStream> Create(std::vector<StreamPtr> sinks,
+                                           ErrorPtr* error);
+
+  // Adds another sink to the stream. It will receive only the data written
+  // after this call.
+  bool AddSink(StreamPtr sink, ErrorPtr* error);
+
+  size_t GetSinkCount() const { return sinks_.size(); }
+
+  // Returns the total amount of data currently buffered for all the sinks.
+  size_t GetBufferedSize() const;
+
+  // == Stream capabilities ===================================================
+  bool IsOpen() const override;
+  bool CanRead() const override { return false; }
+  bool CanWrite() const override;
+  bool CanSeek() const override { return false; }
+  bool CanGetSize() const override { return false; }
+
+  // == Stream size operations ================================================
+  uint64_t GetSize() const override { return 0; }
+  bool SetSizeBlocking(uint64_t size, ErrorPtr* error) override;
+  uint64_t GetRemainingSize() const override { return 0; }
+
+  // == Seek operations =======================================================
+  // Returns the number of bytes written to the stream so far.
+  uint64_t GetPosition() const override { return position_; }
+  bool Seek(int64_t offset,
+            Whence whence,
+            uint64_t* new_position,
+            ErrorPtr* error) override;
+
+  // == Read operations =======================================================
+  bool ReadNonBlocking(void* buffer,
+                       size_t size_to_read,
+                       size_t* size_read,
+                       bool* end_of_stream,
+                       ErrorPtr* error) override;
+
+  // == Write operations ======================================================
+  bool WriteNonBlocking(const void* buffer,
+                        size_t size_to_write,
+                        size_t* size_written,
+                        ErrorPtr* error) override;
+
+  // == Finalizing/closing streams  ===========================================
+  bool FlushBlocking(ErrorPtr* error) override;
+  bool CloseBlocking(ErrorPtr* error) override;
+
+  // == Data availability monitoring ==========================================
+  bool WaitForData(AccessMode mode,
+                   const base::Callback<void(AccessMode)>& callback,
+                   ErrorPtr* error) override;
+
+  bool WaitForDataBlocking(AccessMode in_mode,
+                           base::TimeDelta timeout,
+                           AccessMode* out_mode,
+                           ErrorPtr* error) override;
+
+  void CancelPendingAsyncOperations() override;
+
+ private:
+  // A downstream stream along with the data that it hasn't accepted yet.
+  // The pending data is stored in |buffer| between |begin| and |end|.
+  struct Sink {
+    StreamPtr stream;
+    std::vector<uint8_t> buffer;
+    size_t begin{0};
+    size_t end{0};
+  };
+
+  // Internal constructor used by the Create() factory methods.
+  explicit TeeStream(size_t buffer_size);
+
+  // Writes as much of the buffered data of |sink| as it accepts without
+  // blocking.
+  bool DrainSink(Sink* sink, ErrorPtr* error);
+
+  // Drains all the sinks and returns the first one whose buffer is still full
+  // in |full_sink|, or nullptr if the stream is writable.
+  bool DrainSinks(Sink** full_sink, ErrorPtr* error);
+
+  // Appends |size| bytes from |data| to the buffer of |sink|. The buffer must
+  // have enough free space.
+  void AppendToBuffer(Sink* sink, const uint8_t* data, size_t size);
+
+  // Called when a sink whose buffer was full becomes writable while waiting
+  // for the stream to become writable.
+  void OnSinkWritable(const base::Callback<void(AccessMode)>& callback,
+                      AccessMode mode);
+
+  std::vector<Sink> sinks_;
+  size_t buffer_size_;
+  uint64_t position_{0};
+  bool is_open_{true};
+
+  base::WeakPtrFactory<TeeStream> weak_ptr_factory_{this};
+
+  DISALLOW_COPY_AND_ASSIGN(TeeStream);
+};
+
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_TEE_STREAM_H_
@@ -0,0 +1,172 @@
+// Copyright 2015 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/tee_stream.h>
+
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/streams/hashing_stream.h>
+#include <brillo/streams/memory_pipe_stream.h>
+#include <brillo/streams/memory_stream.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/stream_utils.h>
+#include <gtest/gtest.h>
+
+namespace brillo {
+
+class TeeStreamTest : public testing::Test {
+ public:
+  void SetUp() override {
+    fake_loop_.SetAsCurrent();
+  }
+
+  FakeMessageLoop fake_loop_{nullptr};
+};
+
+TEST_F(TeeStreamTest, Create) {
+  std::string output;
+  std::vector<StreamPtr> sinks;
+  sinks.push_back(MemoryStream::CreateRef(&output, nullptr));
+  auto tee = TeeStream::Create(std::move(sinks), nullptr);
+  ASSERT_NE(nullptr, tee.get());
+  EXPECT_EQ(1u, tee->GetSinkCount());
+  EXPECT_FALSE(tee->CanRead());
+  EXPECT_TRUE(tee->CanWrite());
+  EXPECT_FALSE(tee->CanSeek());
+
+  ErrorPtr error;
+  EXPECT_FALSE(tee->AddSink(MemoryStream::OpenRef("abc", nullptr), &error));
+  EXPECT_EQ(errors::stream::kInvalidParameter, error->GetCode());
+
+  error.reset();
+  char buffer[1];
+  size_t size = 0;
+  bool eos = false;
+  EXPECT_FALSE(tee->ReadNonBlocking(buffer, 1, &size, &eos, &error));
+  EXPECT_EQ(errors::stream::kOperationNotSupported, error->GetCode());
+
+  error.reset();
+  sinks.clear();
+  EXPECT_EQ(nullptr, TeeStream::Create(std::move(sinks), 0, &error).get());
+  EXPECT_EQ(errors::stream::kInvalidParameter, error->GetCode());
+}
+
+TEST_F(TeeStreamTest, Write) {
+  std::string output1;
+  std::string output2;
+  std::vector<StreamPtr> sinks;
+  sinks.push_back(MemoryStream::CreateRef(&output1, nullptr));
+  sinks.push_back(MemoryStream::CreateRef(&output2, nullptr));
+  auto tee = TeeStream::Create(std::move(sinks), nullptr);
+  ASSERT_NE(nullptr, tee.get());
+
+  EXPECT_TRUE(tee->WriteAllBlocking("foo", 3, nullptr));
+  EXPECT_TRUE(tee->WriteAllBlocking("bar", 3, nullptr));
+  EXPECT_EQ(6u, tee->GetPosition());
+  EXPECT_EQ(0u, tee->GetBufferedSize());
+  EXPECT_TRUE(tee->CloseBlocking(nullptr));
+  EXPECT_FALSE(tee->IsOpen());
+  EXPECT_EQ("foobar", output1);
+  EXPECT_EQ("foobar", output2);
+}
+
+TEST_F(TeeStreamTest, Backpressure) {
+  StreamPtr reader;
+  StreamPtr writer;
+  ASSERT_TRUE(MemoryPipeStream::CreatePair(4, &reader, &writer, nullptr));
+  std::string output;
+  std::vector<StreamPtr> sinks;
+  sinks.push_back(MemoryStream::CreateRef(&output, nullptr));
+  sinks.push_back(std::move(writer));
+  auto tee = TeeStream::Create(std::move(sinks), 8, nullptr);
+  ASSERT_NE(nullptr, tee.get());
+
+  const std::string data = "0123456789abcdef";
+  size_t size = 0;
+  // The pipe takes 4 bytes and the next 4 are buffered for it.
+  EXPECT_TRUE(tee->WriteNonBlocking(data.data(), data.size(), &size, nullptr));
+  EXPECT_EQ(8u, size);
+  EXPECT_EQ(4u, tee->GetBufferedSize());
+  EXPECT_TRUE(tee->WriteNonBlocking(data.data() + 8, 8, &size, nullptr));
+  EXPECT_EQ(4u, size);
+  EXPECT_EQ(8u, tee->GetBufferedSize());
+  // The slowest sink is 8 bytes behind, so the tee doesn't accept any more.
+  EXPECT_TRUE(tee->WriteNonBlocking(data.data() + 12, 4, &size, nullptr));
+  EXPECT_EQ(0u, size);
+  EXPECT_EQ("0123456789ab", output);
+
+  bool writable = false;
+  EXPECT_TRUE(tee->WaitForData(
+      Stream::AccessMode::WRITE,
+      base::Bind([](bool* writable, Stream::AccessMode mode) {
+        EXPECT_EQ(Stream::AccessMode::WRITE, mode);
+        *writable = true;
+      }, &writable),
+      nullptr));
+  fake_loop_.RunOnce(false);
+  EXPECT_FALSE(writable);
+
+  char buffer[4];
+  bool eos = false;
+  EXPECT_TRUE(reader->ReadNonBlocking(buffer, sizeof(buffer), &size, &eos,
+                                      nullptr));
+  EXPECT_EQ("0123", std::string(buffer, size));
+  fake_loop_.Run();
+  EXPECT_TRUE(writable);
+  EXPECT_EQ(4u, tee->GetBufferedSize());
+
+  EXPECT_TRUE(tee->WriteNonBlocking(data.data() + 12, 4, &size, nullptr));
+  EXPECT_EQ(4u, size);
+  EXPECT_EQ(data, output);
+  EXPECT_EQ(16u, tee->GetPosition());
+}
+
+TEST_F(TeeStreamTest, CopyData) {
+  std::string input(10000, 'a');
+  for (size_t i = 0; i < input.size(); i++)
+    input[i] = static_cast<char>(i * 7);
+
+  std::string output;
+  auto hashing_stream = HashingStream::Create(
+      MemoryStream::CreateRef(&output, nullptr),
+      HashingStream::Algorithm::SHA256, nullptr);
+  HashingStream* hasher = hashing_stream.get();
+  std::string copy;
+  std::vector<StreamPtr> sinks;
+  sinks.push_back(std::move(hashing_stream));
+  sinks.push_back(MemoryStream::CreateRef(&copy, nullptr));
+  StreamPtr tee = TeeStream::Create(std::move(sinks), 1024, nullptr);
+  ASSERT_NE(nullptr, tee.get());
+
+  uint64_t size_copied = 0;
+  StreamPtr tee_out;
+  stream_utils::CopyData(
+      MemoryStream::OpenRef(input, nullptr), std::move(tee),
+      base::Bind([](uint64_t* size_copied, StreamPtr* tee_out,
+                    StreamPtr /* in */, StreamPtr out, uint64_t size) {
+        *size_copied = size;
+        *tee_out = std::move(out);
+      }, &size_copied, &tee_out),
+      base::Bind([](StreamPtr, StreamPtr, const Error*) { ADD_FAILURE(); }));
+  fake_loop_.Run();
+  ASSERT_NE(nullptr, tee_out.get());
+  EXPECT_EQ(input.size(), size_copied);
+  Blob digest = hasher->GetDigest();
+  EXPECT_TRUE(tee_out->CloseBlocking(nullptr));
+  EXPECT_EQ(input, output);
+  EXPECT_EQ(input, copy);
+
+  std::string expected;
+  auto expected_hasher = HashingStream::Create(
+      MemoryStream::CreateRef(&expected, nullptr),
+      HashingStream::Algorithm::SHA256, nullptr);
+  EXPECT_TRUE(expected_hasher->WriteAllBlocking(input.data(), input.size(),
+                                                nullptr));
+  EXPECT_EQ(expected_hasher->GetDigest(), digest);
+}
+
+}  // namespace brillo
@@ -4,20 +4,52 @@
 
 #include <brillo/streams/tls_stream.h>
 
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
 #include <algorithm>
+#include <cstring>
 #include <limits>
+#include <map>
+#include <memory>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 
+// BoringSSL and OpenSSL 1.1.1 negotiate a range of protocol versions that
+// includes TLS 1.3. Older OpenSSL releases are limited to TLS 1.2 here.
+#if defined(OPENSSL_IS_BORINGSSL) || OPENSSL_VERSION_NUMBER >= 0x10101000L
+#define TLS_1_3_SUPPORTED 1
+#endif
+
+// Kernel TLS offload needs the key material and record sequence numbers of
+// the connection, which only BoringSSL exposes.
+#if defined(OPENSSL_IS_BORINGSSL) && defined(__linux__) && \
+    defined(__has_include)
+#if __has_include(<linux/tls.h>)
+#include <linux/tls.h>
+#define KERNEL_TLS_SUPPORTED 1
+#endif
+#endif
+
 #include <base/bind.h>
+#include <base/lazy_instance.h>
+#include <base/posix/eintr_wrapper.h>
 #include <base/memory/weak_ptr.h>
+#include <base/synchronization/lock.h>
+#include <brillo/errors/error_codes.h>
 #include <brillo/message_loops/message_loop.h>
 #include <brillo/secure_blob.h>
 #include <brillo/streams/openssl_stream_bio.h>
+#include <brillo/streams/stream_errors.h>
 #include <brillo/streams/stream_utils.h>
+#include <brillo/streams/tls_stream_internal.h>
 #include <brillo/strings/string_utils.h>
 
 namespace {
@@ -51,9 +83,9 @@ void TlsInfoCallback(const SSL* /* ssl */, int where, int ret) {
           << ", with status: " << ret << reason;
 }
 
-// Static variable to store the index of TlsStream private data in SSL context
-// used to store custom data for OnCertVerifyResults().
-int ssl_ctx_private_data_index = -1;
+// Static variable to store the index of TlsStream private data in SSL object
+// used to store custom data for OnCertVerifyResults() and OnNewSession().
+int ssl_private_data_index = -1;
 
 // Default trusted certificate store location.
 const char kCACertificatePath[] =
@@ -63,10 +95,250 @@ const char kCACertificatePath[] =
     "/usr/share/chromeos-ca-certificates";
 #endif
 
+// Top cipher suites supported by both Google GFEs and OpenSSL (in server
+// preferred order).
+const char kCipherList[] =
+    "ECDHE-ECDSA-AES128-GCM-SHA256:"
+    "ECDHE-ECDSA-AES256-GCM-SHA384:"
+    "ECDHE-RSA-AES128-GCM-SHA256:"
+    "ECDHE-RSA-AES256-GCM-SHA384";
+
+// Maximum number of client sessions kept for resumption.
+const size_t kMaxCachedSessions = 100;
+
+// Parameters of an SSL_CTX. Connections with the same parameters share one
+// SSL_CTX, so the trusted certificate store is only loaded once per process.
+struct ContextOptions {
+  std::string ca_path;
+  int min_version;
+  int max_version;
+  std::string cipher_list;
+  std::string tls13_cipher_suites;
+
+  bool operator<(const ContextOptions& rhs) const {
+    return std::tie(ca_path, min_version, max_version, cipher_list,
+                    tls13_cipher_suites) <
+           std::tie(rhs.ca_path, rhs.min_version, rhs.max_version,
+                    rhs.cipher_list, rhs.tls13_cipher_suites);
+  }
+};
+
+#if defined(KERNEL_TLS_SUPPORTED)
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+
+// TLS record content types.
+const uint8_t kTlsRecordAlert = 21;
+const uint8_t kTlsRecordApplicationData = 23;
+// Alert description of the close_notify alert.
+const uint8_t kTlsAlertCloseNotify = 0;
+
+// Passes the TLS 1.2 AES-GCM key material for one |direction| (TLS_TX or
+// TLS_RX) of the connection to the kernel. |CryptoInfo| is the kernel
+// structure matching the key size.
+template <typename CryptoInfo>
+bool SetKernelTlsKeys(int fd,
+                      int direction,
+                      uint16_t cipher_type,
+                      const uint8_t* key,
+                      const uint8_t* salt,
+                      uint64_t sequence) {
+  static_assert(sizeof(CryptoInfo::rec_seq) == sizeof(uint64_t),
+                "Unexpected record sequence number size");
+  CryptoInfo info;
+  memset(&info, 0, sizeof(info));
+  info.info.version = TLS_1_2_VERSION;
+  info.info.cipher_type = cipher_type;
+  memcpy(info.key, key, sizeof(info.key));
+  memcpy(info.salt, salt, sizeof(info.salt));
+  brillo::tls_stream_internal::EncodeTlsSequenceNumber(sequence, info.rec_seq);
+  // The explicit nonce only needs to be unique, the sequence number is what
+  // the user-space implementation uses as well.
+  brillo::tls_stream_internal::EncodeTlsSequenceNumber(sequence, info.iv);
+  bool success = setsockopt(fd, SOL_TLS, direction, &info, sizeof(info)) == 0;
+  brillo::SecureMemset(&info, 0, sizeof(info));
+  return success;
+}
+
+#endif  // KERNEL_TLS_SUPPORTED
+
+int ToOpenSslVersion(brillo::TlsStream::Version version) {
+  switch (version) {
+    case brillo::TlsStream::Version::TLS_1_2:
+      return TLS1_2_VERSION;
+    case brillo::TlsStream::Version::TLS_1_3:
+#if defined(TLS_1_3_SUPPORTED)
+      return TLS1_3_VERSION;
+#else
+      // Never negotiated, TlsStreamImpl::Init() rejects a TLS 1.3 minimum.
+      return TLS1_2_VERSION;
+#endif
+  }
+  NOTREACHED();
+  return TLS1_2_VERSION;
+}
+
+// Returns true if |version| is one of the TlsStream::Version values.
+bool IsKnownVersion(brillo::TlsStream::Version version) {
+  switch (version) {
+    case brillo::TlsStream::Version::TLS_1_2:
+    case brillo::TlsStream::Version::TLS_1_3:
+      return true;
+  }
+  return false;
+}
+
+// Encodes |protocols| in the ALPN wire format (a list of length-prefixed
+// strings). Returns false if any of the protocol names is invalid.
+bool EncodeAlpnProtocols(const std::vector<std::string>& protocols,
+                         std::vector<uint8_t>* wire) {
+  wire->clear();
+  for (const std::string& protocol : protocols) {
+    if (protocol.empty() || protocol.size() > 255)
+      return false;
+    wire->push_back(static_cast<uint8_t>(protocol.size()));
+    wire->insert(wire->end(), protocol.begin(), protocol.end());
+  }
+  return true;
+}
+
+// Process-wide cache of SSL_CTX objects and of the client TLS sessions used
+// to resume connections to the hosts we have talked to before. Sessions are
+// keyed by the SSL_CTX and the server host name, since a session can only be
+// resumed with the same context and must not be offered to a different host.
+class TlsContextCache {
+ public:
+  using SessionCacheStats = brillo::TlsStream::SessionCacheStats;
+
+  TlsContextCache() = default;
+
+  // Returns the cached context for |options| or nullptr if there is none.
+  SSL_CTX* FindContext(const ContextOptions& options) {
+    base::AutoLock lock(lock_);
+    auto it = contexts_.find(options);
+    return (it != contexts_.end()) ? it->second.get() : nullptr;
+  }
+
+  // Adds |ctx| to the cache and returns the context to use. If another thread
+  // has added a context for the same |options| in the meantime, that context
+  // is returned and |ctx| is destroyed.
+  SSL_CTX* AddContext(const ContextOptions& options, SSL_CTX* ctx) {
+    std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)> ptr{ctx, SSL_CTX_free};
+    base::AutoLock lock(lock_);
+    auto pair = contexts_.emplace(options, std::move(ptr));
+    if (pair.second)
+      stats_.contexts_created++;
+    return pair.first->second.get();
+  }
+
+  // Offers the session cached for |host| (if any) for resumption on |ssl|.
+  void ApplySession(SSL* ssl, const std::string& host) {
+    base::AutoLock lock(lock_);
+    auto it = sessions_.find(SessionKey{SSL_get_SSL_CTX(ssl), host});
+    if (it != sessions_.end())
+      SSL_set_session(ssl, it->second);
+  }
+
+  // Stores |session| negotiated with |host|, taking ownership of it.
+  void StoreSession(SSL* ssl, const std::string& host, SSL_SESSION* session) {
+    base::AutoLock lock(lock_);
+    SessionKey key{SSL_get_SSL_CTX(ssl), host};
+    auto it = sessions_.find(key);
+    if (it != sessions_.end()) {
+      SSL_SESSION_free(it->second);
+      it->second = session;
+      return;
+    }
+    // Keep the cache bounded. Which session is dropped is not important.
+    if (sessions_.size() >= kMaxCachedSessions) {
+      SSL_SESSION_free(sessions_.begin()->second);
+      sessions_.erase(sessions_.begin());
+    }
+    sessions_.emplace(key, session);
+  }
+
+  // Updates the statistics after a successful handshake.
+  void RecordHandshake(bool resumed) {
+    base::AutoLock lock(lock_);
+    if (resumed)
+      stats_.resumed_handshakes++;
+    else
+      stats_.full_handshakes++;
+  }
+
+  SessionCacheStats GetStats() {
+    base::AutoLock lock(lock_);
+    return stats_;
+  }
+
+  void ClearSessions() {
+    base::AutoLock lock(lock_);
+    for (const auto& pair : sessions_)
+      SSL_SESSION_free(pair.second);
+    sessions_.clear();
+  }
+
+ private:
+  using SessionKey = std::pair<SSL_CTX*, std::string>;
+
+  base::Lock lock_;
+  std::map<ContextOptions, std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)>>
+      contexts_;
+  std::map<SessionKey, SSL_SESSION*> sessions_;
+  SessionCacheStats stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(TlsContextCache);
+};
+
+base::LazyInstance<TlsContextCache>::Leaky g_context_cache =
+    LAZY_INSTANCE_INITIALIZER;
+
 }  // anonymous namespace
 
 namespace brillo {
 
+namespace tls_stream_internal {
+
+size_t GetKernelTlsKeySize(int version, int cipher_nid) {
+  // TLS 1.3 needs post-handshake messages (tickets, key updates) to be
+  // processed, which the kernel leaves to user space.
+  if (version != TLS1_2_VERSION)
+    return 0;
+  if (cipher_nid == NID_aes_128_gcm)
+    return kAesGcm128KeySize;
+  if (cipher_nid == NID_aes_256_gcm)
+    return kAesGcm256KeySize;
+  return 0;
+}
+
+bool SplitKernelTlsKeyBlock(const uint8_t* key_block,
+                            size_t size,
+                            size_t key_size,
+                            KernelTlsKeys* keys) {
+  if (key_size == 0 || size != 2 * (key_size + kAesGcmSaltSize))
+    return false;
+  keys->client_key = key_block;
+  keys->server_key = keys->client_key + key_size;
+  keys->client_salt = keys->server_key + key_size;
+  keys->server_salt = keys->client_salt + kAesGcmSaltSize;
+  return true;
+}
+
+void EncodeTlsSequenceNumber(uint64_t value, uint8_t out[8]) {
+  for (int i = 7; i >= 0; i--) {
+    out[i] = static_cast<uint8_t>(value);
+    value >>= 8;
+  }
+}
+
+}  // namespace tls_stream_internal
+
 // Helper implementation of TLS stream used to hide most of OpenSSL inner
 // workings from the users of brillo::TlsStream.
 class TlsStream::TlsStreamImpl {
@@ -76,6 +348,7 @@ class TlsStream::TlsStreamImpl {
 
   bool Init(StreamPtr socket,
             const std::string& host,
+            const TlsStream::Options& options,
             const base::Closure& success_callback,
             const Stream::ErrorCallback& error_callback,
             ErrorPtr* error);
@@ -102,6 +375,11 @@ class TlsStream::TlsStreamImpl {
                            ErrorPtr* error);
   void CancelPendingAsyncOperations();
 
+  std::string GetAlpnProtocol() const;
+  bool early_data_accepted() const { return early_data_accepted_; }
+  bool is_kernel_tls_enabled() const { return kernel_tls_; }
+  int GetFileDescriptor() const;
+
  private:
   bool ReportError(ErrorPtr* error,
                    const base::Location& location,
@@ -112,16 +390,58 @@ class TlsStream::TlsStreamImpl {
                       const Stream::ErrorCallback& error_callback,
                       Stream::AccessMode mode);
 
+  // Advances the handshake, including sending the early data. Returns the
+  // result of the last OpenSSL call made: 1 once the handshake is complete
+  // and all the early data is sent, or a value to pass to SSL_get_error().
+  int ContinueHandshake();
+
+  // Tries to offload the record encryption and decryption to the kernel
+  // after the handshake. Both directions are offloaded or none is: the
+  // connection stays in user space if it can't be offloaded. Returns false
+  // if the connection is no longer usable, after the kernel took over only
+  // one direction.
+  bool EnableKernelTls(ErrorPtr* error);
+
+  // Reads decrypted data directly from the socket once kernel TLS is active
+  // for the receive direction.
+  bool ReadKernelTls(void* buffer,
+                     size_t size_to_read,
+                     size_t* size_read,
+                     bool* end_of_stream,
+                     ErrorPtr* error);
+
+  // Sends the close_notify alert through the kernel TLS socket.
+  void SendKernelTlsCloseNotify();
+
+  // Returns the shared SSL_CTX for |options|, creating it if needed.
+  SSL_CTX* GetContext(const ContextOptions& options, ErrorPtr* error);
+
   int OnCertVerifyResults(int ok, X509_STORE_CTX* ctx);
   static int OnCertVerifyResultsStatic(int ok, X509_STORE_CTX* ctx);
 
+  // Called by OpenSSL when the server issues a new session (or ticket).
+  static int OnNewSessionStatic(SSL* ssl, SSL_SESSION* session);
+
   StreamPtr socket_;
-  std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)> ctx_{nullptr, SSL_CTX_free};
+  std::string host_;
+  // Owned by the process-wide context cache.
+  SSL_CTX* ctx_{nullptr};
   std::unique_ptr<SSL, decltype(&SSL_free)> ssl_{nullptr, SSL_free};
   BIO* stream_bio_{nullptr};
   bool need_more_read_{false};
   bool need_more_write_{false};
 
+  // Options::early_data and the amount of it sent so far.
+  std::string early_data_;
+  size_t early_data_offset_{0};
+  bool handshake_done_{false};
+  bool early_data_accepted_{false};
+
+  // Set if Options::enable_kernel_tls is requested, and once the connection
+  // has been offloaded to the kernel.
+  bool enable_ktls_{false};
+  bool kernel_tls_{false};
+
   base::WeakPtrFactory<TlsStreamImpl> weak_ptr_factory_{this};
   DISALLOW_COPY_AND_ASSIGN(TlsStreamImpl);
 };
@@ -129,15 +449,14 @@ class TlsStream::TlsStreamImpl {
 TlsStream::TlsStreamImpl::TlsStreamImpl() {
   SSL_load_error_strings();
   SSL_library_init();
-  if (ssl_ctx_private_data_index < 0) {
-    ssl_ctx_private_data_index =
-        SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+  if (ssl_private_data_index < 0) {
+    ssl_private_data_index =
+        SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
   }
 }
 
 TlsStream::TlsStreamImpl::~TlsStreamImpl() {
   ssl_.reset();
-  ctx_.reset();
 }
 
 bool TlsStream::TlsStreamImpl::ReadNonBlocking(void* buffer,
@@ -145,6 +464,9 @@ bool TlsStream::TlsStreamImpl::ReadNonBlocking(void* buffer,
                                                size_t* size_read,
                                                bool* end_of_stream,
                                                ErrorPtr* error) {
+  if (kernel_tls_)
+    return ReadKernelTls(buffer, size_to_read, size_read, end_of_stream, error);
+
   const size_t max_int = std::numeric_limits<int>::max();
   int size_int = static_cast<int>(std::min(size_to_read, max_int));
   int ret = SSL_read(ssl_.get(), buffer, size_int);
@@ -182,6 +504,11 @@ bool TlsStream::TlsStreamImpl::WriteNonBlocking(const void* buffer,
                                                 size_t size_to_write,
                                                 size_t* size_written,
                                                 ErrorPtr* error) {
+  // The kernel encrypts everything written to the socket.
+  if (kernel_tls_)
+    return socket_->WriteNonBlocking(buffer, size_to_write, size_written,
+                                     error);
+
   const size_t max_int = std::numeric_limits<int>::max();
   int size_int = static_cast<int>(std::min(size_to_write, max_int));
   int ret = SSL_write(ssl_.get(), buffer, size_int);
@@ -209,6 +536,12 @@ bool TlsStream::TlsStreamImpl::Flush(ErrorPtr* error) {
 }
 
 bool TlsStream::TlsStreamImpl::Close(ErrorPtr* error) {
+  if (kernel_tls_) {
+    // OpenSSL no longer knows the state of the outgoing record stream.
+    SendKernelTlsCloseNotify();
+    return socket_->CloseBlocking(error);
+  }
+
   // 2 seconds should be plenty here.
   const base::TimeDelta kTimeout = base::TimeDelta::FromSeconds(2);
   // The retry count of 4 below is just arbitrary, to ensure we don't get stuck
@@ -324,56 +657,152 @@ int TlsStream::TlsStreamImpl::OnCertVerifyResults(int ok, X509_STORE_CTX* ctx) {
 int TlsStream::TlsStreamImpl::OnCertVerifyResultsStatic(int ok,
                                                         X509_STORE_CTX* ctx) {
   // Obtain the pointer to the instance of TlsStream::TlsStreamImpl from the
-  // SSL CTX object referenced by |ctx|.
+  // SSL object referenced by |ctx|.
   SSL* ssl = static_cast<SSL*>(X509_STORE_CTX_get_ex_data(
       ctx, SSL_get_ex_data_X509_STORE_CTX_idx()));
-  SSL_CTX* ssl_ctx = ssl ? SSL_get_SSL_CTX(ssl) : nullptr;
   TlsStream::TlsStreamImpl* self = nullptr;
-  if (ssl_ctx) {
-    self = static_cast<TlsStream::TlsStreamImpl*>(SSL_CTX_get_ex_data(
-        ssl_ctx, ssl_ctx_private_data_index));
+  if (ssl) {
+    self = static_cast<TlsStream::TlsStreamImpl*>(
+        SSL_get_ex_data(ssl, ssl_private_data_index));
   }
   return self ? self->OnCertVerifyResults(ok, ctx) : ok;
 }
 
+int TlsStream::TlsStreamImpl::OnNewSessionStatic(SSL* ssl,
+                                                 SSL_SESSION* session) {
+  auto self = static_cast<TlsStream::TlsStreamImpl*>(
+      SSL_get_ex_data(ssl, ssl_private_data_index));
+  if (!self)
+    return 0;
+  // Returning 1 tells OpenSSL that we have taken over the session reference.
+  g_context_cache.Get().StoreSession(ssl, self->host_, session);
+  return 1;
+}
+
+SSL_CTX* TlsStream::TlsStreamImpl::GetContext(const ContextOptions& options,
+                                              ErrorPtr* error) {
+  TlsContextCache& cache = g_context_cache.Get();
+  SSL_CTX* ctx = cache.FindContext(options);
+  if (ctx)
+    return ctx;
+
+#if defined(TLS_1_3_SUPPORTED)
+  const SSL_METHOD* method = TLS_client_method();
+#else
+  const SSL_METHOD* method = TLSv1_2_client_method();
+#endif
+  std::unique_ptr<SSL_CTX, decltype(&SSL_CTX_free)> new_ctx{
+      SSL_CTX_new(method), SSL_CTX_free};
+  if (!new_ctx) {
+    ReportError(error, FROM_HERE, "Cannot create SSL_CTX");
+    return nullptr;
+  }
+
+#if defined(TLS_1_3_SUPPORTED)
+  if (!SSL_CTX_set_min_proto_version(new_ctx.get(), options.min_version) ||
+      !SSL_CTX_set_max_proto_version(new_ctx.get(), options.max_version)) {
+    ReportError(error, FROM_HERE, "Cannot set the TLS version range");
+    return nullptr;
+  }
+#endif
+
+  int res = SSL_CTX_set_cipher_list(new_ctx.get(),
+                                    options.cipher_list.c_str());
+  if (res != 1) {
+    ReportError(error, FROM_HERE, "Cannot set the cipher list");
+    return nullptr;
+  }
+
+  if (!options.tls13_cipher_suites.empty()) {
+#if defined(OPENSSL_IS_BORINGSSL) || !defined(TLS_1_3_SUPPORTED)
+    // BoringSSL does not allow configuring TLS 1.3 cipher suites and older
+    // OpenSSL releases don't support TLS 1.3 at all.
+    stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+    return nullptr;
+#else
+    res = SSL_CTX_set_ciphersuites(new_ctx.get(),
+                                   options.tls13_cipher_suites.c_str());
+    if (res != 1) {
+      ReportError(error, FROM_HERE, "Cannot set the TLS 1.3 cipher suites");
+      return nullptr;
+    }
+#endif
+  }
+
+  res = SSL_CTX_load_verify_locations(new_ctx.get(), nullptr,
+                                      options.ca_path.c_str());
+  if (res != 1) {
+    ReportError(error, FROM_HERE,
+                "Failed to specify trusted certificate location");
+    return nullptr;
+  }
+
+  SSL_CTX_set_verify(new_ctx.get(), SSL_VERIFY_PEER,
+                     &TlsStreamImpl::OnCertVerifyResultsStatic);
+
+  // Sessions are stored in our own cache keyed by the host name, OpenSSL's
+  // internal cache is of no use on the client side.
+  SSL_CTX_set_session_cache_mode(
+      new_ctx.get(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+  SSL_CTX_sess_set_new_cb(new_ctx.get(), &TlsStreamImpl::OnNewSessionStatic);
+
+  return cache.AddContext(options, new_ctx.release());
+}
+
 bool TlsStream::TlsStreamImpl::Init(StreamPtr socket,
                                     const std::string& host,
+                                    const TlsStream::Options& options,
                                     const base::Closure& success_callback,
                                     const Stream::ErrorCallback& error_callback,
                                     ErrorPtr* error) {
-  ctx_.reset(SSL_CTX_new(TLSv1_2_client_method()));
-  if (!ctx_)
-    return ReportError(error, FROM_HERE, "Cannot create SSL_CTX");
-
-  // Top cipher suites supported by both Google GFEs and OpenSSL (in server
-  // preferred order).
-  int res = SSL_CTX_set_cipher_list(ctx_.get(),
-                                    "ECDHE-ECDSA-AES128-GCM-SHA256:"
-                                    "ECDHE-ECDSA-AES256-GCM-SHA384:"
-                                    "ECDHE-RSA-AES128-GCM-SHA256:"
-                                    "ECDHE-RSA-AES256-GCM-SHA384");
-  if (res != 1)
-    return ReportError(error, FROM_HERE, "Cannot set the cipher list");
-
-  res = SSL_CTX_load_verify_locations(ctx_.get(), nullptr, kCACertificatePath);
-  if (res != 1) {
-    return ReportError(error, FROM_HERE,
-                       "Failed to specify trusted certificate location");
+  std::vector<uint8_t> alpn_protocols;
+  if (!EncodeAlpnProtocols(options.alpn_protocols, &alpn_protocols)) {
+    Error::AddTo(error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "Invalid ALPN protocol name");
+    return false;
   }
 
-  // Store a pointer to "this" into SSL_CTX instance.
-  SSL_CTX_set_ex_data(ctx_.get(), ssl_ctx_private_data_index, this);
+#if !defined(TLS_1_3_SUPPORTED)
+  if (options.min_version > TlsStream::Version::TLS_1_2)
+    return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+#endif
+
+  ContextOptions context_options{
+      kCACertificatePath,
+      ToOpenSslVersion(options.min_version),
+      ToOpenSslVersion(options.max_version),
+      options.cipher_list.empty() ? kCipherList : options.cipher_list,
+      options.tls13_cipher_suites};
+  ctx_ = GetContext(context_options, error);
+  if (!ctx_)
+    return false;
+
+  socket_ = std::move(socket);
+  host_ = host;
+  ssl_.reset(SSL_new(ctx_));
+  if (!ssl_)
+    return ReportError(error, FROM_HERE, "Cannot create SSL object");
+
+  // Store a pointer to "this" into SSL instance.
+  SSL_set_ex_data(ssl_.get(), ssl_private_data_index, this);
 
   // Ask OpenSSL to validate the server host from the certificate to match
   // the expected host name we are given:
-  X509_VERIFY_PARAM* param = SSL_CTX_get0_param(ctx_.get());
+  X509_VERIFY_PARAM* param = SSL_get0_param(ssl_.get());
   X509_VERIFY_PARAM_set1_host(param, host.c_str(), host.size());
 
-  SSL_CTX_set_verify(ctx_.get(), SSL_VERIFY_PEER,
-                     &TlsStreamImpl::OnCertVerifyResultsStatic);
+  // Note that unlike most OpenSSL functions, this one returns 0 on success.
+  if (!alpn_protocols.empty() &&
+      SSL_set_alpn_protos(ssl_.get(), alpn_protocols.data(),
+                          alpn_protocols.size()) != 0) {
+    return ReportError(error, FROM_HERE, "Cannot set the ALPN protocols");
+  }
 
-  socket_ = std::move(socket);
-  ssl_.reset(SSL_new(ctx_.get()));
+  // Try to resume the previous session with this host, if there is one.
+  g_context_cache.Get().ApplySession(ssl_.get(), host_);
+  early_data_ = options.early_data;
+  enable_ktls_ = options.enable_kernel_tls;
 
   // Enable TLS progress callback if VLOG level is >=3.
   if (VLOG_IS_ON(3))
@@ -409,9 +838,16 @@ void TlsStream::TlsStreamImpl::DoHandshake(
     const base::Closure& success_callback,
     const Stream::ErrorCallback& error_callback) {
   VLOG(1) << "Begin TLS handshake";
-  int res = SSL_do_handshake(ssl_.get());
+  int res = ContinueHandshake();
   if (res == 1) {
-    VLOG(1) << "Handshake successful";
+    bool resumed = SSL_session_reused(ssl_.get());
+    VLOG(1) << "Handshake successful" << (resumed ? " (session resumed)" : "");
+    g_context_cache.Get().RecordHandshake(resumed);
+    ErrorPtr error;
+    if (enable_ktls_ && !EnableKernelTls(&error)) {
+      error_callback.Run(error.get());
+      return;
+    }
     success_callback.Run();
     return;
   }
@@ -443,6 +879,236 @@ void TlsStream::TlsStreamImpl::DoHandshake(
   error_callback.Run(error.get());
 }
 
+int TlsStream::TlsStreamImpl::ContinueHandshake() {
+  const size_t max_int = std::numeric_limits<int>::max();
+  if (!handshake_done_) {
+#if defined(TLS_1_3_SUPPORTED) && !defined(OPENSSL_IS_BORINGSSL)
+    // Send the early data before finishing the handshake if the resumed
+    // session allows it.
+    SSL_SESSION* session = SSL_get_session(ssl_.get());
+    if (session && SSL_SESSION_get_max_early_data(session) > 0) {
+      while (early_data_offset_ < early_data_.size()) {
+        size_t written = 0;
+        int res = SSL_write_early_data(
+            ssl_.get(), early_data_.data() + early_data_offset_,
+            early_data_.size() - early_data_offset_, &written);
+        if (res != 1)
+          return res;
+        early_data_offset_ += written;
+      }
+    }
+#endif
+    int res = SSL_do_handshake(ssl_.get());
+    if (res != 1)
+      return res;
+    handshake_done_ = true;
+#if defined(TLS_1_3_SUPPORTED) && !defined(OPENSSL_IS_BORINGSSL)
+    early_data_accepted_ = !early_data_.empty() &&
+        SSL_get_early_data_status(ssl_.get()) == SSL_EARLY_DATA_ACCEPTED;
+#endif
+    // Early data rejected by the server has to be sent again.
+    if (!early_data_accepted_)
+      early_data_offset_ = 0;
+  }
+
+  while (early_data_offset_ < early_data_.size()) {
+    size_t size = std::min(early_data_.size() - early_data_offset_, max_int);
+    int res = SSL_write(ssl_.get(), early_data_.data() + early_data_offset_,
+                        static_cast<int>(size));
+    if (res <= 0)
+      return res;
+    early_data_offset_ += static_cast<size_t>(res);
+  }
+  early_data_.clear();
+  return 1;
+}
+
+std::string TlsStream::TlsStreamImpl::GetAlpnProtocol() const {
+  const unsigned char* data = nullptr;
+  unsigned int size = 0;
+  SSL_get0_alpn_selected(ssl_.get(), &data, &size);
+  return std::string(reinterpret_cast<const char*>(data), size);
+}
+
+int TlsStream::TlsStreamImpl::GetFileDescriptor() const {
+  // Reading or writing the socket directly is only valid when the kernel
+  // handles the TLS records in both directions.
+  return is_kernel_tls_enabled() ? socket_->GetFileDescriptor() : -1;
+}
+
+#if defined(KERNEL_TLS_SUPPORTED)
+
+bool TlsStream::TlsStreamImpl::EnableKernelTls(ErrorPtr* error) {
+  int fd = socket_->GetFileDescriptor();
+  if (fd < 0) {
+    VLOG(1) << "Kernel TLS needs a socket file descriptor";
+    return true;
+  }
+  const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl_.get());
+  int cipher_nid = cipher ? SSL_CIPHER_get_cipher_nid(cipher) : NID_undef;
+  size_t key_size =
+      tls_stream_internal::GetKernelTlsKeySize(SSL_version(ssl_.get()),
+                                               cipher_nid);
+  if (key_size == 0) {
+    VLOG(1) << "Kernel TLS is not supported for the negotiated protocol";
+    return true;
+  }
+  // Data already read from the socket can't be handed over to the kernel.
+  if (SSL_has_pending(ssl_.get())) {
+    VLOG(1) << "Not enabling kernel TLS, decrypted data is pending";
+    return true;
+  }
+
+  SecureBlob key_block(SSL_get_key_block_len(ssl_.get()));
+  tls_stream_internal::KernelTlsKeys keys;
+  if (!tls_stream_internal::SplitKernelTlsKeyBlock(
+          key_block.data(), key_block.size(), key_size, &keys) ||
+      !SSL_generate_key_block(ssl_.get(), key_block.data(), key_block.size())) {
+    VLOG(1) << "Unexpected TLS key block";
+    return true;
+  }
+
+  // Without keys, the TLS upper layer protocol passes the data through.
+  if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) < 0) {
+    PLOG(WARNING) << "Failed to enable the TLS upper layer protocol";
+    return true;
+  }
+
+  uint64_t read_sequence = SSL_get_read_sequence(ssl_.get());
+  uint64_t write_sequence = SSL_get_write_sequence(ssl_.get());
+  bool is_aes_128 = key_size == tls_stream_internal::kAesGcm128KeySize;
+  bool rx = is_aes_128 ?
+      SetKernelTlsKeys<tls12_crypto_info_aes_gcm_128>(
+          fd, TLS_RX, TLS_CIPHER_AES_GCM_128, keys.server_key,
+          keys.server_salt, read_sequence) :
+      SetKernelTlsKeys<tls12_crypto_info_aes_gcm_256>(
+          fd, TLS_RX, TLS_CIPHER_AES_GCM_256, keys.server_key,
+          keys.server_salt, read_sequence);
+  if (!rx) {
+    // Nothing has been handed over yet, OpenSSL keeps handling the records.
+    PLOG(WARNING) << "Failed to set the kernel TLS receive keys";
+    return true;
+  }
+
+  // The kernel now decrypts the incoming records and the TLS upper layer
+  // protocol can't be removed, so OpenSSL can't take over again.
+  bool tx = is_aes_128 ?
+      SetKernelTlsKeys<tls12_crypto_info_aes_gcm_128>(
+          fd, TLS_TX, TLS_CIPHER_AES_GCM_128, keys.client_key,
+          keys.client_salt, write_sequence) :
+      SetKernelTlsKeys<tls12_crypto_info_aes_gcm_256>(
+          fd, TLS_TX, TLS_CIPHER_AES_GCM_256, keys.client_key,
+          keys.client_salt, write_sequence);
+  if (!tx) {
+    int saved_errno = errno;
+    LOG(ERROR) << "Kernel TLS enabled only for receiving, closing connection";
+    errors::system::AddSystemError(error, FROM_HERE, saved_errno);
+    Error::AddTo(error, FROM_HERE, "tls_stream", "failed",
+                 "Failed to set the kernel TLS transmit keys");
+    return false;
+  }
+  kernel_tls_ = true;
+  VLOG(1) << "Kernel TLS enabled";
+  return true;
+}
+
+bool TlsStream::TlsStreamImpl::ReadKernelTls(void* buffer,
+                                             size_t size_to_read,
+                                             size_t* size_read,
+                                             bool* end_of_stream,
+                                             ErrorPtr* error) {
+  *size_read = 0;
+  if (end_of_stream)
+    *end_of_stream = false;
+
+  // Records other than application data are returned along with a control
+  // message specifying the record type.
+  char control[CMSG_SPACE(sizeof(uint8_t))];
+  iovec iov{buffer, size_to_read};
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  ssize_t ret = HANDLE_EINTR(recvmsg(socket_->GetFileDescriptor(), &msg, 0));
+  if (ret < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK)
+      return true;
+    errors::system::AddSystemError(error, FROM_HERE, errno);
+    return false;
+  }
+  if (ret == 0) {
+    if (end_of_stream)
+      *end_of_stream = true;
+    return true;
+  }
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  if (cmsg && cmsg->cmsg_level == SOL_TLS &&
+      cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+    uint8_t record_type = *reinterpret_cast<uint8_t*>(CMSG_DATA(cmsg));
+    if (record_type != kTlsRecordApplicationData) {
+      const uint8_t* data = static_cast<const uint8_t*>(buffer);
+      if (record_type == kTlsRecordAlert && ret >= 2 &&
+          data[1] == kTlsAlertCloseNotify) {
+        if (end_of_stream)
+          *end_of_stream = true;
+        return true;
+      }
+      Error::AddTo(error, FROM_HERE, "tls_stream", "failed",
+                   "Unexpected TLS record of type " +
+                       std::to_string(record_type));
+      return false;
+    }
+  }
+  *size_read = static_cast<size_t>(ret);
+  return true;
+}
+
+void TlsStream::TlsStreamImpl::SendKernelTlsCloseNotify() {
+  // Warning level (1) close_notify alert.
+  uint8_t alert[] = {1, kTlsAlertCloseNotify};
+  char control[CMSG_SPACE(sizeof(uint8_t))];
+  iovec iov{alert, sizeof(alert)};
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_TLS;
+  cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(uint8_t));
+  *reinterpret_cast<uint8_t*>(CMSG_DATA(cmsg)) = kTlsRecordAlert;
+  // We don't care much if the alert can't be sent, just as with
+  // SSL_shutdown() in Close().
+  if (HANDLE_EINTR(sendmsg(socket_->GetFileDescriptor(), &msg,
+                           MSG_NOSIGNAL)) < 0) {
+    PLOG(WARNING) << "Failed to send TLS close_notify alert";
+  }
+}
+
+#else  // KERNEL_TLS_SUPPORTED
+
+bool TlsStream::TlsStreamImpl::EnableKernelTls(ErrorPtr* /* error */) {
+  VLOG(1) << "Kernel TLS is not supported on this platform";
+  return true;
+}
+
+bool TlsStream::TlsStreamImpl::ReadKernelTls(void* /* buffer */,
+                                             size_t /* size_to_read */,
+                                             size_t* /* size_read */,
+                                             bool* /* end_of_stream */,
+                                             ErrorPtr* error) {
+  return stream_utils::ErrorOperationNotSupported(FROM_HERE, error);
+}
+
+void TlsStream::TlsStreamImpl::SendKernelTlsCloseNotify() {}
+
+#endif  // KERNEL_TLS_SUPPORTED
+
 /////////////////////////////////////////////////////////////////////////////
 TlsStream::TlsStream(std::unique_ptr<TlsStreamImpl> impl)
     : impl_{std::move(impl)} {}
@@ -457,12 +1123,31 @@ void TlsStream::Connect(StreamPtr socket,
                         const std::string& host,
                         const base::Callback<void(StreamPtr)>& success_callback,
                         const Stream::ErrorCallback& error_callback) {
+  Connect(std::move(socket), host, Options{}, success_callback,
+          error_callback);
+}
+
+void TlsStream::Connect(StreamPtr socket,
+                        const std::string& host,
+                        const Options& options,
+                        const base::Callback<void(StreamPtr)>& success_callback,
+                        const Stream::ErrorCallback& error_callback) {
+  ErrorPtr error;
+  if (!IsKnownVersion(options.min_version) ||
+      !IsKnownVersion(options.max_version) ||
+      options.min_version > options.max_version) {
+    Error::AddTo(&error, FROM_HERE, errors::stream::kDomain,
+                 errors::stream::kInvalidParameter,
+                 "Invalid TLS version range");
+    error_callback.Run(error.get());
+    return;
+  }
+
   std::unique_ptr<TlsStreamImpl> impl{new TlsStreamImpl};
   std::unique_ptr<TlsStream> stream{new TlsStream{std::move(impl)}};
 
   TlsStreamImpl* pimpl = stream->impl_.get();
-  ErrorPtr error;
-  bool success = pimpl->Init(std::move(socket), host,
+  bool success = pimpl->Init(std::move(socket), host, options,
                              base::Bind(success_callback,
                                         base::Passed(std::move(stream))),
                              error_callback, &error);
@@ -471,6 +1156,30 @@ void TlsStream::Connect(StreamPtr socket,
     error_callback.Run(error.get());
 }
 
+std::string TlsStream::GetAlpnProtocol() const {
+  return impl_ ? impl_->GetAlpnProtocol() : std::string{};
+}
+
+bool TlsStream::WasEarlyDataAccepted() const {
+  return impl_ && impl_->early_data_accepted();
+}
+
+bool TlsStream::IsKernelTlsEnabled() const {
+  return impl_ && impl_->is_kernel_tls_enabled();
+}
+
+int TlsStream::GetFileDescriptor() const {
+  return impl_ ? impl_->GetFileDescriptor() : -1;
+}
+
+TlsStream::SessionCacheStats TlsStream::GetSessionCacheStats() {
+  return g_context_cache.Get().GetStats();
+}
+
+void TlsStream::ClearSessionCache() {
+  g_context_cache.Get().ClearSessions();
+}
+
 bool TlsStream::IsOpen() const {
   return impl_ ? true : false;
 }
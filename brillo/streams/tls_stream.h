@@ -7,6 +7,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <base/macros.h>
 #include <brillo/brillo_export.h>
@@ -21,8 +22,66 @@ namespace brillo {
 // asynchronous I/O is supported.
 // The underlying socket stream must already be created and connected to the
 // destination server and passed in TlsStream::Connect() method as |socket|.
+//
+// All TLS streams in the process share the SSL context (and hence the trusted
+// certificate store), and the sessions negotiated with each server host are
+// cached, so reconnecting to the same host uses an abbreviated handshake
+// whenever the server supports session resumption.
 class BRILLO_EXPORT TlsStream : public Stream {
  public:
+  // TLS protocol versions that can be negotiated.
+  enum class Version {
+    TLS_1_2,
+    TLS_1_3,
+  };
+
+  // Connection parameters for Connect().
+  struct Options {
+    // Range of protocol versions to offer to the server. Connect() fails with
+    // kInvalidParameter if |min_version| is above |max_version|. OpenSSL
+    // releases before 1.1.1 only speak TLS 1.2, so there a |min_version| of
+    // TLS 1.3 fails with kOperationNotSupported.
+    Version min_version{Version::TLS_1_2};
+    Version max_version{Version::TLS_1_3};
+    // OpenSSL cipher list used for TLS 1.2 and earlier, in preference order.
+    // If empty, a built-in list of modern AEAD cipher suites is used.
+    std::string cipher_list;
+    // Colon-separated TLS 1.3 cipher suites, in preference order. If empty,
+    // the library defaults are used. Only OpenSSL 1.1.1 and later allow
+    // configuring them, Connect() fails with kOperationNotSupported
+    // otherwise.
+    std::string tls13_cipher_suites;
+    // Application protocols to offer via ALPN (e.g. "h2", "http/1.1"), in
+    // preference order. The protocol selected by the server is returned by
+    // GetAlpnProtocol().
+    std::vector<std::string> alpn_protocols;
+    // Application data to send in the first flight. When a session with the
+    // host is resumed and the server allows it, the data is sent as TLS 1.3
+    // early (0-RTT) data, saving a round trip. Otherwise it is sent as soon
+    // as the handshake completes. Early data can be replayed by an attacker,
+    // so it must only contain idempotent requests.
+    std::string early_data;
+    // Hand the record encryption over to the kernel (Linux kernel TLS) after
+    // the handshake, so the data is no longer copied through user space and
+    // the socket can be used with sendfile() or splice(). Only TLS 1.2
+    // connections using AES-GCM over a socket based stream (see
+    // Stream::GetFileDescriptor()) can be offloaded. Otherwise, the connection
+    // silently stays in user space. Both directions are offloaded together;
+    // the connection fails if the kernel accepts the keys of only one of
+    // them, as the socket can't be handed back to user space.
+    bool enable_kernel_tls{false};
+  };
+
+  // Process-wide TLS connection statistics.
+  struct SessionCacheStats {
+    // Number of SSL contexts created (each loads the certificate store).
+    uint64_t contexts_created{0};
+    // Number of successful handshakes that did not resume a session.
+    uint64_t full_handshakes{0};
+    // Number of successful handshakes that resumed a cached session.
+    uint64_t resumed_handshakes{0};
+  };
+
   ~TlsStream() override;
 
   // Perform a TLS handshake and establish secure connection over |socket|.
@@ -35,12 +94,42 @@ class BRILLO_EXPORT TlsStream : public Stream {
       const base::Callback<void(StreamPtr)>& success_callback,
       const Stream::ErrorCallback& error_callback);
 
+  // Same as above, but with explicit connection |options|.
+  static void Connect(
+      StreamPtr socket,
+      const std::string& host,
+      const Options& options,
+      const base::Callback<void(StreamPtr)>& success_callback,
+      const Stream::ErrorCallback& error_callback);
+
+  // Returns the application protocol negotiated via ALPN, or an empty string
+  // if none was.
+  std::string GetAlpnProtocol() const;
+
+  // Returns true if Options::early_data was accepted by the server as 0-RTT
+  // data.
+  bool WasEarlyDataAccepted() const;
+
+  // Returns true if the TLS records are processed by the kernel, see
+  // Options::enable_kernel_tls.
+  bool IsKernelTlsEnabled() const;
+
+  // Returns the statistics of the shared context and session cache.
+  static SessionCacheStats GetSessionCacheStats();
+
+  // Discards all cached sessions, so the following connections perform a full
+  // handshake.
+  static void ClearSessionCache();
+
   // Overrides from Stream:
   bool IsOpen() const override;
   bool CanRead() const override { return true; }
   bool CanWrite() const override { return true; }
   bool CanSeek() const override { return false; }
   bool CanGetSize() const override { return false; }
+  // Returns the socket descriptor while kernel TLS is enabled, since only
+  // then can plain data be passed through the socket.
+  int GetFileDescriptor() const override;
   uint64_t GetSize() const override { return 0; }
   bool SetSizeBlocking(uint64_t size, ErrorPtr* error) override;
   uint64_t GetRemainingSize() const override { return 0; }
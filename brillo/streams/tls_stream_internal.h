@@ -0,0 +1,53 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Internal helpers of TlsStream, exposed for testing only.
+
+#ifndef LIBBRILLO_BRILLO_STREAMS_TLS_STREAM_INTERNAL_H_
+#define LIBBRILLO_BRILLO_STREAMS_TLS_STREAM_INTERNAL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <brillo/brillo_export.h>
+
+namespace brillo {
+namespace tls_stream_internal {
+
+// Sizes of the TLS 1.2 AES-GCM key material passed to the kernel.
+const size_t kAesGcm128KeySize = 16;
+const size_t kAesGcm256KeySize = 32;
+const size_t kAesGcmSaltSize = 4;
+
+// Returns the size of the write keys if a connection using the protocol
+// |version| and the cipher |cipher_nid| (OpenSSL values) can be offloaded to
+// the kernel, or 0 if it has to stay in user space.
+BRILLO_EXPORT size_t GetKernelTlsKeySize(int version, int cipher_nid);
+
+// Key material of both directions of an AES-GCM connection. The pointers
+// refer to the key block they were extracted from.
+struct KernelTlsKeys {
+  const uint8_t* client_key{nullptr};
+  const uint8_t* server_key{nullptr};
+  const uint8_t* client_salt{nullptr};
+  const uint8_t* server_salt{nullptr};
+};
+
+// Splits the TLS 1.2 |key_block| of an AES-GCM connection using |key_size|
+// bytes long keys. The key block of an AEAD cipher consists of the client and
+// server write keys followed by the client and server implicit nonces (salts).
+// Returns false if |size| doesn't match that layout.
+BRILLO_EXPORT bool SplitKernelTlsKeyBlock(const uint8_t* key_block,
+                                          size_t size,
+                                          size_t key_size,
+                                          KernelTlsKeys* keys);
+
+// Writes the record sequence number |value| into |out| in big-endian byte
+// order, as expected by the kernel.
+BRILLO_EXPORT void EncodeTlsSequenceNumber(uint64_t value, uint8_t out[8]);
+
+}  // namespace tls_stream_internal
+}  // namespace brillo
+
+#endif  // LIBBRILLO_BRILLO_STREAMS_TLS_STREAM_INTERNAL_H_
@@ -0,0 +1,353 @@
+// Copyright 2018 The Chromium OS Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <brillo/streams/tls_stream.h>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <map>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <base/bind.h>
+#include <base/posix/eintr_wrapper.h>
+#include <brillo/message_loops/fake_message_loop.h>
+#include <brillo/streams/file_stream.h>
+#include <brillo/streams/memory_stream.h>
+#include <brillo/streams/stream_errors.h>
+#include <brillo/streams/tls_stream_internal.h>
+#include <gtest/gtest.h>
+#include <openssl/ssl.h>
+
+// Matches the check in tls_stream.cc.
+#if defined(OPENSSL_IS_BORINGSSL) || OPENSSL_VERSION_NUMBER >= 0x10101000L
+#define TLS_1_3_SUPPORTED 1
+#endif
+
+namespace brillo {
+
+using tls_stream_internal::EncodeTlsSequenceNumber;
+using tls_stream_internal::GetKernelTlsKeySize;
+using tls_stream_internal::KernelTlsKeys;
+using tls_stream_internal::SplitKernelTlsKeyBlock;
+
+namespace {
+
+// TLS extension types.
+const uint16_t kExtensionAlpn = 16;
+const uint16_t kExtensionEarlyData = 42;
+const uint16_t kExtensionSupportedVersions = 43;
+
+// Cipher suites selected by the "ECDHE-RSA-AES128-GCM-SHA256" and
+// "ECDHE-RSA-AES256-GCM-SHA384" cipher lists.
+const uint16_t kEcdheRsaAes128Gcm = 0xC02F;
+const uint16_t kEcdheRsaAes256Gcm = 0xC030;
+
+// The parts of a ClientHello message checked by the tests.
+struct ClientHello {
+  std::vector<uint16_t> cipher_suites;
+  std::map<uint16_t, std::string> extensions;
+};
+
+// Reads a |size| bytes long big-endian number at |*offset| of |data|.
+bool ReadNumber(const std::string& data, size_t size, size_t* offset,
+                size_t* value) {
+  if (data.size() - *offset < size)
+    return false;
+  *value = 0;
+  for (size_t i = 0; i < size; i++)
+    *value = (*value << 8) | static_cast<uint8_t>(data[(*offset)++]);
+  return true;
+}
+
+// Reads a vector prefixed with its |length_size| bytes long length.
+bool ReadVector(const std::string& data, size_t length_size, size_t* offset,
+                std::string* value) {
+  size_t length = 0;
+  if (!ReadNumber(data, length_size, offset, &length) ||
+      data.size() - *offset < length) {
+    return false;
+  }
+  *value = data.substr(*offset, length);
+  *offset += length;
+  return true;
+}
+
+// Parses the ClientHello record sent at the beginning of the handshake.
+bool ParseClientHello(const std::string& record, ClientHello* hello) {
+  size_t offset = 0;
+  size_t value = 0;
+  std::string handshake;
+  std::string field;
+  // Record header: content type (handshake) and protocol version.
+  if (!ReadNumber(record, 1, &offset, &value) || value != 22 ||
+      !ReadNumber(record, 2, &offset, &value) ||
+      !ReadVector(record, 2, &offset, &handshake)) {
+    return false;
+  }
+  offset = 0;
+  // Handshake header (ClientHello), client version, random and session ID.
+  if (!ReadNumber(handshake, 1, &offset, &value) || value != 1 ||
+      !ReadNumber(handshake, 3, &offset, &value) ||
+      !ReadNumber(handshake, 2, &offset, &value) ||
+      handshake.size() - offset < 32) {
+    return false;
+  }
+  offset += 32;
+  std::string cipher_suites;
+  if (!ReadVector(handshake, 1, &offset, &field) ||
+      !ReadVector(handshake, 2, &offset, &cipher_suites) ||
+      !ReadVector(handshake, 1, &offset, &field)) {
+    return false;
+  }
+  size_t suites_offset = 0;
+  while (suites_offset < cipher_suites.size()) {
+    if (!ReadNumber(cipher_suites, 2, &suites_offset, &value))
+      return false;
+    hello->cipher_suites.push_back(static_cast<uint16_t>(value));
+  }
+  std::string extensions;
+  if (!ReadVector(handshake, 2, &offset, &extensions))
+    return false;
+  size_t extensions_offset = 0;
+  while (extensions_offset < extensions.size()) {
+    if (!ReadNumber(extensions, 2, &extensions_offset, &value) ||
+        !ReadVector(extensions, 2, &extensions_offset, &field)) {
+      return false;
+    }
+    hello->extensions[static_cast<uint16_t>(value)] = field;
+  }
+  return true;
+}
+
+bool HasCipherSuite(const ClientHello& hello, uint16_t cipher_suite) {
+  for (uint16_t suite : hello.cipher_suites) {
+    if (suite == cipher_suite)
+      return true;
+  }
+  return false;
+}
+
+}  // anonymous namespace
+
+class TlsStreamTest : public testing::Test {
+ public:
+  void SetUp() override {
+    fake_loop_.SetAsCurrent();
+    ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds_));
+  }
+
+  void TearDown() override {
+    if (!connecting_)
+      IGNORE_EINTR(close(fds_[0]));
+    if (fds_[1] >= 0)
+      FailHandshake();
+  }
+
+  // Starts connecting over one end of the socket pair and sends the
+  // ClientHello.
+  void Connect(const TlsStream::Options& options) {
+    StreamPtr socket = FileStream::FromFileDescriptor(fds_[0], true, nullptr);
+    ASSERT_NE(nullptr, socket.get());
+    connecting_ = true;
+    TlsStream::Connect(
+        std::move(socket), "localhost", options,
+        base::Bind(&TlsStreamTest::OnConnected, base::Unretained(this)),
+        base::Bind(&TlsStreamTest::OnError, base::Unretained(this)));
+    // The handshake is posted to the message loop; run it so the ClientHello
+    // is written before ReadClientHello() blocks on the other end.
+    EXPECT_TRUE(fake_loop_.RunOnce(false));
+  }
+
+  // Reads the ClientHello sent by Connect() from the other end of the socket
+  // pair.
+  void ReadClientHello(ClientHello* hello) {
+    std::string record(16 * 1024, 0);
+    ssize_t size = HANDLE_EINTR(read(fds_[1], &record[0], record.size()));
+    ASSERT_GT(size, 0);
+    record.resize(size);
+    ASSERT_TRUE(ParseClientHello(record, hello));
+  }
+
+  // Closes the server end of the socket pair, so a pending handshake fails
+  // and the TLS stream is destroyed.
+  void FailHandshake() {
+    IGNORE_EINTR(close(fds_[1]));
+    fds_[1] = -1;
+    if (connecting_) {
+      fake_loop_.SetFileDescriptorReadiness(fds_[0], MessageLoop::kWatchRead,
+                                            true);
+      fake_loop_.Run();
+    }
+  }
+
+  void OnConnected(StreamPtr /* stream */) { connected_ = true; }
+
+  void OnError(const Error* error) {
+    ASSERT_NE(nullptr, error);
+    error_ = error->Clone();
+  }
+
+  FakeMessageLoop fake_loop_{nullptr};
+  int fds_[2];
+  // Set once |fds_[0]| is owned by the TLS stream.
+  bool connecting_{false};
+  bool connected_{false};
+  ErrorPtr error_;
+};
+
+TEST_F(TlsStreamTest, InvalidOptions) {
+  TlsStream::Options options;
+  options.min_version = TlsStream::Version::TLS_1_3;
+  options.max_version = TlsStream::Version::TLS_1_2;
+  TlsStream::Connect(
+      MemoryStream::Create(nullptr), "localhost", options,
+      base::Bind(&TlsStreamTest::OnConnected, base::Unretained(this)),
+      base::Bind(&TlsStreamTest::OnError, base::Unretained(this)));
+  ASSERT_NE(nullptr, error_.get());
+  EXPECT_EQ(errors::stream::kInvalidParameter, error_->GetCode());
+
+  error_.reset();
+  options.min_version = TlsStream::Version::TLS_1_2;
+  options.max_version = static_cast<TlsStream::Version>(42);
+  TlsStream::Connect(
+      MemoryStream::Create(nullptr), "localhost", options,
+      base::Bind(&TlsStreamTest::OnConnected, base::Unretained(this)),
+      base::Bind(&TlsStreamTest::OnError, base::Unretained(this)));
+  ASSERT_NE(nullptr, error_.get());
+  EXPECT_EQ(errors::stream::kInvalidParameter, error_->GetCode());
+
+  error_.reset();
+  options = TlsStream::Options{};
+  options.alpn_protocols = {"h2", ""};
+  TlsStream::Connect(
+      MemoryStream::Create(nullptr), "localhost", options,
+      base::Bind(&TlsStreamTest::OnConnected, base::Unretained(this)),
+      base::Bind(&TlsStreamTest::OnError, base::Unretained(this)));
+  ASSERT_NE(nullptr, error_.get());
+  EXPECT_EQ(errors::stream::kInvalidParameter, error_->GetCode());
+  EXPECT_FALSE(connected_);
+}
+
+#if !defined(TLS_1_3_SUPPORTED)
+TEST_F(TlsStreamTest, Tls13NotSupported) {
+  TlsStream::Options options;
+  options.min_version = TlsStream::Version::TLS_1_3;
+  TlsStream::Connect(
+      MemoryStream::Create(nullptr), "localhost", options,
+      base::Bind(&TlsStreamTest::OnConnected, base::Unretained(this)),
+      base::Bind(&TlsStreamTest::OnError, base::Unretained(this)));
+  ASSERT_NE(nullptr, error_.get());
+  EXPECT_EQ(errors::stream::kOperationNotSupported, error_->GetCode());
+}
+#endif
+
+TEST_F(TlsStreamTest, DefaultOptions) {
+  Connect(TlsStream::Options{});
+  ClientHello hello;
+  ReadClientHello(&hello);
+  EXPECT_EQ(nullptr, error_.get());
+#if defined(TLS_1_3_SUPPORTED)
+  // TLS 1.2 and 1.3 are offered.
+  ASSERT_EQ(1u, hello.extensions.count(kExtensionSupportedVersions));
+  const std::string& versions = hello.extensions[kExtensionSupportedVersions];
+  EXPECT_NE(std::string::npos, versions.find(std::string{"\x03\x04", 2}));
+  EXPECT_NE(std::string::npos, versions.find(std::string{"\x03\x03", 2}));
+#else
+  // Only TLS 1.2 is offered.
+  EXPECT_EQ(0u, hello.extensions.count(kExtensionSupportedVersions));
+#endif
+  EXPECT_EQ(0u, hello.extensions.count(kExtensionAlpn));
+}
+
+TEST_F(TlsStreamTest, Options) {
+  TlsStream::Options options;
+  options.max_version = TlsStream::Version::TLS_1_2;
+  options.cipher_list = "ECDHE-RSA-AES128-GCM-SHA256";
+  options.alpn_protocols = {"h2", "http/1.1"};
+  options.early_data = "GET / HTTP/1.1\r\n\r\n";
+  Connect(options);
+
+  ClientHello hello;
+  ReadClientHello(&hello);
+  EXPECT_EQ(nullptr, error_.get());
+  // Only TLS 1.2 is offered, so there is no supported_versions extension.
+  EXPECT_EQ(0u, hello.extensions.count(kExtensionSupportedVersions));
+  EXPECT_TRUE(HasCipherSuite(hello, kEcdheRsaAes128Gcm));
+  EXPECT_FALSE(HasCipherSuite(hello, kEcdheRsaAes256Gcm));
+  EXPECT_EQ(std::string{"\x00\x0c\x02h2\x08http/1.1", 14},
+            hello.extensions[kExtensionAlpn]);
+  // Without a session to resume, the early data waits for the handshake.
+  EXPECT_EQ(0u, hello.extensions.count(kExtensionEarlyData));
+}
+
+TEST_F(TlsStreamTest, HandshakeFailure) {
+  Connect(TlsStream::Options{});
+  ClientHello hello;
+  ReadClientHello(&hello);
+  // The handshake waits for the server's reply.
+  EXPECT_FALSE(connected_);
+  EXPECT_EQ(nullptr, error_.get());
+
+  // The server goes away, so the handshake fails when it's continued.
+  FailHandshake();
+  EXPECT_FALSE(connected_);
+  EXPECT_NE(nullptr, error_.get());
+}
+
+TEST(TlsStreamInternal, KernelTlsKeySize) {
+  EXPECT_EQ(16u, GetKernelTlsKeySize(TLS1_2_VERSION, NID_aes_128_gcm));
+  EXPECT_EQ(32u, GetKernelTlsKeySize(TLS1_2_VERSION, NID_aes_256_gcm));
+  // Anything else stays in user space.
+#if defined(TLS_1_3_SUPPORTED)
+  EXPECT_EQ(0u, GetKernelTlsKeySize(TLS1_3_VERSION, NID_aes_128_gcm));
+#endif
+  EXPECT_EQ(0u, GetKernelTlsKeySize(TLS1_1_VERSION, NID_aes_128_gcm));
+  EXPECT_EQ(0u, GetKernelTlsKeySize(TLS1_2_VERSION, NID_aes_128_cbc));
+  EXPECT_EQ(0u, GetKernelTlsKeySize(TLS1_2_VERSION, NID_undef));
+}
+
+TEST(TlsStreamInternal, SplitKernelTlsKeyBlock) {
+  std::vector<uint8_t> key_block(2 * (16 + 4));
+  std::iota(key_block.begin(), key_block.end(), 0);
+  KernelTlsKeys keys;
+  ASSERT_TRUE(SplitKernelTlsKeyBlock(key_block.data(), key_block.size(), 16,
+                                     &keys));
+  EXPECT_EQ(key_block.data(), keys.client_key);
+  EXPECT_EQ(key_block.data() + 16, keys.server_key);
+  EXPECT_EQ(key_block.data() + 32, keys.client_salt);
+  EXPECT_EQ(key_block.data() + 36, keys.server_salt);
+  EXPECT_EQ(36, keys.client_salt[4]);
+
+  key_block.resize(2 * (32 + 4));
+  ASSERT_TRUE(SplitKernelTlsKeyBlock(key_block.data(), key_block.size(), 32,
+                                     &keys));
+  EXPECT_EQ(key_block.data() + 32, keys.server_key);
+  EXPECT_EQ(key_block.data() + 64, keys.client_salt);
+  EXPECT_EQ(key_block.data() + 68, keys.server_salt);
+
+  // The key block of a cipher with MAC keys or explicit IVs has another
+  // layout.
+  EXPECT_FALSE(SplitKernelTlsKeyBlock(key_block.data(), key_block.size(), 16,
+                                      &keys));
+  EXPECT_FALSE(SplitKernelTlsKeyBlock(key_block.data(), 0, 16, &keys));
+  EXPECT_FALSE(SplitKernelTlsKeyBlock(key_block.data(), 8, 0, &keys));
+}
+
+TEST(TlsStreamInternal, EncodeTlsSequenceNumber) {
+  uint8_t out[8];
+  EncodeTlsSequenceNumber(0x0102030405060708, out);
+  EXPECT_EQ((std::vector<uint8_t>{1, 2, 3, 4, 5, 6, 7, 8}),
+            std::vector<uint8_t>(out, out + sizeof(out)));
+  EncodeTlsSequenceNumber(1, out);
+  EXPECT_EQ((std::vector<uint8_t>{0, 0, 0, 0, 0, 0, 0, 1}),
+            std::vector<uint8_t>(out, out + sizeof(out)));
+  EncodeTlsSequenceNumber(0xFFFFFFFFFFFFFFFF, out);
+  EXPECT_EQ(std::vector<uint8_t>(8, 0xFF),
+            std::vector<uint8_t>(out, out + sizeof(out)));
+}
+
+}  // namespace brillo